@@ -0,0 +1,394 @@
+// ==========================================
+// PC上のベンチマーク（env:native）
+// - 描画（フレーム差分）・統計・天気のパース・履歴の圧縮/保存・計測ログ・照度フィルタ・方位のフィルターを
+//   実機と同じコードで、PCのHAL（hal_native）の上で測る
+// - HTTPはBENCH_HTTP_URL（ローカルのスタブサーバー）を指定した時だけ測る
+// - 結果は表で出し、BENCH_HISTORY（既定 bench_history.csv）へ1行ずつ追記する
+//   BENCH_LABELにコミットIDなどを入れておくと、あとで同じベンチを並べて比べられる
+// - 値はPCのCPUでの時間なので、実機との比は別に確かめる（プロファイラの同名区間）
+// - 計測ログは一時ディレクトリ（hal_nativeのファイル）へ書く。書いたバイト数はフラッシュへの書き込み量の目安
+// - "replay <trace>"で実機のトレースを流す（trace_replay）
+// ==========================================
+
+#include "hal_native.h"
+#include "frame_diff.h"
+#include "rolling_stats.h"
+#include "series_codec.h"
+#include "history_store.h"
+#include "sensor_log.h"
+#include "weather_cache.h"
+#include "light_sensor.h"
+#include "forecast.h"
+#include "compass.h"
+#include "trace_replay.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct BenchResult {
+    const char* name;
+    double nsPerOp;
+    double extra;           // ベンチごとの量（1回あたりの画素数・バイト数など）
+    const char* extraUnit;
+};
+
+constexpr int MAX_RESULTS = 32;
+static BenchResult results[MAX_RESULTS];
+static int resultCount = 0;
+
+template<typename F>
+static double timeNs(int iters, F fn){
+    for(int i=0;i<iters/10 + 1;i++) fn(i);      // 暖気
+    auto t0 = std::chrono::steady_clock::now();
+    for(int i=0;i<iters;i++) fn(i);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / iters;
+}
+
+static void record(const char* name, double ns, double extra, const char* unit){
+    if(resultCount < MAX_RESULTS) results[resultCount++] = { name, ns, extra, unit };
+}
+
+// 4bitのバックバッファに矩形を塗る（canvasの代わり）
+static void fillRect4(uint8_t* buf, int x, int y, int w, int h, uint8_t color){
+    for(int py=y; py<y+h; py++){
+        for(int px=x; px<x+w; px++){
+            uint8_t &b = buf[py * (SCREEN_W / 2) + px / 2];
+            b = (px & 1) ? (b & 0xF0) | color : (b & 0x0F) | (color << 4);
+        }
+    }
+}
+
+static uint8_t backBuffer[FRAME_BYTES];
+
+static void benchRender(){
+    halNativeReset();
+    frameDiffBegin();
+    fillRect4(backBuffer, 0, 0, SCREEN_W, SCREEN_H, NORMAL_BG);
+    frameDiffPresent(backBuffer);
+
+    // 全画面が変わる（画面切替）
+    uint64_t before = halNativeDisplay().pixelWrites;
+    int iters = 2000;
+    double ns = timeNs(iters, [](int i){
+        fillRect4(backBuffer, 0, 0, SCREEN_W, SCREEN_H, (i & 1) ? WHITE : NORMAL_BG);
+        frameDiffPresent(backBuffer);
+    });
+    double pixels = (double)(halNativeDisplay().pixelWrites - before) / (iters + iters / 10 + 1);
+    record("render_full", ns, pixels, "px/frame");
+
+    // 値の欄が1つ変わる（毎秒の更新）
+    before = halNativeDisplay().pixelWrites;
+    iters = 20000;
+    ns = timeNs(iters, [](int i){
+        fillRect4(backBuffer, 100, 60, 120, 16, (i & 1) ? BLACK : NORMAL_BG);
+        frameDiffPresent(backBuffer);
+    });
+    pixels = (double)(halNativeDisplay().pixelWrites - before) / (iters + iters / 10 + 1);
+    record("render_field", ns, pixels, "px/frame");
+
+    // 変化なし（比較だけ）
+    ns = timeNs(20000, [](int){ frameDiffPresent(backBuffer); });
+    record("render_idle", ns, 0, "");
+}
+
+static void benchStats(){
+    halNativeReset();
+    static RollingStats stats;       // 1分 / 1時間 / 24時間
+    stats.reset();
+    uint32_t now = 0;
+    HalEnvReading r;
+    double ns = timeNs(200000, [&](int){
+        now += 1000;
+        halNativeAdvance(1000);
+        halEnvStart();
+        halNativeAdvance(20);
+        halEnvRead(r);
+        stats.add(r.temp, now);
+    });
+    record("stats_add", ns, 0, "");
+
+    volatile float sink = 0;
+    ns = timeNs(200000, [&](int i){ sink = sink + stats.summary((StatsWindow)(i % NUM_STATS_WINDOWS), now).mean; });
+    record("stats_summary", ns, 0, "");
+
+    // 比較用：1秒ごとの生の値を24時間分持ち、参照のたびに窓の長さだけ走査する（置き換える前の方式）
+    constexpr int RAW_N = 86400;
+    static float raw[RAW_N];
+    static const int WINDOW_N[NUM_STATS_WINDOWS] = { 60, 3600, RAW_N };
+    for(int i=0;i<RAW_N;i++){
+        halNativeAdvance(1000);
+        halEnvStart();
+        halNativeAdvance(20);
+        halEnvRead(r);
+        raw[i] = r.temp;
+    }
+    ns = timeNs(3000, [&](int i){
+        int n = WINDOW_N[i % NUM_STATS_WINDOWS];
+        float lo = raw[RAW_N - 1], hi = lo;
+        double sum = 0, sq = 0;
+        for(int j=RAW_N-n;j<RAW_N;j++){
+            float v = raw[j];
+            sum += v;
+            sq += (double)v * v;
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+        sink = sink + (float)(sum / n) + lo + hi + (float)sq;
+    });
+    record("stats_naive_scan", ns, 0, "");
+}
+
+// groupエンドポイントと同じ形の応答（不要な項目もそのまま含める）
+static size_t buildGroupPayload(char* out, size_t cap){
+    static const char* DESCRIPTIONS[] = {
+        "clear sky", "few clouds", "broken clouds", "light rain", "snow", "thunderstorm"
+    };
+    static const int CODES[] = { 800, 801, 803, 500, 600, 211 };
+    size_t len = snprintf(out, cap, "{\"cnt\":%d,\"list\":[", NUM_CITIES);
+    for(int i=0;i<NUM_CITIES && len < cap;i++){
+        len += snprintf(out + len, cap - len,
+            "%s{\"coord\":{\"lon\":135.5,\"lat\":34.69},\"sys\":{\"country\":\"JP\",\"timezone\":32400,"
+            "\"sunrise\":1700000000,\"sunset\":1700040000},\"weather\":[{\"id\":%d,\"main\":\"X\","
+            "\"description\":\"%s\",\"icon\":\"01d\"}],\"main\":{\"temp\":%.2f,\"feels_like\":20.1,"
+            "\"temp_min\":18.0,\"temp_max\":23.0,\"pressure\":1012,\"humidity\":60},"
+            "\"visibility\":10000,\"wind\":{\"speed\":3.1,\"deg\":200},\"clouds\":{\"all\":75},"
+            "\"dt\":1700020000,\"id\":%lu,\"name\":\"%s\"}",
+            i ? "," : "", CODES[i], DESCRIPTIONS[i], 15.0 + i, (unsigned long)cities[i].id, cities[i].name);
+    }
+    if(len < cap) len += snprintf(out + len, cap - len, "]}");
+    return len < cap ? len : cap - 1;
+}
+
+static void benchParse(){
+    static char payload[8192];
+    size_t len = buildGroupPayload(payload, sizeof(payload));
+    HalMemoryStream in(payload, len);
+    uint32_t mask = 0;
+    double ns = timeNs(20000, [&](int){
+        in.rewind();
+        mask = 0;
+        parseWeatherGroupStream(in, mask);
+    });
+    if(mask != (1u << NUM_CITIES) - 1) fprintf(stderr, "parse_group: updated mask %lx\n", (unsigned long)mask);
+    record("parse_group", ns, (double)len, "bytes");
+}
+
+// BENCH_HTTP_URLにスタブサーバーのgroupエンドポイントを入れた時だけ（接続 + 受信 + パース、うち接続）
+static void benchHttp(){
+    const char* url = getenv("BENCH_HTTP_URL");
+    if(!url) return;
+    halNativeReset();
+    uint32_t mask = 0;
+    int code = 0;
+    double ns = timeNs(100, [&](int){
+        HalStream* body = nullptr;
+        code = halHttpGet(url, body);
+        mask = 0;
+        if(code > 0) parseWeatherGroupStream(*body, mask);
+        halHttpEnd();
+    });
+    if(code != 200 || !mask) fprintf(stderr, "http_group: code %d mask %lx\n", code, (unsigned long)mask);
+    record("http_group", ns, 0, "");
+
+    // HTTP/1.0は取得ごとに接続し直すので、そのうちTCP接続にかかった分（http_groupに対する%）
+    const HalNativeHttp &http = halNativeHttp();
+    double connectNs = http.connects ? (double)http.connectNs / http.connects : 0;
+    record("http_connect", connectNs, 100.0 * connectNs / ns, "% of group");
+}
+
+static void benchStorage(){
+    halNativeReset();
+    static uint8_t block[SERIES_BLOCK_BYTES];
+    SeriesEncoder enc;
+    int samples = 0;
+    double ns = timeNs(20000, [&](int){
+        enc.begin(block, sizeof(block), NUM_HIST_CHANNELS);
+        for(uint32_t t=0;;t++){
+            HalEnvReading r;
+            halNativeAdvance(1000);
+            halEnvStart();
+            halNativeAdvance(20);
+            halEnvRead(r);
+            int16_t v[NUM_HIST_CHANNELS] = { histEncode(HIST_TEMP, r.temp), histEncode(HIST_HUM, r.hum),
+                                             (int16_t)(halLightRaw() / 4), histEncode(HIST_PRESS, r.pressure) };
+            if(!enc.add(t, v)) break;
+        }
+        samples = enc.count();
+    });
+    record("codec_encode_block", ns, (double)SERIES_BLOCK_BYTES / samples, "bytes/sample");
+
+    volatile int32_t sink = 0;
+    ns = timeNs(50000, [&](int){
+        SeriesDecoder dec;
+        dec.begin(block);
+        uint32_t t;
+        int16_t v[SERIES_MAX_CHANNELS];
+        while(dec.next(t, v)) sink = sink + v[0];
+    });
+    record("codec_decode_block", ns, samples, "samples");
+
+    historyReset();
+    uint32_t now = 0;
+    ns = timeNs(200000, [&](int){
+        now += 1000;
+        historyAppend(24.0f + (now % 7000) / 7000.0f, 50.0f, (int)(now % 300), 1013.0f, now);
+    });
+    record("history_append", ns, 0, "");
+
+    // 統計画面の7日（1時間段）と、1分段を一周分まとめた場合
+    volatile int16_t hsink = 0;
+    HistPoint p;
+    ns = timeNs(20000, [&](int i){
+        HistTier tier = (i & 1) ? TIER_1MIN : TIER_1HOUR;
+        if(historySummary(tier, HIST_TEMP, 0, tier == TIER_1MIN ? HIST_MIN_SLOTS : HIST_HOUR_SLOTS, p)) hsink = hsink + p.mean;
+    });
+    record("history_summary", ns, (HIST_MIN_SLOTS + HIST_HOUR_SLOTS) / 2.0, "points");
+}
+
+// 1秒ごとの計測 + ログ（SENSOR_LOG_FLUSH_MSごとにまとめ書き）。extraは1時間あたりに書くバイト数
+static void benchLog(){
+    char root[] = "/tmp/bench_logXXXXXX";
+    if(!mkdtemp(root)){
+        fprintf(stderr, "log: cannot create a temp dir\n");
+        return;
+    }
+    halNativeReset();
+    halNativeFsRoot(root);
+    halNativeSetEpoch(1700000000);
+    historyReset();
+    sensorLogBegin();
+    const int seconds = 24 * 3600;
+    double ns = timeNs(seconds, [&](int){
+        halNativeAdvance(1000);
+        uint32_t now = halMillis();
+        historyAppend(24.0f + (now % 7000) / 7000.0f, 50.0f, (int)(now % 300), 1013.0f, now);
+        sensorLogSync();
+        if(now % SENSOR_LOG_FLUSH_MS == 0) sensorLogFlush();
+    });
+    sensorLogFlush();
+    double hours = halMillis() / 3600000.0;
+    record("log_sync", ns, halNativeFs().bytesWritten / hours, "bytes/hour");
+
+    // 起動時の復元（1分段・1時間段・1秒段のブロックを全部読む）
+    int restored = 0;
+    ns = timeNs(20, [&](int){
+        historyReset();
+        halNativeReset();
+        halNativeSetEpoch(1700000000 + seconds + 60);
+        sensorLogBegin();
+        restored = historySize(TIER_1MIN) + historySize(TIER_1HOUR) + historySecBlocksClosed();
+    });
+    record("log_restore", ns, restored, "records");
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if(system(cmd) != 0) fprintf(stderr, "log: cannot remove %s\n", root);
+}
+
+static void benchLight(){
+    halNativeReset();
+    halNativeAdvance(12 * 3600000);      // 昼
+    volatile int sink = 0;
+    double ns = timeNs(20000, [&](int){
+        uint16_t raw[LIGHT_OVERSAMPLE];
+        for(int i=0;i<LIGHT_OVERSAMPLE;i++){
+            if(i) halLightWait();
+            raw[i] = (uint16_t)halLightRaw();
+        }
+        uint16_t mv = halLightMillivolts(lightTrimmedMean(raw, LIGHT_OVERSAMPLE, LIGHT_TRIM));
+        sink = sink + lightMillivoltsToLux(mv);
+    });
+    record("light_filter", ns, 0, "");
+}
+
+static void benchForecast(){
+    halNativeReset();
+    forecastReset();
+    uint32_t now = 0;
+    HalEnvReading r;
+    double ns = timeNs(200000, [&](int){
+        now += 1000;
+        halNativeAdvance(1000);
+        halEnvStart();
+        halNativeAdvance(20);
+        halEnvRead(r);
+        forecastAdd(r.temp, r.hum, r.pressure, now);
+    });
+    record("forecast_add", ns, 0, "");
+
+    volatile float sink = 0;
+    ns = timeNs(50000, [&](int){ sink = sink + forecastCurrent(now).change3h; });
+    record("forecast_current", ns, 0, "");
+}
+
+// 方位計タスクの1回分（50Hz）。IMUは模擬、フィルターと傾き補正は実機と同じ
+static void benchCompass(){
+    halNativeReset();
+    static CompassFilter filter;
+    filter.reset();
+    CompassCalibration cal;
+    volatile float sink = 0;
+    double ns = timeNs(200000, [&](int){
+        halNativeAdvance(20);
+        HalImuReading r;
+        halImuRead(r);
+        sink = sink + filter.update(r, cal, 0.02f);
+    });
+    record("compass_update", ns, 0, "");
+}
+
+static void appendHistory(const char* path, const char* label){
+    FILE* f = fopen(path, "a+");
+    if(!f){
+        fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    if(ftell(f) == 0) fprintf(f, "time,label,bench,ns_per_op,extra,unit\n");
+    char stamp[32];
+    time_t t = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", localtime(&t));
+    for(int i=0;i<resultCount;i++){
+        const BenchResult &r = results[i];
+        fprintf(f, "%s,%s,%s,%.1f,%.2f,%s\n", stamp, label, r.name, r.nsPerOp, r.extra, r.extraUnit);
+    }
+    fclose(f);
+}
+
+// pio test（test_build_src）ではテストの側にmain()がある
+#ifndef PIO_UNIT_TESTING
+int main(int argc, char** argv){
+    if(argc > 1 && strcmp(argv[1], "replay") == 0) return runTraceReplay(argc - 2, argv + 2);
+    const char* only = argc > 1 ? argv[1] : nullptr;     // 名前の先頭が一致するベンチだけ
+    struct { const char* group; void (*fn)(); } groups[] = {
+        { "render", benchRender },
+        { "stats", benchStats },
+        { "parse", benchParse },
+        { "http", benchHttp },
+        { "storage", benchStorage },
+        { "log", benchLog },
+        { "light", benchLight },
+        { "forecast", benchForecast },
+        { "compass", benchCompass },
+    };
+    for(auto &g : groups){
+        if(only && strncmp(g.group, only, strlen(only)) != 0) continue;
+        g.fn();
+    }
+
+    printf("%-20s %12s %12s\n", "bench", "ns/op", "extra");
+    for(int i=0;i<resultCount;i++){
+        const BenchResult &r = results[i];
+        printf("%-20s %12.1f %12.2f %s\n", r.name, r.nsPerOp, r.extra, r.extraUnit);
+    }
+
+    const char* path = getenv("BENCH_HISTORY");
+    const char* label = getenv("BENCH_LABEL");
+    appendHistory(path ? path : "bench_history.csv", label ? label : "local");
+    return 0;
+}
+#endif
@@ -0,0 +1,217 @@
+// ==========================================
+// トレースの再生（PC）
+// ==========================================
+
+#include "trace_replay.h"
+#include "hal_native.h"
+#include "trace.h"
+#include "history_store.h"
+#include "rolling_stats.h"
+#include "light_sensor.h"
+#include "weather_cache.h"
+#include "forecast.h"
+#include "mem_stats.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// main.cppと同じ値
+constexpr int LIGHT_ON_LUX = 20;
+constexpr int LIGHT_OFF_LUX = 40;
+constexpr int LUX_MAX = 2000;
+
+typedef std::chrono::steady_clock Clock;
+
+struct ReplayInput {
+    const uint8_t* data;
+    size_t len;
+    size_t pos;
+};
+
+static size_t fillFromMemory(uint8_t* buf, size_t len, void* ctx){
+    ReplayInput* in = (ReplayInput*)ctx;
+    size_t n = in->len - in->pos < len ? in->len - in->pos : len;
+    memcpy(buf, in->data + in->pos, n);
+    in->pos += n;
+    return n;
+}
+
+static int hexValue(int c){
+    if(c >= '0' && c <= '9') return c - '0';
+    c = tolower(c);
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// シリアル出力（"#"の行は飛ばし、残りは16進）ならバイト列に戻す
+static bool loadTrace(const char* path, std::vector<uint8_t> &out){
+    FILE* f = fopen(path, "rb");
+    if(!f) return false;
+    std::vector<uint8_t> raw;
+    uint8_t chunk[4096];
+    size_t n;
+    while((n = fread(chunk, 1, sizeof(chunk), f)) > 0) raw.insert(raw.end(), chunk, chunk + n);
+    fclose(f);
+
+    if(raw.size() < 4 || memcmp(raw.data(), "TRC1", 4) != 0){
+        out.clear();
+        bool comment = false, lineStart = true;
+        int high = -1;
+        for(uint8_t c : raw){
+            if(c == '\n' || c == '\r'){
+                comment = false;
+                lineStart = true;
+                continue;
+            }
+            if(lineStart && c == '#') comment = true;
+            lineStart = false;
+            if(comment) continue;
+            int v = hexValue(c);
+            if(v < 0) continue;
+            if(high < 0) high = v;
+            else {
+                out.push_back((uint8_t)(high << 4 | v));
+                high = -1;
+            }
+        }
+        return true;
+    }
+    out.swap(raw);
+    return true;
+}
+
+static uint32_t totalAllocs(){
+    uint32_t n = 0;
+    for(int i=0;i<NUM_MEM_TAGS;i++) n += memTagStats((MemTag)i).allocs;
+    return n;
+}
+
+int runTraceReplay(int argc, char** argv){
+    if(argc < 1){
+        fprintf(stderr, "usage: program replay <trace> [speed]\n");
+        return 2;
+    }
+    double speed = argc > 1 ? atof(argv[1]) : 0;
+    std::vector<uint8_t> bytes;
+    if(!loadTrace(argv[0], bytes)){
+        fprintf(stderr, "cannot read %s\n", argv[0]);
+        return 1;
+    }
+    ReplayInput input = { bytes.data(), bytes.size(), 0 };
+    TraceReader reader;
+    if(!reader.begin(fillFromMemory, &input)){
+        fprintf(stderr, "%s: not a trace\n", argv[0]);
+        return 1;
+    }
+
+    halNativeReset();
+    historyReset();
+    memStatsReset();
+    static RollingStats tempStats, humStats, luxStats;
+    tempStats.reset();
+    humStats.reset();
+    luxStats.reset();
+    forecastReset();
+    float currentTemp = 20.0f, currentHum = 50.0f, currentPressure = NAN;
+    int currentLux = 0;
+    bool ledOn = false;
+    uint32_t ledChanges = 0;
+    uint32_t samples = 0, inputs = 0, longPresses = 0, responses = 0;
+    uint32_t fetches[4] = {};       // 実機のWeatherFetchStatusと同じ並び（OK, NO_WIFI, HTTP_ERR, JSON_ERR）
+    double sampleNs = 0, parseNs = 0;
+
+    uint32_t traceStart = reader.startMs();
+    uint32_t prevMs = traceStart;
+    uint32_t allocsBefore = totalAllocs();
+    Clock::time_point wallStart = Clock::now();
+    TraceRecord r;
+    while(reader.next(r)){
+        halNativeAdvance(r.ms - prevMs);
+        prevMs = r.ms;
+        if(speed > 0){
+            auto due = wallStart + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double, std::milli>((r.ms - traceStart) / speed));
+            std::this_thread::sleep_until(due);
+        }
+
+        Clock::time_point t0 = Clock::now();
+        switch(r.type){
+            case TRACE_SAMPLE: {
+                // main.cppのhandleSensorSample()のうち、画面以外
+                const SensorSample &s = r.sample;
+                float temp = (s.valid & SAMPLE_TEMP_VALID) ? s.temp : currentTemp;
+                float hum = (s.valid & SAMPLE_HUM_VALID) ? s.hum : currentHum;
+                int lux = (s.valid & SAMPLE_LUX_VALID) ? s.lux : currentLux;
+                if(lux < 0) lux = 0;
+                if(lux > LUX_MAX) lux = LUX_MAX;
+                bool led = lightLedState(ledOn, lux, LIGHT_ON_LUX, LIGHT_OFF_LUX);
+                if(led != ledOn) ledChanges++;
+                ledOn = led;
+                if(s.valid & SAMPLE_PRESS_VALID) currentPressure = s.pressure;
+                historyAppend(temp, hum, lux, currentPressure, s.timestamp);
+                tempStats.add(temp, s.timestamp);
+                humStats.add(hum, s.timestamp);
+                luxStats.add(lux * 100.0f / LUX_MAX, s.timestamp);
+                forecastAdd((s.valid & SAMPLE_TEMP_VALID) ? s.temp : NAN,
+                            (s.valid & SAMPLE_HUM_VALID) ? s.hum : NAN,
+                            (s.valid & SAMPLE_PRESS_VALID) ? s.pressure : NAN, s.timestamp);
+                tempStats.summary(STATS_1MIN, s.timestamp);
+                humStats.summary(STATS_1MIN, s.timestamp);
+                luxStats.summary(STATS_1MIN, s.timestamp);
+                currentTemp = temp;
+                currentHum = hum;
+                currentLux = lux;
+                samples++;
+                sampleNs += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+                break;
+            }
+            case TRACE_INPUT:
+                inputs++;
+                if(r.input.type == INPUT_LONG) longPresses++;
+                break;
+            case TRACE_HTTP: {
+                // weather.cppのhandleResponse()と同じ判定
+                responses++;
+                if(r.httpCode == TRACE_HTTP_NO_WIFI) fetches[1]++;
+                else if(r.httpCode != 200) fetches[2]++;
+                else {
+                    TraceBodyStream body(r.body, r.bodyLen);
+                    uint32_t mask = 0;
+                    bool parsed = parseWeatherGroupStream(body, mask);
+                    fetches[(parsed && mask) ? 0 : 3]++;
+                    parseNs += std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+                }
+                break;
+            }
+        }
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - wallStart).count();
+    uint32_t span = prevMs - traceStart;
+
+    printf("trace      %s%s\n", argv[0], reader.corrupt() ? " (corrupt, stopped early)" : "");
+    printf("records    %lu samples, %lu inputs (%lu long), %lu responses\n",
+           (unsigned long)samples, (unsigned long)inputs, (unsigned long)longPresses, (unsigned long)responses);
+    printf("time       %.1f s of trace in %.1f ms (x%.0f)\n", span / 1000.0, wallMs, wallMs > 0 ? span / wallMs : 0);
+    printf("sample     %.1f ns/sample\n", samples ? sampleNs / samples : 0);
+    printf("parse      %.1f ns/response\n", (fetches[0] + fetches[3]) ? parseNs / (fetches[0] + fetches[3]) : 0);
+    printf("fetch      ok %lu, no wifi %lu, http err %lu, json err %lu\n",
+           (unsigned long)fetches[0], (unsigned long)fetches[1], (unsigned long)fetches[2], (unsigned long)fetches[3]);
+    printf("led        %lu changes\n", (unsigned long)ledChanges);
+    Forecast f = forecastCurrent(prevMs);
+    if(f.valid){
+        printf("forecast   %.1f hPa %+.1f/3h (%s) Z%u %c \"%s\"\n",
+               f.pressure, f.change3h, TENDENCY_NAMES[f.tendency], f.zambretti, f.letter, f.text);
+    } else {
+        printf("forecast   (not enough pressure points)\n");
+    }
+#ifdef MEM_HOOKS
+    printf("allocs     %lu\n", (unsigned long)(totalAllocs() - allocsBefore));
+#else
+    (void)allocsBefore;
+#endif
+    return reader.corrupt() ? 1 : 0;
+}
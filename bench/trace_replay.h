@@ -0,0 +1,10 @@
+// ==========================================
+// トレースの再生（PC）
+// - 実機で記録したトレース（バイナリ、またはシリアルの16進出力をそのまま保存したもの）を
+//   模擬時計の上で、実機のloop()と同じモジュール（履歴・統計・LED判定・天気のパース）に流す
+// - 描画（ウィジェット）は実機だけにあるので、フレームの数・時間は実機の再生（'p'）で取る
+// ==========================================
+#pragma once
+
+// program replay <trace> [倍速]。倍速を省略・0にすると待たずに流す
+int runTraceReplay(int argc, char** argv);
@@ -0,0 +1,32 @@
+// ==========================================
+// 適応サンプリング（センサーごとの計測周期）
+// - 前回計測した値からの変化がしきい値を超えたら最短周期に戻す
+// - 変化がしきい値の半分未満なら周期を倍にする（最長周期まで）
+// - 読まなかった周期は直前の値を使う前提なので、誤差はおおむねしきい値以内に収まる
+// - 最長周期が「値がどれだけ古くなってよいか」の上限
+// - Arduinoに依存しないのでPC上でもそのままテストできる
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+
+// |v - last| / threshold。最大値を取って複数の量をまとめて判定する
+float adaptiveChange(float v, float last, float threshold);
+
+class AdaptiveSampler {
+public:
+    AdaptiveSampler(uint32_t minPeriodMs, uint32_t maxPeriodMs);
+    void reset();
+    // nowに計測すべきか。起床のずれで1周期飛ばさないよう最短周期の半分まで早めに許す
+    bool due(uint32_t now) const;
+    // 計測した時に呼ぶ。changeはadaptiveChange()の最大値（1以上で「動いている」）
+    void measured(float change, uint32_t now);
+    uint32_t period() const { return periodMs; }
+
+private:
+    uint32_t minMs;
+    uint32_t maxMs;
+    uint32_t periodMs;
+    uint32_t lastMs = 0;
+    bool hasSample = false;
+};
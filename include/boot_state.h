@@ -0,0 +1,32 @@
+// ==========================================
+// 起動を速くするための保存状態 + 起動段階の計時
+// - 天気キャッシュ・直近の計測値・都市番号をNVS（Preferences）に保存しておき、
+//   起動直後はそれを使って最初の画面を描く（WiFi・NTP・天気取得は後から裏で終わる）
+// - 天気は取得に成功した時、都市は切り替えた時、計測値は一定間隔で保存（書き込み回数を抑える）
+// - 起動の各段階の時刻を記録し、最後にシリアルへまとめて出す
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+
+constexpr uint32_t READINGS_SAVE_MS = 600000;   // 計測値の保存間隔（10分）
+constexpr int BOOT_MAX_PHASES = 12;
+
+struct BootReadings {
+    float temp = NAN;
+    float hum = NAN;
+    float pressure = NAN;
+    int lux = 0;
+};
+
+// 保存済みの状態を読む。天気はweatherCache[]へ直接戻し、古い扱い（次の要求で取り直す）にする
+// 何も保存されていなければfalse（引数はそのまま）
+bool bootStateLoad(BootReadings &readings, int &cityIdx);
+void bootStateSaveWeather();
+void bootStateSaveCity(int cityIdx);
+void bootStateSaveReadings(const BootReadings &readings);
+
+// 起動段階の区切り（電源投入からの経過時間 micros() を記録）
+void bootPhase(const char* name);
+// 記録した段階をシリアルへ出す
+void bootReport();
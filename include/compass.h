@@ -0,0 +1,64 @@
+// ==========================================
+// 方位の計算（Arduino非依存）
+// - 地磁気はハードアイアン（各軸の中心のずれ）とソフトアイアン（各軸の振れ幅の違い）を
+//   校正値で直してから使う。校正は全方向に回した間の各軸の最小・最大から出す
+// - 加速度から重力の向き（ロール・ピッチ）を出し、地磁気を水平面へ戻してから方位を取る
+//   平らに置いた時は従来のatan2(my, mx)と同じ向きになる
+// - ジャイロの鉛直まわりの角速度で方位を進め、地磁気の方位へ少しずつ寄せる（相補フィルター）
+//   揺さぶられて加速度が1Gから外れている間は、傾きが信用できないのでジャイロだけで進める
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "hal.h"
+
+constexpr float COMPASS_FILTER_TAU_S = 0.5f;        // 地磁気へ寄せる時定数
+constexpr float COMPASS_ACCEL_MIN_G = 0.8f;         // この範囲の外では傾きを使わない
+constexpr float COMPASS_ACCEL_MAX_G = 1.2f;
+constexpr float COMPASS_CAL_MIN_RANGE = 20.0f;      // 校正で各軸に必要な振れ幅（地磁気の単位）
+constexpr uint32_t COMPASS_CAL_MIN_SAMPLES = 200;   // 50Hzで4秒分
+
+struct CompassCalibration {
+    float offset[3] = {0.0f, 0.0f, 0.0f};   // ハードアイアン
+    float scale[3] = {1.0f, 1.0f, 1.0f};    // ソフトアイアン（軸ごとの倍率）
+    bool valid = false;                     // 校正済み（falseなら生の値をそのまま使う）
+};
+
+// 校正中の各軸の最小・最大
+class CompassCalibrator {
+public:
+    void begin();
+    void add(float mx, float my, float mz);
+    uint32_t samples() const { return count; }
+    // 振れ幅が足りなければfalse（outはそのまま）
+    bool finish(CompassCalibration &out) const;
+
+private:
+    float lo[3];
+    float hi[3];
+    uint32_t count = 0;
+};
+
+// -180〜180度に折り返したa - b
+float headingDelta(float a, float b);
+// 0〜360度に折り返す
+float headingWrap(float deg);
+
+// 平らに置いた前提の方位（計測タスクのサンプル用。再生中と方位計の外で使う）
+float compassFlatHeading(float mx, float my, const CompassCalibration &cal);
+// 傾き補正した方位。重力が取れなければNAN
+float compassTiltHeading(const HalImuReading &r, const CompassCalibration &cal);
+
+class CompassFilter {
+public:
+    void reset(){ started = false; }
+    // dtは前回からの秒数。ジャイロで進めてから地磁気の方位へ寄せ、結果の方位を返す
+    float update(const HalImuReading &r, const CompassCalibration &cal, float dt);
+    float heading() const { return value; }
+    bool valid() const { return started; }
+
+private:
+    float value = 0.0f;
+    bool started = false;
+};
@@ -0,0 +1,40 @@
+// ==========================================
+// 方位計タスク（IMUをCOMPASS_SAMPLE_MSごとに読む）
+// - 方位計の画面を開いている間だけ回す（compassStart/compassStop）。止めている間は通知待ちで眠る
+// - 1回ごとに傾き補正 + 相補フィルター（compass）で方位を進め、最新の値だけを公開する
+//   画面はCOMPASS_FRAME_MSごとに最新の値を取って描く（読む周期と描く周期は別）
+// - 校正は全方向に回している間の地磁気の最小・最大から出し、NVS（Preferencesの"compass"）へ保存する
+//   起動時にcompassBegin()で読み戻す。校正値は計測タスクのサンプルから出す平らな方位にも使う
+// - 計測タスク（1秒ごとのIMU）とは同じバスを読むので、ロックはhal側で取る
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+#include "compass.h"
+
+constexpr uint32_t COMPASS_SAMPLE_MS = 20;      // 50Hz
+constexpr uint32_t COMPASS_FRAME_MS = 50;       // 画面は20fps
+constexpr uint32_t COMPASS_CAL_MS = 20000;      // 校正の最長時間（方位計の無操作タイムアウトより短く）
+
+struct CompassStats {
+    uint32_t samples = 0;
+    uint32_t errors = 0;        // IMUが読めなかった
+    uint32_t overruns = 0;      // 周期に間に合わなかった
+    uint32_t maxSampleUs = 0;   // 読み出し + フィルター1回の最大
+};
+
+// 保存済みの校正値を読み、タスクを作る（止まった状態で待つ）
+void compassBegin();
+void compassStart();
+// 止める。校正の途中なら取り消す
+void compassStop();
+bool compassRunning();
+// 最新の方位（まだ出ていなければNAN）
+float compassHeadingNow();
+CompassCalibration compassCalibration();
+
+void compassCalibrationStart();
+bool compassCalibrating();
+// 集めた範囲から校正値を出す。足りていれば保存して使い始めtrue、足りなければ前の校正値のままfalse
+bool compassCalibrationFinish();
+const CompassStats& compassStats();
@@ -0,0 +1,198 @@
+// ==========================================
+// 局所の気象傾向と短期予報（Arduino非依存）
+// - 気圧・温度・湿度をスロット平均の点にし、時間窓の最小二乗直線をO(1)で更新する
+//   （Σx・Σy・Σxy・Σx²を足し引きし、1周ごとに作り直して誤差と原点のずれを戻す）
+// - 気圧は3時間窓（15分 x 12）で傾向、1時間窓（5分 x 12）で急な下降を見る
+// - 露点（Magnus式）・暑さ指数（NOAAのRothfusz式）・Zambretti式の予報を出す
+//   Zambrettiは海面気圧と3時間の傾向だけを使う（風向・季節の補正はしない）
+// - 天気APIの更新間隔の判定（forecastChange）と、急な下降での前倒し（forecastSharpDrop）
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "weather_cache.h"
+
+// 設置場所の標高[m]（海面気圧への換算用）。build_flagsで上書きする
+#ifndef FORECAST_ALTITUDE_M
+#define FORECAST_ALTITUDE_M 0
+#endif
+
+constexpr int TREND_MIN_POINTS = 3;                 // これ未満の点では傾きを出さない
+constexpr float TENDENCY_HPA_3H = 1.6f;             // 3時間でこれ以上動いたら上昇/下降
+constexpr float SHARP_DROP_HPA_PER_HOUR = 1.5f;     // 1時間窓の傾きがこれより急なら前倒しで取得
+// forecastChange()の基準（この変化で1.0。1以上で「動いている」）
+constexpr float STABLE_HPA_3H = 1.0f;
+constexpr float STABLE_TEMP_PER_HOUR = 1.0f;
+constexpr float STABLE_HUM_PER_HOUR = 5.0f;
+
+struct TrendFit {
+    bool valid = false;
+    uint16_t points = 0;
+    float value = NAN;          // 直近の点での直線の値
+    float slopePerHour = 0.0f;
+};
+
+// SLOTS個のスロット（うち1つは集計中）の平均値を点として直線を当てはめる
+template<int SLOTS>
+class TrendWindow {
+public:
+    explicit TrendWindow(uint32_t slotMs) : slotMs(slotMs) {}
+
+    void reset(){
+        openSum = 0.0f;
+        openCount = 0;
+        nextSeq = 0;
+        closedCount = 0;
+        started = false;
+        rebuildSums();
+    }
+
+    void add(float v, uint32_t now){
+        if(isnan(v)) return;
+        advance(now);
+        openSum += v;
+        openCount++;
+    }
+
+    TrendFit fit(uint32_t now){
+        advance(now);
+        TrendFit f;
+        f.points = (uint16_t)n;
+        if(n < TREND_MIN_POINTS) return f;
+        float den = n * sxx - sx * sx;
+        if(den <= 0.0f) return f;
+        float slope = (n * sxy - sx * sy) / den;
+        float intercept = (sy - slope * sx) / n;
+        f.valid = true;
+        f.slopePerHour = slope * (3600000.0f / slotMs);
+        f.value = intercept + slope * (float)(lastSeq - baseSeq);
+        return f;
+    }
+
+private:
+    static constexpr int CLOSED = SLOTS - 1;
+
+    struct Point {
+        float y;
+        bool valid;
+    };
+
+    Point& slot(uint32_t seq){ return ring[seq % CLOSED]; }
+
+    // rolling_statsのRollingWindowと同じ進め方（millis()の一周・長い空白も同じ扱い）
+    void advance(uint32_t now){
+        if(!started){
+            slotStart = now;
+            started = true;
+            return;
+        }
+        int steps = 0;
+        while(now - slotStart >= slotMs && steps <= SLOTS){
+            closeSlot();
+            slotStart += slotMs;
+            steps++;
+        }
+        if(now - slotStart >= slotMs) slotStart = now;
+    }
+
+    void closeSlot(){
+        if(closedCount == CLOSED) expireOldest();
+        uint32_t s = nextSeq++;
+        Point &p = slot(s);
+        p.valid = openCount > 0;
+        p.y = p.valid ? openSum / openCount : 0.0f;
+        closedCount++;
+        if(p.valid){
+            addPoint(s, p.y, 1.0f);
+            lastSeq = s;
+        }
+        openSum = 0.0f;
+        openCount = 0;
+
+        // 引き算の誤差が溜まらないよう、一周ごとに作り直す（xの原点もここで寄せる）
+        if(s % CLOSED == CLOSED - 1) rebuildSums();
+    }
+
+    void expireOldest(){
+        uint32_t oldest = nextSeq - closedCount;
+        const Point &p = slot(oldest);
+        if(p.valid) addPoint(oldest, p.y, -1.0f);
+        closedCount--;
+    }
+
+    // sign=+1で足し、-1で外す
+    void addPoint(uint32_t seq, float y, float sign){
+        float x = (float)(seq - baseSeq);
+        n += (int)sign;
+        sx += sign * x;
+        sy += sign * y;
+        sxy += sign * x * y;
+        sxx += sign * x * x;
+    }
+
+    void rebuildSums(){
+        n = 0;
+        sx = sy = sxy = sxx = 0.0f;
+        baseSeq = nextSeq - closedCount;
+        for(uint32_t i=0;i<closedCount;i++){
+            uint32_t s = baseSeq + i;
+            if(slot(s).valid) addPoint(s, slot(s).y, 1.0f);
+        }
+    }
+
+    uint32_t slotMs;
+    uint32_t slotStart = 0;
+    bool started = false;
+    float openSum = 0.0f;
+    uint32_t openCount = 0;
+    Point ring[CLOSED];
+    uint32_t nextSeq = 0;
+    uint32_t closedCount = 0;
+    uint32_t baseSeq = 0;       // x = seq - baseSeq
+    uint32_t lastSeq = 0;       // 最後に値が入った点
+    int n = 0;
+    float sx = 0.0f, sy = 0.0f, sxy = 0.0f, sxx = 0.0f;
+};
+
+enum PressureTendency : uint8_t {
+    TENDENCY_FALLING = 0,
+    TENDENCY_STEADY,
+    TENDENCY_RISING
+};
+
+struct Forecast {
+    bool valid = false;             // 気圧の3時間窓の傾きが出ている
+    float pressure = NAN;           // hPa（直線の値）
+    float seaLevel = NAN;           // 海面気圧 hPa
+    float change3h = 0.0f;          // 3時間あたりの変化 hPa
+    float dropPerHour = 0.0f;       // 1時間窓の傾き（下降が正）
+    PressureTendency tendency = TENDENCY_STEADY;
+    float temp = NAN;
+    float hum = NAN;
+    float tempPerHour = 0.0f;
+    float humPerHour = 0.0f;
+    float dewPoint = NAN;           // ℃
+    float heatIndex = NAN;          // ℃（体感）
+    uint8_t zambretti = 0;          // 1〜32（0は予報なし）
+    char letter = '?';              // A〜Z
+    const char* text = "";          // 画面用の短い文（15文字以内）
+    WeatherSymbol symbol = SYM_UNKNOWN;
+};
+
+extern const char* const TENDENCY_NAMES[3];
+
+float dewPoint(float temp, float hum);
+float heatIndex(float temp, float hum);
+float seaLevelPressure(float pressure, float temp, float altitudeM);
+// 1〜9: 下降、10〜19: 横ばい、20〜32: 上昇
+uint8_t zambrettiNumber(float seaLevel, PressureTendency tendency);
+char zambrettiLetter(uint8_t number);
+
+void forecastReset();
+// 欠測はNAN（その量だけ点に入らない）
+void forecastAdd(float temp, float hum, float pressure, uint32_t now);
+Forecast forecastCurrent(uint32_t now);
+// 天気APIの間隔用の変化量（adaptive_samplerの基準。予報が無ければ1.0）
+float forecastChange(const Forecast &f);
+bool forecastSharpDrop(const Forecast &f);
@@ -0,0 +1,44 @@
+// ==========================================
+// フレーム差分転送（4bitパレットのバックバッファ → パネル）
+// - 32x8タイルごとに内容のハッシュ（32bit）を持ち、前回転送した時のハッシュと比べる
+//   表示中の内容をもう1枚持たない（フロントバッファ37.5KBの代わりに300タイル x 4B = 1.2KB）
+//   ハッシュが偶然一致すると、そのタイルは次に変わるまで古いまま残る（確率は変化1回あたり2^-32）
+//   なのでFRAME_FULL_PUSH_FRAMESフレームごとと画面の切り替え時には比べずに全タイル送り、残るのをそこまでにする
+// - 横に続く変化タイルをまとめてRGB565へ変換してhalDisplayPush()で送る
+//   変換先は1タイル行分（320x8）を2本。DMAで送っている間に次の列を変換する（計10KB）
+// - Arduino非依存なので、PCのフレームバッファに対しても同じ処理を測れる
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// パレット番号（画面で使う色は11色なので4bitに収まる）
+#define NORMAL_BG 0
+#define BLACK     1
+#define WHITE     2
+#define RED       3
+#define BLUE      4
+#define GREEN     5
+#define ORANGE    6
+#define PURPLE    7
+#define YELLOW    8
+#define GRAY      9
+#define CYAN      10
+
+constexpr int SCREEN_W = 320;
+constexpr int SCREEN_H = 240;
+constexpr size_t FRAME_BYTES = SCREEN_W / 2 * SCREEN_H;     // 4bit = 2ピクセル/バイト
+
+constexpr int PALETTE_USED = 11;
+
+// この回数frameDiffPresent()を呼ぶごとに1回、全タイルを送る（ハッシュの一致で残ったタイルを直す）
+constexpr uint32_t FRAME_FULL_PUSH_FRAMES = 600;
+extern const uint8_t PALETTE_RGB[PALETTE_USED][3];
+
+// 変換表を作る。最初のフレームは全タイル送る
+void frameDiffBegin();
+// 変化したタイルを送り、転送したバイト数を返す。変化がなければ比較だけで0
+uint32_t frameDiffPresent(const uint8_t* back);
+// 次のフレームは比べずに全タイル送る（画面の切り替え時）
+void frameDiffInvalidate();
@@ -0,0 +1,125 @@
+// ==========================================
+// ハードウェア抽象化（薄い関数の集まり）
+// - 表示・環境センサー・照度ADC・IMU・時計・ボタン・HTTP・ファイルだけをここに通す
+// - 実機はhal_esp32.cpp、PC（env:native）はhal_native.cpp。どちらか一方だけがリンクされる
+// - PC版は表示をメモリ上のフレームバッファに描いて書き込み画素数を数え、
+//   センサーは合成した信号を返し、HTTPはPOSIXソケットで（ローカルのスタブサーバーへ）つなぐ
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+typedef Stream HalStream;
+#else
+// Arduinoのstreamのうち、天気のパースで使う分だけ
+class HalStream {
+public:
+    virtual ~HalStream() {}
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    size_t readBytes(char* buf, size_t len);
+    // targetまで読み進める。見つからなければfalse
+    bool find(const char* target);
+    // targetより先にterminatorが来たらfalse
+    bool findUntil(const char* target, const char* terminator);
+};
+#endif
+
+// ---------- 時計 ----------
+uint32_t halMillis();
+uint32_t halMicros();
+// UNIX時刻（秒）。NTPで合わせる前は0
+uint32_t halEpoch();
+
+// ---------- 表示 ----------
+// RGB565（SPIのバイト順）の矩形を送る。halDisplayStart()とhalDisplayFinish()の間で何回でも呼べる
+// 実機はDMAなので、finishまでpixelsの中身を書き換えない（呼ぶ側は2本のバッファを交互に使う）
+void halDisplayStart();
+void halDisplayPush(int x, int y, int w, int h, const uint16_t* pixels);
+void halDisplayFinish();
+
+// ---------- 環境センサー（BME280） ----------
+struct HalEnvReading {
+    float temp;         // ℃
+    float hum;          // %RH（読めなかったらNAN）
+    float pressure;     // hPa（読めなかったらNAN）
+};
+
+enum HalEnvStatus : uint8_t {
+    HAL_ENV_OK = 0,
+    HAL_ENV_BUSY,       // 変換中（周期が短すぎる）
+    HAL_ENV_ERROR       // 通信失敗・変換がスキップされた
+};
+
+// 見つからなければfalse
+bool halEnvBegin();
+// 強制モードで1回変換を始める
+bool halEnvStart();
+HalEnvStatus halEnvRead(HalEnvReading &out);
+
+// ---------- 照度ADC ----------
+void halLightBegin();
+// 12bitの生値。失敗したら負
+int halLightRaw();
+// 生値 → 校正済みの電圧[mV]
+uint16_t halLightMillivolts(uint16_t raw);
+// 照度のオーバーサンプリングの間隔（実機は1tick待ち、PCは模擬時計を1ms進める）
+void halLightWait();
+
+// ---------- IMU ----------
+struct HalImuReading {
+    float accelX, accelY, accelZ;   // G
+    float gyroX, gyroY, gyroZ;      // deg/s
+    float magX, magY, magZ;
+};
+
+// 計測タスクと方位計タスクの両方から呼ぶ（実機はBME280と同じバスをロックして読む）
+bool halImuRead(HalImuReading &out);
+
+// ---------- ボタン ----------
+// 0=A, 1=B, 2=C。押されていればtrue
+bool halButtonDown(int button);
+
+// ---------- HTTP ----------
+// GETしてステータスコードを返す（負は接続失敗）。本文はhalHttpEnd()まで読める
+int halHttpGet(const char* url, HalStream* &body);
+void halHttpEnd();
+
+// ---------- ファイル（実機はLittleFS、PCは指定したディレクトリの下） ----------
+#ifdef ARDUINO
+#include <FS.h>
+typedef fs::File HalFile;
+#else
+#include <memory>
+
+#define FILE_READ "r"
+#define FILE_APPEND "a"
+
+// ArduinoのFileのうち、計測ログで使う分だけ。コピーしても同じファイルを指し、最後の1つが閉じる
+class HalFile {
+public:
+    explicit operator bool() const { return (bool)state; }
+    const char* name() const;
+    size_t size() const;
+    bool seek(uint32_t pos);
+    size_t read(uint8_t* buf, size_t len);
+    size_t write(const uint8_t* buf, size_t len);
+    // ディレクトリを開いた時だけ。次の項目（無ければ空のHalFile）
+    HalFile openNextFile();
+    void close(){ state.reset(); }
+
+    struct State;
+    std::shared_ptr<State> state;
+};
+#endif
+
+// マウントする（壊れていればフォーマットし直す）
+bool halFsBegin();
+HalFile halFsOpen(const char* path, const char* mode = FILE_READ);
+bool halFsExists(const char* path);
+bool halFsMkdir(const char* path);
+bool halFsRemove(const char* path);
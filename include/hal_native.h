@@ -0,0 +1,59 @@
+// ==========================================
+// PC版HAL（env:native）だけにある操作
+// - 時計は模擬時計。halNativeAdvance()で進める（照度のオーバーサンプリングも1msずつ進める）
+// - 表示は320x240のRGB565フレームバッファ。書き込んだ画素数を数える
+// - センサーは模擬時計から合成した信号（日変化 + 気圧の周期変化 + 照明のちらつき + ノイズ）
+// - UNIX時刻はhalNativeSetEpoch()で合わせるまで0（NTP未同期と同じ）。合わせた後は模擬時計で進む
+// - HTTPは接続の回数と時間を数える
+// - ファイルはhalNativeFsRoot()のディレクトリの下に置く（フラッシュの代わり）。書いた回数・バイト数を数える
+// ==========================================
+#pragma once
+
+#include "hal.h"
+
+struct HalNativeFs {
+    uint32_t opens = 0;
+    uint32_t writes = 0;        // write()の回数（実機ではそれぞれがフラッシュへの書き込みになる）
+    uint64_t bytesWritten = 0;
+    uint64_t bytesRead = 0;
+};
+
+struct HalNativeHttp {
+    uint32_t connects = 0;      // halHttpGet()が張ったTCP接続の数（HTTP/1.0なので取得ごとに1本）
+    uint64_t connectNs = 0;     // 名前解決 + connect()にかかった実時間の合計
+};
+
+struct HalNativeDisplay {
+    uint32_t frames = 0;        // halDisplayStart()〜halDisplayFinish()の回数
+    uint32_t pushes = 0;
+    uint64_t pixelWrites = 0;
+};
+
+// 模擬時計を進める
+void halNativeAdvance(uint32_t ms);
+// 模擬時計・表示・ボタンを起動直後に戻す（センサーの信号は時計だけで決まる）
+void halNativeReset();
+const uint16_t* halNativeFramebuffer();
+const HalNativeDisplay& halNativeDisplay();
+void halNativeSetButton(int button, bool down);
+// 今の模擬時計の時刻をepochに合わせる。0で未同期に戻す
+void halNativeSetEpoch(uint32_t epoch);
+// ファイルを置くディレクトリ（既定は"native_fs"）。halFsBegin()で作る
+void halNativeFsRoot(const char* dir);
+const HalNativeFs& halNativeFs();
+const HalNativeHttp& halNativeHttp();
+
+// メモリ上のバイト列を読むストリーム（記録済みペイロードを流す用）
+class HalMemoryStream : public HalStream {
+public:
+    HalMemoryStream(const char* data, size_t len) : data(data), len(len) {}
+    void rewind(){ pos = 0; }
+    int available() override { return (int)(len - pos); }
+    int read() override { return pos < len ? (uint8_t)data[pos++] : -1; }
+    int peek() override { return pos < len ? (uint8_t)data[pos] : -1; }
+
+private:
+    const char* data;
+    size_t len;
+    size_t pos = 0;
+};
@@ -0,0 +1,79 @@
+// ==========================================
+// 計測履歴ストア（多段解像度リングバッファ）
+// - 1秒 / 1分 / 1時間 の3段。下の段が閉じるたびに上の段へ集約
+// - 値はint16固定小数（0.01℃, 0.01%RH, 照度は生値, 0.1hPa）
+// - 追加はO(1)。1分・1時間の段は平均/最小/最大を持つ
+// - 1秒段は差分圧縮したブロックで持ち、読む範囲のブロックだけ復号する
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "series_codec.h"
+
+enum HistChannel : uint8_t {
+    HIST_TEMP = 0,
+    HIST_HUM,
+    HIST_LUX,
+    HIST_PRESS,
+    NUM_HIST_CHANNELS
+};
+
+enum HistTier : uint8_t {
+    TIER_1SEC = 0,
+    TIER_1MIN,
+    TIER_1HOUR,
+    NUM_HIST_TIERS
+};
+
+constexpr int HIST_SEC_BLOCKS = 24;     // 256B x 24 = 6KB（変化が小さいほど長く持てる）
+constexpr int HIST_MIN_SLOTS  = 720;    // 12時間
+constexpr int HIST_HOUR_SLOTS = 168;    // 7日
+
+// 欠測（センサー失敗・電源断などの空白）
+constexpr int16_t HIST_MISSING = INT16_MIN;
+
+struct HistPoint {
+    int16_t mean;
+    int16_t min;
+    int16_t max;
+};
+
+struct HistBucket {
+    HistPoint ch[NUM_HIST_CHANNELS];
+};
+
+extern const char* const HIST_TIER_NAMES[NUM_HIST_TIERS];
+
+int16_t histEncode(HistChannel ch, float v);
+float histDecode(HistChannel ch, int16_t raw);
+
+void historyReset();
+// 1秒段は呼び出し1回で1件。1分・1時間段はnowで区切る
+void historyAppend(float temp, float hum, int lux, float pressure, uint32_t now);
+// 保存済みの1分・1時間の点を古い順に積み直す（起動時の復元用。上の段へは集約しない）
+void historyRestore(HistTier tier, const HistBucket &b);
+// 1分・1時間段の新しい方からback件の手前に欠測をn点差し込む（空白の長さが後から分かった時）
+// 保持件数を超えた分は古い方から落ちる。差し込んだ点数を返す
+int historyInsertGap(HistTier tier, int back, int n);
+// 1秒段の時刻（起動からの秒。millis()の一周をまたいでも戻らない）
+uint32_t historyClockSec();
+// 1秒段の閉じた圧縮ブロック（ログ保存用）。back=0が最新
+uint32_t historySecBlocksClosed();
+const uint8_t* historySecBlock(int back);
+// shiftSecは前の起動の時計から今の時計への差（分からなければ0のまま積む）
+void historyRestoreSecBlock(const uint8_t* block, int32_t shiftSec);
+// 1秒段の時刻がつながらない所（前の起動から戻したブロックの後）に欠測を1点置く。次の追加の直前に入る
+void historyMarkGap();
+
+uint32_t historyPeriodMs(HistTier tier);
+int historySize(HistTier tier);             // 保持している件数
+uint32_t historyAppendCount(HistTier tier); // これまでの追加数（描画の版番号に使う）
+
+// back=0が最新。範囲外ならfalse
+bool historyGet(HistTier tier, int back, HistBucket &out);
+// 最新からback件目を終端に、過去n件ぶんを古い順にoutへ。読めた件数を返す
+int historyRead(HistTier tier, HistChannel ch, int back, int n, HistPoint* out);
+int historyReadBuckets(HistTier tier, int back, int n, HistBucket* out);
+// [back, back+n) の区間をまとめる。有効な点が無ければfalse
+bool historySummary(HistTier tier, HistChannel ch, int back, int n, HistPoint &out);
@@ -0,0 +1,63 @@
+// ==========================================
+// ボタン入力キュー（GPIO割り込み）
+// - BtnA/B/Cのエッジを割り込みで拾い、時刻付きのイベントとしてリングに積む
+//   描画や通信でloop()が止まっていても押下は失われない
+// - チャタリング: 最初のエッジをすぐ採用し、その後BTN_DEBOUNCE_MSは同じボタンのエッジを無視
+//   無視している間に状態が戻った時は、期間明けにピンを読み直して合わせる
+// - 押し続けるとBTN_LONG_MSでINPUT_LONG、その後BTN_REPEAT_MSごとにINPUT_REPEAT
+// - 押してから画面に反映されるまでの時間（入力→表示の遅れ）を分布で記録する
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+
+#define BTN_A_PIN 39
+#define BTN_B_PIN 38
+#define BTN_C_PIN 37
+
+constexpr uint32_t BTN_DEBOUNCE_MS = 10;
+constexpr uint32_t BTN_LONG_MS = 600;
+constexpr uint32_t BTN_REPEAT_MS = 120;
+constexpr uint32_t INPUT_ACTIVE_MS = 100;       // ボタンが動いてからこの間は細かく回す
+
+enum InputButton : uint8_t {
+    BUTTON_A = 0,
+    BUTTON_B,
+    BUTTON_C,
+    NUM_BUTTONS
+};
+
+enum InputType : uint8_t {
+    INPUT_PRESS = 0,
+    INPUT_RELEASE,
+    INPUT_LONG,         // 押し続けてBTN_LONG_MS（1回だけ）
+    INPUT_REPEAT        // その後BTN_REPEAT_MSごと
+};
+
+struct InputEvent {
+    InputButton button;
+    InputType type;
+    uint32_t us;        // エッジを拾ったmicros()（LONG/REPEATは生成した時刻）
+};
+
+constexpr int LATENCY_BINS = 6;
+extern const uint32_t LATENCY_BIN_US[LATENCY_BINS];   // 各ビンの上限（最後は上限なし）
+
+struct InputStats {
+    uint32_t events = 0;
+    uint32_t bounces = 0;       // チャタリングとして捨てたエッジ
+    uint32_t dropped = 0;       // キューが満杯
+    uint32_t lastLatencyUs = 0; // 入力→表示
+    uint32_t maxLatencyUs = 0;
+    uint32_t latency[LATENCY_BINS] = {};
+};
+
+// 割り込みを登録する。呼び出したタスク（loop()）がイベントの通知先になる
+void inputBegin();
+// イベントを古い順に1つ取り出す。無ければfalse（長押し・リピートもここで作る）
+bool pollInputEvent(InputEvent &out);
+// ボタンが押されている、または動いた直後（この間はloop()を細かく回す）
+bool inputActive();
+// 入力を反映したフレームを送り終えた時に、その入力の時刻から呼ぶ
+void inputRecordLatency(uint32_t inputUs);
+const InputStats& inputStats();
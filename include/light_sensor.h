@@ -0,0 +1,26 @@
+// ==========================================
+// 照度センサー（NJL7520L）の信号処理
+// - 1周期の中で間隔をあけて取ったADC値を並べ替え、上下の外れ値を捨てて平均（トリム平均）
+// - 電圧→照度は折れ線テーブルで補間（フォトトランジスタは明るい側で飽和して曲がる）
+// - LEDのON/OFFはヒステリシス付きで、閾値付近でばたつかない
+// - Arduinoに依存しないのでPC上でもそのままテストできる
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+
+constexpr int LIGHT_OVERSAMPLE = 20;    // 1周期あたりの取得数（1ms間隔 = 100Hzのちらつき2周期ぶん）
+constexpr int LIGHT_TRIM = 4;           // 上下それぞれ捨てる数
+
+struct LightCalPoint {
+    uint16_t mv;        // センサー出力電圧
+    uint16_t lux;
+};
+
+// samplesを昇順に並べ替え、上下trim個ずつ除いた平均（四捨五入）を返す
+// 残りが無いほどtrimが大きい時は中央値
+uint16_t lightTrimmedMean(uint16_t *samples, int n, int trim);
+// センサー出力電圧[mV] → 照度[lx]。表の範囲外は端の値に張り付く
+int lightMillivoltsToLux(uint32_t mv);
+// 現在の状態onと照度から次のLED状態を決める（onBelow未満で点灯、offAbove超で消灯）
+bool lightLedState(bool on, int lux, int onBelow, int offAbove);
@@ -0,0 +1,64 @@
+// ==========================================
+// メモリの集計と判定（Arduino非依存）
+// - サブシステム（タグ）ごとの確保・解放の回数
+// - 空きヒープと最大連続ブロックは15分ごとの最小値（床）にまとめ、直近24時間の傾きを出す
+//   一時的な確保（天気取得中のバッファなど）に引きずられないよう床の推移を見る
+// - 傾きと下限からリーク・断片化の疑いを判定する。ホストの耐久試験も同じ判定を使う
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum MemTag : uint8_t {
+    MEM_TAG_LOOP = 0,       // loop()のタスク（他のタグに付け替えていない部分）
+    MEM_TAG_RENDER,
+    MEM_TAG_LOG,            // 計測ログ（LittleFS）
+    MEM_TAG_SENSORS,
+    MEM_TAG_WEATHER,
+    MEM_TAG_OTHER,          // 登録していないタスク（WiFi・lwIPなど）
+    NUM_MEM_TAGS
+};
+
+extern const char* const MEM_TAG_NAMES[NUM_MEM_TAGS];
+
+struct MemTagStats {
+    uint32_t allocs = 0;
+    uint32_t frees = 0;
+    uint32_t failures = 0;
+    uint32_t bytes = 0;     // 要求したバイト数の累計
+};
+
+constexpr uint32_t MEM_WINDOW_MS = 900000;          // 15分の最小値を1点にする
+constexpr int MEM_TREND_LEN = 96;                   // 24時間分
+constexpr int MEM_TREND_MIN_POINTS = 8;             // 2時間分たまるまでは判定しない
+constexpr int32_t MEM_LEAK_BYTES_PER_HOUR = 256;
+constexpr uint32_t MEM_LOW_BYTES = 16384;
+
+struct MemTrend {
+    int points = 0;
+    uint32_t freeBytes = 0;         // 直近の値
+    uint32_t largestBlock = 0;
+    uint32_t minFreeEver = 0;
+    int32_t freePerHour = 0;        // 床の傾き（バイト/時）
+    int32_t largestPerHour = 0;
+    uint16_t fragPermille = 0;      // 1 - 最大ブロック/空き（‰）
+};
+
+enum MemCheck : uint8_t {
+    MEM_CHECK_LEAK  = 0x01,     // 空きの床が下がり続けている
+    MEM_CHECK_FRAG  = 0x02,     // 最大ブロックが空きより速く縮んでいる
+    MEM_CHECK_LOW   = 0x04,     // 最小空きがMEM_LOW_BYTESを割った
+    MEM_CHECK_STACK = 0x08      // スタックの残りが少ないタスクがある（mem_telemetryが付ける）
+};
+
+void memCountAlloc(MemTag tag, size_t size, bool ok);
+void memCountFree(MemTag tag);
+const MemTagStats& memTagStats(MemTag tag);
+
+// ヒープの状態を1回記録する（nowはms）
+void memAddSample(uint32_t now, uint32_t freeBytes, uint32_t largestBlock, uint32_t minFreeEver);
+MemTrend memTrend();
+// MemCheckの組み合わせ（スタック以外）。0なら異常なし
+uint8_t memCheck(const MemTrend &trend);
+void memStatsReset();
@@ -0,0 +1,58 @@
+// ==========================================
+// メモリ・スタックの監視
+// - MEM_SAMPLE_MSごとに空きヒープ・最大連続ブロック・起動後の最小空き・
+//   登録したタスクのスタック残り（最小値）を読んでmem_statsへ渡す
+// - MEM_HOOKSを定義してmalloc/free/calloc/reallocを--wrapすると、
+//   確保を呼んだタスクのタグで回数を数える（platformio.iniのbuild_flags）
+//   同じタスクの中の区間はMEM_TAG_SCOPE(タグ)で付け替える
+// - シリアルの 'm' で一覧を出す
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+#include "mem_stats.h"
+
+constexpr uint32_t MEM_SAMPLE_MS = 60000;
+constexpr int MEM_MAX_TASKS = 6;
+constexpr uint32_t MEM_STACK_MARGIN = 512;      // これを切ったらMEM_CHECK_STACK
+
+struct MemTaskInfo {
+    const char* name = "";
+    TaskHandle_t handle = nullptr;
+    MemTag tag = MEM_TAG_OTHER;
+    uint32_t stackFree = 0;     // 起動後に最も減った時の残り（バイト）
+};
+
+// 監視するタスクを登録（setup()とタスク起動時）。handleがnullなら呼んだタスク
+void memWatchTask(const char* name, TaskHandle_t handle, MemTag tag);
+// ヒープとスタックを読んで記録する
+void memSample();
+int memTaskCount();
+const MemTaskInfo& memTaskInfo(int i);
+// mem_statsの判定 + スタックの残り
+uint8_t memHealth();
+// 記録回数（診断画面の描き直し判定用）
+uint32_t memVersion();
+void memDump(Print &out);
+
+#ifdef MEM_HOOKS
+
+// 呼んだタスクの確保を一時的に別のタグで数える
+class MemTagScope {
+public:
+    explicit MemTagScope(MemTag tag);
+    ~MemTagScope();
+private:
+    int task;
+    MemTag saved;
+};
+
+#define MEM_TAG_CONCAT_(a, b) a##b
+#define MEM_TAG_CONCAT(a, b) MEM_TAG_CONCAT_(a, b)
+#define MEM_TAG_SCOPE(tag) MemTagScope MEM_TAG_CONCAT(memTagScope_, __LINE__)(tag)
+
+#else
+
+#define MEM_TAG_SCOPE(tag) do {} while(0)
+
+#endif
@@ -0,0 +1,27 @@
+// ==========================================
+// 省電力の待機（loop()の眠り方）
+// - loop()は次の期限まで、またはイベント（ボタン・計測サンプル）が来るまでタスク通知で待つ
+//   その間CPUはアイドルタスクでクロックが止まり、millis()を回し続けることはない
+// - ボタンは入力キュー（input_queue）の割り込みで起こし、動いた直後と押している間は短い間隔で回す
+// - LIGHT_SLEEPを定義すると、条件が揃った待ちはライトスリープ（ボタンのGPIOとタイマーで起床）
+//   ※ ライトスリープ中はRTOSのtickが止まり、LEDCのPWM（バックライト）も止まる基板がある
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+
+constexpr uint32_t INPUT_POLL_MS = 5;           // ボタンが動いている間の間隔（リピート・チャタリング明け）
+constexpr uint32_t LIGHT_SLEEP_MIN_MS = 20;     // これより短い待ちは眠っても得をしない
+constexpr uint32_t POWER_MAX_WAIT_MS = 60000;   // 期限が無くてもこれ以上は待たない
+
+struct PowerStats {
+    uint32_t waits = 0;
+    uint32_t lightSleeps = 0;
+    uint32_t gpioWakes = 0;         // ボタンでライトスリープから起きた回数
+    uint64_t idleUs = 0;            // 待っていた時間の合計（ライトスリープを含む）
+    uint64_t sleepUs = 0;           // うちライトスリープ
+};
+
+// 最長waitMs待つ。ボタン・xTaskNotifyGive()で早く戻る。allowSleepならライトスリープも使う
+void powerIdle(uint32_t waitMs, bool allowSleep);
+const PowerStats& powerStats();
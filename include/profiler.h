@@ -0,0 +1,81 @@
+// ==========================================
+// 組み込みプロファイラ（プローブごとのサイクル数ヒストグラム）
+// - 計りたい区間をPROF_SCOPE(プローブ)で囲むと、抜けた時にESP.getCycleCount()の差を記録
+// - ヒストグラムは1オクターブを2分割した対数ビン（256サイクル〜）。p50/p99はビンの上端で返す
+// - プローブは1つのタスクからだけ記録する（同じプローブを複数タスクで使わない）
+//   サイクルカウンタはコアごとなので、記録するタスクはコアに固定されていること
+// - シリアルで 'c' を送るとCSV、'j' でJSON、'r' でリセット（コマンドはmain.cppで受ける）
+// - NO_PROFILERを定義するとプローブは空になり、記録領域も無くなる
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+
+enum ProfProbe : uint8_t {
+    PROF_LOOP = 0,          // loop()1回（待機を除く）
+    PROF_RENDER,            // renderPresent()
+    PROF_SCREEN_HOME,       // 画面ごとのenter/update（ウィジェット描画込み）
+    PROF_SCREEN_SENSOR,
+    PROF_SCREEN_GRAPH,
+    PROF_SCREEN_STATS,
+    PROF_SCREEN_WEATHER,
+    PROF_SCREEN_COMPASS,
+    PROF_SCREEN_CALENDAR,
+    PROF_SCREEN_DIAG,
+    PROF_IDLE_FACE,         // 顔アニメ1コマ
+    PROF_SAMPLE,            // handleSensorSample()（履歴・統計・ログ込み）
+    PROF_BME,               // 計測タスク: BME280読み出し
+    PROF_LIGHT,             // 計測タスク: 照度（1ms間隔の待ちを含む）
+    PROF_IMU,
+    PROF_COMPASS,           // 方位計タスク: IMU読み出し + フィルター1回
+    PROF_HTTP,              // 天気ワーカー: GET（接続・ヘッダ）
+    PROF_JSON,              // 天気ワーカー: ストリームのパース
+    NUM_PROF_PROBES
+};
+
+extern const char* const PROF_PROBE_NAMES[NUM_PROF_PROBES];
+
+constexpr int PROF_BUCKETS = 48;
+
+struct ProfSummary {
+    uint32_t count = 0;
+    uint32_t meanUs = 0;
+    uint32_t p50Us = 0;
+    uint32_t p99Us = 0;
+    uint32_t maxUs = 0;
+};
+
+#ifndef NO_PROFILER
+
+void profRecord(ProfProbe probe, uint32_t cycles);
+inline uint32_t profStart(){ return ESP.getCycleCount(); }
+inline void profStop(ProfProbe probe, uint32_t start){ profRecord(probe, ESP.getCycleCount() - start); }
+
+class ProfScope {
+public:
+    explicit ProfScope(ProfProbe p) : probe(p), start(ESP.getCycleCount()) {}
+    ~ProfScope(){ profRecord(probe, ESP.getCycleCount() - start); }
+private:
+    ProfProbe probe;
+    uint32_t start;
+};
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_SCOPE(probe) ProfScope PROF_CONCAT(profScope_, __LINE__)(probe)
+
+#else
+
+inline void profRecord(ProfProbe, uint32_t){}
+inline uint32_t profStart(){ return 0; }
+inline void profStop(ProfProbe, uint32_t){}
+#define PROF_SCOPE(probe) do {} while(0)
+
+#endif
+
+void profReset();
+ProfSummary profSummary(ProfProbe probe);
+// 全プローブの記録回数の合計（診断画面の描き直し判定用）
+uint32_t profVersion();
+// 記録が1回以上あるプローブを書き出す
+void profDump(Print &out, bool json);
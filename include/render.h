@@ -0,0 +1,28 @@
+// ==========================================
+// オフスクリーン描画レイヤー
+// - 全画面を4bitパレットのスプライト（320x240 = 37.5KB）に描く
+// - 32x8タイルごとのハッシュを前回転送した時と比べ、変化したタイルだけDMAで転送（frame_diff）
+//   内部RAMはスプライト37.5KB + 変換用10KB + ハッシュ1.2KB（表示中の内容の複製は持たない）
+// - 画面はcanvasに描き、loop()の最後にrenderPresent()を呼ぶ
+// ==========================================
+#pragma once
+
+#include <M5Unified.h>
+#include "frame_diff.h"
+
+struct RenderStats {
+    uint32_t frames = 0;        // 1タイル以上転送したフレーム数
+    uint32_t lastBytes = 0;     // 直近フレームのSPI転送量
+    uint32_t lastFrameUs = 0;   // 直近フレームの比較+変換+転送時間
+    uint32_t maxFrameUs = 0;
+    uint64_t totalBytes = 0;
+};
+
+// バックバッファ。描画はすべてここに行う
+extern M5Canvas canvas;
+
+// バッファ確保（WiFiより先、M5.begin()直後に呼ぶ）
+bool renderBegin();
+// 変化したタイルだけパネルへ転送する。変化がなければ比較だけで戻る
+void renderPresent();
+const RenderStats& renderStats();
@@ -0,0 +1,222 @@
+// ==========================================
+// ローリング統計（O(1)更新・O(1)参照）
+// - 平均/分散はWelford法、区間の最小/最大は単調デック
+// - ウィンドウは一定時間ごとのスロット（バケット）に分けて集約し、
+//   古いスロットを引き算で外す（全バッファの再走査をしない）
+// - 0を「空」とみなさず、サンプル数で有効/無効を判定する
+// - 時刻を進めるのはadd()だけ。summary()は状態を変えず、nowまでに外れるスロットを除いて数える
+//   今のスロットより前の時刻（遅れて届いたサンプル）は今のスロットに入れる（巻き戻さない）
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+struct StatsBucket {
+    uint32_t count = 0;
+    float mean = 0.0f;
+    float m2 = 0.0f;        // 偏差平方和
+    float min = 0.0f;
+    float max = 0.0f;
+
+    void add(float v);
+    void merge(const StatsBucket &b);
+    // mergeの逆演算（平均と分散のみ。最小/最大はデックで扱う）
+    void remove(const StatsBucket &b);
+    void clear(){ *this = StatsBucket(); }
+};
+
+struct RollingSummary {
+    bool valid = false;     // 1サンプル以上ある
+    uint32_t count = 0;
+    float mean = 0.0f;
+    float stddev = 0.0f;
+    float min = 0.0f;
+    float max = 0.0f;
+};
+
+// 閉じたスロットの中から最小（または最大）を持つものを先頭に保つ
+template<int CAP>
+class MonoDeque {
+public:
+    void clear(){ head = 0; size = 0; }
+    bool empty() const { return size == 0; }
+    uint32_t front() const { return seq[head]; }
+    uint32_t back() const { return seq[(head + size - 1) % CAP]; }
+    void popFront(){ head = (head + 1) % CAP; size--; }
+    void popBack(){ size--; }
+    void pushBack(uint32_t s){ seq[(head + size) % CAP] = s; size++; }
+    int count() const { return size; }
+    uint32_t at(int i) const { return seq[(head + i) % CAP]; }
+
+private:
+    uint32_t seq[CAP];
+    int head = 0;
+    int size = 0;
+};
+
+// SLOTS個のスロット（うち1つは集計中）で slotMs*SLOTS の時間窓を持つ
+template<int SLOTS>
+class RollingWindow {
+public:
+    explicit RollingWindow(uint32_t slotMs) : slotMs(slotMs) {}
+
+    void reset(){
+        open.clear();
+        total.clear();
+        minQ.clear();
+        maxQ.clear();
+        nextSeq = 0;
+        closedCount = 0;
+        started = false;
+    }
+
+    void add(float v, uint32_t now){
+        if(isnan(v)) return;
+        advance(now);
+        open.add(v);
+    }
+
+    RollingSummary summary(uint32_t now) const {
+        RollingSummary s;
+        if(!started) return s;
+
+        // nowまでにk回閉じたとすると、閉じたスロットのうち古いdrop個が外れ、
+        // k > CLOSEDなら集計中のスロットも外れる
+        uint32_t k = elapsedSlots(now);
+        uint32_t drop = std::min<uint32_t>(closedCount, k + closedCount > CLOSED ? k + closedCount - CLOSED : 0);
+        uint32_t first = nextSeq - closedCount + drop;
+        bool withOpen = k <= (uint32_t)CLOSED;
+
+        StatsBucket all;
+        if(drop == 0){
+            all = total;
+        } else {
+            for(uint32_t q = first; q != nextSeq; q++) all.merge(slot(q));
+        }
+        if(withOpen) all.merge(open);
+
+        s.valid = all.count > 0;
+        if(!s.valid) return s;
+        s.count = all.count;
+        s.mean = all.mean;
+        s.stddev = all.count > 1 ? sqrtf(std::max(all.m2, 0.0f) / (all.count - 1)) : 0.0f;
+
+        // デックの先頭から外れたスロットを飛ばす（seqは古い順に並んでいる）
+        int mi = firstLive(minQ, first);
+        int ma = firstLive(maxQ, first);
+        bool haveClosed = mi < minQ.count();
+        s.min = haveClosed ? slot(minQ.at(mi)).min : open.min;
+        s.max = haveClosed ? slot(maxQ.at(ma)).max : open.max;
+        if(withOpen && open.count > 0){
+            s.min = std::min(s.min, open.min);
+            s.max = std::max(s.max, open.max);
+        }
+        return s;
+    }
+
+private:
+    static constexpr int CLOSED = SLOTS - 1;
+
+    StatsBucket& slot(uint32_t seq){ return ring[seq % CLOSED]; }
+    const StatsBucket& slot(uint32_t seq) const { return ring[seq % CLOSED]; }
+
+    // 今のスロットの始まりから閉じるべき数。前の時刻なら0（差を符号付きで見るのでmillis()の一周も吸収）
+    uint32_t elapsedSlots(uint32_t now) const {
+        int32_t d = (int32_t)(now - slotStart);
+        return d > 0 ? (uint32_t)d / slotMs : 0;
+    }
+
+    static int firstLive(const MonoDeque<CLOSED> &q, uint32_t first){
+        int i = 0;
+        while(i < q.count() && (int32_t)(q.at(i) - first) < 0) i++;
+        return i;
+    }
+
+    // 経過したスロットを閉じる
+    void advance(uint32_t now){
+        if(!started){
+            slotStart = now;
+            started = true;
+            return;
+        }
+        if(elapsedSlots(now) == 0) return;     // 前の時刻を足すとnow - slotStartが桁あふれして全部閉じてしまう
+        int steps = 0;
+        while(now - slotStart >= slotMs && steps <= SLOTS){
+            closeSlot();
+            slotStart += slotMs;
+            steps++;
+        }
+        if(now - slotStart >= slotMs) slotStart = now;  // 長い空白の後は揃え直す
+    }
+
+    void closeSlot(){
+        if(closedCount == CLOSED) expireOldest();
+
+        uint32_t s = nextSeq++;
+        slot(s) = open;
+        closedCount++;
+        if(open.count > 0){
+            total.merge(open);
+            while(!minQ.empty() && slot(minQ.back()).min >= open.min) minQ.popBack();
+            minQ.pushBack(s);
+            while(!maxQ.empty() && slot(maxQ.back()).max <= open.max) maxQ.popBack();
+            maxQ.pushBack(s);
+        }
+        open.clear();
+
+        // 引き算の誤差が溜まらないよう、一周ごとに集約を作り直す
+        if(s % CLOSED == CLOSED - 1) rebuildTotal();
+    }
+
+    void expireOldest(){
+        uint32_t oldest = nextSeq - closedCount;
+        const StatsBucket &b = slot(oldest);
+        if(b.count > 0) total.remove(b);
+        if(!minQ.empty() && minQ.front() == oldest) minQ.popFront();
+        if(!maxQ.empty() && maxQ.front() == oldest) maxQ.popFront();
+        closedCount--;
+    }
+
+    void rebuildTotal(){
+        total.clear();
+        for(uint32_t i=0;i<closedCount;i++) total.merge(slot(nextSeq - closedCount + i));
+    }
+
+    uint32_t slotMs;
+    uint32_t slotStart = 0;
+    bool started = false;
+    StatsBucket open;
+    StatsBucket total;          // 閉じたスロットの合計
+    StatsBucket ring[CLOSED];
+    MonoDeque<CLOSED> minQ;
+    MonoDeque<CLOSED> maxQ;
+    uint32_t nextSeq = 0;
+    uint32_t closedCount = 0;
+};
+
+enum StatsWindow : uint8_t {
+    STATS_1MIN = 0,
+    STATS_1HOUR,
+    STATS_24HOUR,
+    NUM_STATS_WINDOWS
+};
+
+extern const char* const STATS_WINDOW_NAMES[NUM_STATS_WINDOWS];
+
+// 1系列ぶんの 1分 / 1時間 / 24時間 ウィンドウ
+class RollingStats {
+public:
+    RollingStats();
+    void reset();
+    // NaNは欠測として無視する
+    void add(float v, uint32_t now);
+    // nowはadd()と同じ時計で渡す（状態は変えないので、前の時刻を渡しても壊れない）
+    RollingSummary summary(StatsWindow w, uint32_t now) const;
+
+private:
+    RollingWindow<60> minute;   // 1秒 x 60
+    RollingWindow<60> hour;     // 1分 x 60
+    RollingWindow<48> day;      // 30分 x 48
+};
@@ -0,0 +1,31 @@
+// ==========================================
+// 協調スケジューラ（期限順の最小ヒープ）
+// - 周期処理・1回きりの処理をすべて期限つきの仕事として登録し、loop()から期限の来た順に実行する
+// - 仕事はsetup()で作っておき、開始/停止/再設定だけを行う（動的確保なし）
+// - 時刻は呼び出し側が渡す（millis()を直接読まない）ので、PC上では模擬時計で決定的に動く
+// - 期限が同じ仕事は開始した順に実行する
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+
+typedef void (*SchedFn)();
+typedef int SchedId;
+
+constexpr int SCHED_MAX_JOBS = 12;
+constexpr SchedId SCHED_NONE = -1;
+constexpr uint32_t SCHED_IDLE_FOREVER = UINT32_MAX;
+
+void schedReset();
+// 仕事を作る（まだ動かない）。periodMs=0なら1回きり。枠が無ければSCHED_NONE
+SchedId schedCreate(SchedFn fn, uint32_t periodMs = 0);
+// now + delayMs に実行する。動作中なら期限を付け直す
+void schedStart(SchedId id, uint32_t now, uint32_t delayMs);
+void schedStop(SchedId id);
+bool schedActive(SchedId id);
+void schedSetPeriod(SchedId id, uint32_t periodMs);
+// 期限の来た仕事を期限順に実行し、次の期限までの残りms（無ければSCHED_IDLE_FOREVER）を返す
+// 仕事の中から開始/停止してもよい
+uint32_t schedRun(uint32_t now);
+// 次の期限までの残りms（実行はしない）
+uint32_t schedNextDelay(uint32_t now);
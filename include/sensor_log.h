@@ -0,0 +1,32 @@
+// ==========================================
+// 計測ログ（LittleFS上の追記専用セグメント。Arduino非依存、ファイルはhal経由）
+// - 履歴ストアの1分・1時間の点をCRC付き固定長レコードで保存
+// - 1秒段は圧縮ブロックをそのまま可変長レコードで保存
+// - ページ単位でまとめ書きし、古いセグメントから消す
+// - 起動時は末尾から必要な件数だけ読んで履歴へ戻す
+//   前の記録から今までは欠測で埋める（今の時刻が分からなければ欠測1点で区切り、分かった時に残りを差し込む）
+//   時刻が分からないまま起動した時は、分かるまで（最大10分）ログへ書かずに待ち、分かったら遡って時刻を付ける
+//   1秒段のブロックは前の起動の時計の時刻なので、UNIX時刻との差で今の時計へ移し、後ろに欠測を1点置く
+// - まとめ書き待ちは最大SENSOR_LOG_FLUSH_MS分。自分で再起動する所（ESP.restart()）では呼ぶ側がsensorLogFlush()してから落とす
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+
+constexpr uint32_t SENSOR_LOG_FLUSH_MS = 300000;    // 電源断で失うのはこれまで（5分）
+
+struct SensorLogStats {
+    uint32_t restored = 0;      // 起動時に戻したレコード数
+    uint32_t restoreMs = 0;
+    uint32_t appended = 0;
+    uint32_t flushes = 0;
+    uint32_t crcErrors = 0;
+};
+
+// LittleFSをマウントして直近の履歴（各段のRAMに入る分）を復元する。失敗してもfalseを返すだけで計測は続ける
+bool sensorLogBegin();
+// 履歴ストアに増えた点・閉じた1秒ブロックをログへ積む（計測ごとに呼ぶ）
+void sensorLogSync();
+// まとめ書き待ちのレコードを今すぐ書く（SENSOR_LOG_FLUSH_MSごと・再起動の前）
+void sensorLogFlush();
+const SensorLogStats& sensorLogStats();
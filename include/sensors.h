@@ -0,0 +1,79 @@
+// ==========================================
+// センサー取得レイヤー（BME280 + 照度ADC + IMU）
+// - 専用タスクがSENSOR_PERIOD_MSごとに計測し、SPSCリングでloop()へ渡す
+//   周期はvTaskDelayUntil()で保つ。積んだらloop()のタスクへ通知して起こす
+//   LIGHT_SLEEPの時はtickが眠っている間止まるので、loop()のスケジューラがsensorTrigger()で起こす
+// - BME280は強制モードで1回変換 → 次の周期に1回のバースト読み出しで温度/気圧/湿度をまとめて取得
+// - 補正計算は1サンプルにつき1回。I2Cは400kHz
+// - デバイスへのアクセスはhal.h経由（レジスタ操作・補正式はhal_esp32.cpp）
+// - 読み出しと同時に次の変換を開始しておくので、変換完了を待たない
+// - 照度は1ms間隔で複数回取ってトリム平均 → esp_adc_calで電圧 → 照度[lx]
+// - BME280と照度は値が落ち着いている間は読む間隔を延ばす（adaptive_sampler）
+//   読まなかった周期のサンプルは該当のvalidビットが立たず、受け取り側は直前の値を使う
+//   SENSOR_FIXED_RATEを定義すると毎周期すべて読む
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#define BME_SDA 22
+#define BME_SCL 21
+#define LIGHT_PIN 36
+
+constexpr uint32_t SENSOR_PERIOD_MS = 1000;                 // 最短周期（タスクの起床間隔）
+constexpr uint32_t BME_MAX_PERIOD_MS = 30000;               // 温湿度・気圧が古くなってよい上限
+constexpr uint32_t LIGHT_MAX_PERIOD_MS = 5000;              // 照度（LED制御が遅れすぎない程度）
+
+enum SampleValid : uint8_t {
+    SAMPLE_TEMP_VALID  = 0x01,
+    SAMPLE_HUM_VALID   = 0x02,
+    SAMPLE_PRESS_VALID = 0x04,
+    SAMPLE_LUX_VALID   = 0x08,
+    SAMPLE_IMU_VALID   = 0x10
+};
+
+struct SensorSample {
+    uint32_t timestamp = 0;     // 計測したmillis()
+    float temp = NAN;           // ℃
+    float hum = NAN;            // %RH
+    float pressure = NAN;       // hPa
+    int lux = 0;                // lx（light_sensorの換算表による）
+    uint16_t lightMv = 0;       // 照度センサー出力電圧（校正後、フィルタ済み）
+    float accelMag = NAN;       // 加速度の大きさ(G)
+    float magX = NAN;           // 地磁気(方位計用)
+    float magY = NAN;
+    uint8_t valid = 0;          // SampleValidの組み合わせ
+};
+
+// 周期のずれ（計測要求の間隔 - SENSOR_PERIOD_MS の絶対値）の分布
+constexpr int JITTER_BINS = 6;
+extern const uint32_t JITTER_BIN_US[JITTER_BINS];   // 各ビンの上限（最後は上限なし）
+
+struct SensorStats {
+    uint32_t lastI2cUs = 0;     // 直近1回のBME280読み出しにかかった時間
+    uint32_t maxI2cUs = 0;
+    uint32_t ticks = 0;         // タスクの起床回数
+    uint32_t reads = 0;         // BME280を読んだ回数
+    uint32_t lightReads = 0;
+    uint32_t bmePeriodMs = 0;   // 現在の計測周期
+    uint32_t lightPeriodMs = 0;
+    uint32_t errors = 0;
+    uint32_t dropped = 0;       // loop()が追いつかずリングが満杯だった
+    uint32_t jitter[JITTER_BINS] = {};
+    uint32_t maxJitterUs = 0;
+};
+
+// I2C・ADCを初期化してBME280を探す。見つからなければfalse（照度とIMUは取得する）
+bool sensorsBegin();
+// 計測タスクを開始（core1、loop()より高い優先度）。呼び出したタスクがサンプルの通知先になる
+void startSensorTask();
+#ifdef LIGHT_SLEEP
+// 1回計測させる（スケジューラからSENSOR_PERIOD_MSごとに呼ぶ）
+void sensorTrigger();
+#endif
+// 計測タスクが次の要求を待っている（計測の途中でライトスリープしないための確認）
+bool sensorsIdle();
+// 計測済みのサンプルを古い順に1つ取り出す。無ければfalse
+bool pollSensorSample(SensorSample &out);
+const SensorStats& sensorStats();
@@ -0,0 +1,70 @@
+// ==========================================
+// 時系列ブロック圧縮（Gorilla方式の簡易版）
+// - 時刻は秒単位の delta-of-delta、値は前回との差をzig-zagして可変長ビット列に
+// - ブロックは先頭に絶対値を持つので単独で復号できる
+// - 書きかけのブロックもヘッダーが常に最新なのでそのまま読める
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+constexpr int SERIES_MAX_CHANNELS = 4;
+constexpr size_t SERIES_BLOCK_BYTES = 256;
+
+// ヘッダー: 全長(2) 件数(2) 先頭時刻(4) チャンネル数(1) 予約(1)、続けて先頭値(2 x ch)
+constexpr size_t SERIES_HEADER_BYTES = 10;
+
+size_t seriesBlockLength(const uint8_t* block);
+uint16_t seriesBlockCount(const uint8_t* block);
+uint32_t seriesBlockStart(const uint8_t* block);
+// 先頭時刻を書き換える（中の時刻は差分なので、ブロックごと別の時計へ移せる）
+void seriesBlockSetStart(uint8_t* block, uint32_t t);
+
+class SeriesEncoder {
+public:
+    void begin(uint8_t* buf, size_t capacity, int channels);
+    // 入りきらない時はfalse（ブロックはそのまま有効）
+    bool add(uint32_t t, const int16_t* v);
+    uint16_t count() const { return samples; }
+    size_t length() const;
+
+private:
+    void putBits(uint32_t value, int bits);
+    void putTimestamp(int32_t dod);
+    void putValue(int32_t delta);
+    void updateHeader();
+
+    uint8_t* buf = nullptr;
+    size_t capacity = 0;
+    int channels = 0;
+    uint16_t samples = 0;
+    size_t bitPos = 0;
+    uint32_t lastT = 0;
+    int32_t lastDelta = 0;
+    int16_t last[SERIES_MAX_CHANNELS];
+};
+
+class SeriesDecoder {
+public:
+    bool begin(const uint8_t* block);
+    // 次のサンプル。ブロックの終わりならfalse
+    bool next(uint32_t &t, int16_t* v);
+    uint16_t count() const { return samples; }
+    int channelCount() const { return channels; }
+
+private:
+    uint32_t getBits(int bits);
+    int32_t getTimestamp();
+    int32_t getValue();
+
+    const uint8_t* buf = nullptr;
+    size_t bitLimit = 0;
+    int channels = 0;
+    uint16_t samples = 0;
+    uint16_t index = 0;
+    size_t bitPos = 0;
+    uint32_t lastT = 0;
+    int32_t lastDelta = 0;
+    int16_t last[SERIES_MAX_CHANNELS];
+};
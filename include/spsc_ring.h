@@ -0,0 +1,50 @@
+// ==========================================
+// 単一生産者・単一消費者のロックフリーリング
+// - 書き込み側はheadだけ、読み出し側はtailだけを進める
+// - 要素を書いてからheadを公開する（release/acquire）ので、
+//   消費者は書きかけの要素を読まない
+// - 容量はN-1ではなくN（添字は剰余で取り、head-tailで件数を数える）
+// - push/popは呼び出し側へ必ず展開する。割り込み（IRAM_ATTR）から積んでも、
+//   フラッシュ上のコードを呼ばない（フラッシュ書き込み中の割り込みでキャッシュ例外にならない）
+// ==========================================
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#define SPSC_ALWAYS_INLINE inline __attribute__((always_inline))
+
+template<typename T, uint32_t N>
+class SpscRing {
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    // 生産者側。満杯ならfalse（新しい方を捨てる）
+    SPSC_ALWAYS_INLINE bool push(const T &v){
+        uint32_t head = headIdx.load(std::memory_order_relaxed);
+        uint32_t tail = tailIdx.load(std::memory_order_acquire);
+        if(head - tail >= N) return false;
+        slots[head & (N - 1)] = v;
+        headIdx.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 消費者側。空ならfalse
+    SPSC_ALWAYS_INLINE bool pop(T &out){
+        uint32_t tail = tailIdx.load(std::memory_order_relaxed);
+        uint32_t head = headIdx.load(std::memory_order_acquire);
+        if(head == tail) return false;
+        out = slots[tail & (N - 1)];
+        tailIdx.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t size() const {
+        return headIdx.load(std::memory_order_acquire) - tailIdx.load(std::memory_order_acquire);
+    }
+
+private:
+    T slots[N];
+    std::atomic<uint32_t> headIdx{0};
+    std::atomic<uint32_t> tailIdx{0};
+};
@@ -0,0 +1,139 @@
+// ==========================================
+// 入力トレースの記録と読み出し（Arduino非依存）
+// - loop()に届いた入力（センサーのサンプル・ボタンイベント・天気のHTTP応答）を
+//   届いた順にバイト列へ積む。再生すると同じ入力を同じ順で同じ処理に通せる
+// - レコード: 種類(1) + 前のレコードからの経過ms(varint) + 中身
+//   時刻はloop()が受け取ったmillis()。計測・押下からの遅れは中身に持つ
+// - サンプルは固定小数で持つ（温度0.01℃・湿度0.01%・気圧0.1hPa・加速度0.001G・地磁気0.1）
+// - HTTPは応答コードと、パーサーが実際に読んだ分の本文
+// - 記録中だけバッファを確保する。ワーカー（HTTP）とloop()の両方から積むのでロックを取る
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+#include "sensors.h"
+#include "input_queue.h"
+
+// ファイル先頭: "TRC1" 版(1) 予約(3) 記録開始時のmillis()(4)
+constexpr uint8_t TRACE_VERSION = 1;
+constexpr size_t TRACE_HEADER_BYTES = 12;
+
+constexpr size_t TRACE_BUFFER_BYTES = 8192;     // 書き出し待ち（TRACE_FLUSH_MSごとに空ける）
+constexpr size_t TRACE_HTTP_MAX = 6144;         // 1応答の本文（6都市のgroupで約3KB）
+constexpr uint32_t TRACE_FLUSH_MS = 2000;
+
+// HTTPレコードの応答コード。0はWiFiにつながらず要求しなかった
+constexpr int TRACE_HTTP_NO_WIFI = 0;
+
+enum TraceRecordType : uint8_t {
+    TRACE_SAMPLE = 1,
+    TRACE_INPUT,
+    TRACE_HTTP
+};
+
+struct TraceStats {
+    uint32_t samples = 0;
+    uint32_t inputs = 0;
+    uint32_t http = 0;
+    uint32_t bytes = 0;         // ヘッダー込み
+    uint32_t dropped = 0;       // バッファが満杯で積めなかったレコード
+    uint32_t truncated = 0;     // TRACE_HTTP_MAXを超えて切った本文
+};
+
+// ---------- 記録 ----------
+// バッファを確保してヘッダーを積む。確保できなければfalse
+bool traceStart(uint32_t now);
+// 以後は積まない（残りはtraceDrain()で取り出してからtraceRelease()）
+void traceStop();
+void traceRelease();
+bool traceRecording();
+
+void traceSample(const SensorSample &sample, uint32_t now);
+void traceInput(const InputEvent &ev, uint32_t now, uint32_t nowUs);
+void traceHttp(int code, const uint8_t* body, size_t len, uint32_t now);
+// 積んだバイト列を先頭から取り出す（書き出し側がファイルへ書く）
+size_t traceDrain(uint8_t* out, size_t cap);
+const TraceStats& traceStats();
+
+// 読んだ分だけ本文として残すストリーム（天気ワーカーがパーサーとの間に挟む）
+class TraceTeeStream : public HalStream {
+public:
+    explicit TraceTeeStream(HalStream &in);
+    ~TraceTeeStream();
+    TraceTeeStream(const TraceTeeStream&) = delete;
+    TraceTeeStream& operator=(const TraceTeeStream&) = delete;
+    int available() override { return in.available(); }
+    int read() override;
+    int peek() override { return in.peek(); }
+#ifdef ARDUINO
+    size_t write(uint8_t) override { return 0; }
+#endif
+    const uint8_t* data() const { return buf; }
+    size_t length() const { return len; }
+    bool truncated() const { return over; }
+
+private:
+    HalStream &in;
+    uint8_t* buf;
+    size_t len = 0;
+    bool over = false;
+};
+
+// 記録した本文をもう一度流すストリーム
+class TraceBodyStream : public HalStream {
+public:
+    TraceBodyStream(const uint8_t* data, size_t len) : data(data), len(len) {}
+    int available() override { return (int)(len - pos); }
+    int read() override { return pos < len ? data[pos++] : -1; }
+    int peek() override { return pos < len ? data[pos] : -1; }
+#ifdef ARDUINO
+    size_t write(uint8_t) override { return 0; }
+#endif
+
+private:
+    const uint8_t* data;
+    size_t len;
+    size_t pos = 0;
+};
+
+// ---------- 読み出し ----------
+struct TraceRecord {
+    TraceRecordType type;
+    uint32_t ms;                // 記録時にloop()が受け取ったmillis()
+    SensorSample sample;        // TRACE_SAMPLE（timestampは記録時の計測時刻）
+    InputEvent input;           // TRACE_INPUT（usは呼ぶ側が lagUs から付け直す）
+    uint32_t lagUs;             // 押下から受け取りまで
+    int httpCode;               // TRACE_HTTP
+    const uint8_t* body;        // 次にnext()を呼ぶまで有効
+    size_t bodyLen;
+};
+
+// 足りなくなったらバイト列を補充する。0を返したら終わり
+typedef size_t (*TraceFill)(uint8_t* buf, size_t len, void* ctx);
+
+class TraceReader {
+public:
+    ~TraceReader(){ end(); }
+    // ヘッダーを確かめる。形式が違えばfalse
+    bool begin(TraceFill fill, void* ctx);
+    void end();
+    bool next(TraceRecord &out);
+    uint32_t startMs() const { return start; }
+    // 途中で切れた・壊れたレコードで止まった
+    bool corrupt() const { return broken; }
+
+private:
+    bool ensure(size_t n);
+    bool getVarint(uint32_t &v);
+
+    TraceFill fill = nullptr;
+    void* ctx = nullptr;
+    uint8_t* buf = nullptr;
+    size_t pos = 0;
+    size_t len = 0;
+    uint32_t start = 0;
+    uint32_t last = 0;
+    bool broken = false;
+};
@@ -0,0 +1,26 @@
+// ==========================================
+// トレースの保存先（LittleFS）とシリアル出力
+// - 記録はTRACE_FILEへ追記。traceStoreFlush()をTRACE_FLUSH_MSごとに呼んでバッファを空ける
+// - TRACE_FILE_MAXに達したら記録を止める（計測ログの領域を食わない）
+// - シリアルへは16進の行で出す（"# trace"で始まり"# end"で終わる）。PCの再生はそのまま読める
+// - LittleFSのマウントは計測ログ（sensorLogBegin）が済ませている前提
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+#include "trace.h"
+
+#define TRACE_FILE "/trace.bin"
+constexpr uint32_t TRACE_FILE_MAX = 131072;     // 1秒周期のサンプル（IMU込みで約18バイト）で約2時間
+
+// 前のトレースを消して記録を始める
+bool traceStoreStart();
+// 残りを書き出して記録を終える
+void traceStoreStop();
+// 記録中ならバッファを書き出す。上限に達したらfalse（記録は止まっている）
+bool traceStoreFlush();
+uint32_t traceStoreBytes();
+// 再生用に開く。無い・形式が違えばfalse
+bool traceStoreOpen(TraceReader &reader);
+void traceStoreClose();
+void traceStoreDump(Print &out);
@@ -0,0 +1,46 @@
+// ==========================================
+// 天気キャッシュ + バックグラウンド取得ワーカー
+// - HTTP通信はcore0のFreeRTOSタスクで実行し、loop()は止めない
+// - 取得結果はweatherCache[]（weather_cache）へ書き込み、完了イベントだけをloop()へ通知
+// - 6都市はgroupエンドポイント1回でまとめて取得（接続も1回）
+// - レスポンスはHTTPストリームから直接、必要な項目だけフィルタしてパース
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+#include "weather_cache.h"
+
+// スタブHTTPサーバーへ向ける場合は build_flags で上書きする
+#ifndef WEATHER_API_BASE
+#define WEATHER_API_BASE "http://api.openweathermap.org"
+#endif
+
+enum WeatherFetchStatus : uint8_t {
+    FETCH_OK = 0,
+    FETCH_NO_WIFI,
+    FETCH_HTTP_ERR,         // 接続失敗（httpCodeが負）または200以外の応答
+    FETCH_JSON_ERR
+};
+
+struct WeatherFetchResult {
+    uint32_t cityMask;      // 更新された都市（ビット）。全都市が新しく取得しなかった時は0
+    WeatherFetchStatus status;
+    int16_t httpCode;       // FETCH_HTTP_ERRの時の応答コード（負は接続失敗）
+};
+
+// ワーカータスク起動（setup()で1回）
+void startWeatherWorker(const char* apiKey);
+// 古い都市をまとめて取得する要求を積むだけで即戻る。処理待ちがあれば積まない
+// force=trueなら鮮度に関係なく全都市を取得
+// trueを返した時は、あとで必ず完了イベントが1件届く（積めなかった時はfalse）
+bool requestWeatherRefresh(bool force=false);
+// 完了イベントを1件取り出す（loop()から毎回呼ぶ、ブロックしない）
+bool pollWeatherFetchResult(WeatherFetchResult &result);
+// 積んだ要求の完了イベントをまだ全部受け取っていなければtrue（2件積んで1件目が届いた時もtrue）
+bool weatherFetchPending();
+
+// トレース再生中はrequestWeatherRefresh()が通信しない（応答は記録から流す）
+void weatherSetReplay(bool on);
+// 記録した応答をワーカーと同じ処理（パース・キャッシュ更新・完了イベント）に通す
+// httpCodeはTRACE_HTTP_NO_WIFI（0）・負（接続失敗）・HTTPの応答コード
+void weatherReplayResponse(int httpCode, HalStream* body);
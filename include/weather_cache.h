@@ -0,0 +1,61 @@
+// ==========================================
+// 天気キャッシュとgroupレスポンスのパース
+// - キャッシュは固定長バッファ + 列挙型のみでヒープを使わない
+// - 取得ワーカー（weather）が書き、loop()が読む。どちらもロックを取る
+// - Arduino非依存（ストリームはhal.hのHalStream）なので、記録済みペイロードをPCで流して測れる
+// ==========================================
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal.h"
+
+struct CityInfo {
+    const char* name;
+    uint32_t id;        // OpenWeatherMap city id
+};
+
+enum WeatherSymbol : uint8_t {
+    SYM_UNKNOWN = 0,
+    SYM_SUN,
+    SYM_CLOUD,
+    SYM_RAIN,
+    SYM_SNOW,
+    SYM_THUNDER
+};
+
+constexpr size_t WEATHER_DESC_LEN = 32;
+
+struct WeatherCache {
+    bool valid = false;
+    WeatherSymbol symbol = SYM_UNKNOWN;
+    uint16_t conditionCode = 0;     // weather[0].id
+    float temp = 0.0f;
+    unsigned long lastFetch = 0;
+    char description[WEATHER_DESC_LEN] = "";
+};
+
+constexpr int NUM_CITIES = 6;
+constexpr unsigned long WEATHER_STALE_MS = 1800000;   // 30分で古いとみなす（既定）
+extern CityInfo cities[NUM_CITIES];
+extern WeatherCache weatherCache[NUM_CITIES];
+
+// OpenWeatherMapの天気コード（2xx雷, 3xx霧雨, 5xx雨, 6xx雪, 7xx大気, 800晴, 80x雲）から変換
+WeatherSymbol weatherSymbolFromCode(uint16_t conditionCode);
+// 未取得または鮮度の期限（既定WEATHER_STALE_MS）を過ぎた都市
+bool isWeatherStale(int cityIdx);
+// 定期更新の間隔を延ばした時は、鮮度の期限も合わせる（都市の切替で取りに行かないように）
+void setWeatherStaleMs(uint32_t ms);
+
+// 取得する都市（ビット）。forceなら全都市、そうでなければ古い都市だけ
+uint32_t weatherStaleMask(bool force);
+// cityMaskの都市をまとめて取るgroupエンドポイントのURL。書いた長さ（収まらなければlen以上）を返す
+int weatherGroupUrl(char* out, size_t len, const char* base, uint32_t cityMask, const char* apiKey);
+
+// groupレスポンスをストリームから読み、該当都市のキャッシュを更新する
+// 1都市でも更新できればtrue（途中で切れた応答でも、それまでの都市は更新する）。戻り値とupdatedMaskは常に一致する
+bool parseWeatherGroupStream(HalStream &in, uint32_t &updatedMask);
+
+// weatherCache[]はワーカーも書き込むので、読む側もロックを取る
+void lockWeatherCache();
+void unlockWeatherCache();
@@ -0,0 +1,116 @@
+// ==========================================
+// 保持型ウィジェット
+// - 各ウィジェットは最後に描いた内容を覚えていて、
+//   表示が変わる時だけdirtyになる（値が同じなら何も描かない）
+// - 画面(Screen)はウィジェットの配列 + 固定部分の描画 + 値の更新関数
+// ==========================================
+#pragma once
+
+#include "render.h"
+#include "profiler.h"
+
+class Widget {
+public:
+    virtual ~Widget() {}
+    void markDirty(){ dirty = true; }
+    bool isDirty() const { return dirty; }
+    // 画面が消された後に呼ばれる。次のrender()で必ず描く
+    virtual void invalidate(){ markDirty(); }
+    // dirtyなら描いてtrueを返す
+    bool render();
+
+protected:
+    virtual void draw() = 0;
+    bool dirty = true;
+};
+
+// 固定文字列。色（反転表示など）だけ変わる
+class Label : public Widget {
+public:
+    Label(int x, int y, uint8_t textSize, const char* text);
+    void setText(const char* text);
+    void setColors(uint8_t fg, uint8_t bg);
+    // 文字の背後を塗る範囲（メニューの反転表示など）
+    void setBox(int bx, int by, int bw, int bh);
+
+protected:
+    void draw() override;
+
+private:
+    int x, y;
+    int boxX = 0, boxY = 0, boxW = 0, boxH = 0;
+    uint8_t textSize;
+    uint8_t fg = BLACK, bg = NORMAL_BG;
+    const char* text;
+};
+
+// 書式付きの値。整形後の文字列が前回と違う時だけdirty
+class ValueField : public Widget {
+public:
+    // (x,y,w,h)は消去する範囲
+    ValueField(int x, int y, int w, int h, uint8_t textSize);
+    void set(const char* fmt, ...);
+    void setColor(uint8_t fg);
+    void clear();
+
+protected:
+    void draw() override;
+
+private:
+    int x, y, w, h;
+    uint8_t textSize;
+    uint8_t fg = BLACK;
+    char text[32] = "";
+};
+
+// 0-100の横棒
+class Bar : public Widget {
+public:
+    Bar(int x, int y, int w, int h);
+    void set(int percent, uint8_t color);
+
+protected:
+    void draw() override;
+
+private:
+    int x, y, w, h;
+    int percent = -1;
+    uint8_t color = BLACK;
+};
+
+// データの版番号が変わった時だけ描き直すプロット
+class Plot : public Widget {
+public:
+    typedef void (*DrawFn)(bool full);
+    explicit Plot(DrawFn fn) : drawFn(fn) {}
+    void setVersion(uint32_t version);
+    // 次の描画を全体再描画にする（画面に入った時など）
+    void invalidate() override { full = true; markDirty(); }
+
+protected:
+    void draw() override;
+
+private:
+    DrawFn drawFn;
+    uint32_t version = 0;
+    bool full = true;
+};
+
+struct Screen {
+    void (*enter)();        // 画面に入った時の固定部分の描画（背景クリア後）
+    void (*update)();       // 毎秒: ウィジェットへ値を渡すだけ
+    Widget* const* widgets;
+    int widgetCount;
+    ProfProbe probe;        // enter/updateの時間を記録するプローブ
+};
+
+// ウィジェットの数は配列から取る（手で数えると足した時にずれる）
+template<int N>
+constexpr Screen makeScreen(void (*enter)(), void (*update)(), Widget* const (&widgets)[N], ProfProbe probe){
+    return { enter, update, widgets, N, probe };
+}
+
+// 背景を塗り、固定部分を描いて全ウィジェットを描く
+void enterScreen(const Screen &screen);
+// 値を更新し、dirtyなウィジェットだけ描く。描いた数を返す
+int updateScreen(const Screen &screen);
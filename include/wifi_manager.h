@@ -0,0 +1,29 @@
+// ==========================================
+// WiFi接続マネージャー（イベント駆動ステートマシン）
+// - 呼び出し側を一切ブロックしない
+// - 切断時は指数バックオフで再接続
+// - 誰も回線を要求していない間は無線をOFFにする
+// ==========================================
+#pragma once
+
+#include <Arduino.h>
+
+enum WiFiLinkState : uint8_t {
+    LINK_OFF = 0,       // 無線OFF（要求待ち）
+    LINK_CONNECTING,    // 接続試行中
+    LINK_UP,            // IP取得済み（モデムスリープ有効）
+    LINK_BACKOFF        // 失敗後の待機中
+};
+
+void wifiManagerBegin(const char* ssid, const char* pass);
+// loop()から毎回呼ぶ。状態が変わったらtrue
+bool wifiManagerUpdate();
+
+// 回線の利用要求/解放（参照カウント）。どのタスクから呼んでもよい
+void wifiRequestLink();
+void wifiReleaseLink();
+
+WiFiLinkState wifiLinkState();
+bool wifiLinkUp();
+// IP取得まで待つ。ワーカータスク専用でloop()からは呼ばないこと
+bool wifiWaitLinkUp(uint32_t timeoutMs);
@@ -0,0 +1,35 @@
+// ==========================================
+// 適応サンプリング
+// ==========================================
+
+#include "adaptive_sampler.h"
+
+#include <math.h>
+
+float adaptiveChange(float v, float last, float threshold){
+    if(isnan(v) || isnan(last) || threshold <= 0.0f) return 1.0f;
+    return fabsf(v - last) / threshold;
+}
+
+AdaptiveSampler::AdaptiveSampler(uint32_t minPeriodMs, uint32_t maxPeriodMs)
+    : minMs(minPeriodMs), maxMs(maxPeriodMs < minPeriodMs ? minPeriodMs : maxPeriodMs), periodMs(minPeriodMs) {}
+
+void AdaptiveSampler::reset(){
+    periodMs = minMs;
+    hasSample = false;
+}
+
+bool AdaptiveSampler::due(uint32_t now) const {
+    if(!hasSample) return true;
+    return now - lastMs + minMs / 2 >= periodMs;
+}
+
+void AdaptiveSampler::measured(float change, uint32_t now){
+    if(change >= 1.0f){
+        periodMs = minMs;
+    } else if(change < 0.5f){
+        periodMs = (periodMs > maxMs / 2) ? maxMs : periodMs * 2;
+    }
+    lastMs = now;
+    hasSample = true;
+}
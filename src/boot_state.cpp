@@ -0,0 +1,106 @@
+// ==========================================
+// 起動時の保存状態・起動段階の計時
+// ==========================================
+
+#include "boot_state.h"
+#include "weather.h"
+
+#include <Preferences.h>
+
+// 構造体をそのまま保存しているので、レイアウトを変えたら上げる
+constexpr uint8_t BOOT_STATE_VERSION = 1;
+static const char* const NVS_NAMESPACE = "boot";
+
+struct BootPhase {
+    const char* name;
+    uint32_t us;
+};
+
+static BootPhase phases[BOOT_MAX_PHASES];
+static int phaseCount = 0;
+
+static bool openPrefs(Preferences &prefs, bool readOnly){
+    if(!prefs.begin(NVS_NAMESPACE, readOnly)) return false;
+    if(!readOnly && prefs.getUChar("ver", 0) != BOOT_STATE_VERSION){
+        prefs.clear();
+        prefs.putUChar("ver", BOOT_STATE_VERSION);
+    }
+    return true;
+}
+
+bool bootStateLoad(BootReadings &readings, int &cityIdx){
+    Preferences prefs;
+    if(!openPrefs(prefs, true)) return false;
+    if(prefs.getUChar("ver", 0) != BOOT_STATE_VERSION){
+        prefs.end();
+        return false;
+    }
+
+    bool any = false;
+    int city = prefs.getUChar("city", 0xFF);
+    if(city < NUM_CITIES){
+        cityIdx = city;
+        any = true;
+    }
+    if(prefs.getBytesLength("read") == sizeof(BootReadings)){
+        prefs.getBytes("read", &readings, sizeof(BootReadings));
+        any = true;
+    }
+    WeatherCache saved[NUM_CITIES];
+    if(prefs.getBytesLength("wx") == sizeof(saved)){
+        prefs.getBytes("wx", saved, sizeof(saved));
+        // 取得時刻は前回起動のmillis()なので意味がない。表示には使い、鮮度は「古い」にしておく
+        unsigned long stale = millis() - WEATHER_STALE_MS;
+        lockWeatherCache();
+        for(int i=0;i<NUM_CITIES;i++){
+            if(!saved[i].valid) continue;
+            weatherCache[i] = saved[i];
+            weatherCache[i].description[WEATHER_DESC_LEN - 1] = '\0';
+            weatherCache[i].lastFetch = stale;
+        }
+        unlockWeatherCache();
+        any = true;
+    }
+    prefs.end();
+    return any;
+}
+
+void bootStateSaveWeather(){
+    WeatherCache copy[NUM_CITIES];
+    lockWeatherCache();
+    for(int i=0;i<NUM_CITIES;i++) copy[i] = weatherCache[i];
+    unlockWeatherCache();
+
+    Preferences prefs;
+    if(!openPrefs(prefs, false)) return;
+    prefs.putBytes("wx", copy, sizeof(copy));
+    prefs.end();
+}
+
+void bootStateSaveCity(int cityIdx){
+    Preferences prefs;
+    if(!openPrefs(prefs, false)) return;
+    if(prefs.getUChar("city", 0xFF) != cityIdx) prefs.putUChar("city", (uint8_t)cityIdx);
+    prefs.end();
+}
+
+void bootStateSaveReadings(const BootReadings &readings){
+    Preferences prefs;
+    if(!openPrefs(prefs, false)) return;
+    prefs.putBytes("read", &readings, sizeof(BootReadings));
+    prefs.end();
+}
+
+void bootPhase(const char* name){
+    if(phaseCount >= BOOT_MAX_PHASES) return;
+    phases[phaseCount++] = { name, (uint32_t)micros() };
+}
+
+void bootReport(){
+    uint32_t prev = 0;
+    for(int i=0;i<phaseCount;i++){
+        Serial.printf("boot %-12s %7.1f ms (+%.1f)\n", phases[i].name,
+                      phases[i].us / 1000.0f, (phases[i].us - prev) / 1000.0f);
+        prev = phases[i].us;
+    }
+}
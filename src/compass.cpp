@@ -0,0 +1,107 @@
+// ==========================================
+// 方位の計算
+// ==========================================
+
+#include "compass.h"
+
+void CompassCalibrator::begin(){
+    for(int i=0;i<3;i++){
+        lo[i] = INFINITY;
+        hi[i] = -INFINITY;
+    }
+    count = 0;
+}
+
+void CompassCalibrator::add(float mx, float my, float mz){
+    const float m[3] = {mx, my, mz};
+    for(int i=0;i<3;i++){
+        if(isnan(m[i])) return;
+    }
+    for(int i=0;i<3;i++){
+        if(m[i] < lo[i]) lo[i] = m[i];
+        if(m[i] > hi[i]) hi[i] = m[i];
+    }
+    count++;
+}
+
+// 中心を原点へ寄せ、3軸の振れ幅を平均にそろえる（楕円体を球に近づける対角の近似）
+bool CompassCalibrator::finish(CompassCalibration &out) const {
+    if(count < COMPASS_CAL_MIN_SAMPLES) return false;
+    float range[3];
+    float mean = 0.0f;
+    for(int i=0;i<3;i++){
+        range[i] = hi[i] - lo[i];
+        if(range[i] < COMPASS_CAL_MIN_RANGE) return false;
+        mean += range[i] / 3.0f;
+    }
+    for(int i=0;i<3;i++){
+        out.offset[i] = (hi[i] + lo[i]) / 2.0f;
+        out.scale[i] = mean / range[i];
+    }
+    out.valid = true;
+    return true;
+}
+
+float headingWrap(float deg){
+    deg = fmodf(deg, 360.0f);
+    return deg < 0.0f ? deg + 360.0f : deg;
+}
+
+float headingDelta(float a, float b){
+    float d = headingWrap(a - b);
+    return d > 180.0f ? d - 360.0f : d;
+}
+
+static void applyCalibration(const CompassCalibration &cal, float m[3]){
+    for(int i=0;i<3;i++) m[i] = (m[i] - cal.offset[i]) * cal.scale[i];
+}
+
+float compassFlatHeading(float mx, float my, const CompassCalibration &cal){
+    if(isnan(mx) || isnan(my)) return NAN;
+    float m[3] = {mx, my, cal.offset[2]};
+    applyCalibration(cal, m);
+    return headingWrap(atan2f(m[1], m[0]) * 180.0f / (float)M_PI);
+}
+
+// 重力の向きuに垂直な面へ、機体のx軸（xh）とそれを90度回したyh = u × xh を取り、
+// 地磁気をその2軸へ射影する（mのu成分はどちらとも直交するので引かなくてよい）
+float compassTiltHeading(const HalImuReading &r, const CompassCalibration &cal){
+    float g = sqrtf(r.accelX * r.accelX + r.accelY * r.accelY + r.accelZ * r.accelZ);
+    if(!(g > 0.1f)) return NAN;
+    float ux = r.accelX / g, uy = r.accelY / g, uz = r.accelZ / g;
+    float m[3] = {r.magX, r.magY, r.magZ};
+    if(isnan(m[0]) || isnan(m[1]) || isnan(m[2])) return NAN;
+    applyCalibration(cal, m);
+
+    // xh = ex - ux*u（x軸がほぼ鉛直なら方位が決まらない）
+    float xx = 1.0f - ux * ux, xy = -ux * uy, xz = -ux * uz;
+    if(xx < 0.01f) return NAN;
+    float yx = uy * xz - uz * xy;
+    float yy = uz * xx - ux * xz;
+    float yz = ux * xy - uy * xx;
+    float e = m[0] * xx + m[1] * xy + m[2] * xz;
+    float n = m[0] * yx + m[1] * yy + m[2] * yz;
+    return headingWrap(atan2f(n, e) * 180.0f / (float)M_PI);
+}
+
+float CompassFilter::update(const HalImuReading &r, const CompassCalibration &cal, float dt){
+    float mag = compassTiltHeading(r, cal);
+    if(!started){
+        if(isnan(mag)) return value;
+        value = mag;
+        started = true;
+        return value;
+    }
+
+    // 鉛直まわりに左へ回ると、機体から見た地磁気は右へ回る（方位の角度は減る）
+    float g = sqrtf(r.accelX * r.accelX + r.accelY * r.accelY + r.accelZ * r.accelZ);
+    if(g > 0.1f && !isnan(r.gyroX)){
+        float rate = -(r.gyroX * r.accelX + r.gyroY * r.accelY + r.gyroZ * r.accelZ) / g;
+        value = headingWrap(value + rate * dt);
+    }
+    if(!isnan(mag) && g >= COMPASS_ACCEL_MIN_G && g <= COMPASS_ACCEL_MAX_G){
+        float k = dt / (COMPASS_FILTER_TAU_S + dt);
+        value = headingWrap(value + k * headingDelta(mag, value));
+    }
+    return value;
+}
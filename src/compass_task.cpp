@@ -0,0 +1,153 @@
+// ==========================================
+// 方位計タスク
+// ==========================================
+
+#include "compass_task.h"
+#include "profiler.h"
+#include "mem_telemetry.h"
+#include "hal.h"
+
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+#include <mutex>
+
+constexpr uint32_t COMPASS_TASK_STACK = 3072;
+constexpr UBaseType_t COMPASS_TASK_PRIORITY = 2;    // 計測タスクと同じ。描画や通信で周期を乱さない
+constexpr BaseType_t COMPASS_TASK_CORE = 1;
+
+// 校正値は構造体のまま保存しているので、レイアウトを変えたら上げる
+constexpr uint8_t COMPASS_CAL_VERSION = 1;
+static const char* const NVS_NAMESPACE = "compass";
+
+static CompassStats stats;
+static TaskHandle_t compassTask = nullptr;
+static std::atomic<bool> running{false};
+static std::atomic<float> published{NAN};
+
+// フィルター・校正値・校正中の範囲はタスクとloop()の両方から触るのでロックする
+static std::mutex stateMutex;
+static CompassFilter filter;
+static CompassCalibration calibration;
+static CompassCalibrator calibrator;
+static bool calibrating = false;
+
+static void loadCalibration(){
+    Preferences prefs;
+    if(!prefs.begin(NVS_NAMESPACE, true)) return;
+    if(prefs.getUChar("ver", 0) == COMPASS_CAL_VERSION &&
+       prefs.getBytesLength("cal") == sizeof(CompassCalibration)){
+        prefs.getBytes("cal", &calibration, sizeof(CompassCalibration));
+    }
+    prefs.end();
+}
+
+static void saveCalibration(const CompassCalibration &cal){
+    Preferences prefs;
+    if(!prefs.begin(NVS_NAMESPACE, false)) return;
+    prefs.putUChar("ver", COMPASS_CAL_VERSION);
+    prefs.putBytes("cal", &cal, sizeof(CompassCalibration));
+    prefs.end();
+}
+
+static void sampleOnce(uint32_t &lastUs){
+    PROF_SCOPE(PROF_COMPASS);
+    uint32_t start = micros();
+    HalImuReading r;
+    if(!halImuRead(r)){
+        stats.errors++;
+        return;
+    }
+    float dt = lastUs ? (start - lastUs) / 1e6f : 0.0f;
+    lastUs = start;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if(calibrating) calibrator.add(r.magX, r.magY, r.magZ);
+        filter.update(r, calibration, dt);
+        published = filter.valid() ? filter.heading() : NAN;
+    }
+    stats.samples++;
+    uint32_t elapsed = micros() - start;
+    if(elapsed > stats.maxSampleUs) stats.maxSampleUs = elapsed;
+}
+
+static void compassTaskLoop(void*){
+    for(;;){
+        // 止めている間は通知待ち（方位計の画面に入った時に起こされる）
+        while(!running) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            filter.reset();
+        }
+        published = NAN;
+        uint32_t lastUs = 0;
+        TickType_t wake = xTaskGetTickCount();
+        while(running){
+            sampleOnce(lastUs);
+            if(!xTaskDelayUntil(&wake, pdMS_TO_TICKS(COMPASS_SAMPLE_MS))) stats.overruns++;
+        }
+    }
+}
+
+void compassBegin(){
+    if(compassTask) return;
+    loadCalibration();
+    xTaskCreatePinnedToCore(compassTaskLoop, "compass", COMPASS_TASK_STACK, nullptr,
+                            COMPASS_TASK_PRIORITY, &compassTask, COMPASS_TASK_CORE);
+    memWatchTask("compass", compassTask, MEM_TAG_SENSORS);
+}
+
+void compassStart(){
+    if(running || !compassTask) return;
+    running = true;
+    xTaskNotifyGive(compassTask);
+}
+
+void compassStop(){
+    running = false;
+    std::lock_guard<std::mutex> lock(stateMutex);
+    calibrating = false;
+}
+
+bool compassRunning(){
+    return running;
+}
+
+float compassHeadingNow(){
+    return published;
+}
+
+CompassCalibration compassCalibration(){
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return calibration;
+}
+
+void compassCalibrationStart(){
+    std::lock_guard<std::mutex> lock(stateMutex);
+    calibrator.begin();
+    calibrating = true;
+}
+
+bool compassCalibrating(){
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return calibrating;
+}
+
+bool compassCalibrationFinish(){
+    CompassCalibration cal;
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if(!calibrating) return false;
+        calibrating = false;
+        if(!calibrator.finish(cal)) return false;
+        calibration = cal;
+        filter.reset();         // 校正前の方位から寄せていくと数秒ずれるので、次の1回から出し直す
+    }
+    saveCalibration(cal);
+    return true;
+}
+
+const CompassStats& compassStats(){
+    return stats;
+}
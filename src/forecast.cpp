@@ -0,0 +1,152 @@
+// ==========================================
+// 局所の気象傾向と短期予報
+// ==========================================
+
+#include "forecast.h"
+
+#include <algorithm>
+
+const char* const TENDENCY_NAMES[3] = {"falling", "steady", "rising"};
+
+// Zambrettiの番号 → 文字。下降1〜9、横ばい10〜19、上昇20〜32
+static const char ZAMBRETTI_LETTERS[33] = {
+    '?',
+    'A', 'B', 'D', 'H', 'O', 'R', 'U', 'X', 'Z',
+    'A', 'B', 'E', 'K', 'N', 'P', 'S', 'W', 'X', 'Z',
+    'A', 'B', 'C', 'F', 'G', 'I', 'J', 'L', 'M', 'Q', 'T', 'Y', 'Z'
+};
+
+static const char* const ZAMBRETTI_TEXT[26] = {
+    "Settled fine",    "Fine weather",    "Becoming fine",   "Fine, unsettled",
+    "Fine, showers",   "Fair, improving", "Fair, showers",   "Showery later",
+    "Showery, better", "Changeable",      "Showers likely",  "Clearing later",
+    "Unsettled",       "Bright spells",   "Showery",         "Some rain",
+    "Unsettled",       "Rain later",      "Some rain",       "Very unsettled",
+    "Rain, worsening", "Rain at times",   "Frequent rain",   "Rain",
+    "Stormy",          "Stormy, rain"
+};
+
+static TrendWindow<13> pressure3h(15UL * 60UL * 1000UL);   // 15分 x 12
+static TrendWindow<13> pressure1h(5UL * 60UL * 1000UL);    // 5分 x 12
+static TrendWindow<13> temp1h(5UL * 60UL * 1000UL);
+static TrendWindow<13> hum1h(5UL * 60UL * 1000UL);
+
+// Magnus式（Sonntagの係数）
+float dewPoint(float temp, float hum){
+    if(isnan(temp) || isnan(hum) || hum <= 0.0f) return NAN;
+    const float b = 17.62f, c = 243.12f;
+    float g = logf(hum / 100.0f) + b * temp / (c + temp);
+    return c * g / (b - g);
+}
+
+// NOAAの式（華氏で計算）。27℃未満あたりは簡易式のまま
+float heatIndex(float temp, float hum){
+    if(isnan(temp) || isnan(hum)) return NAN;
+    float t = temp * 1.8f + 32.0f;
+    float hi = 0.5f * (t + 61.0f + (t - 68.0f) * 1.2f + hum * 0.094f);
+    if((hi + t) / 2.0f >= 80.0f){
+        hi = -42.379f + 2.04901523f * t + 10.14333127f * hum
+           - 0.22475541f * t * hum - 0.00683783f * t * t - 0.05481717f * hum * hum
+           + 0.00122874f * t * t * hum + 0.00085282f * t * hum * hum
+           - 0.00000199f * t * t * hum * hum;
+        if(hum < 13.0f && t >= 80.0f && t <= 112.0f){
+            hi -= (13.0f - hum) / 4.0f * sqrtf((17.0f - fabsf(t - 95.0f)) / 17.0f);
+        } else if(hum > 85.0f && t >= 80.0f && t <= 87.0f){
+            hi += (hum - 85.0f) / 10.0f * (87.0f - t) / 5.0f;
+        }
+    }
+    return (hi - 32.0f) / 1.8f;
+}
+
+// 測高公式。温度は現地の気温
+float seaLevelPressure(float pressure, float temp, float altitudeM){
+    if(isnan(pressure)) return NAN;
+    if(altitudeM == 0.0f || isnan(temp)) return pressure;
+    float h = 0.0065f * altitudeM;
+    return pressure * powf(1.0f - h / (temp + h + 273.15f), -5.257f);
+}
+
+uint8_t zambrettiNumber(float seaLevel, PressureTendency tendency){
+    if(isnan(seaLevel)) return 0;
+    float z;
+    int lo, hi;
+    switch(tendency){
+        case TENDENCY_FALLING: z = 127.0f - 0.12f * seaLevel; lo = 1;  hi = 9;  break;
+        case TENDENCY_RISING:  z = 185.0f - 0.16f * seaLevel; lo = 20; hi = 32; break;
+        default:               z = 144.0f - 0.13f * seaLevel; lo = 10; hi = 19; break;
+    }
+    int n = (int)lroundf(z);
+    return (uint8_t)std::min(std::max(n, lo), hi);
+}
+
+char zambrettiLetter(uint8_t number){
+    return number <= 32 ? ZAMBRETTI_LETTERS[number] : '?';
+}
+
+// A〜D晴れ、E〜L曇り、M〜X雨（氷点近くは雪）、Y・Z雷
+static WeatherSymbol symbolFromLetter(char letter, float temp){
+    if(letter < 'A' || letter > 'Z') return SYM_UNKNOWN;
+    if(letter <= 'D') return SYM_SUN;
+    if(letter <= 'L') return SYM_CLOUD;
+    if(letter <= 'X') return (!isnan(temp) && temp <= 1.0f) ? SYM_SNOW : SYM_RAIN;
+    return SYM_THUNDER;
+}
+
+void forecastReset(){
+    pressure3h.reset();
+    pressure1h.reset();
+    temp1h.reset();
+    hum1h.reset();
+}
+
+void forecastAdd(float temp, float hum, float pressure, uint32_t now){
+    pressure3h.add(pressure, now);
+    pressure1h.add(pressure, now);
+    temp1h.add(temp, now);
+    hum1h.add(hum, now);
+}
+
+Forecast forecastCurrent(uint32_t now){
+    Forecast f;
+    TrendFit t = temp1h.fit(now);
+    TrendFit h = hum1h.fit(now);
+    if(t.valid){
+        f.temp = t.value;
+        f.tempPerHour = t.slopePerHour;
+    }
+    if(h.valid){
+        f.hum = std::min(std::max(h.value, 0.0f), 100.0f);
+        f.humPerHour = h.slopePerHour;
+    }
+    f.dewPoint = dewPoint(f.temp, f.hum);
+    f.heatIndex = heatIndex(f.temp, f.hum);
+
+    TrendFit p = pressure3h.fit(now);
+    TrendFit p1 = pressure1h.fit(now);
+    if(p1.valid) f.dropPerHour = -p1.slopePerHour;
+    if(!p.valid) return f;
+
+    f.valid = true;
+    f.pressure = p.value;
+    f.change3h = p.slopePerHour * 3.0f;
+    if(f.change3h <= -TENDENCY_HPA_3H) f.tendency = TENDENCY_FALLING;
+    else if(f.change3h >= TENDENCY_HPA_3H) f.tendency = TENDENCY_RISING;
+    f.seaLevel = seaLevelPressure(f.pressure, f.temp, FORECAST_ALTITUDE_M);
+    f.zambretti = zambrettiNumber(f.seaLevel, f.tendency);
+    f.letter = zambrettiLetter(f.zambretti);
+    if(f.letter >= 'A' && f.letter <= 'Z') f.text = ZAMBRETTI_TEXT[f.letter - 'A'];
+    f.symbol = symbolFromLetter(f.letter, f.temp);
+    return f;
+}
+
+float forecastChange(const Forecast &f){
+    if(!f.valid) return 1.0f;
+    float change = fabsf(f.change3h) / STABLE_HPA_3H;
+    change = std::max(change, fabsf(f.tempPerHour) / STABLE_TEMP_PER_HOUR);
+    change = std::max(change, fabsf(f.humPerHour) / STABLE_HUM_PER_HOUR);
+    return change;
+}
+
+bool forecastSharpDrop(const Forecast &f){
+    return f.dropPerHour >= SHARP_DROP_HPA_PER_HOUR;
+}
@@ -0,0 +1,124 @@
+// ==========================================
+// フレーム差分転送
+// ==========================================
+
+#include "frame_diff.h"
+#include "hal.h"
+
+#include <string.h>
+
+constexpr int TILE_W = 32;
+constexpr int TILE_H = 8;
+constexpr int TILES_X = SCREEN_W / TILE_W;
+constexpr int TILES_Y = SCREEN_H / TILE_H;
+constexpr int ROW_BYTES = SCREEN_W / 2;
+constexpr int TILE_BYTES = TILE_W / 2;
+
+const uint8_t PALETTE_RGB[PALETTE_USED][3] = {
+    {210,180,140},  // NORMAL_BG
+    {0,0,0},        // BLACK
+    {255,255,255},  // WHITE
+    {255,0,0},      // RED
+    {0,0,255},      // BLUE
+    {0,255,0},      // GREEN
+    {255,165,0},    // ORANGE
+    {128,0,128},    // PURPLE
+    {255,255,0},    // YELLOW
+    {100,100,100},  // GRAY
+    {0,255,255}     // CYAN
+};
+
+static uint32_t tileHash[TILES_Y][TILES_X];    // 前回転送した時の内容
+static bool primed = false;                     // falseなら全タイル送る
+static uint32_t framesSinceFull = 0;            // 最後に全タイル送ってからのフレーム数
+static uint16_t paletteSwapped[16];             // SPIバイト順のRGB565
+// DMA転送中に次の行を変換できるよう2本持つ
+static uint16_t spanBuffer[2][SCREEN_W * TILE_H];
+static int spanSlot = 0;
+
+void frameDiffBegin(){
+    for(int i=0;i<16;i++){
+        const uint8_t* rgb = PALETTE_RGB[i < PALETTE_USED ? i : 0];
+        uint16_t c = ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+        paletteSwapped[i] = (c >> 8) | (c << 8);
+    }
+    primed = false;
+}
+
+void frameDiffInvalidate(){
+    primed = false;
+}
+
+// タイル1枚（16バイト x 8行）のハッシュ。1行の4語をそれぞれ別の列で混ぜて掛け算の待ちを重ね、
+// 最後にまとめてmurmur3の仕上げで全ビットへ広げる
+static uint32_t hashTile(const uint8_t* back, int tx, int y0){
+    uint32_t h[4] = {0x811C9DC5u, 0x01000193u, 0x9E3779B9u, 0x85EBCA6Bu};
+    const uint8_t* p = back + y0 * ROW_BYTES + tx * TILE_BYTES;
+    for(int line=0; line<TILE_H; line++, p += ROW_BYTES){
+        for(int i=0; i<4; i++){
+            uint32_t w;
+            memcpy(&w, p + i * 4, 4);
+            h[i] = (h[i] ^ w) * 0x01000193u;
+            h[i] ^= h[i] >> 15;
+        }
+    }
+    uint32_t x = h[0] ^ (h[1] * 0x85EBCA6Bu) ^ (h[2] * 0xC2B2AE35u) ^ (h[3] * 0x27D4EB2Fu);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return x;
+}
+
+// 横に連続したタイル列をRGB565へ変換して1回で転送
+static uint32_t pushSpan(const uint8_t* back, int tx0, int tx1, int y0){
+    uint16_t* buf = spanBuffer[spanSlot];
+    spanSlot ^= 1;
+
+    int spanBytes = (tx1 - tx0) * TILE_BYTES;
+    uint16_t* out = buf;
+    for(int line=0; line<TILE_H; line++){
+        size_t off = (y0 + line) * ROW_BYTES + tx0 * TILE_BYTES;
+        const uint8_t* src = back + off;
+        for(int i=0; i<spanBytes; i++){
+            *out++ = paletteSwapped[src[i] >> 4];
+            *out++ = paletteSwapped[src[i] & 0x0F];
+        }
+    }
+
+    int w = (tx1 - tx0) * TILE_W;
+    halDisplayPush(tx0 * TILE_W, y0, w, TILE_H, buf);
+    return w * TILE_H * 2;
+}
+
+uint32_t frameDiffPresent(const uint8_t* back){
+    uint32_t bytes = 0;
+    bool writing = false;
+    if(++framesSinceFull >= FRAME_FULL_PUSH_FRAMES) primed = false;
+    if(!primed) framesSinceFull = 0;
+
+    for(int ty=0; ty<TILES_Y; ty++){
+        int y0 = ty * TILE_H;
+        uint16_t dirty = 0;
+        for(int tx=0; tx<TILES_X; tx++){
+            uint32_t h = hashTile(back, tx, y0);
+            if(primed && h == tileHash[ty][tx]) continue;
+            tileHash[ty][tx] = h;
+            dirty |= (1u << tx);
+        }
+        if(!dirty) continue;
+
+        int tx = 0;
+        while(tx < TILES_X){
+            if(!(dirty & (1u << tx))){ tx++; continue; }
+            int start = tx;
+            while(tx < TILES_X && (dirty & (1u << tx))) tx++;
+            if(!writing){ halDisplayStart(); writing = true; }
+            bytes += pushSpan(back, start, tx, y0);
+        }
+    }
+    if(writing) halDisplayFinish();
+    primed = true;
+    return bytes;
+}
@@ -0,0 +1,306 @@
+// ==========================================
+// ハードウェア抽象化: 実機（M5Stack Basic/Gray）
+// ==========================================
+#ifdef ARDUINO
+
+#include "hal.h"
+#include "sensors.h"
+#include "input_queue.h"
+
+#include <M5Unified.h>
+#include <Wire.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <LittleFS.h>
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <mutex>
+#include <time.h>
+
+constexpr time_t EPOCH_VALID = 1600000000;     // これより前はNTP未同期とみなす
+
+// ---------- 時計 ----------
+uint32_t halMillis(){
+    return millis();
+}
+
+uint32_t halMicros(){
+    return micros();
+}
+
+uint32_t halEpoch(){
+    time_t t = time(nullptr);
+    return t >= EPOCH_VALID ? (uint32_t)t : 0;
+}
+
+// ---------- 表示 ----------
+void halDisplayStart(){
+    M5.Lcd.startWrite();
+}
+
+void halDisplayPush(int x, int y, int w, int h, const uint16_t* pixels){
+    M5.Lcd.pushImageDMA(x, y, w, h, pixels);
+}
+
+void halDisplayFinish(){
+    M5.Lcd.waitDMA();
+    M5.Lcd.endWrite();
+}
+
+// ---------- 環境センサー（BME280をレジスタで直接） ----------
+constexpr uint32_t I2C_CLOCK = 400000;
+
+// BME280とIMUは同じI2C（G21/G22）。計測タスクと方位計タスクから読むので、1回の読み書きごとにロックする
+static std::mutex busMutex;
+
+constexpr uint8_t BME_CHIP_ID = 0x60;
+constexpr uint8_t REG_CALIB_TP = 0x88;      // 0x88-0x9F
+constexpr uint8_t REG_CALIB_H1 = 0xA1;
+constexpr uint8_t REG_CHIP_ID = 0xD0;
+constexpr uint8_t REG_CALIB_H2 = 0xE1;      // 0xE1-0xE7
+constexpr uint8_t REG_CTRL_HUM = 0xF2;
+constexpr uint8_t REG_STATUS = 0xF3;        // 0xF3-0xFEを1回で読む
+constexpr uint8_t REG_CTRL_MEAS = 0xF4;
+constexpr uint8_t REG_CONFIG = 0xF5;
+
+constexpr uint8_t STATUS_MEASURING = 0x08;
+
+// 室内の気象観測向け: 温度x1 / 気圧x4 / 湿度x1、IIRフィルタx4、強制モード（最大約16ms）
+constexpr uint8_t CTRL_HUM = 0x01;                          // osrs_h = x1
+constexpr uint8_t CTRL_MEAS_FORCED = (0x01 << 5) | (0x03 << 2) | 0x01;  // osrs_t x1, osrs_p x4, forced
+constexpr uint8_t CONFIG = (0x02 << 2);                     // filter x4
+
+constexpr int BURST_LEN = 12;               // status, ctrl_meas, config, 予約, press[3], temp[3], hum[2]
+
+static uint8_t bmeAddress = 0;
+
+static struct {
+    uint16_t T1; int16_t T2, T3;
+    uint16_t P1; int16_t P2, P3, P4, P5, P6, P7, P8, P9;
+    uint8_t H1; int16_t H2; uint8_t H3; int16_t H4, H5; int8_t H6;
+} calib;
+
+static bool writeReg(uint8_t reg, uint8_t value){
+    Wire.beginTransmission(bmeAddress);
+    Wire.write(reg);
+    Wire.write(value);
+    return Wire.endTransmission() == 0;
+}
+
+static bool readRegs(uint8_t reg, uint8_t* buf, uint8_t len){
+    Wire.beginTransmission(bmeAddress);
+    Wire.write(reg);
+    if(Wire.endTransmission(false) != 0) return false;
+    if(Wire.requestFrom(bmeAddress, len) != len) return false;
+    for(uint8_t i=0;i<len;i++) buf[i] = Wire.read();
+    return true;
+}
+
+static uint16_t le16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+
+static bool readCalibration(){
+    uint8_t tp[24];
+    uint8_t h1;
+    uint8_t h[7];
+    if(!readRegs(REG_CALIB_TP, tp, sizeof(tp))) return false;
+    if(!readRegs(REG_CALIB_H1, &h1, 1)) return false;
+    if(!readRegs(REG_CALIB_H2, h, sizeof(h))) return false;
+
+    calib.T1 = le16(tp + 0);  calib.T2 = le16(tp + 2);  calib.T3 = le16(tp + 4);
+    calib.P1 = le16(tp + 6);  calib.P2 = le16(tp + 8);  calib.P3 = le16(tp + 10);
+    calib.P4 = le16(tp + 12); calib.P5 = le16(tp + 14); calib.P6 = le16(tp + 16);
+    calib.P7 = le16(tp + 18); calib.P8 = le16(tp + 20); calib.P9 = le16(tp + 22);
+    calib.H1 = h1;
+    calib.H2 = le16(h + 0);
+    calib.H3 = h[2];
+    calib.H4 = (int16_t)((int8_t)h[3] * 16 | (h[4] & 0x0F));
+    calib.H5 = (int16_t)((int8_t)h[5] * 16 | (h[4] >> 4));
+    calib.H6 = (int8_t)h[6];
+    return true;
+}
+
+// 以下の補正式はデータシートの整数版
+static int32_t compensateTemp(int32_t adc, int32_t &tFine){
+    int32_t var1 = ((((adc >> 3) - ((int32_t)calib.T1 << 1))) * calib.T2) >> 11;
+    int32_t var2 = (((((adc >> 4) - calib.T1) * ((adc >> 4) - calib.T1)) >> 12) * calib.T3) >> 14;
+    tFine = var1 + var2;
+    return (tFine * 5 + 128) >> 8;      // 0.01℃
+}
+
+static uint32_t compensatePressure(int32_t adc, int32_t tFine){
+    int64_t var1 = (int64_t)tFine - 128000;
+    int64_t var2 = var1 * var1 * calib.P6;
+    var2 += (var1 * calib.P5) << 17;
+    var2 += (int64_t)calib.P4 << 35;
+    var1 = ((var1 * var1 * calib.P3) >> 8) + ((var1 * calib.P2) << 12);
+    var1 = ((((int64_t)1) << 47) + var1) * calib.P1 >> 33;
+    if(var1 == 0) return 0;
+    int64_t p = 1048576 - adc;
+    p = (((p << 31) - var2) * 3125) / var1;
+    var1 = ((int64_t)calib.P9 * (p >> 13) * (p >> 13)) >> 25;
+    var2 = ((int64_t)calib.P8 * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + ((int64_t)calib.P7 << 4);
+    return (uint32_t)p;                 // Pa (Q24.8)
+}
+
+static uint32_t compensateHumidity(int32_t adc, int32_t tFine){
+    int32_t v = tFine - 76800;
+    v = (((((adc << 14) - ((int32_t)calib.H4 << 20) - (calib.H5 * v)) + 16384) >> 15)
+         * (((((((v * calib.H6) >> 10) * (((v * calib.H3) >> 11) + 32768)) >> 10) + 2097152)
+             * calib.H2 + 8192) >> 14));
+    v = v - (((((v >> 15) * (v >> 15)) >> 7) * calib.H1) >> 4);
+    v = v < 0 ? 0 : v;
+    v = v > 419430400 ? 419430400 : v;
+    return (uint32_t)(v >> 12);         // %RH (Q22.10)
+}
+
+bool halEnvBegin(){
+    Wire.begin(BME_SDA, BME_SCL);
+    Wire.setClock(I2C_CLOCK);
+
+    const uint8_t possibleAddresses[] = {0x76, 0x77};
+    for(uint8_t addr : possibleAddresses){
+        bmeAddress = addr;
+        uint8_t id = 0;
+        if(readRegs(REG_CHIP_ID, &id, 1) && id == BME_CHIP_ID) break;
+        bmeAddress = 0;
+    }
+    if(!bmeAddress || !readCalibration()) {
+        bmeAddress = 0;
+        return false;
+    }
+
+    // ctrl_humはctrl_measを書いた時に反映される
+    writeReg(REG_CONFIG, CONFIG);
+    writeReg(REG_CTRL_HUM, CTRL_HUM);
+    return halEnvStart();
+}
+
+bool halEnvStart(){
+    std::lock_guard<std::mutex> lock(busMutex);
+    return bmeAddress && writeReg(REG_CTRL_MEAS, CTRL_MEAS_FORCED);
+}
+
+// 前回開始した変換の結果を1回のバーストで読む
+HalEnvStatus halEnvRead(HalEnvReading &out){
+    if(!bmeAddress) return HAL_ENV_ERROR;
+    uint8_t buf[BURST_LEN];
+    {
+        std::lock_guard<std::mutex> lock(busMutex);
+        if(!readRegs(REG_STATUS, buf, sizeof(buf))) return HAL_ENV_ERROR;
+    }
+    if(buf[0] & STATUS_MEASURING) return HAL_ENV_BUSY;
+
+    const uint8_t* d = buf + 4;
+    int32_t adcP = ((uint32_t)d[0] << 12) | ((uint32_t)d[1] << 4) | (d[2] >> 4);
+    int32_t adcT = ((uint32_t)d[3] << 12) | ((uint32_t)d[4] << 4) | (d[5] >> 4);
+    int32_t adcH = ((uint32_t)d[6] << 8) | d[7];
+
+    // 0x80000 / 0x8000 は変換がスキップされた印
+    if(adcT == 0x80000) return HAL_ENV_ERROR;
+    int32_t tFine;
+    out.temp = compensateTemp(adcT, tFine) / 100.0f;
+    out.pressure = NAN;
+    out.hum = NAN;
+    if(adcP != 0x80000){
+        uint32_t p = compensatePressure(adcP, tFine);
+        if(p) out.pressure = p / 25600.0f;
+    }
+    if(adcH != 0x8000) out.hum = compensateHumidity(adcH, tFine) / 1024.0f;
+    return HAL_ENV_OK;
+}
+
+// ---------- 照度ADC ----------
+constexpr adc1_channel_t LIGHT_ADC_CHANNEL = ADC1_CHANNEL_0;   // GPIO36
+constexpr adc_atten_t LIGHT_ATTEN = ADC_ATTEN_DB_11;           // 約0〜3.1V
+constexpr uint32_t ADC_DEFAULT_VREF = 1100;                     // eFuseに校正値が無い個体用
+
+static esp_adc_cal_characteristics_t adcChars;
+
+void halLightBegin(){
+    pinMode(LIGHT_PIN, INPUT);
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    adc1_config_channel_atten(LIGHT_ADC_CHANNEL, LIGHT_ATTEN);
+    // eFuseの校正値（Two Point / Vref）があればそれを使った電圧換算になる
+    esp_adc_cal_characterize(ADC_UNIT_1, LIGHT_ATTEN, ADC_WIDTH_BIT_12, ADC_DEFAULT_VREF, &adcChars);
+}
+
+int halLightRaw(){
+    return adc1_get_raw(LIGHT_ADC_CHANNEL);
+}
+
+uint16_t halLightMillivolts(uint16_t raw){
+    return (uint16_t)esp_adc_cal_raw_to_voltage(raw, &adcChars);
+}
+
+// 待ちはvTaskDelayなので、その間CPUは他のタスクに回る
+void halLightWait(){
+    vTaskDelay(1);
+}
+
+// ---------- IMU ----------
+bool halImuRead(HalImuReading &out){
+    std::lock_guard<std::mutex> lock(busMutex);
+    if(!M5.Imu.update()) return false;
+    auto data = M5.Imu.getImuData();
+    out.accelX = data.accel.x;
+    out.accelY = data.accel.y;
+    out.accelZ = data.accel.z;
+    out.gyroX = data.gyro.x;
+    out.gyroY = data.gyro.y;
+    out.gyroZ = data.gyro.z;
+    out.magX = data.mag.x;
+    out.magY = data.mag.y;
+    out.magZ = data.mag.z;
+    return true;
+}
+
+// ---------- ボタン ----------
+static const uint8_t BUTTON_PINS[NUM_BUTTONS] = {BTN_A_PIN, BTN_B_PIN, BTN_C_PIN};
+
+bool halButtonDown(int button){
+    return digitalRead(BUTTON_PINS[button]) == LOW;
+}
+
+// ---------- HTTP ----------
+// HTTP/1.0で1回ずつ接続する（HTTPClientはHTTP/1.0だと接続を再利用しない）
+// groupエンドポイントで全都市を1回で取るので、接続は取得1回につき1本
+static WiFiClient apiClient;
+static HTTPClient apiHttp;
+
+int halHttpGet(const char* url, HalStream* &body){
+    apiHttp.useHTTP10(true);    // chunked転送を避けてストリームを直接パースする
+    apiHttp.begin(apiClient, url);
+    int code = apiHttp.GET();
+    body = &apiHttp.getStream();
+    return code;
+}
+
+void halHttpEnd(){
+    apiHttp.end();
+}
+
+// ---------- ファイル ----------
+bool halFsBegin(){
+    return LittleFS.begin(true);
+}
+
+HalFile halFsOpen(const char* path, const char* mode){
+    return LittleFS.open(path, mode);
+}
+
+bool halFsExists(const char* path){
+    return LittleFS.exists(path);
+}
+
+bool halFsMkdir(const char* path){
+    return LittleFS.mkdir(path);
+}
+
+bool halFsRemove(const char* path){
+    return LittleFS.remove(path);
+}
+
+#endif
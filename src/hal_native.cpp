@@ -0,0 +1,499 @@
+// ==========================================
+// ハードウェア抽象化: PC（env:native）
+// ==========================================
+#ifndef ARDUINO
+
+#include "hal_native.h"
+#include "frame_diff.h"
+#include "mem_stats.h"
+
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+constexpr float DAY_MS = 86400000.0f;
+constexpr uint32_t ENV_CONVERSION_MS = 10;      // 強制モード1回の変換時間（実機は最大約16ms）
+
+static uint64_t simUs = 0;
+static uint16_t framebuffer[SCREEN_W * SCREEN_H];
+static HalNativeDisplay display;
+static bool buttonDown[3];
+static uint32_t noiseState = 1;
+static uint32_t epochBase = 0;      // halNativeSetEpoch()した時のUNIX時刻
+static uint64_t epochBaseUs = 0;
+static char fsRoot[128] = "native_fs";
+static HalNativeFs fsStats;
+static HalNativeHttp httpStats;
+
+// 再現性のあるノイズ（-1〜1）
+static float noise(){
+    noiseState = noiseState * 1664525u + 1013904223u;
+    return (int32_t)noiseState / 2147483648.0f;
+}
+
+void halNativeAdvance(uint32_t ms){
+    simUs += (uint64_t)ms * 1000;
+}
+
+void halNativeReset(){
+    simUs = 0;
+    noiseState = 1;
+    memset(framebuffer, 0, sizeof(framebuffer));
+    display = HalNativeDisplay();
+    memset(buttonDown, 0, sizeof(buttonDown));
+    epochBase = 0;
+    fsStats = HalNativeFs();
+    httpStats = HalNativeHttp();
+}
+
+const uint16_t* halNativeFramebuffer(){
+    return framebuffer;
+}
+
+const HalNativeDisplay& halNativeDisplay(){
+    return display;
+}
+
+void halNativeSetButton(int button, bool down){
+    buttonDown[button] = down;
+}
+
+void halNativeSetEpoch(uint32_t epoch){
+    epochBase = epoch;
+    epochBaseUs = simUs;
+}
+
+void halNativeFsRoot(const char* dir){
+    snprintf(fsRoot, sizeof(fsRoot), "%s", dir);
+}
+
+const HalNativeFs& halNativeFs(){
+    return fsStats;
+}
+
+const HalNativeHttp& halNativeHttp(){
+    return httpStats;
+}
+
+// ---------- 時計 ----------
+uint32_t halMillis(){
+    return (uint32_t)(simUs / 1000);
+}
+
+uint32_t halEpoch(){
+    return epochBase ? epochBase + (uint32_t)((simUs - epochBaseUs) / 1000000) : 0;
+}
+
+uint32_t halMicros(){
+    return (uint32_t)simUs;
+}
+
+// ---------- 表示 ----------
+void halDisplayStart(){
+    display.frames++;
+}
+
+void halDisplayPush(int x, int y, int w, int h, const uint16_t* pixels){
+    display.pushes++;
+    for(int row=0; row<h; row++){
+        int py = y + row;
+        if(py < 0 || py >= SCREEN_H) continue;
+        for(int col=0; col<w; col++){
+            int px = x + col;
+            if(px < 0 || px >= SCREEN_W) continue;
+            framebuffer[py * SCREEN_W + px] = pixels[row * w + col];
+            display.pixelWrites++;
+        }
+    }
+}
+
+void halDisplayFinish(){}
+
+// ---------- 環境センサー ----------
+static bool envConverting = false;
+static uint32_t envStartMs = 0;
+
+static float dayPhase(){
+    return 2.0f * (float)M_PI * (halMillis() / DAY_MS);
+}
+
+bool halEnvBegin(){
+    return halEnvStart();
+}
+
+bool halEnvStart(){
+    envConverting = true;
+    envStartMs = halMillis();
+    return true;
+}
+
+// 気温は昼過ぎに最高、湿度は逆相、気圧は3日周期でゆっくり上下
+static HalEnvReading simulateEnv(){
+    float day = dayPhase();
+    HalEnvReading r;
+    r.temp = 24.0f + 3.0f * sinf(day - 1.2f) + 0.02f * noise();
+    r.hum = 50.0f - 8.0f * sinf(day - 1.2f) + 0.2f * noise();
+    r.pressure = 1013.0f + 6.0f * sinf(day / 3.0f) + 0.03f * noise();
+    return r;
+}
+
+HalEnvStatus halEnvRead(HalEnvReading &out){
+    if(!envConverting) return HAL_ENV_ERROR;        // 強制モードは変換後に眠る
+    if(halMillis() - envStartMs < ENV_CONVERSION_MS) return HAL_ENV_BUSY;
+    envConverting = false;
+    out = simulateEnv();
+    return HAL_ENV_OK;
+}
+
+// ---------- 照度ADC ----------
+void halLightBegin(){}
+
+// 日中は窓の光（0〜約2000mV相当）、夜は100Hzでちらつく照明
+int halLightRaw(){
+    float day = sinf(dayPhase() - (float)M_PI / 2.0f);     // 正午に1
+    float level;
+    if(day > 0){
+        level = 2400.0f * day;
+    } else {
+        float flicker = sinf(2.0f * (float)M_PI * 100.0f * (simUs / 1e6f));
+        level = 600.0f * (1.0f + 0.1f * flicker);
+    }
+    int raw = (int)(level + 20.0f * noise());
+    return raw < 0 ? 0 : (raw > 4095 ? 4095 : raw);
+}
+
+uint16_t halLightMillivolts(uint16_t raw){
+    return (uint16_t)(raw * 3100u / 4095u);
+}
+
+void halLightWait(){
+    halNativeAdvance(1);
+}
+
+// ---------- IMU ----------
+// 静置（重力のみ）で、1分で1周ゆっくり回す
+bool halImuRead(HalImuReading &out){
+    float heading = 2.0f * (float)M_PI * (halMillis() % 60000) / 60000.0f;
+    out.accelX = 0.01f * noise();
+    out.accelY = 0.01f * noise();
+    out.accelZ = 1.0f + 0.01f * noise();
+    out.gyroX = 0.2f * noise();
+    out.gyroY = 0.2f * noise();
+    out.gyroZ = -6.0f + 0.2f * noise();     // 方位が増える向き（6度/秒）
+    out.magX = 30.0f * cosf(heading) + 0.5f * noise();
+    out.magY = 30.0f * sinf(heading) + 0.5f * noise();
+    out.magZ = -35.0f + 0.5f * noise();
+    return true;
+}
+
+// ---------- ボタン ----------
+bool halButtonDown(int button){
+    return button >= 0 && button < 3 && buttonDown[button];
+}
+
+// ---------- HTTP（HTTP/1.0で1回ずつ接続） ----------
+class SocketStream : public HalStream {
+public:
+    void attach(int f){ fd = f; len = 0; pos = 0; }
+    void close(){
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+    }
+    int available() override { return fill() ? (int)(len - pos) : 0; }
+    int read() override { return fill() ? buf[pos++] : -1; }
+    int peek() override { return fill() ? buf[pos] : -1; }
+
+private:
+    bool fill(){
+        if(pos < len) return true;
+        if(fd < 0) return false;
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n <= 0) return false;
+        len = (size_t)n;
+        pos = 0;
+        return true;
+    }
+
+    int fd = -1;
+    uint8_t buf[512];
+    size_t len = 0;
+    size_t pos = 0;
+};
+
+static SocketStream httpBody;
+
+// 1行読む（\r\nは外す。長い行は切り詰める）。接続が切れたらfalse
+static bool readLine(char* out, size_t size){
+    size_t len = 0;
+    for(;;){
+        int c = httpBody.read();
+        if(c < 0) return false;
+        if(c == '\n') break;
+        if(c != '\r' && len < size - 1) out[len++] = (char)c;
+    }
+    out[len] = '\0';
+    return true;
+}
+
+static int httpConnect(const char* host, const char* port){
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if(getaddrinfo(host, port, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for(addrinfo* a = res; a; a = a->ai_next){
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if(fd < 0) continue;
+        if(connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+        ::close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int halHttpGet(const char* url, HalStream* &body){
+    body = &httpBody;
+    httpBody.close();
+
+    // http://host[:port]/path だけを扱う
+    const char* p = strncmp(url, "http://", 7) == 0 ? url + 7 : nullptr;
+    if(!p) return -1;
+    const char* pathStart = strchr(p, '/');
+    if(!pathStart) pathStart = p + strlen(p);
+    char host[128];
+    char port[8] = "80";
+    size_t hostLen = pathStart - p;
+    if(hostLen >= sizeof(host)) return -1;
+    memcpy(host, p, hostLen);
+    host[hostLen] = '\0';
+    char* colon = strchr(host, ':');
+    if(colon){
+        *colon = '\0';
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+
+    // 接続にかかった実時間（模擬時計ではなくPCの時計）
+    auto t0 = std::chrono::steady_clock::now();
+    int fd = httpConnect(host, port);
+    if(fd < 0) return -1;
+    httpStats.connects++;
+    httpStats.connectNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    char request[512];
+    int n = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\nHost: %s\r\n\r\n",
+                     *pathStart ? pathStart : "/", host);
+    if(n <= 0 || n >= (int)sizeof(request) || send(fd, request, n, 0) != n){
+        ::close(fd);
+        return -1;
+    }
+    httpBody.attach(fd);
+
+    // ステータス行を読み、空行までのヘッダーを読み飛ばして本文の先頭に合わせる
+    char line[64];
+    if(!readLine(line, sizeof(line))) return -1;
+    int code = 0;
+    if(sscanf(line, "HTTP/%*d.%*d %d", &code) != 1) return -1;
+    for(;;){
+        if(!readLine(line, sizeof(line))) return -1;
+        if(line[0] == '\0') break;
+    }
+    return code;
+}
+
+void halHttpEnd(){
+    httpBody.close();
+}
+
+// ---------- ファイル（fsRootの下の普通のファイル） ----------
+struct HalFile::State {
+    FILE* file = nullptr;
+    DIR* dir = nullptr;
+    char path[160];             // 開いたパス（LittleFS側の表記。"/log/m00000000.bin"など）
+    ~State(){
+        if(file) fclose(file);
+        if(dir) closedir(dir);
+    }
+};
+
+static void hostPath(const char* path, char* out, size_t len){
+    snprintf(out, len, "%s%s%s", fsRoot, path[0] == '/' ? "" : "/", path);
+}
+
+const char* HalFile::name() const {
+    if(!state) return "";
+    const char* slash = strrchr(state->path, '/');
+    return slash ? slash + 1 : state->path;
+}
+
+size_t HalFile::size() const {
+    if(!state || !state->file) return 0;
+    fflush(state->file);
+    struct stat st;
+    return fstat(fileno(state->file), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+bool HalFile::seek(uint32_t pos){
+    return state && state->file && fseek(state->file, pos, SEEK_SET) == 0;
+}
+
+size_t HalFile::read(uint8_t* buf, size_t len){
+    if(!state || !state->file) return 0;
+    size_t got = fread(buf, 1, len, state->file);
+    fsStats.bytesRead += got;
+    return got;
+}
+
+size_t HalFile::write(const uint8_t* buf, size_t len){
+    if(!state || !state->file) return 0;
+    size_t put = fwrite(buf, 1, len, state->file);
+    fsStats.writes++;
+    fsStats.bytesWritten += put;
+    return put;
+}
+
+HalFile HalFile::openNextFile(){
+    HalFile next;
+    if(!state || !state->dir) return next;
+    for(struct dirent* e = readdir(state->dir); e; e = readdir(state->dir)){
+        if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+        char path[sizeof(state->path) + sizeof(e->d_name) + 1];
+        snprintf(path, sizeof(path), "%s/%s", state->path, e->d_name);
+        return halFsOpen(path);
+    }
+    return next;
+}
+
+bool halFsBegin(){
+    mkdir(fsRoot, 0755);
+    struct stat st;
+    return stat(fsRoot, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+HalFile halFsOpen(const char* path, const char* mode){
+    HalFile f;
+    char host[256];
+    hostPath(path, host, sizeof(host));
+    auto state = std::make_shared<HalFile::State>();
+    snprintf(state->path, sizeof(state->path), "%s", path);
+
+    struct stat st;
+    if(mode[0] == 'r' && stat(host, &st) == 0 && S_ISDIR(st.st_mode)){
+        state->dir = opendir(host);
+        if(!state->dir) return f;
+    } else {
+        state->file = fopen(host, mode[0] == 'a' ? "ab" : mode[0] == 'w' ? "wb" : "rb");
+        if(!state->file) return f;
+    }
+    fsStats.opens++;
+    f.state = state;
+    return f;
+}
+
+bool halFsExists(const char* path){
+    char host[256];
+    hostPath(path, host, sizeof(host));
+    struct stat st;
+    return stat(host, &st) == 0;
+}
+
+bool halFsMkdir(const char* path){
+    char host[256];
+    hostPath(path, host, sizeof(host));
+    return mkdir(host, 0755) == 0;
+}
+
+bool halFsRemove(const char* path){
+    char host[256];
+    hostPath(path, host, sizeof(host));
+    return unlink(host) == 0;
+}
+
+// ---------- ストリーム（Arduinoのfind/findUntil/readBytes相当） ----------
+size_t HalStream::readBytes(char* buf, size_t len){
+    size_t n = 0;
+    while(n < len){
+        int c = read();
+        if(c < 0) break;
+        buf[n++] = (char)c;
+    }
+    return n;
+}
+
+bool HalStream::find(const char* target){
+    return findUntil(target, nullptr);
+}
+
+bool HalStream::findUntil(const char* target, const char* terminator){
+    size_t targetLen = strlen(target);
+    size_t termLen = terminator ? strlen(terminator) : 0;
+    if(targetLen == 0) return true;
+    size_t ti = 0, mi = 0;
+    for(;;){
+        int c = read();
+        if(c < 0) return false;
+        if(c == target[ti]){
+            if(++ti == targetLen) return true;
+        } else {
+            ti = (c == target[0]) ? 1 : 0;
+        }
+        if(termLen){
+            if(c == terminator[mi]){
+                if(++mi == termLen) return false;
+            } else {
+                mi = (c == terminator[0]) ? 1 : 0;
+            }
+        }
+    }
+}
+
+// ---------- mallocフック（実機のMEM_HOOKSと同じ数え方。PCは1スレッドなのでタグはloop） ----------
+#ifdef MEM_HOOKS
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size){
+    void* p = __real_malloc(size);
+    memCountAlloc(MEM_TAG_LOOP, size, p != nullptr);
+    return p;
+}
+
+void* __wrap_calloc(size_t n, size_t size){
+    void* p = __real_calloc(n, size);
+    memCountAlloc(MEM_TAG_LOOP, n * size, p != nullptr);
+    return p;
+}
+
+void* __wrap_realloc(void* ptr, size_t size){
+    void* p = __real_realloc(ptr, size);
+    if(!ptr){
+        memCountAlloc(MEM_TAG_LOOP, size, p != nullptr);
+    } else if(size == 0){
+        memCountFree(MEM_TAG_LOOP);
+    } else if(!p){
+        memCountAlloc(MEM_TAG_LOOP, size, false);
+    } else if(p != ptr){
+        memCountAlloc(MEM_TAG_LOOP, size, true);
+        memCountFree(MEM_TAG_LOOP);
+    }
+    return p;
+}
+
+void __wrap_free(void* ptr){
+    if(ptr) memCountFree(MEM_TAG_LOOP);
+    __real_free(ptr);
+}
+}
+#endif
+
+#endif
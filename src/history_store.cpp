@@ -0,0 +1,340 @@
+// ==========================================
+// 計測履歴ストア
+// ==========================================
+
+#include "history_store.h"
+
+#include <string.h>
+#include <algorithm>
+
+const char* const HIST_TIER_NAMES[NUM_HIST_TIERS] = {"1 sec", "1 min", "1 hour"};
+
+constexpr uint32_t MINUTE_MS = 60000;
+constexpr int MINUTES_PER_HOUR = 60;
+
+// 1秒段は生値だけを圧縮して持つ（平均=最小=最大なので3倍にしない）
+struct SecBlock {
+    uint8_t data[SERIES_BLOCK_BYTES];
+};
+
+template<typename T, int N>
+struct HistRing {
+    T buf[N];
+    int head = 0;           // 次に書く位置
+    int size = 0;
+    uint32_t appended = 0;
+
+    void clear(){ head = 0; size = 0; appended = 0; }
+    void push(const T &v){
+        buf[head] = v;
+        head = (head + 1) % N;
+        if(size < N) size++;
+        appended++;
+    }
+    const T& at(int back) const { return buf[(head + N - 1 - back) % N]; }
+    // 新しい方からback件をn個先へずらし、空いた所をvで埋める
+    int insert(int back, int n, const T &v){
+        if(back < 0 || back > size || n <= 0) return 0;
+        n = std::min(n, N - back);
+        for(int i=0;i<back;i++){
+            int from = (head + N - 1 - i) % N;
+            buf[(from + n) % N] = buf[from];
+        }
+        for(int i=0;i<n;i++) buf[(head + N - back + i) % N] = v;
+        head = (head + n) % N;
+        size = std::min(size + n, N);
+        appended += n;
+        return n;
+    }
+};
+
+// 下の段の点を集めて上の段の1点を作る
+struct HistAccum {
+    int32_t sum[NUM_HIST_CHANNELS];
+    uint16_t count[NUM_HIST_CHANNELS];
+    int16_t min[NUM_HIST_CHANNELS];
+    int16_t max[NUM_HIST_CHANNELS];
+
+    void clear(){
+        for(int c=0;c<NUM_HIST_CHANNELS;c++){
+            sum[c] = 0;
+            count[c] = 0;
+            min[c] = INT16_MAX;
+            max[c] = INT16_MIN;
+        }
+    }
+    void add(int c, const HistPoint &p){
+        if(p.mean == HIST_MISSING) return;
+        sum[c] += p.mean;
+        count[c]++;
+        if(p.min < min[c]) min[c] = p.min;
+        if(p.max > max[c]) max[c] = p.max;
+    }
+    HistBucket bucket() const {
+        HistBucket b;
+        for(int c=0;c<NUM_HIST_CHANNELS;c++){
+            if(count[c] == 0){
+                b.ch[c] = { HIST_MISSING, HIST_MISSING, HIST_MISSING };
+                continue;
+            }
+            int32_t mean = sum[c] >= 0 ? (sum[c] + count[c]/2) / count[c]
+                                       : (sum[c] - count[c]/2) / count[c];
+            b.ch[c] = { (int16_t)mean, min[c], max[c] };
+        }
+        return b;
+    }
+};
+
+static HistRing<SecBlock, HIST_SEC_BLOCKS> secBlocks;     // 閉じたブロック
+static SecBlock openBlock;                                  // 追記中のブロック
+static SeriesEncoder secEncoder;
+static uint32_t secAppended = 0;
+static int secStored = 0;       // 閉じたブロック内のサンプル数
+static HistRing<HistBucket, HIST_MIN_SLOTS> minRing;
+static HistRing<HistBucket, HIST_HOUR_SLOTS> hourRing;
+static HistAccum minuteAcc;
+static HistAccum hourAcc;
+static uint32_t minuteStart = 0;
+static int minutesInHour = 0;
+static bool started = false;
+// 1秒段の時刻は起動からの64bitのmsで数える（millis()/1000のままだと49.7日で0に戻る）
+static uint64_t clockMs = 0;
+static uint32_t clockLast = 0;
+static bool gapPending = false;
+
+int16_t histEncode(HistChannel ch, float v){
+    if(isnan(v)) return HIST_MISSING;
+    float scaled = (ch == HIST_LUX) ? v : (ch == HIST_PRESS) ? v * 10.0f : v * 100.0f;
+    if(scaled > INT16_MAX) return INT16_MAX;
+    if(scaled < -INT16_MAX) return -INT16_MAX;     // INT16_MINは欠測用
+    return (int16_t)lroundf(scaled);
+}
+
+float histDecode(HistChannel ch, int16_t raw){
+    if(raw == HIST_MISSING) return NAN;
+    return (ch == HIST_LUX) ? (float)raw : (ch == HIST_PRESS) ? raw / 10.0f : raw / 100.0f;
+}
+
+static void beginSecBlock(){
+    secEncoder.begin(openBlock.data, SERIES_BLOCK_BYTES, NUM_HIST_CHANNELS);
+}
+
+static void pushSecBlock(const SecBlock &b){
+    if(secBlocks.size == HIST_SEC_BLOCKS) secStored -= seriesBlockCount(secBlocks.at(HIST_SEC_BLOCKS - 1).data);
+    secBlocks.push(b);
+    secStored += seriesBlockCount(b.data);
+}
+
+void historyReset(){
+    secBlocks.clear();
+    beginSecBlock();
+    secAppended = 0;
+    secStored = 0;
+    minRing.clear();
+    hourRing.clear();
+    minuteAcc.clear();
+    hourAcc.clear();
+    minutesInHour = 0;
+    started = false;
+    gapPending = false;
+}
+
+static void closeMinute(){
+    HistBucket b = minuteAcc.bucket();
+    minRing.push(b);
+    for(int c=0;c<NUM_HIST_CHANNELS;c++) hourAcc.add(c, b.ch[c]);
+    minuteAcc.clear();
+
+    if(++minutesInHour == MINUTES_PER_HOUR){
+        hourRing.push(hourAcc.bucket());
+        hourAcc.clear();
+        minutesInHour = 0;
+    }
+}
+
+static void appendSecond(uint32_t t, const int16_t* v){
+    if(!secEncoder.add(t, v)){
+        pushSecBlock(openBlock);
+        beginSecBlock();
+        secEncoder.add(t, v);
+    }
+    secAppended++;
+}
+
+void historyAppend(float temp, float hum, int lux, float pressure, uint32_t now){
+    if(!started){
+        if(secEncoder.count() == 0) beginSecBlock();
+        minuteAcc.clear();
+        hourAcc.clear();
+        minuteStart = now;
+        clockMs = now;
+        clockLast = now;
+        started = true;
+    }
+    // 前の時刻が来ても戻さない（差を符号付きで見るのでmillis()の一周は進める）
+    int32_t dt = (int32_t)(now - clockLast);
+    if(dt > 0){
+        clockMs += dt;
+        clockLast = now;
+    }
+
+    // 空白があった分は空の点で埋める（1分段が一周したら打ち切って揃え直す）
+    int steps = 0;
+    while((int32_t)(now - minuteStart) >= (int32_t)MINUTE_MS && steps < HIST_MIN_SLOTS){
+        closeMinute();
+        minuteStart += MINUTE_MS;
+        steps++;
+    }
+    if((int32_t)(now - minuteStart) >= (int32_t)MINUTE_MS) minuteStart = now;
+
+    int16_t v[NUM_HIST_CHANNELS];
+    v[HIST_TEMP] = histEncode(HIST_TEMP, temp);
+    v[HIST_HUM] = histEncode(HIST_HUM, hum);
+    v[HIST_LUX] = histEncode(HIST_LUX, (float)lux);
+    v[HIST_PRESS] = histEncode(HIST_PRESS, pressure);
+    uint32_t t = historyClockSec();
+    if(gapPending){
+        const int16_t missing[NUM_HIST_CHANNELS] = { HIST_MISSING, HIST_MISSING, HIST_MISSING, HIST_MISSING };
+        appendSecond(t, missing);
+        gapPending = false;
+    }
+    appendSecond(t, v);
+    for(int c=0;c<NUM_HIST_CHANNELS;c++) minuteAcc.add(c, { v[c], v[c], v[c] });
+}
+
+void historyMarkGap(){
+    gapPending = true;
+}
+
+void historyRestore(HistTier tier, const HistBucket &b){
+    if(tier == TIER_1MIN) minRing.push(b);
+    else if(tier == TIER_1HOUR) hourRing.push(b);
+}
+
+int historyInsertGap(HistTier tier, int back, int n){
+    HistBucket missing;
+    for(int c=0;c<NUM_HIST_CHANNELS;c++) missing.ch[c] = { HIST_MISSING, HIST_MISSING, HIST_MISSING };
+    if(tier == TIER_1MIN) return minRing.insert(back, n, missing);
+    if(tier == TIER_1HOUR) return hourRing.insert(back, n, missing);
+    return 0;
+}
+
+uint32_t historyClockSec(){
+    return (uint32_t)(clockMs / 1000);
+}
+
+uint32_t historySecBlocksClosed(){
+    return secBlocks.appended;
+}
+
+const uint8_t* historySecBlock(int back){
+    if(back < 0 || back >= secBlocks.size) return nullptr;
+    return secBlocks.at(back).data;
+}
+
+void historyRestoreSecBlock(const uint8_t* block, int32_t shiftSec){
+    SeriesDecoder dec;
+    if(!dec.begin(block) || dec.channelCount() != NUM_HIST_CHANNELS) return;
+    SecBlock b;
+    memcpy(b.data, block, seriesBlockLength(block));
+    if(shiftSec) seriesBlockSetStart(b.data, seriesBlockStart(b.data) + shiftSec);
+    pushSecBlock(b);
+}
+
+uint32_t historyPeriodMs(HistTier tier){
+    switch(tier){
+        case TIER_1SEC:  return 1000;
+        case TIER_1MIN:  return MINUTE_MS;
+        case TIER_1HOUR: return MINUTE_MS * MINUTES_PER_HOUR;
+        default:         return 0;
+    }
+}
+
+int historySize(HistTier tier){
+    switch(tier){
+        case TIER_1SEC:  return secStored + secEncoder.count();
+        case TIER_1MIN:  return minRing.size;
+        case TIER_1HOUR: return hourRing.size;
+        default:         return 0;
+    }
+}
+
+uint32_t historyAppendCount(HistTier tier){
+    switch(tier){
+        case TIER_1SEC:  return secAppended;
+        case TIER_1MIN:  return minRing.appended;
+        case TIER_1HOUR: return hourRing.appended;
+        default:         return 0;
+    }
+}
+
+// 1秒段の [back+n-1 .. back] を古い順にfnへ。範囲にかからないブロックは復号しない
+// 渡せた件数を返す（壊れたブロックがあればそこで止まる）
+template<typename Fn>
+static int scanSeconds(int back, int n, Fn fn){
+    int total = historySize(TIER_1SEC);
+    int last = total - 1 - back;
+    int first = std::max(last - n + 1, 0);
+    if(last < 0 || first > last) return 0;
+
+    int visited = 0;
+    int base = 0;
+    for(int k=secBlocks.size;k>=0;k--){
+        const uint8_t* block = k > 0 ? secBlocks.at(k - 1).data : openBlock.data;
+        int count = seriesBlockCount(block);
+        if(base + count <= first){
+            base += count;
+            continue;
+        }
+        if(base > last) return visited;
+
+        SeriesDecoder dec;
+        if(!dec.begin(block)) return visited;
+        uint32_t t;
+        int16_t v[NUM_HIST_CHANNELS];
+        for(int i=base;dec.next(t, v) && i<=last;i++){
+            if(i < first) continue;
+            HistBucket b;
+            for(int c=0;c<NUM_HIST_CHANNELS;c++) b.ch[c] = { v[c], v[c], v[c] };
+            fn(b);
+            visited++;
+        }
+        base += count;
+    }
+    return visited;
+}
+
+// 任意の段の [back+n-1 .. back] を古い順にfnへ。実際に渡した件数を返す
+template<typename Fn>
+static int scanTier(HistTier tier, int back, int n, Fn fn){
+    int available = historySize(tier) - back;
+    if(back < 0 || available <= 0 || n <= 0) return 0;
+    if(n > available) n = available;
+
+    if(tier == TIER_1SEC) return scanSeconds(back, n, fn);
+    for(int i=n-1;i>=0;i--) fn(tier == TIER_1MIN ? minRing.at(back + i) : hourRing.at(back + i));
+    return n;
+}
+
+bool historyGet(HistTier tier, int back, HistBucket &out){
+    return scanTier(tier, back, 1, [&](const HistBucket &b){ out = b; }) == 1;
+}
+
+int historyReadBuckets(HistTier tier, int back, int n, HistBucket* out){
+    int i = 0;
+    return scanTier(tier, back, n, [&](const HistBucket &b){ out[i++] = b; });
+}
+
+int historyRead(HistTier tier, HistChannel ch, int back, int n, HistPoint* out){
+    int i = 0;
+    return scanTier(tier, back, n, [&](const HistBucket &b){ out[i++] = b.ch[ch]; });
+}
+
+bool historySummary(HistTier tier, HistChannel ch, int back, int n, HistPoint &out){
+    HistAccum acc;
+    acc.clear();
+    scanTier(tier, back, n, [&](const HistBucket &b){ acc.add(ch, b.ch[ch]); });
+    if(acc.count[ch] == 0) return false;
+    out = acc.bucket().ch[ch];
+    return true;
+}
@@ -0,0 +1,152 @@
+// ==========================================
+// ボタン入力キュー
+// ==========================================
+
+#include "input_queue.h"
+#include "spsc_ring.h"
+#include "hal.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+constexpr uint32_t INPUT_QUEUE_LEN = 32;
+
+const uint32_t LATENCY_BIN_US[LATENCY_BINS] = {5000, 10000, 20000, 50000, 100000, UINT32_MAX};
+
+static const uint8_t BUTTON_PINS[NUM_BUTTONS] = {BTN_A_PIN, BTN_B_PIN, BTN_C_PIN};
+
+struct ButtonState {
+    bool pressed = false;       // 採用済みの状態
+    uint32_t changedUs = 0;     // 採用した時刻
+    // 以下は取り出し側だけが使う
+    bool held = false;
+    bool longSent = false;
+    uint32_t nextRepeatUs = 0;
+};
+
+static ButtonState buttons[NUM_BUTTONS];
+// 積むのは割り込みと、割り込みを止めた取り出し側の読み直しだけなので単一生産者として扱える
+static SpscRing<InputEvent, INPUT_QUEUE_LEN> queue;
+static portMUX_TYPE inputMux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t notifyTask = nullptr;
+static volatile uint32_t lastEdgeMs = 0;
+static InputStats stats;
+
+// 状態を変えてイベントを積む（inputMuxを取った状態で呼ぶ）
+// queue.push()はここへ展開されるので、割り込みの経路はすべてIRAMに載る
+static bool IRAM_ATTR acceptEdge(int b, bool pressed, uint32_t now){
+    ButtonState &s = buttons[b];
+    if(pressed == s.pressed) return false;
+    s.pressed = pressed;
+    s.changedUs = now;
+    InputEvent ev = { (InputButton)b, pressed ? INPUT_PRESS : INPUT_RELEASE, now };
+    if(!queue.push(ev)) stats.dropped++;
+    return true;
+}
+
+// GPIO39はADC1を使っている間に短いLOWを拾うことがある（ESP32のエラッタ）
+// レベルを読み直すので、戻った後なら状態は変わらず捨てられる
+static void IRAM_ATTR onEdge(int b){
+    uint32_t now = micros();
+    bool pressed = digitalRead(BUTTON_PINS[b]) == LOW;
+    lastEdgeMs = millis();
+
+    portENTER_CRITICAL_ISR(&inputMux);
+    bool accepted = false;
+    if(now - buttons[b].changedUs < BTN_DEBOUNCE_MS * 1000){
+        if(pressed != buttons[b].pressed) stats.bounces++;
+    } else {
+        accepted = acceptEdge(b, pressed, now);
+    }
+    portEXIT_CRITICAL_ISR(&inputMux);
+
+    if(accepted && notifyTask){
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(notifyTask, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+static void IRAM_ATTR onEdgeA(){ onEdge(BUTTON_A); }
+static void IRAM_ATTR onEdgeB(){ onEdge(BUTTON_B); }
+static void IRAM_ATTR onEdgeC(){ onEdge(BUTTON_C); }
+
+void inputBegin(){
+    notifyTask = xTaskGetCurrentTaskHandle();
+    void (*const handlers[NUM_BUTTONS])() = { onEdgeA, onEdgeB, onEdgeC };
+    for(int b=0;b<NUM_BUTTONS;b++){
+        pinMode(BUTTON_PINS[b], INPUT);     // 外付けプルアップ（37-39は入力専用）
+        buttons[b].pressed = halButtonDown(b);
+        attachInterrupt(digitalPinToInterrupt(BUTTON_PINS[b]), handlers[b], CHANGE);
+    }
+}
+
+// 無視していた間に状態が戻った/ライトスリープ中に押された、をピンの読み直しで拾う
+static void resync(uint32_t now){
+    for(int b=0;b<NUM_BUTTONS;b++){
+        bool pressed = halButtonDown(b);
+        portENTER_CRITICAL(&inputMux);
+        if(now - buttons[b].changedUs >= BTN_DEBOUNCE_MS * 1000) acceptEdge(b, pressed, now);
+        portEXIT_CRITICAL(&inputMux);
+    }
+}
+
+// 押し続けているボタンの長押し・リピート
+static bool holdEvent(uint32_t now, InputEvent &out){
+    for(int b=0;b<NUM_BUTTONS;b++){
+        ButtonState &s = buttons[b];
+        if(!s.held) continue;
+        if(!s.longSent && now - s.changedUs >= BTN_LONG_MS * 1000){
+            s.longSent = true;
+            s.nextRepeatUs = now + BTN_REPEAT_MS * 1000;
+            out = { (InputButton)b, INPUT_LONG, now };
+            return true;
+        }
+        if(s.longSent && (int32_t)(now - s.nextRepeatUs) >= 0){
+            s.nextRepeatUs += BTN_REPEAT_MS * 1000;
+            out = { (InputButton)b, INPUT_REPEAT, now };
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pollInputEvent(InputEvent &out){
+    uint32_t now = micros();
+    resync(now);
+    if(queue.pop(out)){
+        ButtonState &s = buttons[out.button];
+        s.held = (out.type == INPUT_PRESS);
+        s.longSent = false;
+        stats.events++;
+        return true;
+    }
+    if(holdEvent(now, out)){
+        stats.events++;
+        return true;
+    }
+    return false;
+}
+
+bool inputActive(){
+    for(int b=0;b<NUM_BUTTONS;b++){
+        if(buttons[b].pressed || halButtonDown(b)) return true;
+    }
+    return millis() - lastEdgeMs < INPUT_ACTIVE_MS;
+}
+
+void inputRecordLatency(uint32_t inputUs){
+    uint32_t latency = micros() - inputUs;
+    stats.lastLatencyUs = latency;
+    if(latency > stats.maxLatencyUs) stats.maxLatencyUs = latency;
+    int bin = 0;
+    while(latency >= LATENCY_BIN_US[bin] && bin < LATENCY_BINS - 1) bin++;
+    stats.latency[bin]++;
+#ifdef INPUT_STATS_LOG
+    Serial.printf("input->photon: %lu us\n", (unsigned long)latency);
+#endif
+}
+
+const InputStats& inputStats(){
+    return stats;
+}
@@ -0,0 +1,51 @@
+// ==========================================
+// 照度センサーの信号処理
+// ==========================================
+
+#include "light_sensor.h"
+
+// 負荷抵抗10kΩ・ADC減衰11dBでの典型特性（約3.3mV/lx、3V付近から飽和）
+// 個体差が大きいので、照度計と並べて測った値に置き換えて使う
+static const LightCalPoint LIGHT_CAL[] = {
+    {0, 0}, {33, 10}, {165, 50}, {330, 100}, {990, 300}, {1650, 500},
+    {2310, 700}, {2640, 850}, {2900, 1100}, {3050, 1500}, {3150, 2000}
+};
+constexpr int LIGHT_CAL_POINTS = sizeof(LIGHT_CAL) / sizeof(LIGHT_CAL[0]);
+
+uint16_t lightTrimmedMean(uint16_t *samples, int n, int trim){
+    if(n <= 0) return 0;
+    // 20個程度なので挿入ソートで十分
+    for(int i=1;i<n;i++){
+        uint16_t v = samples[i];
+        int j = i;
+        while(j > 0 && samples[j - 1] > v){
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = v;
+    }
+    if(trim < 0) trim = 0;
+    if(n - 2 * trim <= 0) return samples[n / 2];
+
+    uint32_t sum = 0;
+    int kept = n - 2 * trim;
+    for(int i=trim;i<n-trim;i++) sum += samples[i];
+    return (uint16_t)((sum + kept / 2) / kept);
+}
+
+int lightMillivoltsToLux(uint32_t mv){
+    if(mv <= LIGHT_CAL[0].mv) return LIGHT_CAL[0].lux;
+    for(int i=1;i<LIGHT_CAL_POINTS;i++){
+        const LightCalPoint &a = LIGHT_CAL[i - 1];
+        const LightCalPoint &b = LIGHT_CAL[i];
+        if(mv > b.mv) continue;
+        uint32_t span = b.mv - a.mv;
+        return a.lux + (int)(((mv - a.mv) * (uint32_t)(b.lux - a.lux) + span / 2) / span);
+    }
+    return LIGHT_CAL[LIGHT_CAL_POINTS - 1].lux;
+}
+
+bool lightLedState(bool on, int lux, int onBelow, int offAbove){
+    if(on) return lux <= offAbove;
+    return lux < onBelow;
+}
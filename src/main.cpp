@@ -6,13 +6,26 @@
 // ==========================================
 
 #include <M5Unified.h>
-#include <Wire.h>
-#include <Adafruit_BME280.h>
-#include <WiFi.h>
-#include <HTTPClient.h>
-#include <ArduinoJson.h>
 #include <time.h>
 #include <math.h>
+#include "weather.h"
+#include "wifi_manager.h"
+#include "render.h"
+#include "widgets.h"
+#include "rolling_stats.h"
+#include "history_store.h"
+#include "sensor_log.h"
+#include "sensors.h"
+#include "compass_task.h"
+#include "light_sensor.h"
+#include "adaptive_sampler.h"
+#include "forecast.h"
+#include "scheduler.h"
+#include "power.h"
+#include "input_queue.h"
+#include "boot_state.h"
+#include "mem_telemetry.h"
+#include "trace_store.h"
 
 const char* WIFI_SSID = "jikei-class-air";
 const char* WIFI_PASS = "2tXDsAx4";
@@ -21,71 +34,52 @@ const char* NTP_SERVER = "ntp.nict.jp";
 const long GMT_OFFSET_SEC = 9*3600;
 const int DAYLIGHT_OFFSET_SEC = 0;
 
-struct CityInfo {
-    String name;
-    String id;
-};
-CityInfo cities[] = {
-    {"Osaka",   "1853909"},
-    {"Tokyo",   "1850147"},
-    {"Nagoya",  "1856057"},
-    {"Sapporo", "2128295"},
-    {"Fukuoka", "1863967"},
-    {"Naha",    "1894616"}
-};
-const int NUM_CITIES = 6;
 int cityIndex = 0;
 
-struct WeatherCache {
-    bool valid = false;
-    String cityName;
-    String description;
-    String symbol;
-    float temp = 0.0f;
-    unsigned long lastFetch = 0;
-};
-WeatherCache weatherCache[6];
-
-#define BME_SDA 22
-#define BME_SCL 21
-Adafruit_BME280 bme;
-#define LIGHT_PIN 36
-constexpr int LIGHT_THRESHOLD = 100;
+// 照度[lx]。この間は前の状態を保つ（閾値付近でLEDがばたつかない）
+constexpr int LIGHT_ON_LUX = 20;
+constexpr int LIGHT_OFF_LUX = 40;
 constexpr int LUX_MAX = 2000;
 constexpr int ledPin = 25;
 
-constexpr int MAX_DATA_POINTS = 60;
-float tempData[MAX_DATA_POINTS];
-float humData[MAX_DATA_POINTS];
-float luxData[MAX_DATA_POINTS];
-int dataIndex = 0;
-
-#define NORMAL_BG M5.Lcd.color565(210,180,140)
-#define BLACK   M5.Lcd.color565(0,0,0)
-#define WHITE   M5.Lcd.color565(255,255,255)
-#define RED     M5.Lcd.color565(255,0,0)
-#define BLUE    M5.Lcd.color565(0,0,255)
-#define GREEN   M5.Lcd.color565(0,255,0)
-#define ORANGE  M5.Lcd.color565(255,165,0)
-#define PURPLE  M5.Lcd.color565(128,0,128)
-#define YELLOW  M5.Lcd.color565(255,255,0)
-#define GRAY    M5.Lcd.color565(100,100,100)
-#define CYAN    M5.Lcd.color565(0,255,255)
+constexpr int MAX_DATA_POINTS = 60;     // グラフ1画面の点数
+HistTier graphTier = TIER_1SEC;
+
+// 統計画面（1分/1時間/24時間）・アイドル顔はこちらを参照（バッファの再走査をしない）
+RollingStats tempStats;
+RollingStats humStats;
+RollingStats luxStats;
+// 統計画面のページ。ローリング統計の窓の後ろに、履歴ストアの1時間段から集計する7日を置く
+constexpr int STATS_PAGE_7DAY = NUM_STATS_WINDOWS;
+constexpr int NUM_STATS_PAGES = NUM_STATS_WINDOWS + 1;
+int statsPage = STATS_1MIN;
+uint32_t statsClock = 0;        // 最後に足したサンプルの時刻。統計はこの時計だけで進める
+
+// 直近の計測値（画面の更新関数から参照）
+float currentTemp = 20.0f;
+float currentHum = 50.0f;
+float currentPressure = NAN;
+int currentLux = 0;
+bool ledOn = false;
 
 int screenMode = -1;
 int menuCursor = 0;
 const int NUM_MENU_ITEMS = 6;
-String menuItems[] = {"Sensor View", "Graph", "Statistics", "Weather", "Compass", "Calendar"};
+const char* menuItems[] = {"Sensor View", "Graph", "Statistics", "Weather", "Compass", "Calendar"};
 
-unsigned long lastUpdate = 0;
-constexpr unsigned long UPDATE_INTERVAL = 1000;
-unsigned long lastWeatherUpdate = 0;
 constexpr unsigned long UPDATE_WEATHER_INTERVAL = 1800000;
-unsigned long lastInteraction = 0;
+// 局所の気圧・気温・湿度が落ち着いている間は更新間隔を倍々に延ばす（最長2時間）
+// 気圧が急に下がり始めたらFORECAST_EARLY_GAP_MS以上空いていれば前倒しで取りに行く
+constexpr unsigned long WEATHER_MAX_INTERVAL = 4 * UPDATE_WEATHER_INTERVAL;
+constexpr unsigned long FORECAST_CHECK_MS = 60000;
+constexpr unsigned long FORECAST_EARLY_GAP_MS = 900000;
+AdaptiveSampler weatherInterval(UPDATE_WEATHER_INTERVAL, WEATHER_MAX_INTERVAL);
+Forecast localForecast;                 // forecastJobで1分ごとに更新
+uint32_t lastWeatherRefresh = 0;
 
-unsigned long lastIdleUpdate = 0;
 constexpr unsigned long IDLE_TIMEOUT = 5000;
 constexpr unsigned long IDLE_TIMEOUT_COMPASS = 30000;
+constexpr unsigned long IDLE_FRAME_MS = 120;
 bool idleModeActive = false;
 bool eyesOpen = true;
 unsigned long lastBlinkTime = 0;
@@ -95,400 +89,602 @@ bool isSurprised = false;
 unsigned long surpriseStartTime = 0;
 const int SURPRISE_DURATION = 1500;
 
-unsigned long msgStartMillis = 0;
-unsigned long msgDuration = 1200;
 int msgX=200, msgY=10, msgW=120, msgH=20;
 bool msgActive = false;
-
-int lastDisplayedCityIndex = -1;
-String lastDisplayedSymbol = "";
-String lastDisplayedDescription = "";
-float lastDisplayedTemp = NAN;
+char msgText[16];
+
+// 時間で動く処理はすべてスケジューラの仕事にする（loop()はその間眠る）
+#ifdef LIGHT_SLEEP
+SchedId sampleJob = SCHED_NONE;       // 計測タスクを起こす（SENSOR_PERIOD_MSごと）
+#endif
+SchedId weatherJob = SCHED_NONE;      // 天気の定期更新
+SchedId messageJob = SCHED_NONE;      // 一時メッセージを消す
+SchedId idleJob = SCHED_NONE;         // 無操作タイムアウト → 顔表示
+SchedId idleFrameJob = SCHED_NONE;    // 顔アニメのコマ送り
+SchedId readingsJob = SCHED_NONE;     // 計測値をNVSへ（次の起動の最初の画面用）
+SchedId memJob = SCHED_NONE;          // ヒープ・スタックの記録
+SchedId logJob = SCHED_NONE;          // 計測ログのまとめ書き待ちを出す（電源断で失う分を抑える）
+SchedId traceJob = SCHED_NONE;        // 記録中のトレースを書き出す
+SchedId forecastJob = SCHED_NONE;     // 局所の傾向・予報の更新と前倒し取得の判定
+SchedId compassJob = SCHED_NONE;      // 方位計の画面を開いている間のコマ送り（COMPASS_FRAME_MS）
+constexpr uint32_t LINK_POLL_MS = 50; // WiFi・天気取得が動いている間のポーリング間隔
+
+// 入力→表示の遅れの計測用（このループで処理した最初の入力の時刻）
+bool inputPending = false;
+uint32_t inputPendingUs = 0;
+
+// 顔の機嫌は瞬間値ではなく直近1分の平均で決める（計測ごとに更新）
+float moodTemp = 20.0f;
+float moodHum = 50.0f;
+int moodLux = 0;
+
+// トレース再生（'p'）。記録した入力を記録の順に、TRACE_REPLAY_SPEED倍の速さでloop()へ流す
+// 再生中は計測・天気の通信・保存を止め、終わったら結果をシリアルへ出して再起動する
+#ifndef TRACE_REPLAY_SPEED
+#define TRACE_REPLAY_SPEED 20       // 描画が追いつく程度。1なら記録と同じ間隔
+#endif
+
+struct ReplayState {
+    bool active = false;
+    bool ended = false;
+    bool havePending = false;
+    TraceRecord pending;            // 次に流すレコード（期限待ち）
+    uint32_t startMs = 0;           // 再生を始めたmillis()
+    uint32_t traceStartMs = 0;      // 記録を始めたmillis()
+    uint32_t lastTraceMs = 0;
+    uint32_t samples = 0;
+    uint32_t inputs = 0;
+    uint32_t responses = 0;
+    uint32_t fetches[4] = {};       // WeatherFetchStatusごと
+    uint32_t framesBefore = 0;
+    uint32_t bytesBefore = 0;
+    uint32_t allocsBefore = 0;
+};
+ReplayState replay;
+TraceReader replayReader;
 
 void drawTimeDate(int x, int y){
     struct tm timeInfo;
-    if(!getLocalTime(&timeInfo)) return;
+    if(!getLocalTime(&timeInfo, 0)) return;
     
-    M5.Lcd.setTextSize(1);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    M5.Lcd.setCursor(x, y);
-    M5.Lcd.printf("%02d/%02d", timeInfo.tm_mon+1, timeInfo.tm_mday);
-    M5.Lcd.setCursor(x, y+10);
-    M5.Lcd.printf("%02d:%02d", timeInfo.tm_hour, timeInfo.tm_min);
+    canvas.setTextSize(1);
+    canvas.setTextColor(BLACK, NORMAL_BG);
+    canvas.setCursor(x, y);
+    canvas.printf("%02d/%02d", timeInfo.tm_mon+1, timeInfo.tm_mday);
+    canvas.setCursor(x, y+10);
+    canvas.printf("%02d:%02d", timeInfo.tm_hour, timeInfo.tm_min);
 }
 
 void drawBatteryIcon(int x, int y){
     int batLevel = M5.Power.getBatteryLevel();
     bool isCharging = M5.Power.isCharging();
     
-    M5.Lcd.drawRect(x, y, 20, 10, BLACK);
-    M5.Lcd.fillRect(x+20, y+3, 2, 4, BLACK);
+    canvas.drawRect(x, y, 20, 10, BLACK);
+    canvas.fillRect(x+20, y+3, 2, 4, BLACK);
     int fillWidth = (batLevel * 18) / 100;
     uint16_t color = (batLevel > 50) ? GREEN : (batLevel > 20) ? ORANGE : RED;
-    M5.Lcd.fillRect(x+1, y+1, fillWidth, 8, color);
+    canvas.fillRect(x+1, y+1, fillWidth, 8, color);
     
-    M5.Lcd.setTextSize(1);
-    M5.Lcd.setCursor(x+25, y+2);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
+    canvas.setTextSize(1);
+    canvas.setCursor(x+25, y+2);
+    canvas.setTextColor(BLACK, NORMAL_BG);
     if(isCharging){
-        M5.Lcd.printf("%d%%+", batLevel);
+        canvas.printf("%d%%+", batLevel);
     } else {
-        M5.Lcd.printf("%d%%", batLevel);
+        canvas.printf("%d%%", batLevel);
     }
 }
 
-void drawHomeScreen();
-void drawNormalScreen();
-void drawGraphScreen();
-void drawStatsScreen();
-void drawCompassScreen();
-void drawCalendarScreen();
-void drawWeatherScreenOptimized(int cityIdx, bool force);
-void drawWeatherFullFromCache(int cityIdx);
-void drawIdleFaceAnimated(float temp,float hum,int lux,float tempWeather,String weatherSymbol);
+const Screen& currentScreen();
+void redrawCurrentScreen();
+void drawIdleFaceAnimated(float temp,float hum,int lux,float tempWeather,WeatherSymbol weatherSymbol);
 bool initBME280();
-void checkIdleFace(float temp,float hum,int lux,float tempWeather,String weatherSymbol);
-String getWeatherSymbol(String description);
-void requestWeatherFetchNow(int cityIdx);
 void scheduleWeatherFetchForCity(int cityIdx);
-void connectWiFi();
-void showTempMessage(const String &text, int duration=1200);
-void checkTempMessage();
+void handleWeatherFetchResults();
+void handleWiFiLinkChange();
+void showTempMessage(const char* text, int duration=1200);
+void drawTempMessage();
+void expireTempMessage();
 void resetStats();
 
-void showTempMessage(const String &text, int duration){
-    M5.Lcd.fillRect(msgX, msgY, msgW, msgH, NORMAL_BG);
-    M5.Lcd.setCursor(msgX+2, msgY+2);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    M5.Lcd.setTextSize(2);
-    M5.Lcd.print(text);
-    msgStartMillis = millis();
-    msgDuration = duration;
+void drawTempMessage(){
+    canvas.fillRect(msgX, msgY, msgW, msgH, NORMAL_BG);
+    canvas.setCursor(msgX+2, msgY+2);
+    canvas.setTextColor(BLACK, NORMAL_BG);
+    canvas.setTextSize(2);
+    canvas.print(msgText);
+}
+
+void showTempMessage(const char* text, int duration){
+    strlcpy(msgText, text, sizeof(msgText));
+    drawTempMessage();
     msgActive = true;
+    schedStart(messageJob, millis(), duration);
 }
 
-void checkTempMessage(){
-    if(msgActive && millis() - msgStartMillis >= msgDuration){
-        M5.Lcd.fillRect(msgX, msgY, msgW, msgH, NORMAL_BG);
-        msgActive = false;
-    }
+void expireTempMessage(){
+    if(!msgActive) return;
+    canvas.fillRect(msgX, msgY, msgW, msgH, NORMAL_BG);
+    msgActive = false;
+    // メッセージの下にあった固定部分・ウィジェットを描き戻す
+    redrawCurrentScreen();
 }
 
 bool initBME280(){
-    byte possibleAddresses[] = {0x76, 0x77, 0x75};
-    for(byte i=0;i<3;i++){
-        if(bme.begin(possibleAddresses[i], &Wire)){
-            showTempMessage("BME OK", 700);
-            return true;
-        }
+    if(sensorsBegin()){
+        showTempMessage("BME OK", 700);
+        return true;
     }
     showTempMessage("BME Error", 900);
     return false;
 }
 
-String getWeatherSymbol(String description){
-    String d = description; d.toLowerCase();
-    if(d.indexOf("clear") != -1) return "SUN";
-    if(d.indexOf("cloud") != -1) return "CLD";
-    if(d.indexOf("rain") != -1 || d.indexOf("drizzle") != -1) return "RAIN";
-    if(d.indexOf("snow") != -1) return "SNOW";
-    if(d.indexOf("thun") != -1 || d.indexOf("tstorm") != -1) return "THTR";
-    return "UNK";
+// 起動直後はNTP同期が終わるまで回線を確保しておく
+// NTPの同期を待つ間は回線を握る。APもNTPも応えない時に握りっぱなしにならないよう、
+// 接続の失敗（LINK_BACKOFF）かNTP_HOLD_MSで手放し、次に天気の取得で回線が上がった時にもう一度問い合わせる
+constexpr unsigned long NTP_HOLD_MS = 120000;
+bool ntpHoldsLink = false;
+bool ntpSynced = false;
+unsigned long ntpHoldStart = 0;
+
+void ntpStart(){
+    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
+    wifiRequestLink();
+    ntpHoldsLink = true;
+    ntpHoldStart = millis();
+}
+
+void ntpRelease(){
+    if(!ntpHoldsLink) return;
+    ntpHoldsLink = false;
+    wifiReleaseLink();
 }
 
-void connectWiFi(){
-    showTempMessage("WiFi...");
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(WIFI_SSID, WIFI_PASS);
-    unsigned long start = millis();
-    while(WiFi.status() != WL_CONNECTED && millis()-start < 8000) delay(150);
-    if(WiFi.status() == WL_CONNECTED) showTempMessage("WiFi OK", 700);
-    else showTempMessage("WiFi Fail", 800);
+void handleWiFiLinkChange(){
+    bool changed = wifiManagerUpdate();
+    if(changed){
+        switch(wifiLinkState()){
+            case LINK_CONNECTING: showTempMessage("WiFi...", 700); break;
+            case LINK_UP:         showTempMessage("WiFi OK", 700); break;
+            case LINK_BACKOFF:
+                showTempMessage("WiFi Fail", 800);
+                ntpRelease();
+                break;
+            default: break;
+        }
+    }
+    if(ntpSynced || !(ntpHoldsLink || changed)) return;
+    struct tm timeInfo;
+    if(getLocalTime(&timeInfo, 0)){
+        ntpSynced = true;
+        ntpRelease();
+    } else if(ntpHoldsLink && millis() - ntpHoldStart >= NTP_HOLD_MS){
+        ntpRelease();
+    } else if(!ntpHoldsLink && changed && wifiLinkState() == LINK_UP){
+        ntpStart();
+    }
 }
 
-void requestWeatherFetchNow(int cityIdx){
-    String url = "http://api.openweathermap.org/data/2.5/weather?id=" + cities[cityIdx].id +
-                 "&units=metric&lang=en&appid=" + String(API_KEY);
+void scheduleWeatherFetchForCity(int cityIdx){
+    // 通常はキャッシュが温まっているので、古い時だけ裏で一括更新
+    if(isWeatherStale(cityIdx)) requestWeatherRefresh();
+    updateScreen(currentScreen());
+}
 
-    if(WiFi.status() != WL_CONNECTED){
-        connectWiFi();
-        if(WiFi.status() != WL_CONNECTED){
-            showTempMessage("No WiFi", 900);
-            return;
+// ワーカーからの完了イベントを処理。描画はloop()側だけで行う
+void handleWeatherFetchResults(){
+    WeatherFetchResult result;
+    while(pollWeatherFetchResult(result)){
+        if(replay.active) replay.fetches[result.status]++;
+        switch(result.status){
+            case FETCH_OK:
+                if(!result.cityMask) break;
+                if(!replay.active) bootStateSaveWeather();
+                if(!idleModeActive && screenMode == 3 && (result.cityMask & (1u << cityIndex))){
+                    updateScreen(currentScreen());
+                }
+                break;
+            case FETCH_NO_WIFI:  showTempMessage("No WiFi", 900); break;
+            case FETCH_HTTP_ERR: {
+                char msg[16];
+                if(result.httpCode > 0) snprintf(msg, sizeof(msg), "HTTP %d", result.httpCode);
+                else snprintf(msg, sizeof(msg), "HTTP err");
+                showTempMessage(msg, 800);
+                break;
+            }
+            case FETCH_JSON_ERR: showTempMessage("JSON err", 800); break;
         }
     }
+}
 
-    HTTPClient http;
-    http.begin(url);
-    int httpCode = http.GET();
-    if(httpCode > 0){
-        String payload = http.getString();
-        StaticJsonDocument<1024> doc;
-        if(!deserializeJson(doc, payload)){
-            weatherCache[cityIdx].valid = true;
-            weatherCache[cityIdx].cityName = cities[cityIdx].name;
-            weatherCache[cityIdx].description = String(doc["weather"][0]["description"] | "NoDesc");
-            weatherCache[cityIdx].symbol = getWeatherSymbol(weatherCache[cityIdx].description);
-            weatherCache[cityIdx].temp = doc["main"]["temp"] | 0.0f;
-            weatherCache[cityIdx].lastFetch = millis();
-            drawWeatherScreenOptimized(cityIdx, false);
-        } else showTempMessage("JSON err", 800);
-    } else showTempMessage("HTTP err", 800);
-    http.end();
+// ---------- メニュー ----------
+ValueField homeDate(200, 10, 30, 8, 1);
+ValueField homeTime(200, 20, 30, 8, 1);
+Bar homeBattery(261, 11, 18, 8);
+ValueField homeBatteryText(285, 12, 35, 8, 1);
+Label menuLabels[NUM_MENU_ITEMS] = {
+    Label(30,  60, 2, menuItems[0]),
+    Label(30,  90, 2, menuItems[1]),
+    Label(30, 120, 2, menuItems[2]),
+    Label(30, 150, 2, menuItems[3]),
+    Label(30, 180, 2, menuItems[4]),
+    Label(30, 210, 2, menuItems[5])
+};
+Widget* const homeWidgets[] = {
+    &homeDate, &homeTime, &homeBattery, &homeBatteryText,
+    &menuLabels[0], &menuLabels[1], &menuLabels[2], &menuLabels[3], &menuLabels[4], &menuLabels[5]
+};
+
+void enterHome(){
+    canvas.setTextColor(BLACK, NORMAL_BG);
+    canvas.setTextSize(4);
+    canvas.setCursor(80, 20);
+    canvas.printf("MENU");
+    canvas.drawRect(260, 10, 20, 10, BLACK);
+    canvas.fillRect(280, 13, 2, 4, BLACK);
+    for(int i=0; i<NUM_MENU_ITEMS; i++) menuLabels[i].setBox(20, 55 + i*30, 280, 28);
 }
 
-void scheduleWeatherFetchForCity(int cityIdx){
-    if(weatherCache[cityIdx].valid){
-        drawWeatherScreenOptimized(cityIdx, false);
-    } else {
-        M5.Lcd.fillScreen(NORMAL_BG);
-        M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-        M5.Lcd.setTextSize(4);
-        M5.Lcd.setCursor(20, 20);
-        M5.Lcd.printf("[%s]", cities[cityIdx].name.c_str());
-        M5.Lcd.setCursor(20, 110);
-        M5.Lcd.printf("Fetching...");
-    }
-    requestWeatherFetchNow(cityIdx);
-}
-
-void drawHomeScreen(){
-    M5.Lcd.fillScreen(NORMAL_BG);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    M5.Lcd.setTextSize(4);
-    M5.Lcd.setCursor(80, 20);
-    M5.Lcd.printf("MENU");
-    
-    drawTimeDate(200, 10);
-    drawBatteryIcon(260, 10);
-    
+void updateHome(){
+    struct tm timeInfo;
+    if(getLocalTime(&timeInfo, 0)){
+        homeDate.set("%02d/%02d", timeInfo.tm_mon+1, timeInfo.tm_mday);
+        homeTime.set("%02d:%02d", timeInfo.tm_hour, timeInfo.tm_min);
+    }
+    int batLevel = M5.Power.getBatteryLevel();
+    homeBattery.set(batLevel, (batLevel > 50) ? GREEN : (batLevel > 20) ? ORANGE : RED);
+    homeBatteryText.set(M5.Power.isCharging() ? "%d%%+" : "%d%%", batLevel);
     for(int i=0; i<NUM_MENU_ITEMS; i++){
-        int y = 60 + i*30;
-        if(i == menuCursor){
-            M5.Lcd.fillRect(20, y-5, 280, 28, BLACK);
-            M5.Lcd.setTextColor(WHITE, BLACK);
-        } else {
-            M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-        }
-        M5.Lcd.setTextSize(2);
-        M5.Lcd.setCursor(30, y);
-        M5.Lcd.printf("%s", menuItems[i].c_str());
+        if(i == menuCursor) menuLabels[i].setColors(WHITE, BLACK);
+        else menuLabels[i].setColors(BLACK, NORMAL_BG);
     }
 }
 
-void drawWeatherFullFromCache(int cityIdx){
-    WeatherCache &c = weatherCache[cityIdx];
-    M5.Lcd.fillScreen(NORMAL_BG);
+const Screen homeScreen = makeScreen(enterHome, updateHome, homeWidgets, PROF_SCREEN_HOME);
+
+// ---------- 0: センサー表示 ----------
+Label sensorTempLabel(30, 30, 3, "Temp:");
+Label sensorHumLabel(30, 110, 3, "Hum :");
+Label sensorLuxLabel(30, 190, 3, "Light:");
+ValueField sensorTemp(140, 20, 180, 60, 5);
+ValueField sensorHum(140, 100, 180, 60, 5);
+ValueField sensorLux(140, 180, 180, 60, 5);
+ValueField sensorPress(180, 2, 140, 16, 2);
+Widget* const sensorWidgets[] = {
+    &sensorTempLabel, &sensorHumLabel, &sensorLuxLabel, &sensorTemp, &sensorHum, &sensorLux, &sensorPress
+};
 
-    M5.Lcd.setTextSize(4);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    M5.Lcd.setCursor(20, 20);
-    M5.Lcd.printf("[%s]", c.cityName.c_str());
+void updateSensor(){
+    sensorTemp.setColor((currentTemp>=30)?RED:(currentTemp<=20)?CYAN:GREEN);
+    sensorTemp.set("%.1f C", currentTemp);
+    sensorHum.setColor((currentHum>=80)?PURPLE:(currentHum<=60)?BLUE:GREEN);
+    sensorHum.set("%.1f %%", currentHum);
 
-    M5.Lcd.setTextSize(3);
-    M5.Lcd.setCursor(20, 85);
-    M5.Lcd.printf("%s", c.description.c_str());
+    int luxPercent = (int)((currentLux / (float)LUX_MAX) * 100.0f);
+    if(luxPercent > 100) luxPercent = 100;
+    sensorLux.setColor((luxPercent>=80)?WHITE:(luxPercent<=10)?GRAY:YELLOW);
+    sensorLux.set("%d %%", luxPercent);
 
-    M5.Lcd.setTextSize(6);
-    M5.Lcd.setCursor(70, 140);
-    M5.Lcd.printf("%.1f C", c.temp);
+    if(isnan(currentPressure)) sensorPress.set("---- hPa");
+    else sensorPress.set("%.1f hPa", currentPressure);
+}
 
-    lastDisplayedCityIndex = cityIdx;
-    lastDisplayedSymbol = c.symbol;
-    lastDisplayedDescription = c.description;
-    lastDisplayedTemp = c.temp;
+const Screen sensorScreen = makeScreen(nullptr, updateSensor, sensorWidgets, PROF_SCREEN_SENSOR);
+
+// ---------- 1: グラフ ----------
+constexpr int GRAPH_X = 10;
+constexpr int GRAPH_W = 300;
+constexpr int GRAPH_BASE_Y = 220;
+constexpr int GRAPH_STEP = GRAPH_W / MAX_DATA_POINTS;
+constexpr float GRAPH_TEMP_GRID = 5.0f;      // 温度軸は5℃刻みで伸縮
+constexpr float GRAPH_TEMP_MIN_SPAN = 30.0f;
+
+float graphTempLo = 10.0f;
+float graphTempHi = 40.0f;
+uint32_t graphDrawnSamples = 0;
+HistTier graphDrawnTier = TIER_1SEC;
+// 表示中の60点（右詰め、末尾が最新）。1秒段は圧縮されているので描画のたびに引き直さない
+HistBucket graphPoints[MAX_DATA_POINTS];
+int graphPointCount = 0;
+
+int graphY(float v, float lo, float hi){
+    return GRAPH_BASE_Y - (int)((v - lo) * GRAPH_BASE_Y / (hi - lo));
 }
 
-void drawWeatherScreenOptimized(int cityIdx, bool force){
-    WeatherCache &c = weatherCache[cityIdx];
-    if(!c.valid){
-        M5.Lcd.fillRect(20,70,280,120,NORMAL_BG);
-        M5.Lcd.setTextSize(3);
-        M5.Lcd.setCursor(20, 110);
-        M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-        M5.Lcd.printf("No Data");
-        lastDisplayedCityIndex = -1;
-        return;
+// 表示中の温度範囲から軸を決める。範囲が変わった時だけtrue
+// 今の軸に収まっていて極端に余っていなければ変えない（境界付近での往復を防ぐ）
+bool updateGraphRange(){
+    int16_t rawLo = INT16_MAX, rawHi = INT16_MIN;
+    for(int i=MAX_DATA_POINTS-graphPointCount;i<MAX_DATA_POINTS;i++){
+        const HistPoint &p = graphPoints[i].ch[HIST_TEMP];
+        if(p.mean == HIST_MISSING) continue;
+        rawLo = min(rawLo, p.min);
+        rawHi = max(rawHi, p.max);
+    }
+    if(rawLo > rawHi) return false;
+
+    float lo = histDecode(HIST_TEMP, rawLo);
+    float hi = histDecode(HIST_TEMP, rawHi);
+    float span = graphTempHi - graphTempLo;
+    bool fits = lo >= graphTempLo && hi <= graphTempHi;
+    if(fits && (span <= GRAPH_TEMP_MIN_SPAN || hi - lo > span / 2.0f)) return false;
+
+    lo = floorf(lo / GRAPH_TEMP_GRID) * GRAPH_TEMP_GRID;
+    hi = ceilf(hi / GRAPH_TEMP_GRID) * GRAPH_TEMP_GRID;
+    if(hi - lo < GRAPH_TEMP_MIN_SPAN){
+        float mid = floorf((lo + hi) / 2.0f / GRAPH_TEMP_GRID) * GRAPH_TEMP_GRID;
+        lo = mid - GRAPH_TEMP_MIN_SPAN / 2.0f;
+        hi = lo + GRAPH_TEMP_MIN_SPAN;
     }
+    if(lo == graphTempLo && hi == graphTempHi) return false;
+    graphTempLo = lo;
+    graphTempHi = hi;
+    return true;
+}
 
-    if(force || lastDisplayedCityIndex != cityIdx){
-        drawWeatherFullFromCache(cityIdx);
+void drawGraphLine(int x1, int x2, int16_t v1, int16_t v2, HistChannel ch, float lo, float hi, float scale, uint16_t color){
+    if(v1 == HIST_MISSING || v2 == HIST_MISSING) return;
+    canvas.drawLine(x1, graphY(histDecode(ch, v1) * scale, lo, hi),
+                    x2, graphY(histDecode(ch, v2) * scale, lo, hi), color);
+}
+
+// 点(i-1)→点iの区間を3系列ぶん描く。i=MAX_DATA_POINTS-1が最新
+void drawGraphSegment(int i){
+    if(i - 1 < MAX_DATA_POINTS - graphPointCount) return;     // まだ計測していない区間
+    const HistBucket &p1 = graphPoints[i-1];
+    const HistBucket &p2 = graphPoints[i];
+
+    int x1 = GRAPH_X + (i-1)*GRAPH_STEP;
+    int x2 = GRAPH_X + i*GRAPH_STEP;
+
+    drawGraphLine(x1, x2, p1.ch[HIST_TEMP].mean, p2.ch[HIST_TEMP].mean, HIST_TEMP, graphTempLo, graphTempHi, 1.0f, RED);
+    drawGraphLine(x1, x2, p1.ch[HIST_HUM].mean, p2.ch[HIST_HUM].mean, HIST_HUM, 0, 100, 1.0f, BLUE);
+    drawGraphLine(x1, x2, p1.ch[HIST_LUX].mean, p2.ch[HIST_LUX].mean, HIST_LUX, 0, 100, 100.0f / LUX_MAX, YELLOW);
+}
+
+// 通常は1サンプルごとに左へ1区間スクロールして最新区間だけ描く（O(1)）。
+// 画面に入った時・軸が変わった時・サンプルを取りこぼした時だけ全体を描き直す
+void drawGraphPlot(bool full){
+    uint32_t appended = historyAppendCount(graphTier);
+    uint32_t newSamples = appended - graphDrawnSamples;
+    bool reload = full || graphTier != graphDrawnTier || newSamples != 1;
+    graphDrawnSamples = appended;
+    graphDrawnTier = graphTier;
+
+    // 1点増えただけなら左に詰めて最新を1つ読む。それ以外は範囲ごと読み直す
+    if(reload){
+        int n = historyReadBuckets(graphTier, 0, MAX_DATA_POINTS, graphPoints);
+        memmove(&graphPoints[MAX_DATA_POINTS - n], graphPoints, n * sizeof(HistBucket));
+        graphPointCount = n;
+    } else {
+        memmove(graphPoints, &graphPoints[1], (MAX_DATA_POINTS - 1) * sizeof(HistBucket));
+        historyGet(graphTier, 0, graphPoints[MAX_DATA_POINTS - 1]);
+        graphPointCount = min(graphPointCount + 1, MAX_DATA_POINTS);
+    }
+    bool rescaled = updateGraphRange();
+
+    // メッセージはグラフの上端に重なる。スクロールするとメッセージの文字まで左へずれて
+    // グラフに残るので、出ている間は全体を描き直してからメッセージを描き戻す
+    if(reload || rescaled || msgActive){
+        canvas.fillRect(GRAPH_X, 0, GRAPH_W, GRAPH_BASE_Y+20, NORMAL_BG);
+        for(int i=1;i<MAX_DATA_POINTS;i++) drawGraphSegment(i);
+        if(msgActive) drawTempMessage();
         return;
     }
 
-    if(c.description != lastDisplayedDescription){
-        M5.Lcd.fillRect(20,80,280,40,NORMAL_BG);
-        M5.Lcd.setTextSize(3);
-        M5.Lcd.setCursor(20,85);
-        M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-        M5.Lcd.printf("%s", c.description.c_str());
-        lastDisplayedDescription = c.description;
-    }
+    canvas.setScrollRect(GRAPH_X, 0, GRAPH_W, GRAPH_BASE_Y+20);
+    canvas.scroll(-GRAPH_STEP, 0);
+    canvas.clearScrollRect();
+    drawGraphSegment(MAX_DATA_POINTS-1);
+}
+
+Plot graphPlot(drawGraphPlot);
+Widget* const graphWidgets[] = { &graphPlot };
+
+void updateGraph(){
+    // 表示中の段に点が増えた時だけ描く（1分・1時間段はたまにしか動かない）
+    graphPlot.setVersion(historyAppendCount(graphTier) * NUM_HIST_TIERS + graphTier);
+}
+
+const Screen graphScreen = makeScreen(nullptr, updateGraph, graphWidgets, PROF_SCREEN_GRAPH);
 
-    if(isnan(lastDisplayedTemp) || fabs(c.temp - lastDisplayedTemp) >= 0.1f){
-        M5.Lcd.fillRect(70,140,200,80,NORMAL_BG);
-        M5.Lcd.setTextSize(6);
-        M5.Lcd.setCursor(70,140);
-        M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-        M5.Lcd.printf("%.1f C", c.temp);
-        lastDisplayedTemp = c.temp;
+// ---------- 2: 統計 ----------
+ValueField statWindowField(5, 14, 64, 20, 2);
+ValueField statFields[3][3] = {
+    { ValueField(70, 60, 88, 24, 3), ValueField(160, 60, 78, 24, 3), ValueField(240, 60, 80, 24, 3) },
+    { ValueField(70,120, 88, 24, 3), ValueField(160,120, 78, 24, 3), ValueField(240,120, 80, 24, 3) },
+    { ValueField(70,180, 88, 24, 3), ValueField(160,180, 78, 24, 3), ValueField(240,180, 80, 24, 3) }
+};
+Widget* const statsWidgets[] = {
+    &statWindowField,
+    &statFields[0][0], &statFields[0][1], &statFields[0][2],
+    &statFields[1][0], &statFields[1][1], &statFields[1][2],
+    &statFields[2][0], &statFields[2][1], &statFields[2][2]
+};
+
+void enterStats(){
+    canvas.setTextSize(3);
+    canvas.setTextColor(BLACK,NORMAL_BG);
+    canvas.setCursor(80,10); canvas.printf("AVG");
+    canvas.setCursor(180,10); canvas.printf("MAX");
+    canvas.setCursor(260,10); canvas.printf("MIN");
+    canvas.drawFastHLine(5,45,310,BLACK);
+    canvas.setCursor(10,60); canvas.printf("T:");
+    canvas.setCursor(10,120); canvas.printf("H:");
+    canvas.setCursor(10,180); canvas.printf("L:");
+}
+
+void setStatsRow(int row, const RollingSummary &s, const char* fmt){
+    if(!s.valid){
+        for(int col=0;col<3;col++) statFields[row][col].set("--");
+        return;
     }
+    statFields[row][0].set(fmt, s.mean);
+    statFields[row][1].set(fmt, s.max);
+    statFields[row][2].set(fmt, s.min);
+}
+
+// 履歴ストアの段の直近n点をまとめる（照度は生値で持っているので%に直す）
+RollingSummary historyStatsRow(HistTier tier, int n, HistChannel ch, float scale){
+    RollingSummary s;
+    HistPoint p;
+    if(!historySummary(tier, ch, 0, n, p)) return s;
+    s.valid = true;
+    s.mean = histDecode(ch, p.mean) * scale;
+    s.min = histDecode(ch, p.min) * scale;
+    s.max = histDecode(ch, p.max) * scale;
+    return s;
 }
 
-void drawNormalScreen(){
-    M5.Lcd.fillScreen(NORMAL_BG);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    M5.Lcd.setTextSize(3);
-    M5.Lcd.setCursor(30, 30);  M5.Lcd.printf("Temp:");
-    M5.Lcd.setCursor(30,110);  M5.Lcd.printf("Hum :");
-    M5.Lcd.setCursor(30,190);  M5.Lcd.printf("Light:");
+void updateStats(){
+    if(statsPage == STATS_PAGE_7DAY){
+        statWindowField.set("7d");
+        setStatsRow(0, historyStatsRow(TIER_1HOUR, HIST_HOUR_SLOTS, HIST_TEMP, 1.0f), "%.1f");
+        setStatsRow(1, historyStatsRow(TIER_1HOUR, HIST_HOUR_SLOTS, HIST_HUM, 1.0f), "%.1f");
+        setStatsRow(2, historyStatsRow(TIER_1HOUR, HIST_HOUR_SLOTS, HIST_LUX, 100.0f / LUX_MAX), "%.0f%%");
+        return;
+    }
+    StatsWindow w = (StatsWindow)statsPage;
+    statWindowField.set("%s", STATS_WINDOW_NAMES[w]);
+    setStatsRow(0, tempStats.summary(w, statsClock), "%.1f");
+    setStatsRow(1, humStats.summary(w, statsClock), "%.1f");
+    setStatsRow(2, luxStats.summary(w, statsClock), "%.0f%%");
 }
 
-void drawGraphScreen(){
-    static int lastIndex = -1;
-    if(lastIndex == dataIndex) return;
-    lastIndex = dataIndex;
+const Screen statsScreen = makeScreen(enterStats, updateStats, statsWidgets, PROF_SCREEN_STATS);
+
+// ---------- 3: 天気 ----------
+ValueField weatherCity(20, 20, 300, 32, 4);
+ValueField weatherDesc(20, 80, 280, 40, 3);
+ValueField weatherTemp(70, 140, 200, 80, 6);
+ValueField weatherLocal(20, 222, 300, 16, 2);
+Widget* const weatherWidgets[] = { &weatherCity, &weatherDesc, &weatherTemp, &weatherLocal };
+
+// 下の行は局所の気圧・3時間変化・露点・体感温度
+void updateWeatherLocal(){
+    const Forecast &f = localForecast;
+    if(f.valid){
+        weatherLocal.set("%.0fhPa %+.1f Td%.0f HI%.0f", f.pressure, f.change3h, f.dewPoint, f.heatIndex);
+    } else if(!isnan(currentPressure)){
+        weatherLocal.set("%.0fhPa", currentPressure);
+    } else {
+        weatherLocal.clear();
+    }
+}
 
-    constexpr int baseY=220,width=300,startX=10;
-    float tempScale = baseY / 30.0;
-    float humScale = baseY / 100.0;
-    float luxScale = baseY / 100.0;
+// キャッシュが古い・取れていない時は、説明の代わりに局所の予報を色を変えて出す
+void updateWeather(){
+    weatherCity.set("[%s]", cities[cityIndex].name);
+    bool stale = isWeatherStale(cityIndex);
+    lockWeatherCache();
+    const WeatherCache &c = weatherCache[cityIndex];
+    if(c.valid) weatherTemp.set("%.1f C", c.temp);
+    else weatherTemp.clear();
+    if(c.valid && !stale){
+        weatherDesc.setColor(BLACK);
+        weatherDesc.set("%s", c.description);
+    } else if(localForecast.valid){
+        weatherDesc.setColor(BLUE);
+        weatherDesc.set("%s", localForecast.text);
+    } else if(c.valid){
+        weatherDesc.setColor(BLACK);
+        weatherDesc.set("%s", c.description);
+    } else {
+        weatherDesc.setColor(BLACK);
+        weatherDesc.set(weatherFetchPending() ? "Fetching..." : "No Data");
+    }
+    unlockWeatherCache();
+    updateWeatherLocal();
+}
 
-    M5.Lcd.fillRect(startX,0,width,baseY+20,NORMAL_BG);
+const Screen weatherScreen = makeScreen(nullptr, updateWeather, weatherWidgets, PROF_SCREEN_WEATHER);
 
-    for(int i=1;i<MAX_DATA_POINTS;i++){
-        int idx1 = (dataIndex + i - 1) % MAX_DATA_POINTS;
-        int idx2 = (dataIndex + i) % MAX_DATA_POINTS;
-        int x1 = startX + (i-1)*(width/MAX_DATA_POINTS);
-        int x2 = startX + i*(width/MAX_DATA_POINTS);
+// ---------- 4: 方位計 ----------
+float compassHeading = 0.0f;
+uint32_t compassCalStart = 0;
 
-        int yT1 = baseY - (int)((tempData[idx1]-10.0f)*tempScale);
-        int yT2 = baseY - (int)((tempData[idx2]-10.0f)*tempScale);
-        M5.Lcd.drawLine(x1, yT1, x2, yT2, RED);
+// 毎コマ描き直すのは針と数値だけ。針は前に描いた線と先の丸を背景色で消してから描く
+constexpr int DIAL_X = 160, DIAL_Y = 156, DIAL_R = 40, NEEDLE_TIP = 5;
+int needleX = DIAL_X, needleY = DIAL_Y;
 
-        int yH1 = baseY - (int)(humData[idx1]*humScale);
-        int yH2 = baseY - (int)(humData[idx2]*humScale);
-        M5.Lcd.drawLine(x1, yH1, x2, yH2, BLUE);
+void drawCompassDial(bool full){
+    if(!full){
+        canvas.drawLine(DIAL_X, DIAL_Y, needleX, needleY, NORMAL_BG);
+        canvas.fillCircle(needleX, needleY, NEEDLE_TIP, NORMAL_BG);
+    }
+    canvas.drawCircle(DIAL_X, DIAL_Y, DIAL_R, BLACK);     // 先の丸で欠けた所を戻す
+    float angle = (90 - compassHeading) * M_PI / 180.0;
+    needleX = DIAL_X + DIAL_R * cos(angle);
+    needleY = DIAL_Y - DIAL_R * sin(angle);
+    canvas.drawLine(DIAL_X, DIAL_Y, needleX, needleY, RED);
+    canvas.fillCircle(needleX, needleY, NEEDLE_TIP, RED);
+}
 
-        float lux1Pct = (luxData[idx1] / LUX_MAX) * 100.0f;
-        float lux2Pct = (luxData[idx2] / LUX_MAX) * 100.0f;
-        int yL1 = baseY - (int)(lux1Pct*luxScale);
-        int yL2 = baseY - (int)(lux2Pct*luxScale);
-        M5.Lcd.drawLine(x1, yL1, x2, yL2, YELLOW);
+ValueField compassDirection(120, 60, 80, 48, 6);
+Plot compassDial(drawCompassDial);
+ValueField compassValue(70, 210, 180, 24, 3);
+Widget* const compassWidgets[] = { &compassDirection, &compassDial, &compassValue };
+
+// 方位は画面を開いている間は方位計タスク（compassJobで取る）、それ以外・再生中は計測タスクのサンプルから
+// 針と数値は1度単位（20fpsで小数の桁がちらつかない・同じ角度なら描かない）
+void updateCompass(){
+    float heading = compassHeading;
+
+    const char* direction;
+    if(heading >= 337.5 || heading < 22.5) direction = "N";
+    else if(heading >= 22.5 && heading < 67.5) direction = "NE";
+    else if(heading >= 67.5 && heading < 112.5) direction = "E";
+    else if(heading >= 112.5 && heading < 157.5) direction = "SE";
+    else if(heading >= 157.5 && heading < 202.5) direction = "S";
+    else if(heading >= 202.5 && heading < 247.5) direction = "SW";
+    else if(heading >= 247.5 && heading < 292.5) direction = "W";
+    else direction = "NW";
+
+    compassDirection.set("%s", direction);
+    compassDial.setVersion((uint32_t)lroundf(heading));
+    if(compassCalibrating()){
+        uint32_t elapsed = millis() - compassCalStart;
+        uint32_t left = elapsed < COMPASS_CAL_MS ? COMPASS_CAL_MS - elapsed : 0;
+        compassValue.set("CAL %2lus", (unsigned long)((left + 999) / 1000));
+    } else {
+        compassValue.set("%3ld deg", lroundf(heading) % 360);
     }
 }
 
-void drawStatsScreen(){
-    M5.Lcd.fillScreen(NORMAL_BG);
-    float sumT=0,sumH=0,sumL=0;
-    float maxT=-9999,minT=9999,maxH=-9999,minH=9999,maxL=-9999,minL=9999;
-    int countT=0,countH=0,countL=0;
+const Screen compassScreen = makeScreen(nullptr, updateCompass, compassWidgets, PROF_SCREEN_COMPASS);
 
-    for(int i=0;i<MAX_DATA_POINTS;i++){
-        if(tempData[i]!=0){ sumT += tempData[i]; maxT = max(maxT,tempData[i]); minT=min(minT,tempData[i]); countT++; }
-        if(humData[i]!=0){ sumH += humData[i]; maxH = max(maxH,humData[i]); minH=min(minH,humData[i]); countH++; }
-        if(luxData[i]!=0){ 
-            float luxPct = (luxData[i] / LUX_MAX) * 100.0f;
-            sumL += luxPct; 
-            maxL = max(maxL, luxPct); 
-            minL = min(minL, luxPct); 
-            countL++; 
-        }
-    }
+// ---------- 5: カレンダー ----------
+void drawCalendarPlot(bool){
+    canvas.fillScreen(NORMAL_BG);
+    canvas.setTextColor(BLACK, NORMAL_BG);
 
-    float avgT = (countT>0)? sumT/countT : 0;
-    float avgH = (countH>0)? sumH/countH : 0;
-    float avgL = (countL>0)? sumL/countL : 0;
-    if(countT==0){ maxT=minT=0; } if(countH==0){ maxH=minH=0;} if(countL==0){ maxL=minL=0; }
-
-    M5.Lcd.setTextSize(3);
-    M5.Lcd.setTextColor(BLACK,NORMAL_BG);
-    M5.Lcd.setCursor(80,10); M5.Lcd.printf("AVG");
-    M5.Lcd.setCursor(180,10); M5.Lcd.printf("MAX");
-    M5.Lcd.setCursor(260,10); M5.Lcd.printf("MIN");
-    M5.Lcd.drawFastHLine(5,45,310,BLACK);
-
-    int y=60;
-    M5.Lcd.setCursor(10,y); M5.Lcd.printf("T:"); M5.Lcd.setCursor(70,y); M5.Lcd.printf("%.1f",avgT);
-    M5.Lcd.setCursor(160,y); M5.Lcd.printf("%.1f",maxT); M5.Lcd.setCursor(240,y); M5.Lcd.printf("%.1f",minT);
-    y+=60;
-    M5.Lcd.setCursor(10,y); M5.Lcd.printf("H:"); M5.Lcd.setCursor(70,y); M5.Lcd.printf("%.1f",avgH);
-    M5.Lcd.setCursor(160,y); M5.Lcd.printf("%.1f",maxH); M5.Lcd.setCursor(240,y); M5.Lcd.printf("%.1f",minH);
-    y+=60;
-    M5.Lcd.setCursor(10,y); M5.Lcd.printf("L:"); M5.Lcd.setCursor(70,y); M5.Lcd.printf("%d%%",(int)avgL);
-    M5.Lcd.setCursor(160,y); M5.Lcd.printf("%d%%",(int)maxL); M5.Lcd.setCursor(240,y); M5.Lcd.printf("%d%%",(int)minL);
-}
-
-void drawCompassScreen(){
-    M5.Lcd.fillScreen(NORMAL_BG);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    
-    auto imu_update = M5.Imu.update();
-    if(imu_update){
-        auto data = M5.Imu.getImuData();
-        float heading = atan2(data.mag.y, data.mag.x) * 180.0 / M_PI;
-        if(heading < 0) heading += 360;
-        
-        String direction = "";
-        if(heading >= 337.5 || heading < 22.5) direction = "N";
-        else if(heading >= 22.5 && heading < 67.5) direction = "NE";
-        else if(heading >= 67.5 && heading < 112.5) direction = "E";
-        else if(heading >= 112.5 && heading < 157.5) direction = "SE";
-        else if(heading >= 157.5 && heading < 202.5) direction = "S";
-        else if(heading >= 202.5 && heading < 247.5) direction = "SW";
-        else if(heading >= 247.5 && heading < 292.5) direction = "W";
-        else direction = "NW";
-        
-        M5.Lcd.setTextSize(6);
-        M5.Lcd.setCursor(120, 60);
-        M5.Lcd.printf("%s", direction.c_str());
-        
-        M5.Lcd.setTextSize(4);
-        M5.Lcd.setCursor(80, 140);
-        M5.Lcd.printf("%.1f deg", heading);
-        
-        int cx = 160, cy = 180;
-        int r = 40;
-        M5.Lcd.drawCircle(cx, cy, r, BLACK);
-        float angle = (90 - heading) * M_PI / 180.0;
-        int ex = cx + r * cos(angle);
-        int ey = cy - r * sin(angle);
-        M5.Lcd.drawLine(cx, cy, ex, ey, RED);
-        M5.Lcd.fillCircle(ex, ey, 5, RED);
-    }
-}
-
-void drawCalendarScreen(){
-    M5.Lcd.fillScreen(NORMAL_BG);
-    M5.Lcd.setTextColor(BLACK, NORMAL_BG);
-    
     struct tm timeInfo;
-    if(!getLocalTime(&timeInfo)){
-        M5.Lcd.setTextSize(3);
-        M5.Lcd.setCursor(50, 100);
-        M5.Lcd.printf("No Time Data");
+    if(!getLocalTime(&timeInfo, 0)){
+        canvas.setTextSize(3);
+        canvas.setCursor(50, 100);
+        canvas.printf("No Time Data");
         return;
     }
-    
+
     // 年月表示
-    M5.Lcd.setTextSize(4);
-    M5.Lcd.setCursor(50, 10);
-    M5.Lcd.printf("%d/%02d", timeInfo.tm_year+1900, timeInfo.tm_mon+1);
-    
+    canvas.setTextSize(4);
+    canvas.setCursor(50, 10);
+    canvas.printf("%d/%02d", timeInfo.tm_year+1900, timeInfo.tm_mon+1);
+
     // 曜日ヘッダー
-    M5.Lcd.setTextSize(2);
+    canvas.setTextSize(2);
     const char* dow[] = {"Su","Mo","Tu","We","Th","Fr","Sa"};
     for(int i=0; i<7; i++){
-        M5.Lcd.setCursor(10 + i*45, 50);
-        M5.Lcd.printf("%s", dow[i]);
+        canvas.setCursor(10 + i*45, 50);
+        canvas.printf("%s", dow[i]);
     }
-    
+
     // 月初の曜日と日数計算
     struct tm firstDay = timeInfo;
     firstDay.tm_mday = 1;
     mktime(&firstDay);
     int startDow = firstDay.tm_wday;
-    
+
     int daysInMonth = 31;
     int month = timeInfo.tm_mon;
     if(month == 3 || month == 5 || month == 8 || month == 10) daysInMonth = 30;
@@ -496,46 +692,160 @@ void drawCalendarScreen(){
         int year = timeInfo.tm_year + 1900;
         daysInMonth = (year%4==0 && (year%100!=0 || year%400==0)) ? 29 : 28;
     }
-    
+
     // カレンダー描画
     int day = 1;
     for(int row=0; row<6; row++){
         for(int col=0; col<7; col++){
             if(row==0 && col<startDow) continue;
             if(day > daysInMonth) break;
-            
+
             int x = 10 + col*45;
             int y = 75 + row*25;
-            
+
             if(day == timeInfo.tm_mday){
-                M5.Lcd.fillRect(x-2, y-2, 40, 22, BLACK);
-                M5.Lcd.setTextColor(WHITE, BLACK);
+                canvas.fillRect(x-2, y-2, 40, 22, BLACK);
+                canvas.setTextColor(WHITE, BLACK);
             } else {
-                M5.Lcd.setTextColor(BLACK, NORMAL_BG);
+                canvas.setTextColor(BLACK, NORMAL_BG);
             }
-            
-            M5.Lcd.setCursor(x, y);
-            M5.Lcd.printf("%2d", day);
+
+            canvas.setCursor(x, y);
+            canvas.printf("%2d", day);
             day++;
         }
         if(day > daysInMonth) break;
     }
 }
 
-void drawIdleFaceAnimated(float temp,float hum,int lux,float tempWeather,String weatherSymbol){
+Plot calendarPlot(drawCalendarPlot);
+Widget* const calendarWidgets[] = { &calendarPlot };
+
+void updateCalendar(){
+    // 日付が変わった時だけ描き直す
+    struct tm timeInfo;
+    if(getLocalTime(&timeInfo, 0)) calendarPlot.setVersion(timeInfo.tm_year*400 + timeInfo.tm_yday + 1);
+    else calendarPlot.setVersion(0);
+}
+
+const Screen calendarScreen = makeScreen(nullptr, updateCalendar, calendarWidgets, PROF_SCREEN_CALENDAR);
+
+// ---------- 6: 診断（メニューには出さない。Bの長押しで入る。A/Cでページ切替） ----------
+constexpr int DIAG_SCREEN = NUM_MENU_ITEMS;
+
+enum DiagPage : uint8_t {
+    DIAG_TIMING = 0,
+    DIAG_MEMORY,
+    NUM_DIAG_PAGES
+};
+const char* const DIAG_PAGE_TITLES[NUM_DIAG_PAGES] = { "Diag: timing", "Diag: memory" };
+DiagPage diagPage = DIAG_TIMING;
+
+void drawDiagTiming(){
+    canvas.setCursor(4, 34);
+    canvas.printf("%-12s %7s %7s %7s %7s", "probe", "n", "p50 us", "p99 us", "max us");
+    int y = 46;
+    for(int i=0;i<NUM_PROF_PROBES;i++){
+        ProfSummary s = profSummary((ProfProbe)i);
+        if(s.count == 0) continue;
+        canvas.setCursor(4, y);
+        canvas.printf("%-12s %7lu %7lu %7lu %7lu", PROF_PROBE_NAMES[i], (unsigned long)s.count,
+                      (unsigned long)s.p50Us, (unsigned long)s.p99Us, (unsigned long)s.maxUs);
+        y += 10;
+    }
+}
+
+void drawDiagMemory(){
+    MemTrend t = memTrend();
+    uint8_t flags = memHealth();
+    canvas.setCursor(4, 34);
+    canvas.printf("heap free %7lu  largest %7lu", (unsigned long)t.freeBytes, (unsigned long)t.largestBlock);
+    canvas.setCursor(4, 44);
+    canvas.printf("min  free %7lu  frag %3u.%u%%", (unsigned long)t.minFreeEver,
+                  t.fragPermille / 10, t.fragPermille % 10);
+    canvas.setCursor(4, 54);
+    canvas.printf("trend %2d pts  free %+ld/h  largest %+ld/h", t.points,
+                  (long)t.freePerHour, (long)t.largestPerHour);
+    canvas.setCursor(4, 64);
+    canvas.setTextColor(flags ? RED : BLACK, NORMAL_BG);
+    canvas.printf("checks %s%s%s%s%s", flags ? "" : "ok",
+                  (flags & MEM_CHECK_LEAK) ? " LEAK" : "", (flags & MEM_CHECK_FRAG) ? " FRAG" : "",
+                  (flags & MEM_CHECK_LOW) ? " LOW" : "", (flags & MEM_CHECK_STACK) ? " STACK" : "");
+    canvas.setTextColor(BLACK, NORMAL_BG);
+
+    int y = 80;
+#ifdef MEM_HOOKS
+    canvas.setCursor(4, y);
+    canvas.printf("%-8s %9s %9s %9s", "tag", "allocs", "frees", "bytes");
+    y += 10;
+    for(int i=0;i<NUM_MEM_TAGS;i++){
+        const MemTagStats &s = memTagStats((MemTag)i);
+        canvas.setCursor(4, y);
+        canvas.printf("%-8s %9lu %9lu %9lu", MEM_TAG_NAMES[i], (unsigned long)s.allocs,
+                      (unsigned long)s.frees, (unsigned long)s.bytes);
+        y += 10;
+    }
+    y += 6;
+#endif
+    canvas.setCursor(4, y);
+    canvas.printf("%-8s %9s", "task", "stack");
+    y += 10;
+    for(int i=0;i<memTaskCount();i++){
+        const MemTaskInfo &task = memTaskInfo(i);
+        canvas.setCursor(4, y);
+        canvas.setTextColor(task.stackFree < MEM_STACK_MARGIN ? RED : BLACK, NORMAL_BG);
+        canvas.printf("%-8s %9lu", task.name, (unsigned long)task.stackFree);
+        y += 10;
+    }
+}
+
+void drawDiagPlot(bool){
+    canvas.fillRect(0, 30, SCREEN_W, SCREEN_H - 30, NORMAL_BG);
+    canvas.setTextSize(1);
+    canvas.setTextColor(BLACK, NORMAL_BG);
+    if(diagPage == DIAG_TIMING) drawDiagTiming();
+    else drawDiagMemory();
+}
+
+Label diagTitle(4, 8, 2, DIAG_PAGE_TITLES[DIAG_TIMING]);
+Plot diagPlot(drawDiagPlot);
+Widget* const diagWidgets[] = { &diagTitle, &diagPlot };
+
+void updateDiag(){
+    diagTitle.setText(DIAG_PAGE_TITLES[diagPage]);
+    diagPlot.setVersion(diagPage == DIAG_TIMING ? profVersion() : memVersion());
+}
+
+const Screen diagScreen = makeScreen(nullptr, updateDiag, diagWidgets, PROF_SCREEN_DIAG);
+
+// 画面レジストリ（screenModeで引く。-1はメニュー、最後は隠し画面）
+const Screen* const SCREENS[NUM_MENU_ITEMS + 1] = {
+    &sensorScreen, &graphScreen, &statsScreen, &weatherScreen, &compassScreen, &calendarScreen,
+    &diagScreen
+};
+
+const Screen& currentScreen(){
+    return screenMode < 0 ? homeScreen : *SCREENS[screenMode];
+}
+
+void redrawCurrentScreen(){
+    if(!idleModeActive) enterScreen(currentScreen());
+}
+
+void drawIdleFaceAnimated(float temp,float hum,int,float,WeatherSymbol weatherSymbol){
     int cx=160,cy=120;
     int eyeW=20,eyeH=15;
     int mouthW=60,mouthH=20;
 
-    M5.Lcd.fillScreen(NORMAL_BG);
+    canvas.fillScreen(NORMAL_BG);
     drawTimeDate(200, 10);
     drawBatteryIcon(260, 10);
     
     // びっくり表情チェック
     if(isSurprised && millis() - surpriseStartTime < SURPRISE_DURATION){
-        M5.Lcd.fillCircle(cx-40, cy-20, 18, BLACK);
-        M5.Lcd.fillCircle(cx+40, cy-20, 18, BLACK);
-        M5.Lcd.fillCircle(cx, cy+40, 25, RED);
+        canvas.fillCircle(cx-40, cy-20, 18, BLACK);
+        canvas.fillCircle(cx+40, cy-20, 18, BLACK);
+        canvas.fillCircle(cx, cy+40, 25, RED);
         return;
     } else if(isSurprised){
         isSurprised = false;
@@ -559,17 +869,17 @@ void drawIdleFaceAnimated(float temp,float hum,int lux,float tempWeather,String
     int faceY = cy + bodySwayY;
     
     // 目（黒の楕円のみ、移動可能）
-    M5.Lcd.fillEllipse(faceX-40+eyeLookX, faceY-20+eyeLookY, eyeW, eyesOpen ? eyeH : 2, BLACK);
-    M5.Lcd.fillEllipse(faceX+40+eyeLookX, faceY-20+eyeLookY, eyeW, eyesOpen ? eyeH : 2, BLACK);
+    canvas.fillEllipse(faceX-40+eyeLookX, faceY-20+eyeLookY, eyeW, eyesOpen ? eyeH : 2, BLACK);
+    canvas.fillEllipse(faceX+40+eyeLookX, faceY-20+eyeLookY, eyeW, eyesOpen ? eyeH : 2, BLACK);
 
     // 口（天気で変化、振幅縮小）
     float mouthT = sin(millis()/200.0)*3.0;
-    if(temp>30 || weatherSymbol=="SUN"){
-        M5.Lcd.fillEllipse(faceX, faceY+40+mouthT, mouthW/2, mouthH, RED);
-    } else if(hum>70 || weatherSymbol=="RAIN"){
-        M5.Lcd.drawLine(faceX-mouthW/2, faceY+40+mouthT, faceX+mouthW/2, faceY+40+mouthT, RED);
+    if(temp>30 || weatherSymbol==SYM_SUN){
+        canvas.fillEllipse(faceX, faceY+40+mouthT, mouthW/2, mouthH, RED);
+    } else if(hum>70 || weatherSymbol==SYM_RAIN){
+        canvas.drawLine(faceX-mouthW/2, faceY+40+mouthT, faceX+mouthW/2, faceY+40+mouthT, RED);
     } else {
-        M5.Lcd.fillRect(faceX-mouthW/2, faceY+40+mouthT, mouthW, mouthH/2, RED);
+        canvas.fillRect(faceX-mouthW/2, faceY+40+mouthT, mouthW, mouthH/2, RED);
     }
 
     // まばたき
@@ -583,195 +893,521 @@ void drawIdleFaceAnimated(float temp,float hum,int lux,float tempWeather,String
     }
 }
 
-void checkIdleFace(float temp,float hum,int lux,float tempWeather,String weatherSymbol){
-    unsigned long now = millis();
-    unsigned long timeout = (screenMode == 4) ? IDLE_TIMEOUT_COMPASS : IDLE_TIMEOUT;
-    
-    if(now - lastInteraction > timeout){
-        if(!idleModeActive){
-            idleModeActive = true;
-            lastIdleUpdate = now;
-        }
-        if(now - lastIdleUpdate > 120){
-            lastIdleUpdate = now;
-            drawIdleFaceAnimated(temp, hum, lux, tempWeather, weatherSymbol);
+unsigned long idleTimeout(){
+    return (screenMode == 4) ? IDLE_TIMEOUT_COMPASS : IDLE_TIMEOUT;
+}
+
+// 無操作タイムアウト（idleJob）
+void enterIdleFace(){
+    idleModeActive = true;
+    schedStart(idleFrameJob, millis(), 0);
+}
+
+// 顔アニメの1コマ（idleFrameJob）
+void drawIdleFrame(){
+    PROF_SCOPE(PROF_IDLE_FACE);
+    bool stale = isWeatherStale(cityIndex);
+    lockWeatherCache();
+    WeatherSymbol sym = weatherCache[cityIndex].valid ? weatherCache[cityIndex].symbol : SYM_UNKNOWN;
+    float tmpw = weatherCache[cityIndex].valid ? weatherCache[cityIndex].temp : 0.0f;
+    unlockWeatherCache();
+    // 古い・取れていない時は局所の予報と体感温度
+    if(stale && localForecast.valid){
+        sym = localForecast.symbol;
+        tmpw = localForecast.heatIndex;
+    }
+    drawIdleFaceAnimated(moodTemp, moodHum, moodLux, tmpw, sym);
+}
+
+// ボタン操作の後に呼ぶ。顔表示をやめ、タイムアウトを付け直す
+void noteInteraction(uint32_t now){
+    if(idleModeActive){
+        idleModeActive = false;
+        schedStop(idleFrameJob);
+        enterScreen(currentScreen());
+    }
+    schedStart(idleJob, now, idleTimeout());
+}
+
+void resetStats(){
+    historyReset();
+    tempStats.reset();
+    humStats.reset();
+    luxStats.reset();
+    forecastReset();
+    localForecast = Forecast();
+}
+
+// 計測タスクから届いた1サンプル分の処理（履歴・統計・LED・画面更新）
+void handleSensorSample(const SensorSample &sample){
+    PROF_SCOPE(PROF_SAMPLE);
+    uint32_t now = sample.timestamp;
+
+    if(sample.valid & SAMPLE_IMU_VALID){
+        // 加速度センサーで揺さぶり検出
+        if(sample.accelMag > 1.5 && idleModeActive){
+            isSurprised = true;
+            surpriseStartTime = millis();
         }
+        // 方位計タスクが動いている間はそちらの傾き補正した方位を使う
+        float heading = compassFlatHeading(sample.magX, sample.magY, compassCalibration());
+        if(!compassRunning() && !isnan(heading)) compassHeading = heading;
+    }
+
+    // 読めなかった項目は直前の値を使う
+    float temp = (sample.valid & SAMPLE_TEMP_VALID) ? sample.temp : currentTemp;
+    float hum  = (sample.valid & SAMPLE_HUM_VALID) ? sample.hum : currentHum;
+    if(sample.valid & SAMPLE_PRESS_VALID) currentPressure = sample.pressure;
+
+    int lux = (sample.valid & SAMPLE_LUX_VALID) ? sample.lux : currentLux;
+    if(lux<0) lux=0; 
+    if(lux>LUX_MAX) lux=LUX_MAX;
+
+    ledOn = lightLedState(ledOn, lux, LIGHT_ON_LUX, LIGHT_OFF_LUX);
+    digitalWrite(ledPin, ledOn ? HIGH : LOW);
+
+    historyAppend(temp, hum, lux, currentPressure, now);
+    if(!replay.active) sensorLogSync();     // 再生した値はログに残さない
+    tempStats.add(temp, now);
+    humStats.add(hum, now);
+    luxStats.add(lux * 100.0f / LUX_MAX, now);
+    statsClock = now;
+    // 傾向は実際に読んだ値だけで取る（読まなかった周期の直前値を重ねない）
+    forecastAdd((sample.valid & SAMPLE_TEMP_VALID) ? sample.temp : NAN,
+                (sample.valid & SAMPLE_HUM_VALID) ? sample.hum : NAN,
+                (sample.valid & SAMPLE_PRESS_VALID) ? sample.pressure : NAN, now);
+
+    currentTemp = temp;
+    currentHum = hum;
+    currentLux = lux;
+    if(!idleModeActive) updateScreen(currentScreen());
+
+    RollingSummary moodT = tempStats.summary(STATS_1MIN, now);
+    RollingSummary moodH = humStats.summary(STATS_1MIN, now);
+    RollingSummary moodL = luxStats.summary(STATS_1MIN, now);
+    moodTemp = moodT.valid ? moodT.mean : temp;
+    moodHum = moodH.valid ? moodH.mean : hum;
+    moodLux = moodL.valid ? (int)(moodL.mean * LUX_MAX / 100.0f) : lux;
+}
+
+// 前回保存した計測値・都市・天気を戻す（最初の画面用）
+void restoreBootState(){
+    BootReadings r;
+    if(!bootStateLoad(r, cityIndex)) return;
+    if(!isnan(r.temp)) currentTemp = r.temp;
+    if(!isnan(r.hum)) currentHum = r.hum;
+    currentPressure = r.pressure;
+    currentLux = r.lux;
+    moodTemp = currentTemp;
+    moodHum = currentHum;
+    moodLux = currentLux;
+}
+
+// 計測値の定期保存（readingsJob）
+void saveReadings(){
+    BootReadings r;
+    r.temp = currentTemp;
+    r.hum = currentHum;
+    r.pressure = currentPressure;
+    r.lux = currentLux;
+    bootStateSaveReadings(r);
+}
+
+// 天気の定期更新（weatherJob）。次の間隔は局所の変化で決める（鮮度の期限も同じ長さ）
+void refreshWeather(){
+    uint32_t now = millis();
+    weatherInterval.measured(forecastChange(localForecast), now);
+    uint32_t period = weatherInterval.period();
+    schedSetPeriod(weatherJob, period);
+    schedStart(weatherJob, now, period);
+    setWeatherStaleMs(period);
+    lastWeatherRefresh = now;
+    requestWeatherRefresh(true);
+}
+
+// 局所の傾向の更新（forecastJob）。気圧が急に下がり始めたら定期更新を前倒しする
+void updateForecast(){
+    uint32_t now = millis();
+    localForecast = forecastCurrent(now);
+    if(!idleModeActive && screenMode == 3) updateScreen(weatherScreen);
+    if(replay.active || !forecastSharpDrop(localForecast)) return;
+    if(now - lastWeatherRefresh < FORECAST_EARLY_GAP_MS) return;
+    weatherInterval.reset();
+    schedStart(weatherJob, now, 0);
+}
+
+// ---------- 方位計 ----------
+void finishCompassCalibration(){
+    showTempMessage(compassCalibrationFinish() ? "Cal saved" : "Cal failed", 1500);
+}
+
+// 方位計の画面でA/C: 校正の開始。校正中にもう一度押すと早めに終える（COMPASS_CAL_MSで自動で終わる）
+void toggleCompassCalibration(){
+    if(replay.active) return;
+    if(compassCalibrating()){
+        finishCompassCalibration();
     } else {
-        if(idleModeActive){
-            idleModeActive = false;
-            if(screenMode == -1) drawHomeScreen();
-            else {
-                switch(screenMode){
-                    case 0: drawNormalScreen(); break;
-                    case 1: drawGraphScreen(); break;
-                    case 2: drawStatsScreen(); break;
-                    case 3: drawWeatherScreenOptimized(cityIndex, true); break;
-                    case 4: drawCompassScreen(); break;
-                    case 5: drawCalendarScreen(); break;
-                }
+        compassCalibrationStart();
+        compassCalStart = millis();
+        showTempMessage("Rotate", COMPASS_CAL_MS);
+    }
+    updateScreen(compassScreen);
+}
+
+// 方位計のコマ送り（compassJob）。タスクが出した最新の方位を取って描く
+void updateCompassFrame(){
+    float heading = compassHeadingNow();
+    if(!isnan(heading)) compassHeading = heading;
+    if(compassCalibrating() && millis() - compassCalStart >= COMPASS_CAL_MS) finishCompassCalibration();
+    updateScreen(compassScreen);
+}
+
+// 方位計タスクは画面を開いている間だけ回す（顔表示・再生中は止める）
+void syncCompassTask(uint32_t now){
+    bool want = screenMode == 4 && !idleModeActive && !replay.active;
+    if(want == compassRunning()) return;
+    if(want){
+        compassStart();
+        schedStart(compassJob, now, COMPASS_FRAME_MS);
+    } else {
+        compassStop();
+        schedStop(compassJob);
+    }
+}
+
+// ---------- トレースの記録と再生 ----------
+uint32_t totalAllocs(){
+    uint32_t n = 0;
+    for(int i=0;i<NUM_MEM_TAGS;i++) n += memTagStats((MemTag)i).allocs;
+    return n;
+}
+
+// 記録・再生はどちらもホーム画面・初期の表示設定から始める（同じ入力で同じ画面を通る）
+void resetUiState(){
+    screenMode = -1;
+    menuCursor = 0;
+    cityIndex = 0;
+    graphTier = TIER_1SEC;
+    statsPage = STATS_1MIN;
+    diagPage = DIAG_TIMING;
+    bool wasIdle = idleModeActive;
+    noteInteraction(millis());
+    if(!wasIdle) enterScreen(currentScreen());
+}
+
+// 記録中のトレースの書き出し（traceJob）
+void flushTrace(){
+    if(traceStoreFlush()) return;
+    schedStop(traceJob);
+    showTempMessage("Trace full", 900);
+}
+
+void toggleTraceRecording(){
+    if(replay.active) return;
+    if(traceRecording()){
+        schedStop(traceJob);
+        traceStoreStop();
+        showTempMessage("Trace off", 900);
+        Serial.printf("# trace stopped: %lu bytes\n", (unsigned long)traceStoreBytes());
+        return;
+    }
+    resetUiState();
+    if(!traceStoreStart()){
+        showTempMessage("Trace err", 900);
+        return;
+    }
+    schedStart(traceJob, millis(), TRACE_FLUSH_MS);
+    showTempMessage("Trace on", 900);
+}
+
+void startReplay(){
+    if(replay.active || traceRecording()) return;
+    replay = ReplayState();
+    if(!traceStoreOpen(replayReader)){
+        showTempMessage("No trace", 900);
+        return;
+    }
+#ifdef LIGHT_SLEEP
+    schedStop(sampleJob);
+#endif
+    // LIGHT_SLEEPでない時は計測タスクが自分の周期で回り続け、届いたサンプルは再生中は捨てる
+    schedStop(weatherJob);
+    schedStop(readingsJob);
+    weatherSetReplay(true);
+
+    // 記録の値だけが履歴・統計に入るように空にしてから流す
+    resetStats();
+    resetUiState();
+    profReset();
+    replay.active = true;
+    replay.startMs = millis();
+    replay.traceStartMs = replayReader.startMs();
+    replay.framesBefore = renderStats().frames;
+    replay.bytesBefore = renderStats().totalBytes;
+    replay.allocsBefore = totalAllocs();
+    Serial.println("# replay start");
+}
+
+// 期限の来たレコードを記録の順に1つ取り出す。HTTP応答はここで天気の処理へ流す
+// 先頭がwantと違う種類なら、次のloop()でその種類を受け取る所まで待つ
+bool replayTake(TraceRecordType want, TraceRecord &out){
+    uint32_t elapsed = (millis() - replay.startMs) * TRACE_REPLAY_SPEED;
+    for(;;){
+        if(!replay.havePending){
+            if(!replayReader.next(replay.pending)){
+                replay.ended = true;
+                return false;
             }
+            replay.havePending = true;
         }
+        const TraceRecord &r = replay.pending;
+        if(r.ms - replay.traceStartMs > elapsed) return false;
+        replay.lastTraceMs = r.ms;
+        if(r.type == TRACE_HTTP){
+            TraceBodyStream body(r.body, r.bodyLen);
+            weatherReplayResponse(r.httpCode, &body);
+            replay.responses++;
+            replay.havePending = false;
+            continue;
+        }
+        if(r.type != want) return false;
+        out = r;
+        replay.havePending = false;
+        return true;
     }
 }
 
-void resetStats(){
-    for(int i=0;i<MAX_DATA_POINTS;i++){ 
-        tempData[i]=0.0; 
-        humData[i]=0.0; 
-        luxData[i]=0.0; 
+// ボタンイベントの入口。再生中は記録から取り（実際の押下は捨てる）、記録中は受け取った順に残す
+bool nextInputEvent(InputEvent &ev){
+    if(replay.active){
+        while(pollInputEvent(ev)) {}
+        TraceRecord r;
+        if(replay.ended || !replayTake(TRACE_INPUT, r)) return false;
+        ev = r.input;
+        ev.us = micros() - r.lagUs;
+        replay.inputs++;
+        return true;
+    }
+    if(!pollInputEvent(ev)) return false;
+    if(traceRecording()) traceInput(ev, millis(), micros());
+    return true;
+}
+
+// サンプルの入口（nextInputEventと同じ）
+bool nextSensorSample(SensorSample &sample){
+    if(replay.active){
+        while(pollSensorSample(sample)) {}
+        TraceRecord r;
+        if(replay.ended || !replayTake(TRACE_SAMPLE, r)) return false;
+        sample = r.sample;
+        replay.samples++;
+        return true;
+    }
+    if(!pollSensorSample(sample)) return false;
+    if(traceRecording()) traceSample(sample, millis());
+    return true;
+}
+
+// 結果を出して再起動する（履歴・統計・天気が再生の値になっているので、保存分から起動し直す）
+void finishReplay(){
+    uint32_t wall = millis() - replay.startMs;
+    uint32_t span = replay.lastTraceMs - replay.traceStartMs;
+    const RenderStats &rs = renderStats();
+    Serial.printf("# replay: %lu samples, %lu inputs, %lu responses%s\n",
+                  (unsigned long)replay.samples, (unsigned long)replay.inputs,
+                  (unsigned long)replay.responses, replayReader.corrupt() ? " (trace corrupt)" : "");
+    Serial.printf("# trace %lu ms in %lu ms (x%.1f)\n",
+                  (unsigned long)span, (unsigned long)wall, wall ? (float)span / wall : 0.0f);
+    Serial.printf("# frames %lu, bytes %lu\n",
+                  (unsigned long)(rs.frames - replay.framesBefore),
+                  (unsigned long)(rs.totalBytes - replay.bytesBefore));
+    Serial.printf("# allocs %lu\n", (unsigned long)(totalAllocs() - replay.allocsBefore));
+    Serial.printf("# fetch ok %lu, no wifi %lu, http err %lu, json err %lu\n",
+                  (unsigned long)replay.fetches[FETCH_OK], (unsigned long)replay.fetches[FETCH_NO_WIFI],
+                  (unsigned long)replay.fetches[FETCH_HTTP_ERR], (unsigned long)replay.fetches[FETCH_JSON_ERR]);
+    profDump(Serial, false);        // 再生中だけの描画・画面更新の分布と回数
+    Serial.println("# replay end, restarting");
+    Serial.flush();
+    traceStoreClose();
+    sensorLogFlush();       // 再生の前に計測した分（再生中はログへ積まない）
+    ESP.restart();
+}
+
+void initJobs(){
+#ifdef LIGHT_SLEEP
+    sampleJob = schedCreate(sensorTrigger, SENSOR_PERIOD_MS);
+#endif
+    weatherJob = schedCreate(refreshWeather, UPDATE_WEATHER_INTERVAL);
+    messageJob = schedCreate(expireTempMessage);
+    idleJob = schedCreate(enterIdleFace);
+    idleFrameJob = schedCreate(drawIdleFrame, IDLE_FRAME_MS);
+    readingsJob = schedCreate(saveReadings, READINGS_SAVE_MS);
+    memJob = schedCreate(memSample, MEM_SAMPLE_MS);
+    logJob = schedCreate(sensorLogFlush, SENSOR_LOG_FLUSH_MS);
+    traceJob = schedCreate(flushTrace, TRACE_FLUSH_MS);
+    forecastJob = schedCreate(updateForecast, FORECAST_CHECK_MS);
+    compassJob = schedCreate(updateCompassFrame, COMPASS_FRAME_MS);
+}
+
+int wrapIndex(int v, int n){
+    return ((v % n) + n) % n;
+}
+
+// A/Cでの移動（stepは押した回数の合計、Aが-1・Cが+1）
+void applyStep(int step){
+    if(step == 0) return;
+    if(screenMode == -1){
+        menuCursor = wrapIndex(menuCursor + step, NUM_MENU_ITEMS);
+        updateScreen(homeScreen);
+    } else if(screenMode == 1){
+        graphTier = (HistTier)wrapIndex(graphTier + step, NUM_HIST_TIERS);
+        updateScreen(graphScreen);
+        showTempMessage(HIST_TIER_NAMES[graphTier], 900);
+    } else if(screenMode == 2){
+        statsPage = wrapIndex(statsPage + step, NUM_STATS_PAGES);
+        updateScreen(statsScreen);
+    } else if(screenMode == 3){
+        cityIndex = wrapIndex(cityIndex + step, NUM_CITIES);
+        if(!replay.active) bootStateSaveCity(cityIndex);
+        scheduleWeatherFetchForCity(cityIndex);
+    } else if(screenMode == 4){
+        toggleCompassCalibration();
+    } else if(screenMode == DIAG_SCREEN){
+        diagPage = (DiagPage)wrapIndex(diagPage + step, NUM_DIAG_PAGES);
+        diagPlot.invalidate();
+        updateScreen(diagScreen);
     }
-    dataIndex = 0;
 }
 
+// シリアルのコマンド（1文字）。c: プロファイラCSV / j: JSON / r: リセット / m: メモリ
+// t: トレース記録の開始/終了 / p: トレース再生 / d: トレースを16進で出す
+void handleSerialCommands(){
+    while(Serial.available() > 0){
+        switch(Serial.read()){
+            case 'c': profDump(Serial, false); break;
+            case 'j': profDump(Serial, true); break;
+            case 'r': profReset(); Serial.println("# profiler reset"); break;
+            case 'm': memDump(Serial); break;
+            case 't': toggleTraceRecording(); break;
+            case 'p': startReplay(); break;
+            case 'd': traceStoreDump(Serial); break;
+            default: break;
+        }
+    }
+}
+
+// 起動は3段階。①保存状態で最初の画面を出す ②計測・通信を裏で始める ③履歴をフラッシュから戻す
+// WiFi接続・NTP同期・天気取得はloop()が回り始めてから終わる
 void setup(){
+    memWatchTask("loop", nullptr, MEM_TAG_LOOP);
     auto cfg = M5.config();
     M5.begin(cfg);
-    M5.Lcd.setTextSize(2);
-    M5.Lcd.setTextColor(WHITE);
-    
+    bootPhase("m5");
+    renderBegin();
+    canvas.setTextSize(2);
+    canvas.setTextColor(WHITE);
+    initJobs();
+    inputBegin();
     pinMode(ledPin, OUTPUT);
-    pinMode(LIGHT_PIN, INPUT);
+    restoreBootState();
+    bootPhase("nvs");
+
+    enterScreen(homeScreen);
+    renderPresent();
+    bootPhase("first frame");
 
-    Wire.begin(BME_SDA,BME_SCL);
-    Wire.setClock(100000);
     initBME280();
+    wifiManagerBegin(WIFI_SSID, WIFI_PASS);
+    ntpStart();
+    startWeatherWorker(API_KEY);
+    requestWeatherRefresh(true);
+    bootPhase("net start");
 
+    // 計測は履歴を戻してから始める（戻す前の点が上書きされないように）
     resetStats();
-    lastInteraction = millis();
-
-    connectWiFi();
-    configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
-
-    for(int i=0;i<NUM_CITIES;i++) weatherCache[i].valid = false;
-
-    drawHomeScreen();
-    requestWeatherFetchNow(cityIndex);
-    lastWeatherUpdate = millis();
+    sensorLogBegin();
+    bootPhase("history");
+    startSensorTask();
+    compassBegin();
+
+    uint32_t now = millis();
+    noteInteraction(now);
+#ifdef LIGHT_SLEEP
+    schedStart(sampleJob, now, SENSOR_PERIOD_MS);
+#endif
+    schedStart(weatherJob, now, UPDATE_WEATHER_INTERVAL);
+    schedStart(forecastJob, now, FORECAST_CHECK_MS);
+    lastWeatherRefresh = now;
+    schedStart(readingsJob, now, READINGS_SAVE_MS);
+    schedStart(memJob, now, 0);
+    schedStart(logJob, now, SENSOR_LOG_FLUSH_MS);
+    bootPhase("ready");
+    bootReport();
 }
 
 void loop(){
+    uint32_t loopStart = profStart();
     M5.update();
     unsigned long now = millis();
 
-    if(M5.BtnA.wasPressed()){
-        lastInteraction = now;
-        if(screenMode == -1){
-            menuCursor = (menuCursor + NUM_MENU_ITEMS - 1) % NUM_MENU_ITEMS;
-            drawHomeScreen();
-        } else if(screenMode == 3){
-            cityIndex = (cityIndex + NUM_CITIES - 1) % NUM_CITIES;
-            scheduleWeatherFetchForCity(cityIndex);
+    handleWiFiLinkChange();
+    handleWeatherFetchResults();
+    handleSerialCommands();
+
+    // 割り込みで積まれたボタンイベントを古い順に処理する
+    // A/Cの連打・リピートは合計して、最後に1回だけ描き直す
+    bool interacted = false;
+    int step = 0;
+    InputEvent ev;
+    while(nextInputEvent(ev)){
+        if(ev.type == INPUT_RELEASE) continue;
+        if(ev.button == BUTTON_B && ev.type == INPUT_REPEAT) continue;    // 画面の出入りは繰り返さない
+        if(ev.button != BUTTON_B && ev.type == INPUT_LONG) continue;
+        if(!inputPending){
+            inputPending = true;
+            inputPendingUs = ev.us;
         }
-    }
-    
-    if(M5.BtnB.wasPressed()){
-        lastInteraction = now;
-        if(screenMode == -1){
-            screenMode = menuCursor;
-            switch(screenMode){
-                case 0: drawNormalScreen(); break;
-                case 1: drawGraphScreen(); break;
-                case 2: drawStatsScreen(); break;
-                case 3: drawWeatherScreenOptimized(cityIndex, true); break;
-                case 4: drawCompassScreen(); break;
-                case 5: drawCalendarScreen(); break;
-            }
+        interacted = true;
+        if(ev.button == BUTTON_B){
+            applyStep(step);
+            step = 0;
+            // 長押しは診断画面（押した時点で一度画面が切り替わっている）
+            if(ev.type == INPUT_LONG) screenMode = DIAG_SCREEN;
+            else screenMode = (screenMode == -1) ? menuCursor : -1;
+            enterScreen(currentScreen());
         } else {
-            screenMode = -1;
-            drawHomeScreen();
-        }
-    }
-    
-    if(M5.BtnC.wasPressed()){
-        lastInteraction = now;
-        if(screenMode == -1){
-            menuCursor = (menuCursor + 1) % NUM_MENU_ITEMS;
-            drawHomeScreen();
-        } else if(screenMode == 3){
-            cityIndex = (cityIndex + 1) % NUM_CITIES;
-            scheduleWeatherFetchForCity(cityIndex);
+            step += (ev.button == BUTTON_A) ? -1 : 1;
         }
     }
+    applyStep(step);
 
-    if(now - lastUpdate >= UPDATE_INTERVAL){
-        lastUpdate = now;
+    if(interacted) noteInteraction(now);
 
-        // 加速度センサーで揺さぶり検出
-        auto imu_update = M5.Imu.update();
-        if(imu_update){
-            auto data = M5.Imu.getImuData();
-            float accelMag = sqrt(data.accel.x * data.accel.x + 
-                                  data.accel.y * data.accel.y + 
-                                  data.accel.z * data.accel.z);
-            if(accelMag > 1.5 && idleModeActive){
-                isSurprised = true;
-                surpriseStartTime = millis();
-            }
-        }
+    // 計測は専用タスク。溜まっているサンプルを古い順に処理する
+    SensorSample sample;
+    while(nextSensorSample(sample)) handleSensorSample(sample);
 
-        int prevIndex = (dataIndex + MAX_DATA_POINTS - 1) % MAX_DATA_POINTS;
-        float temp = tempData[prevIndex] != 0.0f ? tempData[prevIndex] : 20.0f;
-        float hum  = humData[prevIndex] != 0.0f ? humData[prevIndex] : 50.0f;
-
-        if(bme.readTemperature() == bme.readTemperature()){
-            float t = bme.readTemperature();
-            float h = bme.readHumidity();
-            if(!isnan(t)) temp = t;
-            if(!isnan(h)) hum = h;
-        }
-        
-        int lux = analogRead(LIGHT_PIN); 
-        if(lux<0) lux=0; 
-        if(lux>LUX_MAX) lux=LUX_MAX;
-
-        bool ledOn = (lux < LIGHT_THRESHOLD);
-        digitalWrite(ledPin, ledOn ? HIGH : LOW);
-
-        tempData[dataIndex] = temp;
-        humData[dataIndex] = hum;
-        luxData[dataIndex] = lux;
-        dataIndex = (dataIndex + 1) % MAX_DATA_POINTS;
-
-        if(now - lastWeatherUpdate >= UPDATE_WEATHER_INTERVAL){
-            requestWeatherFetchNow(cityIndex);
-            lastWeatherUpdate = now;
-        }
-
-        if(!idleModeActive && screenMode == 0){
-            M5.Lcd.setTextSize(5);
-            M5.Lcd.fillRect(140,20,180,60,NORMAL_BG);
-            M5.Lcd.setCursor(140,20);
-            M5.Lcd.setTextColor((temp>=30)?RED:(temp<=20)?CYAN:GREEN,NORMAL_BG);
-            M5.Lcd.printf("%.1f C", temp);
-
-            M5.Lcd.fillRect(140,100,180,60,NORMAL_BG);
-            M5.Lcd.setCursor(140,100);
-            M5.Lcd.setTextColor((hum>=80)?PURPLE:(hum<=60)?BLUE:GREEN,NORMAL_BG);
-            M5.Lcd.printf("%.1f %%", hum);
-
-            int luxPercent = (int)((lux / (float)LUX_MAX) * 100.0f);
-            if(luxPercent > 100) luxPercent = 100;
-            M5.Lcd.fillRect(140,180,180,60,NORMAL_BG);
-            M5.Lcd.setCursor(140,180);
-            M5.Lcd.setTextColor((luxPercent>=80)?WHITE:(luxPercent<=10)?GRAY:YELLOW,NORMAL_BG);
-            M5.Lcd.printf("%d %%", luxPercent);
-        }
-        else if(!idleModeActive && screenMode == 1){
-            drawGraphScreen();
-        }
-        else if(!idleModeActive && screenMode == 3){
-            drawWeatherScreenOptimized(cityIndex, false);
-        }
-        else if(!idleModeActive && screenMode == 4){
-            drawCompassScreen();
-        }
-        else if(!idleModeActive && screenMode == 5){
-            drawCalendarScreen();
-        }
-
-        checkTempMessage();
-        String sym = weatherCache[cityIndex].valid ? weatherCache[cityIndex].symbol : String("UNK");
-        float tmpw = weatherCache[cityIndex].valid ? weatherCache[cityIndex].temp : 0.0f;
-        checkIdleFace(temp, hum, lux, tmpw, sym);
+    schedRun(millis());
+    syncCompassTask(millis());
+    uint32_t framesBefore = renderStats().frames;
+    {
+        PROF_SCOPE(PROF_RENDER);
+        renderPresent();
+    }
+    if(inputPending){
+        // 入力を反映したフレームを送り終えた時点までを記録する（変化が無ければ記録しない）
+        if(renderStats().frames != framesBefore) inputRecordLatency(inputPendingUs);
+        inputPending = false;
     }
+    if(replay.ended) finishReplay();
+
+    // 次の期限まで眠る（ボタン・サンプル到着で起きる）
+    // WiFiの状態遷移と天気の完了通知はポーリングなので、動いている間は細かく回し、眠りもしない
+    // トレース再生中もレコードの期限を見るために同じ間隔で回す
+    // 方位計タスクが回っている間はライトスリープしない（RTOSのtickが止まると読み出しが途切れる）
+    uint32_t wait = schedNextDelay(millis());
+    bool polling = weatherFetchPending() || ntpHoldsLink || wifiLinkState() != LINK_OFF || replay.active;
+    if(polling && wait > LINK_POLL_MS) wait = LINK_POLL_MS;
+    profStop(PROF_LOOP, loopStart);
+    powerIdle(wait, !polling && sensorsIdle() && !compassRunning());
 }
@@ -0,0 +1,117 @@
+// ==========================================
+// メモリの集計と判定
+// ==========================================
+
+#include "mem_stats.h"
+
+const char* const MEM_TAG_NAMES[NUM_MEM_TAGS] = {
+    "loop", "render", "log", "sensors", "weather", "other"
+};
+
+struct MemPoint {
+    uint32_t freeFloor;
+    uint32_t largestFloor;
+};
+
+static MemTagStats tags[NUM_MEM_TAGS];
+static MemPoint points[MEM_TREND_LEN];
+static int pointHead = 0;           // 次に書く位置
+static int pointCount = 0;
+
+static bool windowOpen = false;
+static uint32_t windowStart = 0;
+static MemPoint window;
+static MemTrend latest;
+
+void memCountAlloc(MemTag tag, size_t size, bool ok){
+    MemTagStats &t = tags[tag];
+    if(!ok){
+        t.failures++;
+        return;
+    }
+    t.allocs++;
+    t.bytes += size;
+}
+
+void memCountFree(MemTag tag){
+    tags[tag].frees++;
+}
+
+const MemTagStats& memTagStats(MemTag tag){
+    return tags[tag];
+}
+
+static void pushPoint(const MemPoint &p){
+    points[pointHead] = p;
+    pointHead = (pointHead + 1) % MEM_TREND_LEN;
+    if(pointCount < MEM_TREND_LEN) pointCount++;
+}
+
+void memAddSample(uint32_t now, uint32_t freeBytes, uint32_t largestBlock, uint32_t minFreeEver){
+    latest.freeBytes = freeBytes;
+    latest.largestBlock = largestBlock;
+    latest.minFreeEver = minFreeEver;
+
+    if(windowOpen && now - windowStart >= MEM_WINDOW_MS){
+        pushPoint(window);
+        windowOpen = false;
+    }
+    if(!windowOpen){
+        windowOpen = true;
+        windowStart = now;
+        window.freeFloor = freeBytes;
+        window.largestFloor = largestBlock;
+        return;
+    }
+    if(freeBytes < window.freeFloor) window.freeFloor = freeBytes;
+    if(largestBlock < window.largestFloor) window.largestFloor = largestBlock;
+}
+
+// 最小二乗の傾き（1点あたり） → バイト/時
+static int32_t slopePerHour(uint32_t MemPoint::*field){
+    int n = pointCount;
+    int first = (pointHead - n + MEM_TREND_LEN) % MEM_TREND_LEN;
+    float meanX = (n - 1) / 2.0f;
+    float meanY = 0;
+    for(int i=0;i<n;i++) meanY += points[(first + i) % MEM_TREND_LEN].*field;
+    meanY /= n;
+    float sxy = 0, sxx = 0;
+    for(int i=0;i<n;i++){
+        float dx = i - meanX;
+        sxy += dx * ((float)(points[(first + i) % MEM_TREND_LEN].*field) - meanY);
+        sxx += dx * dx;
+    }
+    if(sxx <= 0) return 0;
+    return (int32_t)(sxy / sxx * (3600000.0f / MEM_WINDOW_MS));
+}
+
+MemTrend memTrend(){
+    MemTrend t = latest;
+    t.points = pointCount;
+    if(pointCount >= 2){
+        t.freePerHour = slopePerHour(&MemPoint::freeFloor);
+        t.largestPerHour = slopePerHour(&MemPoint::largestFloor);
+    }
+    if(t.freeBytes > 0 && t.largestBlock <= t.freeBytes){
+        t.fragPermille = (uint16_t)(1000 - (uint64_t)t.largestBlock * 1000 / t.freeBytes);
+    }
+    return t;
+}
+
+uint8_t memCheck(const MemTrend &trend){
+    uint8_t flags = 0;
+    if(trend.minFreeEver > 0 && trend.minFreeEver < MEM_LOW_BYTES) flags |= MEM_CHECK_LOW;
+    if(trend.points < MEM_TREND_MIN_POINTS) return flags;
+    if(trend.freePerHour < -MEM_LEAK_BYTES_PER_HOUR) flags |= MEM_CHECK_LEAK;
+    if(trend.largestPerHour < -MEM_LEAK_BYTES_PER_HOUR &&
+       trend.largestPerHour < trend.freePerHour - MEM_LEAK_BYTES_PER_HOUR) flags |= MEM_CHECK_FRAG;
+    return flags;
+}
+
+void memStatsReset(){
+    for(int i=0;i<NUM_MEM_TAGS;i++) tags[i] = MemTagStats();
+    pointHead = 0;
+    pointCount = 0;
+    windowOpen = false;
+    latest = MemTrend();
+}
@@ -0,0 +1,171 @@
+// ==========================================
+// メモリ・スタックの監視
+// ==========================================
+
+#include "mem_telemetry.h"
+
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static MemTaskInfo tasks[MEM_MAX_TASKS];
+static int taskCount = 0;
+static uint32_t samples = 0;
+
+#ifdef MEM_HOOKS
+// タスクごとの現在のタグ（MEM_TAG_SCOPEで付け替える）
+static volatile MemTag activeTag[MEM_MAX_TASKS];
+static portMUX_TYPE countMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+void memWatchTask(const char* name, TaskHandle_t handle, MemTag tag){
+    if(taskCount >= MEM_MAX_TASKS) return;
+    MemTaskInfo &t = tasks[taskCount];
+    t.name = name;
+    t.handle = handle ? handle : xTaskGetCurrentTaskHandle();
+    t.tag = tag;
+    t.stackFree = uxTaskGetStackHighWaterMark(t.handle);
+#ifdef MEM_HOOKS
+    activeTag[taskCount] = tag;
+#endif
+    taskCount++;     // 要素を書いてから増やす（フックは件数までしか見ない）
+}
+
+void memSample(){
+    for(int i=0;i<taskCount;i++){
+        tasks[i].stackFree = uxTaskGetStackHighWaterMark(tasks[i].handle);
+    }
+    memAddSample(millis(),
+                 heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                 heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                 heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+    samples++;
+}
+
+int memTaskCount(){
+    return taskCount;
+}
+
+const MemTaskInfo& memTaskInfo(int i){
+    return tasks[i];
+}
+
+uint8_t memHealth(){
+    uint8_t flags = memCheck(memTrend());
+    for(int i=0;i<taskCount;i++){
+        if(tasks[i].stackFree < MEM_STACK_MARGIN) flags |= MEM_CHECK_STACK;
+    }
+    return flags;
+}
+
+uint32_t memVersion(){
+    return samples;
+}
+
+void memDump(Print &out){
+    MemTrend t = memTrend();
+    uint8_t flags = memHealth();
+    out.printf("# heap free=%lu largest=%lu min=%lu frag=%u permille\n",
+               (unsigned long)t.freeBytes, (unsigned long)t.largestBlock,
+               (unsigned long)t.minFreeEver, t.fragPermille);
+    out.printf("# trend points=%d free_per_h=%ld largest_per_h=%ld\n",
+               t.points, (long)t.freePerHour, (long)t.largestPerHour);
+    out.printf("# checks=%s%s%s%s%s\n", flags ? "" : "ok",
+               (flags & MEM_CHECK_LEAK) ? " leak" : "", (flags & MEM_CHECK_FRAG) ? " frag" : "",
+               (flags & MEM_CHECK_LOW) ? " low" : "", (flags & MEM_CHECK_STACK) ? " stack" : "");
+#ifdef MEM_HOOKS
+    out.println("tag,allocs,frees,failures,bytes");
+    for(int i=0;i<NUM_MEM_TAGS;i++){
+        const MemTagStats &s = memTagStats((MemTag)i);
+        out.printf("%s,%lu,%lu,%lu,%lu\n", MEM_TAG_NAMES[i], (unsigned long)s.allocs,
+                   (unsigned long)s.frees, (unsigned long)s.failures, (unsigned long)s.bytes);
+    }
+#endif
+    out.println("task,stack_free");
+    for(int i=0;i<taskCount;i++){
+        out.printf("%s,%lu\n", tasks[i].name, (unsigned long)tasks[i].stackFree);
+    }
+}
+
+#ifdef MEM_HOOKS
+
+// 登録していないタスク・割り込み・スケジューラ開始前はMEM_TAG_OTHER
+static int findTask(TaskHandle_t handle){
+    for(int i=0;i<taskCount;i++){
+        if(tasks[i].handle == handle) return i;
+    }
+    return -1;
+}
+
+static MemTag currentTag(){
+    if(xPortInIsrContext() || xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) return MEM_TAG_OTHER;
+    int i = findTask(xTaskGetCurrentTaskHandle());
+    return i < 0 ? MEM_TAG_OTHER : activeTag[i];
+}
+
+MemTagScope::MemTagScope(MemTag tag) : task(findTask(xTaskGetCurrentTaskHandle())), saved(MEM_TAG_OTHER) {
+    if(task < 0) return;
+    saved = activeTag[task];
+    activeTag[task] = tag;
+}
+
+MemTagScope::~MemTagScope(){
+    if(task >= 0) activeTag[task] = saved;
+}
+
+static void countAlloc(size_t size, bool ok){
+    MemTag tag = currentTag();
+    portENTER_CRITICAL_SAFE(&countMux);
+    memCountAlloc(tag, size, ok);
+    portEXIT_CRITICAL_SAFE(&countMux);
+}
+
+static void countFree(){
+    MemTag tag = currentTag();
+    portENTER_CRITICAL_SAFE(&countMux);
+    memCountFree(tag);
+    portEXIT_CRITICAL_SAFE(&countMux);
+}
+
+// -Wl,--wrap=malloc などでリンカがこちらへ回す
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size){
+    void* p = __real_malloc(size);
+    countAlloc(size, p != nullptr);
+    return p;
+}
+
+void* __wrap_calloc(size_t n, size_t size){
+    void* p = __real_calloc(n, size);
+    countAlloc(n * size, p != nullptr);
+    return p;
+}
+
+// 移動した時は確保1回 + 解放1回として数える
+void* __wrap_realloc(void* ptr, size_t size){
+    void* p = __real_realloc(ptr, size);
+    if(!ptr){
+        countAlloc(size, p != nullptr);
+    } else if(size == 0){
+        countFree();
+    } else if(!p){
+        countAlloc(size, false);
+    } else if(p != ptr){
+        countAlloc(size, true);
+        countFree();
+    }
+    return p;
+}
+
+void __wrap_free(void* ptr){
+    if(ptr) countFree();
+    __real_free(ptr);
+}
+}
+
+#endif
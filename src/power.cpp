@@ -0,0 +1,69 @@
+// ==========================================
+// 省電力の待機
+// ==========================================
+
+#include "power.h"
+#include "input_queue.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_timer.h>
+#ifdef LIGHT_SLEEP
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#endif
+
+static const uint8_t BUTTON_PINS[] = {BTN_A_PIN, BTN_B_PIN, BTN_C_PIN};
+
+static PowerStats stats;
+
+#ifdef LIGHT_SLEEP
+static void lightSleep(uint32_t ms){
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    // 押されている間LOWなのでレベルで起こす。レベル割り込みが連発しないよう割り込みは止めておき、
+    // 起きたら元のエッジ割り込みに戻す（眠っている間の押下は入力キューがピンを読み直して拾う）
+    for(uint8_t pin : BUTTON_PINS){
+        gpio_intr_disable((gpio_num_t)pin);
+        gpio_wakeup_enable((gpio_num_t)pin, GPIO_INTR_LOW_LEVEL);
+    }
+    esp_sleep_enable_gpio_wakeup();
+
+    uint64_t start = esp_timer_get_time();
+    esp_light_sleep_start();
+    stats.sleepUs += esp_timer_get_time() - start;
+    stats.lightSleeps++;
+
+    for(uint8_t pin : BUTTON_PINS){
+        gpio_wakeup_disable((gpio_num_t)pin);
+        gpio_set_intr_type((gpio_num_t)pin, GPIO_INTR_ANYEDGE);
+        gpio_intr_enable((gpio_num_t)pin);
+    }
+    if(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) stats.gpioWakes++;
+}
+#endif
+
+void powerIdle(uint32_t waitMs, bool allowSleep){
+    bool input = inputActive();
+    if(waitMs > POWER_MAX_WAIT_MS) waitMs = POWER_MAX_WAIT_MS;
+    if(input && waitMs > INPUT_POLL_MS) waitMs = INPUT_POLL_MS;
+    if(waitMs == 0) return;
+
+    stats.waits++;
+    uint64_t start = esp_timer_get_time();
+#ifdef LIGHT_SLEEP
+    if(allowSleep && !input && waitMs >= LIGHT_SLEEP_MIN_MS){
+        // 眠る直前に届いた通知は捨てずに先に処理させる
+        if(ulTaskNotifyTake(pdTRUE, 0) == 0) lightSleep(waitMs);
+        stats.idleUs += esp_timer_get_time() - start;
+        return;
+    }
+#else
+    (void)allowSleep;
+#endif
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+    stats.idleUs += esp_timer_get_time() - start;
+}
+
+const PowerStats& powerStats(){
+    return stats;
+}
@@ -0,0 +1,117 @@
+// ==========================================
+// 組み込みプロファイラ
+// ==========================================
+
+#include "profiler.h"
+
+const char* const PROF_PROBE_NAMES[NUM_PROF_PROBES] = {
+    "loop", "render", "scr_home", "scr_sensor", "scr_graph", "scr_stats", "scr_weather",
+    "scr_compass", "scr_calendar", "scr_diag", "idle_face", "sample", "bme", "light", "imu",
+    "compass", "http", "json"
+};
+
+constexpr int PROF_MIN_OCTAVE = 8;      // 256サイクル未満は最初のビン
+
+#ifndef NO_PROFILER
+
+struct ProbeData {
+    uint32_t count;
+    uint64_t totalCycles;
+    uint32_t maxCycles;
+    uint32_t hist[PROF_BUCKETS];
+};
+
+static ProbeData probes[NUM_PROF_PROBES];
+
+static int bucketOf(uint32_t cycles){
+    if(cycles < (1u << PROF_MIN_OCTAVE)) return 0;
+    int octave = 31 - __builtin_clz(cycles);
+    int half = (cycles >> (octave - 1)) & 1;
+    int b = (octave - PROF_MIN_OCTAVE) * 2 + half;
+    return b < PROF_BUCKETS ? b : PROF_BUCKETS - 1;
+}
+
+static uint64_t bucketUpper(int b){
+    int octave = b / 2 + PROF_MIN_OCTAVE;
+    uint64_t base = 1ull << octave;
+    return (b & 1) ? base * 2 : base + base / 2;
+}
+
+void profRecord(ProfProbe probe, uint32_t cycles){
+    ProbeData &d = probes[probe];
+    d.count++;
+    d.totalCycles += cycles;
+    if(cycles > d.maxCycles) d.maxCycles = cycles;
+    d.hist[bucketOf(cycles)]++;
+}
+
+static uint32_t percentileCycles(const ProbeData &d, uint32_t permille){
+    uint32_t target = (uint32_t)(((uint64_t)d.count * permille + 999) / 1000);
+    uint32_t seen = 0;
+    for(int b=0;b<PROF_BUCKETS;b++){
+        seen += d.hist[b];
+        if(seen >= target){
+            uint64_t upper = bucketUpper(b);
+            // 最大値より上のビン端は出さない
+            return upper < d.maxCycles ? (uint32_t)upper : d.maxCycles;
+        }
+    }
+    return d.maxCycles;
+}
+
+void profReset(){
+    memset(probes, 0, sizeof(probes));
+}
+
+ProfSummary profSummary(ProfProbe probe){
+    ProfSummary s;
+    ProbeData d = probes[probe];     // 記録中のタスクと競合しても表示が少しずれるだけ
+    if(d.count == 0) return s;
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    s.count = d.count;
+    s.meanUs = (uint32_t)(d.totalCycles / d.count / mhz);
+    s.p50Us = percentileCycles(d, 500) / mhz;
+    s.p99Us = percentileCycles(d, 990) / mhz;
+    s.maxUs = d.maxCycles / mhz;
+    return s;
+}
+
+uint32_t profVersion(){
+    uint32_t v = 0;
+    for(int i=0;i<NUM_PROF_PROBES;i++) v += probes[i].count;
+    return v;
+}
+
+#else
+
+void profReset(){}
+ProfSummary profSummary(ProfProbe){ return ProfSummary(); }
+uint32_t profVersion(){ return 0; }
+
+#endif
+
+void profDump(Print &out, bool json){
+#ifdef NO_PROFILER
+    out.println(json ? "{\"profiler\":\"off\"}" : "# profiler off");
+    return;
+#endif
+    if(json) out.print("{\"probes\":[");
+    else out.println("probe,count,mean_us,p50_us,p99_us,max_us");
+    bool first = true;
+    for(int i=0;i<NUM_PROF_PROBES;i++){
+        ProfSummary s = profSummary((ProfProbe)i);
+        if(s.count == 0) continue;
+        if(json){
+            out.printf("%s{\"p\":\"%s\",\"n\":%lu,\"mean\":%lu,\"p50\":%lu,\"p99\":%lu,\"max\":%lu}",
+                       first ? "" : ",", PROF_PROBE_NAMES[i], (unsigned long)s.count,
+                       (unsigned long)s.meanUs, (unsigned long)s.p50Us, (unsigned long)s.p99Us,
+                       (unsigned long)s.maxUs);
+        } else {
+            out.printf("%s,%lu,%lu,%lu,%lu,%lu\n", PROF_PROBE_NAMES[i], (unsigned long)s.count,
+                       (unsigned long)s.meanUs, (unsigned long)s.p50Us, (unsigned long)s.p99Us,
+                       (unsigned long)s.maxUs);
+        }
+        first = false;
+    }
+    if(json) out.println("]}");
+}
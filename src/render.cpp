@@ -0,0 +1,53 @@
+// ==========================================
+// オフスクリーン描画レイヤー
+// ==========================================
+
+#include "render.h"
+#include "mem_telemetry.h"
+
+M5Canvas canvas(&M5.Lcd);
+
+static bool ready = false;
+static RenderStats stats;
+
+bool renderBegin(){
+    MEM_TAG_SCOPE(MEM_TAG_RENDER);
+    canvas.setColorDepth(4);
+    canvas.setPsram(false);
+    if(!canvas.createSprite(SCREEN_W, SCREEN_H)){
+        Serial.println("render: sprite alloc failed");
+        return false;
+    }
+    canvas.createPalette();
+    canvas.setBaseColor(NORMAL_BG);     // scroll()で空いた部分の色
+    for(int i=0;i<16;i++){
+        const uint8_t* rgb = PALETTE_RGB[i < PALETTE_USED ? i : 0];
+        canvas.setPaletteColor(i, rgb[0], rgb[1], rgb[2]);
+    }
+
+    frameDiffBegin();
+    M5.Lcd.setSwapBytes(false);
+    ready = true;
+    return true;
+}
+
+void renderPresent(){
+    if(!ready) return;
+    uint32_t t0 = micros();
+    uint32_t bytes = frameDiffPresent((const uint8_t*)canvas.getBuffer());
+    if(!bytes) return;
+
+    uint32_t elapsed = micros() - t0;
+    stats.frames++;
+    stats.lastBytes = bytes;
+    stats.lastFrameUs = elapsed;
+    stats.totalBytes += bytes;
+    if(elapsed > stats.maxFrameUs) stats.maxFrameUs = elapsed;
+#ifdef RENDER_STATS_LOG
+    Serial.printf("render: %lu bytes %lu us\n", (unsigned long)bytes, (unsigned long)elapsed);
+#endif
+}
+
+const RenderStats& renderStats(){
+    return stats;
+}
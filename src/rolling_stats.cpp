@@ -0,0 +1,74 @@
+// ==========================================
+// ローリング統計
+// ==========================================
+
+#include "rolling_stats.h"
+
+const char* const STATS_WINDOW_NAMES[NUM_STATS_WINDOWS] = {"1m", "1h", "24h"};
+
+void StatsBucket::add(float v){
+    if(count == 0){
+        min = max = v;
+    } else {
+        if(v < min) min = v;
+        if(v > max) max = v;
+    }
+    count++;
+    float delta = v - mean;
+    mean += delta / count;
+    m2 += delta * (v - mean);
+}
+
+// Chanらの並列版Welford
+void StatsBucket::merge(const StatsBucket &b){
+    if(b.count == 0) return;
+    if(count == 0){
+        *this = b;
+        return;
+    }
+    uint32_t n = count + b.count;
+    float delta = b.mean - mean;
+    mean += delta * b.count / n;
+    m2 += b.m2 + delta * delta * ((float)count * b.count / n);
+    if(b.min < min) min = b.min;
+    if(b.max > max) max = b.max;
+    count = n;
+}
+
+void StatsBucket::remove(const StatsBucket &b){
+    if(b.count == 0) return;
+    if(b.count >= count){
+        clear();
+        return;
+    }
+    uint32_t n = count - b.count;
+    float restMean = (mean * count - b.mean * b.count) / n;
+    float delta = b.mean - restMean;
+    m2 -= b.m2 + delta * delta * ((float)n * b.count / count);
+    if(m2 < 0.0f) m2 = 0.0f;
+    mean = restMean;
+    count = n;
+}
+
+RollingStats::RollingStats()
+    : minute(1000UL), hour(60UL * 1000UL), day(30UL * 60UL * 1000UL) {}
+
+void RollingStats::reset(){
+    minute.reset();
+    hour.reset();
+    day.reset();
+}
+
+void RollingStats::add(float v, uint32_t now){
+    minute.add(v, now);
+    hour.add(v, now);
+    day.add(v, now);
+}
+
+RollingSummary RollingStats::summary(StatsWindow w, uint32_t now) const {
+    switch(w){
+        case STATS_1HOUR:  return hour.summary(now);
+        case STATS_24HOUR: return day.summary(now);
+        default:           return minute.summary(now);
+    }
+}
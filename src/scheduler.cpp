@@ -0,0 +1,138 @@
+// ==========================================
+// 協調スケジューラ
+// ==========================================
+
+#include "scheduler.h"
+
+struct SchedJob {
+    SchedFn fn = nullptr;
+    uint32_t due = 0;
+    uint32_t period = 0;
+    uint32_t seq = 0;       // 同じ期限の順序付け
+    int heapPos = -1;       // ヒープ内の位置（-1なら停止中）
+};
+
+static SchedJob jobs[SCHED_MAX_JOBS];
+static int jobCount = 0;
+static SchedId heap[SCHED_MAX_JOBS];
+static int heapSize = 0;
+static uint32_t seqCounter = 0;
+
+// millis()の桁あふれをまたいでも比較できるよう差の符号で見る
+static bool earlier(SchedId a, SchedId b){
+    int32_t d = (int32_t)(jobs[a].due - jobs[b].due);
+    if(d != 0) return d < 0;
+    return (int32_t)(jobs[a].seq - jobs[b].seq) < 0;
+}
+
+static void place(int pos, SchedId id){
+    heap[pos] = id;
+    jobs[id].heapPos = pos;
+}
+
+static void siftUp(int pos){
+    SchedId id = heap[pos];
+    while(pos > 0){
+        int parent = (pos - 1) / 2;
+        if(!earlier(id, heap[parent])) break;
+        place(pos, heap[parent]);
+        pos = parent;
+    }
+    place(pos, id);
+}
+
+static void siftDown(int pos){
+    SchedId id = heap[pos];
+    for(;;){
+        int child = pos * 2 + 1;
+        if(child >= heapSize) break;
+        if(child + 1 < heapSize && earlier(heap[child + 1], heap[child])) child++;
+        if(!earlier(heap[child], id)) break;
+        place(pos, heap[child]);
+        pos = child;
+    }
+    place(pos, id);
+}
+
+static void heapRemove(SchedId id){
+    int pos = jobs[id].heapPos;
+    if(pos < 0) return;
+    jobs[id].heapPos = -1;
+    heapSize--;
+    if(pos == heapSize) return;
+    // 末尾を空いた位置へ移し、上下どちらかへずらす
+    SchedId moved = heap[heapSize];
+    place(pos, moved);
+    siftDown(pos);
+    siftUp(jobs[moved].heapPos);
+}
+
+static void heapInsert(SchedId id){
+    place(heapSize, id);
+    heapSize++;
+    siftUp(heapSize - 1);
+}
+
+static bool validId(SchedId id){
+    return id >= 0 && id < jobCount;
+}
+
+void schedReset(){
+    for(int i=0;i<SCHED_MAX_JOBS;i++) jobs[i] = SchedJob();
+    jobCount = 0;
+    heapSize = 0;
+    seqCounter = 0;
+}
+
+SchedId schedCreate(SchedFn fn, uint32_t periodMs){
+    if(jobCount >= SCHED_MAX_JOBS || !fn) return SCHED_NONE;
+    SchedId id = jobCount++;
+    jobs[id].fn = fn;
+    jobs[id].period = periodMs;
+    return id;
+}
+
+void schedStart(SchedId id, uint32_t now, uint32_t delayMs){
+    if(!validId(id)) return;
+    heapRemove(id);
+    jobs[id].due = now + delayMs;
+    jobs[id].seq = seqCounter++;
+    heapInsert(id);
+}
+
+void schedStop(SchedId id){
+    if(validId(id)) heapRemove(id);
+}
+
+bool schedActive(SchedId id){
+    return validId(id) && jobs[id].heapPos >= 0;
+}
+
+void schedSetPeriod(SchedId id, uint32_t periodMs){
+    if(validId(id)) jobs[id].period = periodMs;
+}
+
+uint32_t schedRun(uint32_t now){
+    while(heapSize > 0){
+        SchedId id = heap[0];
+        SchedJob &job = jobs[id];
+        if((int32_t)(now - job.due) < 0) break;
+
+        heapRemove(id);
+        if(job.period){
+            // 位相を保って次へ。大きく遅れた時は追いつこうとせず今から1周期後
+            job.due += job.period;
+            if((int32_t)(now - job.due) >= 0) job.due = now + job.period;
+            job.seq = seqCounter++;
+            heapInsert(id);
+        }
+        job.fn();
+    }
+    return schedNextDelay(now);
+}
+
+uint32_t schedNextDelay(uint32_t now){
+    if(heapSize == 0) return SCHED_IDLE_FOREVER;
+    int32_t d = (int32_t)(jobs[heap[0]].due - now);
+    return d > 0 ? (uint32_t)d : 0;
+}
@@ -0,0 +1,510 @@
+// ==========================================
+// 計測ログ（ファイルはhal経由。実機はLittleFS）
+// ==========================================
+
+#include "sensor_log.h"
+#include "history_store.h"
+#include "hal.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef ARDUINO
+#include "mem_telemetry.h"
+#else
+#define MEM_TAG_SCOPE(tag) do {} while(0)      // PCは1スレッドなので付け替えない
+#endif
+
+#define LOG_DIR "/log"
+
+constexpr uint8_t LOG_VERSION = 2;          // 2: 気圧のチャンネルを追加
+constexpr size_t LOG_PAGE_BYTES = 256;          // フラッシュの1ページ
+
+// 固定長なので n件目の位置は n*sizeof で決まる（索引ファイルは持たない）
+struct LogRecord {
+    uint32_t epoch;         // 0 = 時刻未同期
+    uint8_t tier;
+    uint8_t version;
+    uint16_t crc;           // crc=0としてレコード全体を計算
+    HistBucket bucket;
+};
+static_assert(sizeof(LogRecord) == 32, "LogRecord layout changed");
+
+constexpr int LOG_MAX_BATCH = LOG_PAGE_BYTES / sizeof(LogRecord);
+
+// 1秒段の圧縮ブロックは可変長。ヘッダーの後にブロック本体が続く
+struct BlockRecordHeader {
+    uint16_t length;        // ブロック本体のバイト数
+    uint16_t crc;           // ブロック本体のCRC
+    uint32_t epochOffset;   // ブロック内の時刻(秒) + これ = UNIX時刻。0 = 未同期
+};
+static_assert(sizeof(BlockRecordHeader) == 8, "BlockRecordHeader layout changed");
+
+// 1分段: 16KB x 3 = 約1.1日分、1時間段: 4KB x 3 = 約16日分
+constexpr uint32_t LOG_MIN_SEGMENT_BYTES = 16384;
+constexpr uint32_t LOG_HOUR_SEGMENT_BYTES = 4096;
+constexpr int LOG_SEGMENTS = 3;
+// 1秒段: 7日分。模擬センサーの毎秒読み出しで4チャンネル約284KB/日（test_series_codec）なので290KB/日で見積もる
+// 回転で一番古いセグメントを消すので、残るのは満杯のセグメント LOG_SEC_SEGMENTS - 1 個（64KB x 33 = 約2.1MB）
+constexpr uint32_t LOG_SEC_SEGMENT_BYTES = 65536;
+constexpr uint32_t LOG_SEC_DAYS = 7;
+constexpr uint32_t LOG_SEC_BYTES_PER_DAY = 290 * 1024;
+constexpr int LOG_SEC_SEGMENTS = (LOG_SEC_DAYS * LOG_SEC_BYTES_PER_DAY + LOG_SEC_SEGMENT_BYTES - 1) / LOG_SEC_SEGMENT_BYTES + 1;
+constexpr int LOG_TAIL_BLOCKS = HIST_SEC_BLOCKS;
+// 時刻が分からないまま起動した時は、分かるまで書かずに待つ（分かれば今までの点に遡って時刻を付けられる）
+// 1秒段のRAM（約30分）から落ちる前に諦めて、時刻なしで書く
+constexpr uint32_t LOG_UNSYNCED_HOLD_MS = 600000;
+
+static SensorLogStats stats;
+
+// CRC-16/CCITT
+static uint16_t crc16(const uint8_t* data, size_t len){
+    uint16_t crc = 0xFFFF;
+    for(size_t i=0;i<len;i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for(int b=0;b<8;b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t recordCrc(const LogRecord &r){
+    LogRecord tmp = r;
+    tmp.crc = 0;
+    return crc16((const uint8_t*)&tmp, sizeof(tmp));
+}
+
+static bool recordValid(const LogRecord &r){
+    return r.version == LOG_VERSION && r.tier < NUM_HIST_TIERS && r.crc == recordCrc(r);
+}
+
+// "<tag><16進の通し番号>.bin" を古い順に並べたセグメント列
+class SegmentLog {
+public:
+    SegmentLog(char tag, uint32_t segmentBytes, int maxSegments, int batch)
+        : tag(tag), segBytes(segmentBytes),
+          maxSegments(maxSegments), batch(std::min(batch, LOG_MAX_BATCH)) {}
+
+    void begin(){
+        haveSeg = false;
+        pendingCount = 0;
+
+        HalFile dir = halFsOpen(LOG_DIR);
+        if(!dir) return;
+        for(HalFile f = dir.openNextFile(); f; f = dir.openNextFile()){
+            const char* name = strrchr(f.name(), '/');
+            name = name ? name + 1 : f.name();
+            if(name[0] != tag) continue;
+            char* end;
+            uint32_t id = strtoul(name + 1, &end, 16);
+            if(strcmp(end, ".bin") != 0) continue;
+            if(!haveSeg || id < firstSeg) firstSeg = id;
+            if(!haveSeg || id > lastSeg) lastSeg = id;
+            haveSeg = true;
+        }
+        dir.close();
+        if(!haveSeg) return;
+
+        // 書きかけで切れたセグメントには追記しない（レコード境界がずれる）
+        lastBytes = segmentBytesOf(lastSeg);
+        if(lastBytes % sizeof(LogRecord) != 0) lastBytes = segBytes;
+    }
+
+    // 可変長ブロック用。途中で切れたブロックがあれば次は新しいセグメントへ
+    void beginBlocks(){
+        begin();
+        if(!haveSeg) return;
+        lastBytes = segmentBytesOf(lastSeg);
+        if(walkBlocks(lastSeg, [](uint32_t, uint16_t){}) != lastBytes) lastBytes = segBytes;
+    }
+
+    void append(const LogRecord &r){
+        pending[pendingCount++] = r;
+        if(pendingCount >= batch) flush();
+    }
+
+    void flush(){
+        int done = 0;
+        while(done < pendingCount){
+            if(!haveSeg || lastBytes + sizeof(LogRecord) > segBytes) rotate();
+            int n = std::min((uint32_t)(pendingCount - done), (uint32_t)((segBytes - lastBytes) / sizeof(LogRecord)));
+
+            char path[32];
+            segmentPath(lastSeg, path, sizeof(path));
+            HalFile f = halFsOpen(path, FILE_APPEND);
+            if(!f) break;
+            size_t bytes = n * sizeof(LogRecord);
+            size_t written = f.write((const uint8_t*)&pending[done], bytes);
+            f.close();
+            stats.flushes++;
+            if(written != bytes){
+                lastBytes = segBytes;       // 次は新しいセグメントから
+                break;
+            }
+            lastBytes += bytes;
+            done += n;
+        }
+        pendingCount = 0;
+    }
+
+    // ブロックは1つで1ページ程度なのでまとめずにすぐ書く
+    void appendBlock(const BlockRecordHeader &h, const uint8_t* data){
+        size_t bytes = sizeof(h) + h.length;
+        if(!haveSeg || lastBytes + bytes > segBytes) rotate();
+
+        char path[32];
+        segmentPath(lastSeg, path, sizeof(path));
+        HalFile f = halFsOpen(path, FILE_APPEND);
+        if(!f) return;
+        size_t written = f.write((const uint8_t*)&h, sizeof(h));
+        written += f.write(data, h.length);
+        f.close();
+        stats.flushes++;
+        lastBytes = (written == bytes) ? lastBytes + bytes : segBytes;
+    }
+
+    // 末尾からn個のブロックを古い順にfnへ。本体を読むのは最後のn個だけ
+    uint32_t readTailBlocks(int n, void (*fn)(const BlockRecordHeader&, const uint8_t*)){
+        if(!haveSeg || n <= 0) return 0;
+
+        // ヘッダーだけ辿って末尾n個の位置を覚える（最新セグメントで足りなければ1つ前から）
+        BlockRef refs[LOG_TAIL_BLOCKS];
+        n = std::min(n, LOG_TAIL_BLOCKS);
+        int found = 0;
+        uint32_t seg = lastSeg;
+        if(seg != firstSeg && countBlocks(seg) < (uint32_t)n) seg--;
+        for(;seg <= lastSeg;seg++){
+            walkBlocks(seg, [&](uint32_t offset, uint16_t length){
+                refs[found % n] = { seg, offset, length };
+                found++;
+            });
+        }
+
+        uint32_t delivered = 0;
+        int start = found > n ? found - n : 0;
+        uint8_t data[SERIES_BLOCK_BYTES];
+        for(int i=start;i<found;i++){
+            const BlockRef &r = refs[i % n];
+            char path[32];
+            segmentPath(r.seg, path, sizeof(path));
+            HalFile f = halFsOpen(path, FILE_READ);
+            if(!f) continue;
+            BlockRecordHeader h;
+            f.seek(r.offset);
+            bool ok = f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) && h.length <= sizeof(data)
+                      && f.read(data, h.length) == h.length && h.crc == crc16(data, h.length);
+            f.close();
+            if(ok){
+                fn(h, data);
+                delivered++;
+            } else {
+                stats.crcErrors++;
+            }
+        }
+        return delivered;
+    }
+
+    // 末尾からn件ぶん遡った位置から順に読む。CRCが合ったレコード数を返す
+    uint32_t readTail(uint32_t n, void (*fn)(const LogRecord&)){
+        if(!haveSeg || n == 0) return 0;
+
+        uint32_t seg = lastSeg;
+        uint32_t startIdx = 0;
+        for(;;){
+            uint32_t count = segmentRecords(seg);
+            if(count >= n){
+                startIdx = count - n;
+                break;
+            }
+            n -= count;
+            if(seg == firstSeg) break;
+            seg--;
+        }
+
+        uint32_t delivered = 0;
+        LogRecord buf[LOG_MAX_BATCH];
+        for(;seg <= lastSeg;seg++, startIdx = 0){
+            char path[32];
+            segmentPath(seg, path, sizeof(path));
+            HalFile f = halFsOpen(path, FILE_READ);
+            if(!f) continue;
+            f.seek(startIdx * sizeof(LogRecord));
+            for(;;){
+                size_t got = f.read((uint8_t*)buf, sizeof(buf)) / sizeof(LogRecord);
+                if(got == 0) break;
+                for(size_t i=0;i<got;i++){
+                    if(recordValid(buf[i])){
+                        fn(buf[i]);
+                        delivered++;
+                    } else {
+                        stats.crcErrors++;
+                    }
+                }
+            }
+            f.close();
+        }
+        return delivered;
+    }
+
+private:
+    struct BlockRef {
+        uint32_t seg;
+        uint32_t offset;
+        uint16_t length;
+    };
+
+    uint32_t countBlocks(uint32_t id){
+        int count = 0;
+        walkBlocks(id, [&](uint32_t, uint16_t){ count++; });
+        return count;
+    }
+
+    // ヘッダーの長さで次のブロックへ飛びながら数える。正しく辿れた終端のバイト位置を返す
+    template<typename Fn>
+    uint32_t walkBlocks(uint32_t id, Fn fn){
+        char path[32];
+        segmentPath(id, path, sizeof(path));
+        HalFile f = halFsOpen(path, FILE_READ);
+        if(!f) return 0;
+        uint32_t size = f.size();
+        uint32_t offset = 0;
+        BlockRecordHeader h;
+        while(offset + sizeof(h) <= size){
+            f.seek(offset);
+            if(f.read((uint8_t*)&h, sizeof(h)) != sizeof(h)) break;
+            if(h.length > SERIES_BLOCK_BYTES || offset + sizeof(h) + h.length > size) break;
+            fn(offset, h.length);
+            offset += sizeof(h) + h.length;
+        }
+        f.close();
+        return offset;
+    }
+
+    void segmentPath(uint32_t id, char* out, size_t len){
+        snprintf(out, len, LOG_DIR "/%c%08lx.bin", tag, (unsigned long)id);
+    }
+
+    size_t segmentBytesOf(uint32_t id){
+        char path[32];
+        segmentPath(id, path, sizeof(path));
+        HalFile f = halFsOpen(path, FILE_READ);
+        if(!f) return 0;
+        size_t size = f.size();
+        f.close();
+        return size;
+    }
+
+    uint32_t segmentRecords(uint32_t id){
+        return segmentBytesOf(id) / sizeof(LogRecord);
+    }
+
+    void rotate(){
+        if(haveSeg){
+            lastSeg++;
+        } else {
+            firstSeg = lastSeg = 0;
+            haveSeg = true;
+        }
+        lastBytes = 0;
+        while(lastSeg - firstSeg + 1 > (uint32_t)maxSegments){
+            char path[32];
+            segmentPath(firstSeg, path, sizeof(path));
+            halFsRemove(path);
+            firstSeg++;
+        }
+    }
+
+    char tag;
+    uint32_t segBytes;
+    int maxSegments;
+    int batch;
+    bool haveSeg = false;
+    uint32_t firstSeg = 0;
+    uint32_t lastSeg = 0;
+    uint32_t lastBytes = 0;     // lastSegの大きさ
+    LogRecord pending[LOG_MAX_BATCH];
+    int pendingCount = 0;
+};
+
+// 1分段は1ページ分（8件 = 8分）まとめて書く。1時間段は1件ずつ
+static SegmentLog minuteLog('m', LOG_MIN_SEGMENT_BYTES, LOG_SEGMENTS, LOG_MAX_BATCH);
+static SegmentLog hourLog('h', LOG_HOUR_SEGMENT_BYTES, LOG_SEGMENTS, 1);
+static SegmentLog secLog('x', LOG_SEC_SEGMENT_BYTES, LOG_SEC_SEGMENTS, 1);
+static uint32_t loggedCount[NUM_HIST_TIERS];
+static uint32_t loggedSecBlocks = 0;
+static bool logReady = false;
+
+static HistTier restoreTier;
+static int restoreSlots;
+static uint32_t restorePrevEpoch;
+static uint32_t restoreSecOffset;      // 今の起動の 1秒段の時刻 + これ = UNIX時刻。0 = 未同期
+
+// 時刻が分からずに欠測1点で区切った所。時刻が分かったら残りの空白を差し込む
+struct PendingGap {
+    uint32_t lastEpoch;         // 区切りの前の最後の記録の時刻。0 = 無し
+    uint32_t appendedAtBoot;    // 区切りを置いた時の追加数（そこから後に足した点の手前に入れる）
+    int slots;
+};
+static PendingGap pendingGaps[NUM_HIST_TIERS];
+static bool bootUnsynced = false;
+static uint32_t beginMs = 0;
+
+static void restoreMissing(uint32_t n){
+    HistBucket missing;
+    for(int c=0;c<NUM_HIST_CHANNELS;c++) missing.ch[c] = { HIST_MISSING, HIST_MISSING, HIST_MISSING };
+    for(uint32_t i=0;i<n;i++) historyRestore(restoreTier, missing);
+}
+
+// 記録の間に空白があれば欠測で埋めて時間軸を揃える
+static void restoreRecord(const LogRecord &r){
+    if(r.tier != restoreTier) return;
+    if(r.epoch && restorePrevEpoch && r.epoch > restorePrevEpoch){
+        uint32_t periodSec = historyPeriodMs(restoreTier) / 1000;
+        uint32_t gap = (r.epoch - restorePrevEpoch) / periodSec;
+        if(gap > (uint32_t)restoreSlots) gap = restoreSlots;
+        if(gap > 0) restoreMissing(gap - 1);
+    }
+    historyRestore(restoreTier, r.bucket);
+    restorePrevEpoch = r.epoch;
+}
+
+// 前の起動の1秒段の時刻は前の起動の時計。書いた時と今の両方でUNIX時刻との差が分かれば今の時計へ移す
+static void restoreSecBlock(const BlockRecordHeader &h, const uint8_t* data){
+    int32_t shift = (h.epochOffset && restoreSecOffset) ? (int32_t)(h.epochOffset - restoreSecOffset) : 0;
+    historyRestoreSecBlock(data, shift);
+}
+
+// 前の記録から起動までの空白の点数（段の保持数まで）
+static uint32_t gapSlots(HistTier tier, int slots, uint32_t prevEpoch, uint32_t epochNow){
+    uint32_t periodSec = historyPeriodMs(tier) / 1000;
+    uint32_t gap = epochNow > prevEpoch ? (epochNow - prevEpoch) / periodSec : 0;
+    return std::min(gap, (uint32_t)slots);
+}
+
+// 最後の記録から今までを欠測で埋める。今の時刻が分からない時（電源を入れ直してNTPの前）は
+// 前後がつながって見えないよう欠測を1点だけ置き、残りは時刻が分かった時に差し込む（fillPendingGaps）
+static uint32_t restore(SegmentLog &log, HistTier tier, int slots, uint32_t epochNow){
+    restoreTier = tier;
+    restoreSlots = slots;
+    restorePrevEpoch = 0;
+    uint32_t delivered = log.readTail(slots, restoreRecord);
+    if(delivered == 0) return 0;
+
+    uint32_t gap = 1;
+    if(epochNow && restorePrevEpoch) gap = gapSlots(tier, slots, restorePrevEpoch, epochNow);
+    restoreMissing(gap);
+    if(!epochNow && restorePrevEpoch) pendingGaps[tier] = { restorePrevEpoch, historyAppendCount(tier), slots };
+    return delivered;
+}
+
+// 起動した時のUNIX時刻が分かったので、欠測1点で区切った所に残りの空白を差し込む
+// 差し込んだ点はログへは書かない（次の起動では記録の時刻の差からまた埋まる）
+static void fillPendingGaps(uint32_t epoch){
+    uint32_t epochAtBoot = epoch - (halMillis() - beginMs) / 1000;
+    for(int t=0;t<NUM_HIST_TIERS;t++){
+        PendingGap &g = pendingGaps[t];
+        if(!g.lastEpoch) continue;
+        uint32_t gap = gapSlots((HistTier)t, g.slots, g.lastEpoch, epochAtBoot);
+        int back = (int)(historyAppendCount((HistTier)t) - g.appendedAtBoot);
+        if(gap > 1) loggedCount[t] += historyInsertGap((HistTier)t, back, gap - 1);
+        g.lastEpoch = 0;
+    }
+}
+
+// 1秒段の今の時刻。まだ1件も足していなければ、最初の追加で時計が始まるmillis()の秒
+static uint32_t secClockNow(){
+    return historyAppendCount(TIER_1SEC) ? historyClockSec() : halMillis() / 1000;
+}
+
+bool sensorLogBegin(){
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    uint32_t start = halMillis();
+    if(!halFsBegin()) return false;
+    if(!halFsExists(LOG_DIR)) halFsMkdir(LOG_DIR);
+
+    minuteLog.begin();
+    hourLog.begin();
+    secLog.beginBlocks();
+    memset(pendingGaps, 0, sizeof(pendingGaps));
+    uint32_t epochNow = halEpoch();
+    bootUnsynced = epochNow == 0;
+    beginMs = start;
+    restoreSecOffset = epochNow ? epochNow - secClockNow() : 0;
+    uint32_t secBlocks = secLog.readTailBlocks(HIST_SEC_BLOCKS, restoreSecBlock);
+    if(secBlocks) historyMarkGap();
+    stats.restored = restore(minuteLog, TIER_1MIN, HIST_MIN_SLOTS, epochNow)
+                   + restore(hourLog, TIER_1HOUR, HIST_HOUR_SLOTS, epochNow)
+                   + secBlocks;
+
+    // 復元した点をもう一度書かないように
+    for(int t=0;t<NUM_HIST_TIERS;t++) loggedCount[t] = historyAppendCount((HistTier)t);
+    loggedSecBlocks = historySecBlocksClosed();
+    stats.restoreMs = halMillis() - start;
+    logReady = true;
+#ifdef SENSOR_LOG_VERBOSE
+    printf("log: restored %lu records in %lu ms\n",
+           (unsigned long)stats.restored, (unsigned long)stats.restoreMs);
+#endif
+    return true;
+}
+
+static void syncTier(SegmentLog &log, HistTier tier, uint32_t epoch){
+    uint32_t total = historyAppendCount(tier);
+    uint32_t fresh = total - loggedCount[tier];
+    loggedCount[tier] = total;
+    if(fresh > (uint32_t)historySize(tier)) fresh = historySize(tier);
+
+    uint32_t periodSec = historyPeriodMs(tier) / 1000;
+    for(int back=(int)fresh-1;back>=0;back--){
+        LogRecord r;
+        memset(&r, 0, sizeof(r));
+        r.epoch = epoch ? epoch - back * periodSec : 0;
+        r.tier = tier;
+        r.version = LOG_VERSION;
+        historyGet(tier, back, r.bucket);
+        r.crc = recordCrc(r);
+        log.append(r);
+        stats.appended++;
+    }
+}
+
+// 1秒段はブロックが閉じた時だけ書く（数分に1回）
+static void syncSecBlocks(uint32_t epoch){
+    uint32_t total = historySecBlocksClosed();
+    uint32_t fresh = std::min(total - loggedSecBlocks, (uint32_t)HIST_SEC_BLOCKS);
+    loggedSecBlocks = total;
+
+    for(int back=(int)fresh-1;back>=0;back--){
+        const uint8_t* block = historySecBlock(back);
+        if(!block) continue;
+        BlockRecordHeader h;
+        h.length = seriesBlockLength(block);
+        h.crc = crc16(block, h.length);
+        h.epochOffset = epoch ? epoch - historyClockSec() : 0;
+        secLog.appendBlock(h, block);
+        stats.appended++;
+    }
+}
+
+void sensorLogSync(){
+    if(!logReady) return;
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    uint32_t epoch = halEpoch();
+    if(epoch) fillPendingGaps(epoch);
+    else if(bootUnsynced && halMillis() - beginMs < LOG_UNSYNCED_HOLD_MS) return;
+    syncTier(minuteLog, TIER_1MIN, epoch);
+    syncTier(hourLog, TIER_1HOUR, epoch);
+    syncSecBlocks(epoch);
+}
+
+void sensorLogFlush(){
+    if(!logReady) return;
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    minuteLog.flush();
+    hourLog.flush();
+}
+
+const SensorLogStats& sensorLogStats(){
+    return stats;
+}
@@ -0,0 +1,210 @@
+// ==========================================
+// センサー取得レイヤー
+// ==========================================
+
+#include "sensors.h"
+#include "spsc_ring.h"
+#include "light_sensor.h"
+#include "adaptive_sampler.h"
+#include "profiler.h"
+#include "mem_telemetry.h"
+#include "hal.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
+
+constexpr uint32_t SENSOR_TASK_STACK = 4096;
+constexpr UBaseType_t SENSOR_TASK_PRIORITY = 2;     // loop()(1)より上。描画や通信で周期を乱さない
+constexpr BaseType_t SENSOR_TASK_CORE = 1;
+constexpr uint32_t SENSOR_RING_LEN = 8;             // loop()が数秒止まっても取りこぼさない
+
+// 前回読んだ値からこれだけ動いたら最短周期に戻す
+constexpr float BME_TEMP_STEP = 0.05f;      // ℃
+constexpr float BME_HUM_STEP = 0.3f;        // %RH
+constexpr float BME_PRESS_STEP = 0.05f;     // hPa
+constexpr float LIGHT_MIN_STEP = 3.0f;      // lx（暗い時）
+constexpr float LIGHT_REL_STEP = 0.05f;     // 明るい時は5%
+
+#ifdef SENSOR_FIXED_RATE
+constexpr uint32_t BME_PERIOD_LIMIT = SENSOR_PERIOD_MS;
+constexpr uint32_t LIGHT_PERIOD_LIMIT = SENSOR_PERIOD_MS;
+#else
+constexpr uint32_t BME_PERIOD_LIMIT = BME_MAX_PERIOD_MS;
+constexpr uint32_t LIGHT_PERIOD_LIMIT = LIGHT_MAX_PERIOD_MS;
+#endif
+
+const uint32_t JITTER_BIN_US[JITTER_BINS] = {100, 500, 1000, 5000, 20000, UINT32_MAX};
+
+static bool bmePresent = false;
+static bool bmeMeasuring = false;
+
+static SensorStats stats;
+static SpscRing<SensorSample, SENSOR_RING_LEN> sampleRing;
+static TaskHandle_t sensorTask = nullptr;
+static TaskHandle_t consumerTask = nullptr;
+static std::atomic<bool> waiting{false};
+
+static AdaptiveSampler bmeSampler(SENSOR_PERIOD_MS, BME_PERIOD_LIMIT);
+static AdaptiveSampler lightSampler(SENSOR_PERIOD_MS, LIGHT_PERIOD_LIMIT);
+static SensorSample lastBme;       // 周期を決める比較用（前回読んだ値）
+static int lastLux = -1;
+
+bool sensorsBegin(){
+    halLightBegin();
+    bmePresent = halEnvBegin();
+    return bmePresent;
+}
+
+// 前回開始した変換の結果を読む（次の変換は読む周期の直前に始める）
+static bool readBme(SensorSample &out){
+    if(!bmePresent) return false;
+    PROF_SCOPE(PROF_BME);
+
+    uint32_t start = micros();
+    HalEnvReading r;
+    HalEnvStatus status = halEnvRead(r);
+    // まだ変換中（周期が短すぎる時）は次の周期に回す
+    bmeMeasuring = status == HAL_ENV_BUSY;
+    uint32_t elapsed = micros() - start;
+
+    stats.lastI2cUs = elapsed;
+    if(elapsed > stats.maxI2cUs) stats.maxI2cUs = elapsed;
+    stats.reads++;
+#ifdef SENSOR_STATS_LOG
+    Serial.printf("bme: %lu us\n", (unsigned long)elapsed);
+#endif
+    if(status == HAL_ENV_ERROR){
+        stats.errors++;
+        return false;
+    }
+    if(status != HAL_ENV_OK) return false;
+
+    out.temp = r.temp;
+    out.valid |= SAMPLE_TEMP_VALID;
+    if(!isnan(r.pressure)){
+        out.pressure = r.pressure;
+        out.valid |= SAMPLE_PRESS_VALID;
+    }
+    if(!isnan(r.hum)){
+        out.hum = r.hum;
+        out.valid |= SAMPLE_HUM_VALID;
+    }
+    return true;
+}
+
+// 照明のちらつき（100/120Hz）とノイズを均すため、1tick(1ms)おきにLIGHT_OVERSAMPLE回取る
+static void readLight(SensorSample &out){
+    PROF_SCOPE(PROF_LIGHT);
+    uint16_t raw[LIGHT_OVERSAMPLE];
+    for(int i=0;i<LIGHT_OVERSAMPLE;i++){
+        if(i) halLightWait();
+        int v = halLightRaw();
+        if(v < 0) return;
+        raw[i] = (uint16_t)v;
+    }
+    uint16_t filtered = lightTrimmedMean(raw, LIGHT_OVERSAMPLE, LIGHT_TRIM);
+    out.lightMv = halLightMillivolts(filtered);
+    out.lux = lightMillivoltsToLux(out.lightMv);
+    out.valid |= SAMPLE_LUX_VALID;
+}
+
+static void readImu(SensorSample &out){
+    PROF_SCOPE(PROF_IMU);
+    HalImuReading r;
+    if(!halImuRead(r)) return;
+    out.accelMag = sqrtf(r.accelX * r.accelX + r.accelY * r.accelY + r.accelZ * r.accelZ);
+    out.magX = r.magX;
+    out.magY = r.magY;
+    out.valid |= SAMPLE_IMU_VALID;
+}
+
+static void sampleBme(SensorSample &s, uint32_t now){
+    if(bmeSampler.due(now) && readBme(s)){
+        float change = adaptiveChange(s.temp, lastBme.temp, BME_TEMP_STEP);
+        change = fmaxf(change, adaptiveChange(s.hum, lastBme.hum, BME_HUM_STEP));
+        change = fmaxf(change, adaptiveChange(s.pressure, lastBme.pressure, BME_PRESS_STEP));
+        bmeSampler.measured(change, now);
+        lastBme = s;
+        stats.bmePeriodMs = bmeSampler.period();
+    }
+    // 強制モードは1回変換すると眠るので、次に読む周期の直前に変換を始めておく
+    if(bmePresent && !bmeMeasuring && bmeSampler.due(now + SENSOR_PERIOD_MS)) halEnvStart();
+}
+
+static void sampleLight(SensorSample &s, uint32_t now){
+    if(!lightSampler.due(now)) return;
+    readLight(s);
+    if(!(s.valid & SAMPLE_LUX_VALID)) return;
+    stats.lightReads++;
+    float step = fmaxf(LIGHT_MIN_STEP, s.lux * LIGHT_REL_STEP);
+    lightSampler.measured(lastLux < 0 ? 1.0f : adaptiveChange(s.lux, lastLux, step), now);
+    lastLux = s.lux;
+    stats.lightPeriodMs = lightSampler.period();
+}
+
+static void recordJitter(uint32_t intervalUs){
+    uint32_t nominal = SENSOR_PERIOD_MS * 1000;
+    uint32_t jitter = intervalUs > nominal ? intervalUs - nominal : nominal - intervalUs;
+    if(jitter > stats.maxJitterUs) stats.maxJitterUs = jitter;
+    int bin = 0;
+    while(jitter >= JITTER_BIN_US[bin] && bin < JITTER_BINS - 1) bin++;
+    stats.jitter[bin]++;
+}
+
+static void sensorTaskLoop(void*){
+    uint32_t lastUs = 0;
+#ifndef LIGHT_SLEEP
+    TickType_t lastWake = xTaskGetTickCount();
+#endif
+    for(;;){
+        waiting = true;
+#ifdef LIGHT_SLEEP
+        // ライトスリープ中はtickが止まるので、周期はスケジューラ側（millis()基準）が決めて起こす
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+        // 処理時間やloop()の混み具合に関係なく起床時刻を一定間隔に保つ
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(SENSOR_PERIOD_MS));
+#endif
+        waiting = false;
+        uint32_t nowUs = micros();
+        if(lastUs) recordJitter(nowUs - lastUs);
+        lastUs = nowUs;
+
+        stats.ticks++;
+
+        SensorSample s;
+        s.timestamp = millis();
+        sampleBme(s, s.timestamp);
+        sampleLight(s, s.timestamp);
+        readImu(s);     // 揺さぶり検出・方位計タスクを止めている間の方位用なので毎周期
+        if(!sampleRing.push(s)) stats.dropped++;
+        if(consumerTask) xTaskNotifyGive(consumerTask);
+    }
+}
+
+void startSensorTask(){
+    if(sensorTask) return;
+    consumerTask = xTaskGetCurrentTaskHandle();
+    xTaskCreatePinnedToCore(sensorTaskLoop, "sensors", SENSOR_TASK_STACK, nullptr,
+                            SENSOR_TASK_PRIORITY, &sensorTask, SENSOR_TASK_CORE);
+    memWatchTask("sensors", sensorTask, MEM_TAG_SENSORS);
+}
+
+#ifdef LIGHT_SLEEP
+void sensorTrigger(){
+    if(sensorTask) xTaskNotifyGive(sensorTask);
+}
+#endif
+
+bool sensorsIdle(){
+    return waiting;
+}
+
+bool pollSensorSample(SensorSample &out){
+    return sampleRing.pop(out);
+}
+
+const SensorStats& sensorStats(){
+    return stats;
+}
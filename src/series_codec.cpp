@@ -0,0 +1,157 @@
+// ==========================================
+// 時系列ブロック圧縮
+// ==========================================
+
+#include "series_codec.h"
+
+#include <string.h>
+#include <algorithm>
+
+// 1サンプルの最大ビット数（時刻 3+32、値 4+17 x ch）
+static size_t worstCaseBits(int channels){
+    return 35 + channels * 21;
+}
+
+static uint32_t zigzag(int32_t v){ return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t unzigzag(uint32_t v){ return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static uint16_t readU16(const uint8_t* p){ return p[0] | (p[1] << 8); }
+static void writeU16(uint8_t* p, uint16_t v){ p[0] = v; p[1] = v >> 8; }
+
+size_t seriesBlockLength(const uint8_t* block){ return readU16(block); }
+uint16_t seriesBlockCount(const uint8_t* block){ return readU16(block + 2); }
+uint32_t seriesBlockStart(const uint8_t* block){ return readU16(block + 4) | ((uint32_t)readU16(block + 6) << 16); }
+
+void seriesBlockSetStart(uint8_t* block, uint32_t t){
+    writeU16(block + 4, t);
+    writeU16(block + 6, t >> 16);
+}
+
+// ---------- 符号化 ----------
+void SeriesEncoder::begin(uint8_t* out, size_t cap, int ch){
+    buf = out;
+    capacity = cap;
+    channels = std::min(ch, SERIES_MAX_CHANNELS);
+    samples = 0;
+    lastDelta = 0;
+    bitPos = (SERIES_HEADER_BYTES + channels * 2) * 8;
+    memset(buf, 0, capacity);
+    buf[8] = channels;
+    updateHeader();
+}
+
+size_t SeriesEncoder::length() const {
+    return (bitPos + 7) / 8;
+}
+
+void SeriesEncoder::updateHeader(){
+    writeU16(buf, length());
+    writeU16(buf + 2, samples);
+}
+
+void SeriesEncoder::putBits(uint32_t value, int bits){
+    while(bits > 0){
+        int bit = (value >> (bits - 1)) & 1;
+        if(bit) buf[bitPos >> 3] |= 0x80 >> (bitPos & 7);
+        bitPos++;
+        bits--;
+    }
+}
+
+// 1Hz計測ならほぼ毎回0になり1ビットで済む
+void SeriesEncoder::putTimestamp(int32_t dod){
+    uint32_t z = zigzag(dod);
+    if(z == 0)              putBits(0, 1);
+    else if(z < (1u << 4))  { putBits(0b10, 2);  putBits(z, 4); }
+    else if(z < (1u << 12)) { putBits(0b110, 3); putBits(z, 12); }
+    else                    { putBits(0b111, 3); putBits(z, 32); }
+}
+
+// 温湿度はほとんど変化しないので0の時を1ビットに
+void SeriesEncoder::putValue(int32_t delta){
+    uint32_t z = zigzag(delta);
+    if(z == 0)              putBits(0, 1);
+    else if(z < (1u << 2))  { putBits(0b10, 2);   putBits(z, 2); }
+    else if(z < (1u << 6))  { putBits(0b110, 3);  putBits(z, 6); }
+    else if(z < (1u << 10)) { putBits(0b1110, 4); putBits(z, 10); }
+    else                    { putBits(0b1111, 4); putBits(z, 17); }
+}
+
+bool SeriesEncoder::add(uint32_t t, const int16_t* v){
+    if(samples == 0xFFFF) return false;
+    if(samples == 0){
+        writeU16(buf + 4, t);
+        writeU16(buf + 6, t >> 16);
+        uint8_t* p = buf + SERIES_HEADER_BYTES;
+        for(int c=0;c<channels;c++) writeU16(p + c*2, v[c]);
+    } else {
+        if(bitPos + worstCaseBits(channels) > capacity * 8) return false;
+        int32_t delta = (int32_t)(t - lastT);
+        putTimestamp(delta - lastDelta);
+        lastDelta = delta;
+        for(int c=0;c<channels;c++) putValue((int32_t)v[c] - last[c]);
+    }
+    lastT = t;
+    for(int c=0;c<channels;c++) last[c] = v[c];
+    samples++;
+    updateHeader();
+    return true;
+}
+
+// ---------- 復号 ----------
+bool SeriesDecoder::begin(const uint8_t* block){
+    buf = block;
+    size_t len = seriesBlockLength(block);
+    channels = block[8];
+    if(channels <= 0 || channels > SERIES_MAX_CHANNELS) return false;
+    if(len < SERIES_HEADER_BYTES + channels * 2 || len > SERIES_BLOCK_BYTES) return false;
+    bitLimit = len * 8;
+    samples = seriesBlockCount(block);
+    index = 0;
+    bitPos = (SERIES_HEADER_BYTES + channels * 2) * 8;
+    lastT = seriesBlockStart(block);
+    lastDelta = 0;
+    return true;
+}
+
+uint32_t SeriesDecoder::getBits(int bits){
+    uint32_t v = 0;
+    while(bits > 0){
+        v <<= 1;
+        if(bitPos < bitLimit && (buf[bitPos >> 3] & (0x80 >> (bitPos & 7)))) v |= 1;
+        bitPos++;
+        bits--;
+    }
+    return v;
+}
+
+int32_t SeriesDecoder::getTimestamp(){
+    if(!getBits(1)) return 0;
+    if(!getBits(1)) return unzigzag(getBits(4));
+    if(!getBits(1)) return unzigzag(getBits(12));
+    return unzigzag(getBits(32));
+}
+
+int32_t SeriesDecoder::getValue(){
+    if(!getBits(1)) return 0;
+    if(!getBits(1)) return unzigzag(getBits(2));
+    if(!getBits(1)) return unzigzag(getBits(6));
+    if(!getBits(1)) return unzigzag(getBits(10));
+    return unzigzag(getBits(17));
+}
+
+bool SeriesDecoder::next(uint32_t &t, int16_t* v){
+    if(index >= samples) return false;
+    if(index == 0){
+        const uint8_t* p = buf + SERIES_HEADER_BYTES;
+        for(int c=0;c<channels;c++) last[c] = (int16_t)readU16(p + c*2);
+    } else {
+        lastDelta += getTimestamp();
+        lastT += lastDelta;
+        for(int c=0;c<channels;c++) last[c] = (int16_t)(last[c] + getValue());
+    }
+    index++;
+    t = lastT;
+    for(int c=0;c<channels;c++) v[c] = last[c];
+    return true;
+}
@@ -0,0 +1,321 @@
+// ==========================================
+// 入力トレース
+// ==========================================
+
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <mutex>
+
+static const uint8_t TRACE_MAGIC[4] = {'T', 'R', 'C', '1'};
+
+// 1レコードの上限（種類 + 時刻 + HTTPの応答コード・長さ + 本文）
+constexpr size_t TRACE_RECORD_MAX = TRACE_HTTP_MAX + 16;
+
+static std::mutex traceMutex;
+static uint8_t* buffer = nullptr;       // 書き出し待ち（先頭から詰める）
+static size_t bufferLen = 0;
+static std::atomic<bool> recording{false};      // 記録中か（traceRecording()はロックなしで読む）
+static uint32_t lastMs = 0;
+static TraceStats stats;
+
+// ---------- 符号化 ----------
+struct TraceWriter {
+    uint8_t* p;
+    void u8(uint8_t v){ *p++ = v; }
+    void u16(uint16_t v){ *p++ = v & 0xFF; *p++ = v >> 8; }
+    void varint(uint32_t v){
+        while(v >= 0x80){
+            *p++ = (v & 0x7F) | 0x80;
+            v >>= 7;
+        }
+        *p++ = v;
+    }
+};
+
+static int16_t toFixed(float v, float scale){
+    float x = roundf(v * scale);
+    if(x > 32767) x = 32767;
+    if(x < -32768) x = -32768;
+    return (int16_t)x;
+}
+
+static uint32_t zigzag(int32_t v){ return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+static int32_t unzigzag(uint32_t v){ return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+// ロック中に呼ぶ。入りきらなければ捨てて数え、falseを返す
+static bool append(const uint8_t* rec, size_t n){
+    if(bufferLen + n > TRACE_BUFFER_BYTES){
+        stats.dropped++;
+        return false;
+    }
+    memcpy(buffer + bufferLen, rec, n);
+    bufferLen += n;
+    stats.bytes += n;
+    return true;
+}
+
+// 種類と時刻差を書く。時刻差はレコードを積む順に取るのでロック中に呼ぶ
+static void putHead(TraceWriter &w, TraceRecordType type, uint32_t now){
+    w.u8(type);
+    w.varint(now - lastMs);
+}
+
+// 1レコードを積む。捨てた時は時刻差の基準を進めない（次のレコードの時刻がずれる）
+static bool appendRecord(const uint8_t* rec, size_t n, uint32_t now){
+    if(!append(rec, n)) return false;
+    lastMs = now;
+    return true;
+}
+
+bool traceStart(uint32_t now){
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if(recording) return true;
+    if(!buffer) buffer = (uint8_t*)malloc(TRACE_BUFFER_BYTES);
+    if(!buffer) return false;
+    stats = TraceStats();
+    bufferLen = 0;
+    uint8_t head[TRACE_HEADER_BYTES] = {};
+    memcpy(head, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    head[4] = TRACE_VERSION;
+    for(int i=0;i<4;i++) head[8 + i] = (now >> (8 * i)) & 0xFF;
+    append(head, sizeof(head));
+    lastMs = now;
+    recording = true;
+    return true;
+}
+
+void traceStop(){
+    std::lock_guard<std::mutex> lock(traceMutex);
+    recording = false;
+}
+
+void traceRelease(){
+    std::lock_guard<std::mutex> lock(traceMutex);
+    recording = false;
+    free(buffer);
+    buffer = nullptr;
+    bufferLen = 0;
+}
+
+bool traceRecording(){
+    return recording;
+}
+
+void traceSample(const SensorSample &s, uint32_t now){
+    uint8_t rec[32];
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if(!recording) return;
+    TraceWriter w = { rec };
+    putHead(w, TRACE_SAMPLE, now);
+    w.varint(now - s.timestamp);
+    w.u8(s.valid);
+    if(s.valid & SAMPLE_TEMP_VALID) w.u16(toFixed(s.temp, 100));
+    if(s.valid & SAMPLE_HUM_VALID) w.u16(toFixed(s.hum, 100));
+    if(s.valid & SAMPLE_PRESS_VALID) w.u16(toFixed(s.pressure - 1000, 10));
+    if(s.valid & SAMPLE_LUX_VALID){
+        w.varint(s.lux < 0 ? 0 : s.lux);
+        w.varint(s.lightMv);
+    }
+    if(s.valid & SAMPLE_IMU_VALID){
+        w.u16(toFixed(s.accelMag, 1000));
+        w.u16(toFixed(s.magX, 10));
+        w.u16(toFixed(s.magY, 10));
+    }
+    if(appendRecord(rec, w.p - rec, now)) stats.samples++;
+}
+
+void traceInput(const InputEvent &ev, uint32_t now, uint32_t nowUs){
+    uint8_t rec[16];
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if(!recording) return;
+    TraceWriter w = { rec };
+    putHead(w, TRACE_INPUT, now);
+    w.u8(ev.button | (ev.type << 4));
+    w.varint(nowUs - ev.us);
+    if(appendRecord(rec, w.p - rec, now)) stats.inputs++;
+}
+
+void traceHttp(int code, const uint8_t* body, size_t len, uint32_t now){
+    if(len > TRACE_HTTP_MAX) len = TRACE_HTTP_MAX;
+    uint8_t head[16];
+    std::lock_guard<std::mutex> lock(traceMutex);
+    if(!recording) return;
+    if(bufferLen + sizeof(head) + len > TRACE_BUFFER_BYTES){
+        stats.dropped++;
+        return;
+    }
+    TraceWriter w = { head };
+    putHead(w, TRACE_HTTP, now);
+    w.varint(zigzag(code));
+    w.varint(len);
+    appendRecord(head, w.p - head, now);
+    if(len) append(body, len);
+    stats.http++;
+}
+
+size_t traceDrain(uint8_t* out, size_t cap){
+    std::lock_guard<std::mutex> lock(traceMutex);
+    size_t n = bufferLen < cap ? bufferLen : cap;
+    if(!n) return 0;
+    memcpy(out, buffer, n);
+    memmove(buffer, buffer + n, bufferLen - n);
+    bufferLen -= n;
+    return n;
+}
+
+const TraceStats& traceStats(){
+    return stats;
+}
+
+// ---------- 本文の取り込み ----------
+// 受け皿は記録中の応答ごとに確保する（ワーカーのスタックには置けない大きさ）
+TraceTeeStream::TraceTeeStream(HalStream &in)
+    : in(in), buf(recording ? (uint8_t*)malloc(TRACE_HTTP_MAX) : nullptr) {}
+
+TraceTeeStream::~TraceTeeStream(){
+    free(buf);
+}
+
+int TraceTeeStream::read(){
+    int c = in.read();
+    if(c >= 0 && buf){
+        if(len < TRACE_HTTP_MAX) buf[len++] = (uint8_t)c;
+        else if(!over){
+            over = true;
+            std::lock_guard<std::mutex> lock(traceMutex);
+            stats.truncated++;
+        }
+    }
+    return c;
+}
+
+// ---------- 読み出し ----------
+bool TraceReader::begin(TraceFill fillFn, void* fillCtx){
+    end();
+    fill = fillFn;
+    ctx = fillCtx;
+    broken = false;
+    buf = (uint8_t*)malloc(TRACE_RECORD_MAX);
+    if(!buf || !ensure(TRACE_HEADER_BYTES) || memcmp(buf, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+       buf[4] != TRACE_VERSION){
+        end();
+        return false;
+    }
+    start = buf[8] | (buf[9] << 8) | (buf[10] << 16) | ((uint32_t)buf[11] << 24);
+    last = start;
+    pos += TRACE_HEADER_BYTES;
+    return true;
+}
+
+void TraceReader::end(){
+    free(buf);
+    buf = nullptr;
+    pos = len = 0;
+}
+
+// 未読がnバイト以上あるように詰め直して補充する
+bool TraceReader::ensure(size_t n){
+    if(len - pos >= n) return true;
+    memmove(buf, buf + pos, len - pos);
+    len -= pos;
+    pos = 0;
+    while(len < n){
+        size_t got = fill(buf + len, TRACE_RECORD_MAX - len, ctx);
+        if(!got) return false;
+        len += got;
+    }
+    return true;
+}
+
+bool TraceReader::getVarint(uint32_t &v){
+    v = 0;
+    for(int shift=0; shift<35; shift+=7){
+        if(!ensure(1)) return false;
+        uint8_t b = buf[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+bool TraceReader::next(TraceRecord &out){
+    if(!buf) return false;
+    if(!ensure(1)) return false;                // ここで終わるのは正常
+    out.type = (TraceRecordType)buf[pos++];
+    uint32_t dt;
+    if(!getVarint(dt)){
+        broken = true;
+        return false;
+    }
+    out.ms = last + dt;
+    last = out.ms;
+
+    auto u8 = [&](uint8_t &v){
+        if(!ensure(1)) return false;
+        v = buf[pos++];
+        return true;
+    };
+    auto i16 = [&](int16_t &v){
+        if(!ensure(2)) return false;
+        v = (int16_t)(buf[pos] | (buf[pos + 1] << 8));
+        pos += 2;
+        return true;
+    };
+
+    bool ok = false;
+    switch(out.type){
+        case TRACE_SAMPLE: {
+            SensorSample &s = out.sample;
+            s = SensorSample();
+            uint32_t lag;
+            int16_t v = 0;
+            ok = getVarint(lag) && u8(s.valid);
+            s.timestamp = out.ms - lag;
+            if(ok && (s.valid & SAMPLE_TEMP_VALID)){ ok = i16(v); s.temp = v / 100.0f; }
+            if(ok && (s.valid & SAMPLE_HUM_VALID)){ ok = i16(v); s.hum = (uint16_t)v / 100.0f; }
+            if(ok && (s.valid & SAMPLE_PRESS_VALID)){ ok = i16(v); s.pressure = 1000 + v / 10.0f; }
+            if(ok && (s.valid & SAMPLE_LUX_VALID)){
+                uint32_t lux = 0, mv = 0;
+                ok = getVarint(lux) && getVarint(mv);
+                s.lux = (int)lux;
+                s.lightMv = (uint16_t)mv;
+            }
+            if(ok && (s.valid & SAMPLE_IMU_VALID)){
+                int16_t a = 0, x = 0, y = 0;
+                ok = i16(a) && i16(x) && i16(y);
+                s.accelMag = a / 1000.0f;
+                s.magX = x / 10.0f;
+                s.magY = y / 10.0f;
+            }
+            break;
+        }
+        case TRACE_INPUT: {
+            uint8_t b = 0;
+            ok = u8(b) && getVarint(out.lagUs);
+            out.input.button = (InputButton)(b & 0x0F);
+            out.input.type = (InputType)(b >> 4);
+            out.input.us = 0;
+            ok = ok && out.input.button < NUM_BUTTONS;
+            break;
+        }
+        case TRACE_HTTP: {
+            uint32_t code, n;
+            ok = getVarint(code) && getVarint(n) && n <= TRACE_HTTP_MAX && ensure(n);
+            if(ok){
+                out.httpCode = unzigzag(code);
+                out.body = buf + pos;
+                out.bodyLen = n;
+                pos += n;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if(!ok) broken = true;
+    return ok;
+}
@@ -0,0 +1,90 @@
+// ==========================================
+// トレースの保存先
+// ==========================================
+
+#include "trace_store.h"
+#include "mem_telemetry.h"
+
+#include <LittleFS.h>
+
+constexpr size_t TRACE_CHUNK = 512;
+constexpr int DUMP_LINE_BYTES = 32;
+
+static uint32_t fileBytes = 0;
+static File replayFile;
+
+bool traceStoreStart(){
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    if(traceRecording()) return true;
+    LittleFS.remove(TRACE_FILE);
+    fileBytes = 0;
+    return traceStart(millis());
+}
+
+// バッファが空になるまでチャンクずつ追記する
+static void writeOut(){
+    uint8_t chunk[TRACE_CHUNK];
+    File f = LittleFS.open(TRACE_FILE, FILE_APPEND);
+    for(;;){
+        size_t n = traceDrain(chunk, sizeof(chunk));
+        if(!n) break;
+        if(f) f.write(chunk, n);
+        fileBytes += n;
+    }
+    if(f) f.close();
+}
+
+bool traceStoreFlush(){
+    if(!traceRecording()) return false;
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    writeOut();
+    if(fileBytes + TRACE_BUFFER_BYTES <= TRACE_FILE_MAX) return true;
+    traceStoreStop();
+    return false;
+}
+
+void traceStoreStop(){
+    MEM_TAG_SCOPE(MEM_TAG_LOG);
+    traceStop();
+    writeOut();
+    traceRelease();
+}
+
+uint32_t traceStoreBytes(){
+    return fileBytes;
+}
+
+static size_t fillFromFile(uint8_t* buf, size_t len, void*){
+    return replayFile ? replayFile.read(buf, len) : 0;
+}
+
+bool traceStoreOpen(TraceReader &reader){
+    traceStoreClose();
+    replayFile = LittleFS.open(TRACE_FILE, FILE_READ);
+    if(!replayFile) return false;
+    if(reader.begin(fillFromFile, nullptr)) return true;
+    traceStoreClose();
+    return false;
+}
+
+void traceStoreClose(){
+    if(replayFile) replayFile.close();
+}
+
+void traceStoreDump(Print &out){
+    File f = LittleFS.open(TRACE_FILE, FILE_READ);
+    if(!f){
+        out.println("# no trace");
+        return;
+    }
+    out.printf("# trace %lu bytes\n", (unsigned long)f.size());
+    uint8_t line[DUMP_LINE_BYTES];
+    for(;;){
+        size_t n = f.read(line, sizeof(line));
+        if(!n) break;
+        for(size_t i=0;i<n;i++) out.printf("%02x", line[i]);
+        out.println();
+    }
+    f.close();
+    out.println("# end");
+}
@@ -0,0 +1,183 @@
+// ==========================================
+// 天気取得ワーカー（OpenWeatherMap API）
+// ==========================================
+
+#include "weather.h"
+#include "wifi_manager.h"
+#include "profiler.h"
+#include "mem_telemetry.h"
+#include "trace.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+
+constexpr int FETCH_QUEUE_LEN = 2;
+constexpr uint32_t WORKER_STACK = 8192;
+constexpr UBaseType_t WORKER_PRIORITY = 1;
+constexpr BaseType_t WORKER_CORE = 0;             // loop()はcore1
+constexpr uint32_t WORKER_LINK_WAIT = 20000;
+
+static const char* apiKey = "";
+static QueueHandle_t fetchRequestQueue = nullptr;
+static QueueHandle_t fetchResultQueue = nullptr;
+static TaskHandle_t workerTask = nullptr;
+
+struct WeatherFetchRequest {
+    bool force;
+};
+
+// 処理待ちの要求があれば重複して積まない
+static portMUX_TYPE pendingMux = portMUX_INITIALIZER_UNLOCKED;
+static bool refreshPending = false;
+// 積んだ要求のうち、完了イベントをloop()がまだ受け取っていない数（pendingMuxで守る）
+static int fetchesInFlight = 0;
+static bool replaying = false;
+
+// 応答コードと本文 → 状態。記録した応答の再生も同じ処理を通る
+// 200以外（401のキー誤り・429のレート制限など）は本文を読まずにHTTPエラー
+static WeatherFetchStatus handleResponse(int httpCode, HalStream* body, uint32_t &updatedMask){
+    if(httpCode == TRACE_HTTP_NO_WIFI) return FETCH_NO_WIFI;
+    if(httpCode != 200 || !body) return FETCH_HTTP_ERR;
+    uint32_t parseStart = profStart();
+    bool parsed = parseWeatherGroupStream(*body, updatedMask);
+    profStop(PROF_JSON, parseStart);
+    return parsed ? FETCH_OK : FETCH_JSON_ERR;
+}
+
+// groupエンドポイントでcityMaskの都市をまとめて取得
+static WeatherFetchStatus fetchWeatherGroup(uint32_t cityMask, uint32_t &updatedMask, int &httpCode){
+    char url[256];
+    weatherGroupUrl(url, sizeof(url), WEATHER_API_BASE, cityMask, apiKey);
+
+    uint32_t httpStart = profStart();
+    HalStream* body = nullptr;
+    httpCode = halHttpGet(url, body);
+    profStop(PROF_HTTP, httpStart);
+    if(httpCode <= 0){
+        halHttpEnd();
+        if(traceRecording()) traceHttp(httpCode < 0 ? httpCode : -1, nullptr, 0, millis());
+        return FETCH_HTTP_ERR;
+    }
+    if(!traceRecording()){
+        WeatherFetchStatus status = handleResponse(httpCode, body, updatedMask);
+        halHttpEnd();
+        return status;
+    }
+    // 記録中はパーサーが読んだ分の本文を残す
+    TraceTeeStream tee(*body);
+    WeatherFetchStatus status = handleResponse(httpCode, &tee, updatedMask);
+    halHttpEnd();
+    traceHttp(httpCode, tee.data(), tee.length(), millis());
+    return status;
+}
+
+static void finishFetch(){
+    portENTER_CRITICAL(&pendingMux);
+    if(fetchesInFlight > 0) fetchesInFlight--;
+    portEXIT_CRITICAL(&pendingMux);
+}
+
+// 結果キューが溢れても取得済みキャッシュは残るので捨ててよい（その分は完了として数える）
+static void postResult(const WeatherFetchResult &result){
+    if(xQueueSend(fetchResultQueue, &result, 0) != pdTRUE) finishFetch();
+}
+
+static void weatherWorkerLoop(void*){
+    WeatherFetchRequest request;
+    for(;;){
+        if(xQueueReceive(fetchRequestQueue, &request, portMAX_DELAY) != pdTRUE) continue;
+
+        portENTER_CRITICAL(&pendingMux);
+        refreshPending = false;
+        portEXIT_CRITICAL(&pendingMux);
+
+        uint32_t staleMask = weatherStaleMask(request.force);
+
+        WeatherFetchResult result;
+        result.cityMask = 0;
+        result.status = FETCH_OK;
+        result.httpCode = 0;
+        // 全都市が新しければ通信しない（完了だけ知らせて、待っている側の印を下ろさせる）
+        if(!staleMask){
+            postResult(result);
+            continue;
+        }
+
+        // 回線はマネージャーに要求して待つ。待つのはワーカーだけ
+        wifiRequestLink();
+        if(wifiWaitLinkUp(WORKER_LINK_WAIT)){
+            int httpCode = 0;
+            result.status = fetchWeatherGroup(staleMask, result.cityMask, httpCode);
+            result.httpCode = (int16_t)httpCode;
+        } else {
+            result.status = FETCH_NO_WIFI;
+            if(traceRecording()) traceHttp(TRACE_HTTP_NO_WIFI, nullptr, 0, millis());
+        }
+        wifiReleaseLink();
+
+        postResult(result);
+    }
+}
+
+void startWeatherWorker(const char* key){
+    if(workerTask) return;
+    apiKey = key;
+    fetchRequestQueue = xQueueCreate(FETCH_QUEUE_LEN, sizeof(WeatherFetchRequest));
+    fetchResultQueue = xQueueCreate(FETCH_QUEUE_LEN, sizeof(WeatherFetchResult));
+    xTaskCreatePinnedToCore(weatherWorkerLoop, "weather", WORKER_STACK, nullptr,
+                            WORKER_PRIORITY, &workerTask, WORKER_CORE);
+    memWatchTask("weather", workerTask, MEM_TAG_WEATHER);
+}
+
+bool requestWeatherRefresh(bool force){
+    if(!fetchRequestQueue) return false;
+    if(replaying) return true;      // 応答はトレースから届く
+
+    portENTER_CRITICAL(&pendingMux);
+    bool alreadyPending = refreshPending;
+    refreshPending = true;
+    if(!alreadyPending || force) fetchesInFlight++;     // ワーカーが結果を出す前に数える
+    portEXIT_CRITICAL(&pendingMux);
+    if(alreadyPending && !force) return true;
+
+    WeatherFetchRequest request = { force };
+    if(xQueueSend(fetchRequestQueue, &request, 0) != pdTRUE){
+        portENTER_CRITICAL(&pendingMux);
+        refreshPending = false;
+        fetchesInFlight--;
+        portEXIT_CRITICAL(&pendingMux);
+        return false;
+    }
+    return true;
+}
+
+bool pollWeatherFetchResult(WeatherFetchResult &result){
+    if(!fetchResultQueue) return false;
+    if(xQueueReceive(fetchResultQueue, &result, 0) != pdTRUE) return false;
+    finishFetch();
+    return true;
+}
+
+bool weatherFetchPending(){
+    portENTER_CRITICAL(&pendingMux);
+    bool pending = fetchesInFlight > 0;
+    portEXIT_CRITICAL(&pendingMux);
+    return pending;
+}
+
+void weatherSetReplay(bool on){
+    replaying = on;
+}
+
+void weatherReplayResponse(int httpCode, HalStream* body){
+    WeatherFetchResult result;
+    result.cityMask = 0;
+    result.status = handleResponse(httpCode, body, result.cityMask);
+    result.httpCode = (int16_t)httpCode;
+    if(!fetchResultQueue) return;
+    portENTER_CRITICAL(&pendingMux);
+    fetchesInFlight++;      // 受け取った時の差し引きが合うように
+    portEXIT_CRITICAL(&pendingMux);
+    postResult(result);
+}
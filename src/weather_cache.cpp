@@ -0,0 +1,215 @@
+// ==========================================
+// 天気キャッシュとパース
+// ==========================================
+
+#include "weather_cache.h"
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+
+CityInfo cities[NUM_CITIES] = {
+    {"Osaka",   1853909},
+    {"Tokyo",   1850147},
+    {"Nagoya",  1856057},
+    {"Sapporo", 2128295},
+    {"Fukuoka", 1863967},
+    {"Naha",    1894616}
+};
+WeatherCache weatherCache[NUM_CITIES];
+
+// フィルターと1都市分の領域は、64bitのPCでも足りるようにノード数から出す
+// {"id", "weather":[{"id", "description"}], "main":{"temp"}}
+constexpr size_t WEATHER_FILTER_DOC_SIZE =
+    JSON_OBJECT_SIZE(3) + JSON_ARRAY_SIZE(1) + JSON_OBJECT_SIZE(2) + JSON_OBJECT_SIZE(1);
+// ストリームから読むのでキー（6個、終端込み36バイト）と説明文もドキュメントへ複写される
+constexpr size_t WEATHER_ITEM_DOC_SIZE =
+    WEATHER_FILTER_DOC_SIZE + JSON_STRING_SIZE(36) + JSON_STRING_SIZE(WEATHER_DESC_LEN);
+
+static std::mutex cacheMutex;
+static uint32_t staleMs = WEATHER_STALE_MS;
+
+// 天気コードの百の位で引く。800（快晴）だけは8xxの中で別扱い
+static const WeatherSymbol SYMBOL_BY_GROUP[10] = {
+    SYM_UNKNOWN, SYM_UNKNOWN, SYM_THUNDER, SYM_RAIN, SYM_UNKNOWN,
+    SYM_RAIN,    SYM_SNOW,    SYM_UNKNOWN, SYM_CLOUD, SYM_UNKNOWN
+};
+
+WeatherSymbol weatherSymbolFromCode(uint16_t conditionCode){
+    if(conditionCode == 800) return SYM_SUN;
+    uint16_t group = conditionCode / 100;
+    return group < 10 ? SYMBOL_BY_GROUP[group] : SYM_UNKNOWN;
+}
+
+void lockWeatherCache(){
+    cacheMutex.lock();
+}
+
+void unlockWeatherCache(){
+    cacheMutex.unlock();
+}
+
+bool isWeatherStale(int cityIdx){
+    lockWeatherCache();
+    const WeatherCache &c = weatherCache[cityIdx];
+    bool stale = !c.valid || halMillis() - c.lastFetch >= staleMs;
+    unlockWeatherCache();
+    return stale;
+}
+
+void setWeatherStaleMs(uint32_t ms){
+    lockWeatherCache();
+    staleMs = ms;
+    unlockWeatherCache();
+}
+
+uint32_t weatherStaleMask(bool force){
+    uint32_t mask = 0;
+    for(int i=0;i<NUM_CITIES;i++){
+        if(force || isWeatherStale(i)) mask |= (1u << i);
+    }
+    return mask;
+}
+
+int weatherGroupUrl(char* out, size_t len, const char* base, uint32_t cityMask, const char* apiKey){
+    int n = snprintf(out, len, "%s/data/2.5/group?id=", base);
+    bool first = true;
+    for(int i=0;i<NUM_CITIES;i++){
+        if(!(cityMask & (1u << i))) continue;
+        n += snprintf(out + n, n < (int)len ? len - n : 0, first ? "%lu" : ",%lu", (unsigned long)cities[i].id);
+        first = false;
+    }
+    n += snprintf(out + n, n < (int)len ? len - n : 0, "&units=metric&lang=en&appid=%s", apiKey);
+    return n;
+}
+
+// weather配列の2つ目以降の要素を読み飛ばして渡すストリーム
+// ArduinoJsonのフィルターは配列の全要素に同じ条件を当てるので、天気が複数ある都市（雨 + 霧など）では
+// 1都市分のドキュメントが溢れてNoMemoryになる。使うのは先頭の要素だけなので、パーサーに見せない
+// 文字列の中の括弧やエスケープは数えないよう、1文字ずつ状態を追う
+class FirstConditionStream : public HalStream {
+public:
+    explicit FirstConditionStream(HalStream &in) : in(in) {}
+    int available() override { return (ahead >= 0 ? 1 : 0) + in.available(); }
+    int read() override {
+        int c = peek();
+        ahead = -1;
+        return c;
+    }
+    int peek() override {
+        if(ahead < 0) ahead = next();
+        return ahead;
+    }
+#ifdef ARDUINO
+    size_t write(uint8_t) override { return 0; }
+#endif
+
+private:
+    int next();
+
+    HalStream &in;
+    int ahead = -1;             // peek()で読んだ1文字
+    int depth = 0;              // {と[の深さ
+    int arrayDepth = 0;         // weather配列の中の深さ（0は外）
+    bool dropping = false;      // 先頭の要素を渡し終え、]まで捨てている
+    bool inString = false;
+    bool escaped = false;
+    bool afterWeatherKey = false;
+    char key[8];
+    size_t keyLen = 0;
+};
+
+// 読めた文字が無ければ-1（状態は変えないので、実機の待ち読みでもそのまま呼び直せる）
+int FirstConditionStream::next(){
+    for(;;){
+        int c = in.read();
+        if(c < 0) return -1;
+        bool pass = !dropping;
+        if(inString){
+            if(escaped) escaped = false;
+            else if(c == '\\') escaped = true;
+            else if(c == '"'){
+                inString = false;
+                afterWeatherKey = keyLen == 7 && memcmp(key, "weather", 7) == 0;
+            } else if(keyLen < sizeof(key)) key[keyLen++] = (char)c;
+            else keyLen = sizeof(key);
+        } else {
+            bool weatherValue = afterWeatherKey;
+            if(c != ':' && c != ' ' && c != '\n' && c != '\r' && c != '\t') afterWeatherKey = false;
+            switch(c){
+                case '"':
+                    inString = true;
+                    keyLen = 0;
+                    break;
+                case '{':
+                    depth++;
+                    break;
+                case '[':
+                    depth++;
+                    if(weatherValue && !arrayDepth) arrayDepth = depth;
+                    break;
+                case '}':
+                    depth--;
+                    if(arrayDepth && depth == arrayDepth) dropping = true;     // 先頭の要素が閉じた
+                    break;
+                case ']':
+                    if(arrayDepth && depth == arrayDepth){
+                        arrayDepth = 0;
+                        dropping = false;
+                        pass = true;
+                    }
+                    depth--;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if(pass) return c;
+    }
+}
+
+static int findCityById(uint32_t id){
+    for(int i=0;i<NUM_CITIES;i++){
+        if(cities[i].id == id) return i;
+    }
+    return -1;
+}
+
+// "list"配列を1都市ずつフィルタ付きでデシリアライズする。
+// ドキュメントは1都市分（天気は先頭の1つ）しか持たないので、都市数やペイロード長に関係なくRAM使用量は一定
+bool parseWeatherGroupStream(HalStream &raw, uint32_t &updatedMask){
+    FirstConditionStream in(raw);
+    static StaticJsonDocument<WEATHER_FILTER_DOC_SIZE> filter;
+    if(filter.isNull()){
+        filter["id"] = true;
+        filter["weather"][0]["id"] = true;
+        filter["weather"][0]["description"] = true;
+        filter["main"]["temp"] = true;
+    }
+
+    if(!in.find("\"list\":[")) return false;
+
+    StaticJsonDocument<WEATHER_ITEM_DOC_SIZE> item;
+    do {
+        DeserializationError err = deserializeJson(item, in, DeserializationOption::Filter(filter));
+        if(err) break;      // 途中で切れても、それまでに読めた都市の更新は残す
+
+        int cityIdx = findCityById(item["id"] | 0L);
+        if(cityIdx < 0) continue;
+
+        uint16_t code = item["weather"][0]["id"] | 0;
+
+        lockWeatherCache();
+        WeatherCache &c = weatherCache[cityIdx];
+        c.valid = true;
+        snprintf(c.description, sizeof(c.description), "%s", item["weather"][0]["description"] | "NoDesc");
+        c.conditionCode = code;
+        c.symbol = weatherSymbolFromCode(code);
+        c.temp = item["main"]["temp"] | 0.0f;
+        c.lastFetch = halMillis();
+        unlockWeatherCache();
+        updatedMask |= (1u << cityIdx);
+    } while(in.findUntil(",", "]"));
+    return updatedMask != 0;
+}
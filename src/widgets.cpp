@@ -0,0 +1,127 @@
+// ==========================================
+// 保持型ウィジェット
+// ==========================================
+
+#include "widgets.h"
+
+#include <stdarg.h>
+
+bool Widget::render(){
+    if(!dirty) return false;
+    draw();
+    dirty = false;
+    return true;
+}
+
+Label::Label(int x, int y, uint8_t textSize, const char* text)
+    : x(x), y(y), textSize(textSize), text(text) {}
+
+void Label::setText(const char* t){
+    if(t == text) return;
+    text = t;
+    markDirty();
+}
+
+void Label::setColors(uint8_t f, uint8_t b){
+    if(f == fg && b == bg) return;
+    fg = f; bg = b;
+    markDirty();
+}
+
+void Label::setBox(int bx, int by, int bw, int bh){
+    boxX = bx; boxY = by; boxW = bw; boxH = bh;
+    markDirty();
+}
+
+void Label::draw(){
+    if(boxW > 0) canvas.fillRect(boxX, boxY, boxW, boxH, bg);
+    canvas.setTextSize(textSize);
+    canvas.setTextColor(fg, bg);
+    canvas.setCursor(x, y);
+    canvas.printf("%s", text);
+}
+
+ValueField::ValueField(int x, int y, int w, int h, uint8_t textSize)
+    : x(x), y(y), w(w), h(h), textSize(textSize) {}
+
+void ValueField::set(const char* fmt, ...){
+    char next[sizeof(text)];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(next, sizeof(next), fmt, args);
+    va_end(args);
+    if(strcmp(next, text) == 0) return;
+    strlcpy(text, next, sizeof(text));
+    markDirty();
+}
+
+void ValueField::setColor(uint8_t f){
+    if(f == fg) return;
+    fg = f;
+    markDirty();
+}
+
+void ValueField::clear(){
+    if(text[0] == '\0') return;
+    text[0] = '\0';
+    markDirty();
+}
+
+void ValueField::draw(){
+    canvas.fillRect(x, y, w, h, NORMAL_BG);
+    canvas.setTextSize(textSize);
+    canvas.setTextColor(fg, NORMAL_BG);
+    canvas.setCursor(x, y);
+    canvas.printf("%s", text);
+}
+
+Bar::Bar(int x, int y, int w, int h) : x(x), y(y), w(w), h(h) {}
+
+void Bar::set(int p, uint8_t c){
+    if(p < 0) p = 0;
+    if(p > 100) p = 100;
+    if(p == percent && c == color) return;
+    percent = p;
+    color = c;
+    markDirty();
+}
+
+void Bar::draw(){
+    int fillWidth = (percent * w) / 100;
+    canvas.fillRect(x, y, fillWidth, h, color);
+    canvas.fillRect(x + fillWidth, y, w - fillWidth, h, NORMAL_BG);
+}
+
+void Plot::setVersion(uint32_t v){
+    if(v == version) return;
+    version = v;
+    markDirty();
+}
+
+void Plot::draw(){
+    drawFn(full);
+    full = false;
+}
+
+static int updateWidgets(const Screen &screen){
+    if(screen.update) screen.update();
+    int drawn = 0;
+    for(int i=0;i<screen.widgetCount;i++){
+        if(screen.widgets[i]->render()) drawn++;
+    }
+    return drawn;
+}
+
+void enterScreen(const Screen &screen){
+    PROF_SCOPE(screen.probe);
+    canvas.fillScreen(NORMAL_BG);
+    if(screen.enter) screen.enter();
+    for(int i=0;i<screen.widgetCount;i++) screen.widgets[i]->invalidate();
+    updateWidgets(screen);
+    frameDiffInvalidate();      // 切り替え時は全タイル送る（ハッシュの一致で残ったタイルもここで直る）
+}
+
+int updateScreen(const Screen &screen){
+    PROF_SCOPE(screen.probe);
+    return updateWidgets(screen);
+}
@@ -0,0 +1,150 @@
+// ==========================================
+// WiFi接続マネージャー
+// ==========================================
+
+#include "wifi_manager.h"
+
+#include <WiFi.h>
+#include <atomic>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+constexpr unsigned long CONNECT_TIMEOUT = 10000;
+constexpr unsigned long BACKOFF_INITIAL = 2000;
+constexpr unsigned long BACKOFF_MAX = 300000;
+constexpr unsigned long RADIO_IDLE_GRACE = 10000;   // 解放後、無線OFFまでの猶予
+
+constexpr EventBits_t LINK_UP_BIT = 1 << 0;
+
+static const char* wifiSsid = "";
+static const char* wifiPass = "";
+
+static WiFiLinkState state = LINK_OFF;
+static unsigned long stateSince = 0;
+static unsigned long backoffMs = BACKOFF_INITIAL;
+
+static std::atomic<int> linkRequests{0};
+static std::atomic<uint32_t> lastRelease{0};     // 解放はワーカーからも来る
+static std::atomic<bool> gotIpEvent{false};
+static std::atomic<bool> disconnectEvent{false};
+static EventGroupHandle_t linkEvents = nullptr;
+
+// WiFiイベントタスクから呼ばれる。フラグを立てるだけ
+static void onWiFiEvent(arduino_event_id_t event, arduino_event_info_t){
+    switch(event){
+        case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+            gotIpEvent = true;
+            xEventGroupSetBits(linkEvents, LINK_UP_BIT);
+            break;
+        case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+        case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+            disconnectEvent = true;
+            xEventGroupClearBits(linkEvents, LINK_UP_BIT);
+            break;
+        default:
+            break;
+    }
+}
+
+static void enterState(WiFiLinkState next, unsigned long now){
+    state = next;
+    stateSince = now;
+}
+
+static void startConnect(unsigned long now){
+    gotIpEvent = false;
+    disconnectEvent = false;
+    WiFi.mode(WIFI_STA);
+    WiFi.begin(wifiSsid, wifiPass);
+    enterState(LINK_CONNECTING, now);
+}
+
+static void radioOff(unsigned long now){
+    xEventGroupClearBits(linkEvents, LINK_UP_BIT);
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    backoffMs = BACKOFF_INITIAL;
+    enterState(LINK_OFF, now);
+}
+
+static void startBackoff(unsigned long now){
+    WiFi.disconnect();
+    enterState(LINK_BACKOFF, now);
+}
+
+void wifiManagerBegin(const char* ssid, const char* pass){
+    wifiSsid = ssid;
+    wifiPass = pass;
+    linkEvents = xEventGroupCreate();
+    WiFi.persistent(false);         // 接続のたびにflashへ書かない
+    WiFi.setAutoReconnect(false);   // 再接続はこちらで制御する
+    WiFi.onEvent(onWiFiEvent);
+    WiFi.mode(WIFI_OFF);
+    enterState(LINK_OFF, millis());
+}
+
+bool wifiManagerUpdate(){
+    unsigned long now = millis();
+    WiFiLinkState prev = state;
+    bool wanted = linkRequests > 0;
+
+    switch(state){
+        case LINK_OFF:
+            if(wanted) startConnect(now);
+            break;
+
+        case LINK_CONNECTING:
+            if(gotIpEvent.exchange(false)){
+                WiFi.setSleep(true);    // 接続中はモデムスリープ
+                backoffMs = BACKOFF_INITIAL;
+                disconnectEvent = false;
+                enterState(LINK_UP, now);
+            } else if(disconnectEvent.exchange(false) || now - stateSince >= CONNECT_TIMEOUT){
+                startBackoff(now);
+            }
+            break;
+
+        case LINK_UP:
+            if(disconnectEvent.exchange(false)){
+                startBackoff(now);
+            } else if(!wanted && now - lastRelease >= RADIO_IDLE_GRACE){
+                radioOff(now);
+            }
+            break;
+
+        case LINK_BACKOFF:
+            if(!wanted){
+                radioOff(now);
+            } else if(now - stateSince >= backoffMs){
+                backoffMs = min(backoffMs * 2, BACKOFF_MAX);
+                startConnect(now);
+            }
+            break;
+    }
+    return state != prev;
+}
+
+void wifiRequestLink(){
+    linkRequests++;
+}
+
+// 0で止める（余分な解放で負にしない）。0を直接書くと、同時に来た要求の加算を消してしまう
+void wifiReleaseLink(){
+    int n = linkRequests.load();
+    while(n > 0 && !linkRequests.compare_exchange_weak(n, n - 1)) {}
+    if(n <= 1) lastRelease = millis();
+}
+
+WiFiLinkState wifiLinkState(){
+    return state;
+}
+
+bool wifiLinkUp(){
+    return linkEvents && (xEventGroupGetBits(linkEvents) & LINK_UP_BIT);
+}
+
+bool wifiWaitLinkUp(uint32_t timeoutMs){
+    if(!linkEvents) return false;
+    EventBits_t bits = xEventGroupWaitBits(linkEvents, LINK_UP_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    return bits & LINK_UP_BIT;
+}
@@ -0,0 +1,168 @@
+// ==========================================
+// 適応サンプリングのテスト（pio test -e native -f test_adaptive_sampler）
+// - 周期の倍増・最短への戻り・早めに許す幅・millis()の一周
+// - PC版の模擬センサーで24時間を1秒ごとに再生し、計測タスクと同じ判定で読む回数を数える
+//   読まなかった秒は直前に読んだ値を使うとして、毎秒の真の値との誤差を出す
+// ==========================================
+
+#include <unity.h>
+#include "adaptive_sampler.h"
+#include "hal_native.h"
+#include "light_sensor.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+
+// sensors.cppと同じ値
+constexpr uint32_t PERIOD_MS = 1000;
+constexpr uint32_t BME_MAX_MS = 30000;
+constexpr uint32_t LIGHT_MAX_MS = 5000;
+constexpr float TEMP_STEP = 0.05f;
+constexpr float HUM_STEP = 0.3f;
+constexpr float PRESS_STEP = 0.05f;
+constexpr float LUX_MIN_STEP = 3.0f;
+constexpr float LUX_REL_STEP = 0.05f;
+
+constexpr uint32_t DAY_S = 24 * 3600;
+
+void setUp(){
+    halNativeReset();
+}
+
+void tearDown(){}
+
+void test_period_doubles_and_resets(){
+    AdaptiveSampler s(1000, 30000);
+    uint32_t now = 0;
+    const uint32_t expect[] = {2000, 4000, 8000, 16000, 30000, 30000};
+    for(uint32_t e : expect){
+        TEST_ASSERT_TRUE(s.due(now));
+        s.measured(0.1f, now);
+        TEST_ASSERT_EQUAL_UINT32(e, s.period());
+        now += e;
+    }
+    s.measured(0.7f, now);          // 半分〜1の間は据え置き
+    TEST_ASSERT_EQUAL_UINT32(30000, s.period());
+    s.measured(1.0f, now);
+    TEST_ASSERT_EQUAL_UINT32(1000, s.period());
+}
+
+void test_due_early_margin_and_wrap(){
+    AdaptiveSampler s(1000, 8000);
+    uint32_t t0 = UINT32_MAX - 1500;
+    s.measured(0.0f, t0);           // 周期2000
+    TEST_ASSERT_FALSE(s.due(t0 + 1499));
+    TEST_ASSERT_TRUE(s.due(t0 + 1500));     // 最短周期の半分まで早めてよい（ここでmillis()が一周）
+    s.reset();
+    TEST_ASSERT_TRUE(s.due(t0));
+    TEST_ASSERT_EQUAL_UINT32(1000, s.period());
+}
+
+void test_change_of_missing_value_counts_as_moving(){
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, adaptiveChange(NAN, 1.0f, 0.1f));
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, adaptiveChange(1.0f, NAN, 0.1f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 2.0f, adaptiveChange(1.2f, 1.0f, 0.1f));
+}
+
+// 値の誤差（読んだ値を保持した時の真の値とのずれ）
+struct Errors {
+    std::vector<float> v;
+    void add(float e){ v.push_back(fabsf(e)); }
+    float quantile(float q){
+        std::sort(v.begin(), v.end());
+        return v[(size_t)(q * (v.size() - 1))];
+    }
+    float max(){ return *std::max_element(v.begin(), v.end()); }
+};
+
+static HalEnvReading readEnv(){
+    HalEnvReading r;
+    halEnvStart();
+    halNativeAdvance(10);
+    TEST_ASSERT_EQUAL(HAL_ENV_OK, halEnvRead(r));
+    return r;
+}
+
+void test_replay_day_env(){
+    AdaptiveSampler sampler(PERIOD_MS, BME_MAX_MS);
+    HalEnvReading held{};
+    Errors temp, hum, press;
+    uint32_t reads = 0;
+    for(uint32_t i=0;i<DAY_S;i++){
+        uint32_t now = halMillis();
+        HalEnvReading truth = readEnv();    // 毎秒の真の値（PC版はいつ読んでも同じ模擬値）
+        if(sampler.due(now)){
+            float change = adaptiveChange(truth.temp, held.temp, TEMP_STEP);
+            change = fmaxf(change, adaptiveChange(truth.hum, held.hum, HUM_STEP));
+            change = fmaxf(change, adaptiveChange(truth.pressure, held.pressure, PRESS_STEP));
+            sampler.measured(i ? change : 1.0f, now);
+            held = truth;
+            reads++;
+        }
+        temp.add(truth.temp - held.temp);
+        hum.add(truth.hum - held.hum);
+        press.add(truth.pressure - held.pressure);
+        halNativeAdvance(PERIOD_MS - 10);
+    }
+    char msg[160];
+    snprintf(msg, sizeof(msg), "env 24h: %u reads of %u (%.1f%%), temp p99 %.3f max %.3f, hum p99 %.2f max %.2f, press p99 %.3f max %.3f",
+             (unsigned)reads, (unsigned)DAY_S, 100.0 * reads / DAY_S,
+             temp.quantile(0.99f), temp.max(), hum.quantile(0.99f), hum.max(), press.quantile(0.99f), press.max());
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(DAY_S / 4, reads);
+    // 1回の読み逃しのずれはしきい値とノイズの幅に収まる
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(TEMP_STEP + 0.04f, temp.max());
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(HUM_STEP + 0.4f, hum.max());
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(PRESS_STEP + 0.06f, press.max());
+    TEST_ASSERT_LESS_OR_EQUAL_FLOAT(TEMP_STEP, temp.quantile(0.99f));
+}
+
+// sensors.cppのreadLight()と同じ取り方（20回読んでトリム平均）
+static int readLux(){
+    uint16_t raw[LIGHT_OVERSAMPLE];
+    for(int i=0;i<LIGHT_OVERSAMPLE;i++){
+        if(i) halLightWait();
+        raw[i] = (uint16_t)halLightRaw();
+    }
+    return lightMillivoltsToLux(halLightMillivolts(lightTrimmedMean(raw, LIGHT_OVERSAMPLE, LIGHT_TRIM)));
+}
+
+void test_replay_day_light(){
+    AdaptiveSampler sampler(PERIOD_MS, LIGHT_MAX_MS);
+    Errors lux;
+    int held = -1;
+    uint32_t reads = 0, over = 0;
+    for(uint32_t i=0;i<DAY_S;i++){
+        uint32_t now = halMillis();
+        int truth = readLux();
+        if(sampler.due(now)){
+            float step = fmaxf(LUX_MIN_STEP, truth * LUX_REL_STEP);
+            sampler.measured(held < 0 ? 1.0f : adaptiveChange(truth, held, step), now);
+            held = truth;
+            reads++;
+        }
+        float err = truth - held;
+        lux.add(err);
+        if(fabsf(err) > fmaxf(LUX_MIN_STEP, truth * LUX_REL_STEP) * 2) over++;
+        halNativeAdvance(PERIOD_MS - (LIGHT_OVERSAMPLE - 1));
+    }
+    char msg[128];
+    snprintf(msg, sizeof(msg), "light 24h: %u reads of %u (%.1f%%), lux p99 %.1f max %.1f, over 2 steps %u s",
+             (unsigned)reads, (unsigned)DAY_S, 100.0 * reads / DAY_S, lux.quantile(0.99f), lux.max(), (unsigned)over);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(DAY_S / 2, reads);
+    // 大きくずれるのは朝夕に照明が切り替わった直後の1周期だけ
+    TEST_ASSERT_LESS_THAN(DAY_S / 1000, over);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_period_doubles_and_resets);
+    RUN_TEST(test_due_early_margin_and_wrap);
+    RUN_TEST(test_change_of_missing_value_counts_as_moving);
+    RUN_TEST(test_replay_day_env);
+    RUN_TEST(test_replay_day_light);
+    return UNITY_END();
+}
@@ -0,0 +1,228 @@
+// ==========================================
+// 方位の計算のテスト（pio test -e native -f test_compass）
+// - 角度の折り返し、平らな時の傾き補正がatan2(my, mx)と同じになるか
+// - ロール・ピッチ±40度まで傾けても方位がずれないか（補正しない方位とのずれも出す）
+// - ハードアイアン・ソフトアイアンで歪めた地磁気を全方向に回して校正し、方位が戻るか
+// - 相補フィルター: 回転への追従、地磁気のノイズを抑えるか、揺さぶられている間はジャイロだけで進むか
+// ==========================================
+
+#include <unity.h>
+#include "compass.h"
+
+#include <stdio.h>
+
+constexpr float DEG = (float)M_PI / 180.0f;
+constexpr float FIELD_H = 30.0f;        // 水平成分（hal_nativeと同じ大きさ）
+constexpr float FIELD_Z = -35.0f;
+
+struct Vec { float x, y, z; };
+
+// 水平に置いた機体から見た量を、ロール（x軸まわり）→ ピッチ（y軸まわり）の順に傾けた機体から見た量にする
+// 機体の向き R = Ry(pitch)·Rx(roll) なので、機体から見たベクトルは R^T·v。x軸の水平面での向きは変わらない
+static Vec tilt(Vec v, float roll, float pitch){
+    float cr = cosf(roll), sr = sinf(roll), cp = cosf(pitch), sp = sinf(pitch);
+    // Ry^T
+    Vec a = { cp * v.x - sp * v.z, v.y, sp * v.x + cp * v.z };
+    // Rx^T
+    return Vec{ a.x, cr * a.y + sr * a.z, -sr * a.y + cr * a.z };
+}
+
+// 方位headingで水平に置いた時の読み（hal_nativeと同じ向き）を傾ける
+static HalImuReading reading(float heading, float roll = 0.0f, float pitch = 0.0f, float yawRate = 0.0f){
+    Vec g = tilt(Vec{0.0f, 0.0f, 1.0f}, roll, pitch);
+    Vec m = tilt(Vec{FIELD_H * cosf(heading * DEG), FIELD_H * sinf(heading * DEG), FIELD_Z}, roll, pitch);
+    Vec w = tilt(Vec{0.0f, 0.0f, -yawRate}, roll, pitch);      // 方位が増える向きは鉛直軸まわりの負の回転
+    return HalImuReading{g.x, g.y, g.z, w.x, w.y, w.z, m.x, m.y, m.z};
+}
+
+static uint32_t seed = 1;
+static float noise(){
+    seed = seed * 1664525u + 1013904223u;
+    return (int32_t)seed / 2147483648.0f;
+}
+
+void setUp(){
+    seed = 1;
+}
+
+void tearDown(){}
+
+void test_wrap_and_delta(){
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 350.0f, headingWrap(-10.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 0.0f, headingWrap(720.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 1.0f, headingWrap(-719.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 20.0f, headingDelta(10.0f, 350.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, -20.0f, headingDelta(350.0f, 10.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, 180.0f, headingDelta(180.0f, 0.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1e-4f, -179.0f, headingDelta(0.0f, 179.0f));
+}
+
+void test_flat_matches_atan2(){
+    CompassCalibration none;
+    for(int h=0;h<360;h+=15){
+        HalImuReading r = reading((float)h);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, headingDelta(compassTiltHeading(r, none), (float)h));
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, headingDelta(compassFlatHeading(r.magX, r.magY, none), (float)h));
+    }
+    HalImuReading noGravity = reading(0.0f);
+    noGravity.accelX = noGravity.accelY = noGravity.accelZ = 0.0f;
+    TEST_ASSERT_TRUE(isnan(compassTiltHeading(noGravity, none)));
+    TEST_ASSERT_TRUE(isnan(compassFlatHeading(NAN, 1.0f, none)));
+}
+
+void test_tilt_compensation(){
+    CompassCalibration none;
+    float worstTilt = 0, worstFlat = 0;
+    for(int h=0;h<360;h+=10){
+        for(int roll=-40;roll<=40;roll+=10){
+            for(int pitch=-40;pitch<=40;pitch+=10){
+                HalImuReading r = reading((float)h, roll * DEG, pitch * DEG);
+                worstTilt = fmaxf(worstTilt, fabsf(headingDelta(compassTiltHeading(r, none), (float)h)));
+                worstFlat = fmaxf(worstFlat, fabsf(headingDelta(compassFlatHeading(r.magX, r.magY, none), (float)h)));
+            }
+        }
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "roll/pitch up to 40 deg: worst %.3f deg tilt-compensated, %.1f deg flat", worstTilt, worstFlat);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(0.05f, worstTilt);
+    TEST_ASSERT_TRUE(worstFlat > 20.0f);
+}
+
+// 機体に付いた磁性体のずれ（各軸の中心と振れ幅）
+static const float HARD[3] = {12.0f, -7.5f, 4.0f};
+static const float SOFT[3] = {1.25f, 0.8f, 1.05f};
+
+static HalImuReading distort(HalImuReading r){
+    r.magX = r.magX * SOFT[0] + HARD[0];
+    r.magY = r.magY * SOFT[1] + HARD[1];
+    r.magZ = r.magZ * SOFT[2] + HARD[2];
+    return r;
+}
+
+void test_calibration(){
+    CompassCalibrator cal;
+    cal.begin();
+    // 全方向に回す（方位を回しながら裏返しもする）。途中に読めなかったサンプル
+    for(int i=0;i<600;i++){
+        HalImuReading r = distort(reading(i * 7.3f, i * 2.9f * DEG, 80.0f * DEG * sinf(i * 0.031f)));
+        cal.add(r.magX + 0.2f * noise(), r.magY + 0.2f * noise(), r.magZ + 0.2f * noise());
+        if(i % 50 == 0) cal.add(NAN, 0.0f, 0.0f);
+    }
+    TEST_ASSERT_EQUAL_UINT32(600, cal.samples());
+    CompassCalibration c;
+    TEST_ASSERT_TRUE(cal.finish(c));
+    TEST_ASSERT_TRUE(c.valid);
+    for(int i=0;i<3;i++) TEST_ASSERT_FLOAT_WITHIN(1.5f, HARD[i], c.offset[i]);
+    // 倍率は各軸をそろえるだけなので、比で比べる
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, SOFT[1] / SOFT[0], c.scale[0] / c.scale[1]);
+
+    CompassCalibration none;
+    float worstCal = 0, worstRaw = 0;
+    for(int h=0;h<360;h+=5){
+        HalImuReading r = distort(reading((float)h, 20.0f * DEG, -15.0f * DEG));
+        worstCal = fmaxf(worstCal, fabsf(headingDelta(compassTiltHeading(r, c), (float)h)));
+        worstRaw = fmaxf(worstRaw, fabsf(headingDelta(compassTiltHeading(r, none), (float)h)));
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "distorted field: worst %.2f deg calibrated, %.1f deg uncalibrated", worstCal, worstRaw);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(3.0f, worstCal);
+    TEST_ASSERT_TRUE(worstRaw > 15.0f);
+}
+
+void test_calibration_needs_range_and_samples(){
+    CompassCalibrator cal;
+    CompassCalibration c;
+    c.offset[0] = 99.0f;
+    cal.begin();
+    for(uint32_t i=0;i<COMPASS_CAL_MIN_SAMPLES - 1;i++){
+        HalImuReading r = reading(i * 10.0f, 60.0f * DEG * sinf(i * 0.1f), 60.0f * DEG * cosf(i * 0.1f));
+        cal.add(r.magX, r.magY, r.magZ);
+    }
+    TEST_ASSERT_FALSE(cal.finish(c));       // 数が足りない
+    cal.begin();
+    for(int i=0;i<400;i++){
+        HalImuReading r = reading(i * 3.0f);    // 平らに回しただけではzが振れない
+        cal.add(r.magX, r.magY, r.magZ);
+    }
+    TEST_ASSERT_FALSE(cal.finish(c));
+    TEST_ASSERT_EQUAL_FLOAT(99.0f, c.offset[0]);    // 失敗したら触らない
+    TEST_ASSERT_FALSE(c.valid);
+}
+
+// 50Hzで6度/秒の回転（350度から0度をまたぐ）
+void test_filter_tracks_rotation_and_smooths_noise(){
+    CompassCalibration none;
+    CompassFilter f;
+    const float dt = 0.02f;
+    float heading = 350.0f, worst = 0, sumFilt = 0, sumRaw = 0;
+    int n = 0;
+    TEST_ASSERT_FALSE(f.valid());
+    for(int i=0;i<1500;i++){
+        HalImuReading r = reading(heading, 0.0f, 0.0f, 6.0f);
+        r.gyroZ += 0.2f * noise();
+        r.magX += 3.0f * noise();
+        r.magY += 3.0f * noise();
+        float raw = compassTiltHeading(r, none);
+        float out = f.update(r, none, i ? dt : 0.0f);
+        TEST_ASSERT_TRUE(f.valid());
+        if(i >= 250){       // 時定数の10倍待ってから
+            float e = fabsf(headingDelta(out, heading));
+            worst = fmaxf(worst, e);
+            sumFilt += e * e;
+            sumRaw += headingDelta(raw, heading) * headingDelta(raw, heading);
+            n++;
+        }
+        heading = headingWrap(heading + 6.0f * dt);
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "rms error %.2f deg filtered, %.2f deg magnetometer only", sqrtf(sumFilt / n), sqrtf(sumRaw / n));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(2.0f, worst);
+    TEST_ASSERT_LESS_THAN(sqrtf(sumRaw / n) / 2, sqrtf(sumFilt / n));
+}
+
+// 揺さぶられて加速度が1.6Gの間は、傾きの狂った地磁気の方位を使わずジャイロで進む
+void test_filter_ignores_magnetometer_while_shaken(){
+    CompassCalibration none;
+    CompassFilter f;
+    const float dt = 0.02f;
+    float heading = 90.0f;
+    for(int i=0;i<100;i++){
+        f.update(reading(heading, 0.0f, 0.0f, 6.0f), none, i ? dt : 0.0f);
+        heading += 6.0f * dt;
+    }
+    float worst = 0;
+    for(int i=0;i<100;i++){
+        HalImuReading r = reading(heading, 0.0f, 0.0f, 6.0f);
+        r.accelX += 0.6f;           // 横に振られて重力の向きが45度近くずれて見える
+        r.accelZ += 0.6f;
+        float out = f.update(r, none, dt);
+        worst = fmaxf(worst, fabsf(headingDelta(out, heading)));
+        heading += 6.0f * dt;
+    }
+    TEST_ASSERT_LESS_THAN(1.0f, worst);
+
+    f.reset();
+    TEST_ASSERT_FALSE(f.valid());
+    HalImuReading bad = reading(0.0f);
+    bad.magX = NAN;
+    f.update(bad, none, dt);
+    TEST_ASSERT_FALSE(f.valid());       // 地磁気が取れるまで始めない
+    f.update(reading(45.0f), none, dt);
+    TEST_ASSERT_TRUE(f.valid());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 45.0f, f.heading());
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_wrap_and_delta);
+    RUN_TEST(test_flat_matches_atan2);
+    RUN_TEST(test_tilt_compensation);
+    RUN_TEST(test_calibration);
+    RUN_TEST(test_calibration_needs_range_and_samples);
+    RUN_TEST(test_filter_tracks_rotation_and_smooths_noise);
+    RUN_TEST(test_filter_ignores_magnetometer_while_shaken);
+    return UNITY_END();
+}
@@ -0,0 +1,192 @@
+// ==========================================
+// 気象傾向と短期予報のテスト（pio test -e native -f test_forecast）
+// - 足し引きで更新する直線の当てはめが、スロット平均を全部持って解き直した結果と一致するか
+//   （何百周も回して誤差が溜まらないか・millis()の一周・長い空白）
+// - 一定の速さで下がる気圧で3時間の変化・傾向・Zambrettiが出るか、急な下降の前倒し
+// - 露点・暑さ指数・海面気圧・Zambrettiの番号を既知の値と比べる
+// ==========================================
+
+#include <unity.h>
+#include "forecast.h"
+
+#include <stdio.h>
+#include <vector>
+
+constexpr uint32_t MINUTE_MS = 60000;
+constexpr uint32_t SLOT_MS = 15 * MINUTE_MS;
+constexpr int SLOTS = 13;
+
+struct Point {
+    uint32_t slot;
+    double y;
+};
+
+// 閉じたスロットのうち直近SLOTS - 1個の平均で解き直す
+static TrendFit naiveFit(const std::vector<Point> &pts, uint32_t closedSlots){
+    TrendFit f;
+    double n = 0, sx = 0, sy = 0, sxy = 0, sxx = 0;
+    uint32_t last = 0;
+    for(const Point &p : pts){
+        if(p.slot >= closedSlots || p.slot + (SLOTS - 1) < closedSlots) continue;
+        double x = p.slot;
+        n++; sx += x; sy += p.y; sxy += x * p.y; sxx += x * x;
+        last = p.slot;
+    }
+    f.points = (uint16_t)n;
+    if(n < TREND_MIN_POINTS) return f;
+    double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    f.valid = true;
+    f.slopePerHour = (float)(slope * 3600000.0 / SLOT_MS);
+    f.value = (float)((sy - slope * sx) / n + slope * last);
+    return f;
+}
+
+void setUp(){
+    forecastReset();
+}
+
+void tearDown(){}
+
+// 1分ごとの気圧（ゆっくりした波 + 細かい揺れ）で300時間（1周3時間 x 100周）
+void test_incremental_fit_matches_full_solve(){
+    TrendWindow<SLOTS> w(SLOT_MS);
+    w.reset();
+    std::vector<Point> pts;
+    uint32_t t0 = UINT32_MAX - 40 * MINUTE_MS;      // 途中でmillis()が一周する
+    double sum = 0;
+    int count = 0;
+    uint32_t seed = 1;
+    float worstSlope = 0, worstValue = 0;
+    for(uint32_t m=0;m<300 * 60;m++){
+        uint32_t slot = m / 15;
+        if(m % 15 == 0 && m){
+            if(count) pts.push_back(Point{slot - 1, sum / count});
+            sum = 0;
+            count = 0;
+            TrendFit a = w.fit(t0 + m * MINUTE_MS);
+            TrendFit b = naiveFit(pts, slot);
+            TEST_ASSERT_EQUAL(b.valid, a.valid);
+            TEST_ASSERT_EQUAL_UINT16(b.points, a.points);
+            if(a.valid){
+                worstSlope = fmaxf(worstSlope, fabsf(a.slopePerHour - b.slopePerHour));
+                worstValue = fmaxf(worstValue, fabsf(a.value - b.value));
+            }
+        }
+        seed = seed * 1664525u + 1013904223u;
+        bool missing = (m / 15) % 37 == 5;      // 時々1スロットまるごと欠測
+        if(missing) continue;
+        float v = 1005.0f + 8.0f * sinf(m / 700.0f) + ((seed >> 16) % 100) / 500.0f;
+        w.add(v, t0 + m * MINUTE_MS);
+        sum += v;
+        count++;
+    }
+    char msg[96];
+    snprintf(msg, sizeof(msg), "worst diff over 300 h: slope %.5f hPa/h, value %.5f hPa", worstSlope, worstValue);
+    TEST_MESSAGE(msg);
+    // floatの桁（1000hPa台で7桁）の範囲。周回で溜まっていけばここを超える
+    TEST_ASSERT_LESS_THAN(0.005f, worstSlope);
+    TEST_ASSERT_LESS_THAN(0.01f, worstValue);
+}
+
+void test_long_gap_empties_window(){
+    TrendWindow<SLOTS> w(SLOT_MS);
+    w.reset();
+    for(uint32_t m=0;m<4 * 60;m++) w.add(1000.0f + m * 0.01f, m * MINUTE_MS);
+    TEST_ASSERT_TRUE(w.fit(4 * 60 * MINUTE_MS).valid);
+    uint32_t later = 4 * 60 * MINUTE_MS + 24 * 3600000u;      // 1日止まっていた
+    TEST_ASSERT_FALSE(w.fit(later).valid);
+    for(uint32_t m=0;m<60;m++) w.add(990.0f, later + m * MINUTE_MS);
+    TrendFit f = w.fit(later + 60 * MINUTE_MS);
+    TEST_ASSERT_TRUE(f.valid);
+    TEST_ASSERT_EQUAL_UINT16(4, f.points);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 990.0f, f.value);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, 0.0f, f.slopePerHour);
+}
+
+// 1秒ごとに2hPa/3hで下がる気圧を4時間
+void test_steady_fall(){
+    uint32_t now = 0;
+    for(uint32_t s=0;s<4 * 3600;s++){
+        now = s * 1000;
+        forecastAdd(20.0f, 60.0f, 1010.0f - s * (2.0f / 10800.0f), now);
+    }
+    Forecast f = forecastCurrent(now);
+    TEST_ASSERT_TRUE(f.valid);
+    TEST_ASSERT_FLOAT_WITHIN(0.02f, -2.0f, f.change3h);
+    TEST_ASSERT_EQUAL(TENDENCY_FALLING, f.tendency);
+    // 値は最後に閉じたスロットの真ん中あたり（現在より最大1スロット半古い）
+    float current = 1010.0f - now * (2.0f / 10800000.0f);
+    TEST_ASSERT_FLOAT_WITHIN(0.3f, current, f.pressure);
+    TEST_ASSERT_TRUE(f.zambretti >= 1 && f.zambretti <= 9);
+    TEST_ASSERT_NOT_EQUAL('?', f.letter);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, f.tempPerHour);
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 12.0f, f.dewPoint);
+    TEST_ASSERT_FALSE(forecastSharpDrop(f));        // 0.67hPa/hは急ではない
+    TEST_ASSERT_TRUE(forecastChange(f) >= 1.0f);
+}
+
+// 落ち着いた日（細かい揺れだけ）は動いていない扱い、そこから2hPa/hで下がり始めたら前倒し
+void test_sharp_drop(){
+    uint32_t now = 0, seed = 7;
+    for(uint32_t s=0;s<4 * 3600;s++){
+        now = s * 1000;
+        seed = seed * 1664525u + 1013904223u;
+        forecastAdd(22.0f, 50.0f, 1013.0f + ((seed >> 16) % 100) / 1000.0f, now);
+    }
+    Forecast f = forecastCurrent(now);
+    TEST_ASSERT_EQUAL(TENDENCY_STEADY, f.tendency);
+    TEST_ASSERT_FALSE(forecastSharpDrop(f));
+    TEST_ASSERT_LESS_THAN(1.0f, forecastChange(f));
+
+    uint32_t dropStart = now, detectedAt = 0;
+    for(uint32_t s=1;s<=3600;s++){
+        now = dropStart + s * 1000;
+        forecastAdd(22.0f, 50.0f, 1013.0f - s * (2.0f / 3600.0f), now);
+        if(!detectedAt && forecastSharpDrop(forecastCurrent(now))) detectedAt = now;
+    }
+    TEST_ASSERT_NOT_EQUAL(0, detectedAt);
+    char msg[64];
+    snprintf(msg, sizeof(msg), "2 hPa/h drop flagged after %lu min", (unsigned long)((detectedAt - dropStart) / MINUTE_MS));
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_OR_EQUAL(45 * MINUTE_MS, detectedAt - dropStart);
+}
+
+void test_missing_values_and_no_data(){
+    Forecast f = forecastCurrent(0);
+    TEST_ASSERT_FALSE(f.valid);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, forecastChange(f));
+    TEST_ASSERT_EQUAL('?', f.letter);
+    for(uint32_t m=0;m<4 * 60;m++) forecastAdd(NAN, NAN, 1000.0f, m * MINUTE_MS);
+    f = forecastCurrent(4 * 60 * MINUTE_MS);
+    TEST_ASSERT_TRUE(f.valid);
+    TEST_ASSERT_TRUE(isnan(f.temp));
+    TEST_ASSERT_TRUE(isnan(f.dewPoint));
+    TEST_ASSERT_EQUAL(TENDENCY_STEADY, f.tendency);
+}
+
+void test_formulas(){
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 9.26f, dewPoint(20.0f, 50.0f));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 25.0f, dewPoint(25.0f, 100.0f));
+    TEST_ASSERT_TRUE(isnan(dewPoint(20.0f, 0.0f)));
+    // NOAAの表: 90°F・70%で106°F
+    TEST_ASSERT_FLOAT_WITHIN(0.6f, (106.0f - 32.0f) / 1.8f, heatIndex((90.0f - 32.0f) / 1.8f, 70.0f));
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 20.0f, heatIndex(20.0f, 50.0f));      // 涼しい時は気温とほぼ同じ
+    TEST_ASSERT_FLOAT_WITHIN(0.2f, 1011.9f, seaLevelPressure(1000.0f, 15.0f, 100.0f));
+    TEST_ASSERT_EQUAL_FLOAT(1000.0f, seaLevelPressure(1000.0f, 15.0f, 0.0f));
+    TEST_ASSERT_EQUAL_UINT8(12, zambrettiNumber(1013.0f, TENDENCY_STEADY));
+    TEST_ASSERT_EQUAL('E', zambrettiLetter(12));
+    TEST_ASSERT_EQUAL_UINT8(20, zambrettiNumber(1030.0f, TENDENCY_RISING));
+    TEST_ASSERT_EQUAL_UINT8(9, zambrettiNumber(950.0f, TENDENCY_FALLING));     // 範囲の端で止まる
+    TEST_ASSERT_EQUAL_UINT8(0, zambrettiNumber(NAN, TENDENCY_STEADY));
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_incremental_fit_matches_full_solve);
+    RUN_TEST(test_long_gap_empties_window);
+    RUN_TEST(test_steady_fall);
+    RUN_TEST(test_sharp_drop);
+    RUN_TEST(test_missing_values_and_no_data);
+    RUN_TEST(test_formulas);
+    return UNITY_END();
+}
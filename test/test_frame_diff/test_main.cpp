@@ -0,0 +1,100 @@
+// ==========================================
+// フレーム差分転送のテスト（pio test -e native -f test_frame_diff）
+// - 変化したタイルだけ送るか、変化なしなら何も送らないか
+// - パネル側だけが古くなった時（ハッシュの一致で送り損ねたのと同じ状態）に
+//   FRAME_FULL_PUSH_FRAMESフレーム以内で直るか
+// - frameDiffInvalidate()の次のフレームで全タイル送るか
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "frame_diff.h"
+
+#include <string.h>
+
+constexpr uint32_t FULL_PIXELS = SCREEN_W * SCREEN_H;
+
+static uint8_t back[FRAME_BYTES];
+
+static void fillRect4(int x, int y, int w, int h, uint8_t color){
+    for(int py=y; py<y+h; py++){
+        for(int px=x; px<x+w; px++){
+            uint8_t &b = back[py * (SCREEN_W / 2) + px / 2];
+            b = (px & 1) ? (b & 0xF0) | color : (b & 0x0F) | (color << 4);
+        }
+    }
+}
+
+// パネルの内容がバックバッファと一致するか
+static bool panelMatches(){
+    const uint16_t* fb = halNativeFramebuffer();
+    for(int y=0; y<SCREEN_H; y++){
+        for(int x=0; x<SCREEN_W; x++){
+            uint8_t b = back[y * (SCREEN_W / 2) + x / 2];
+            const uint8_t* rgb = PALETTE_RGB[(x & 1) ? (b & 0x0F) : (b >> 4)];
+            uint16_t c = ((rgb[0] & 0xF8) << 8) | ((rgb[1] & 0xFC) << 3) | (rgb[2] >> 3);
+            if(fb[y * SCREEN_W + x] != (uint16_t)((c >> 8) | (c << 8))) return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t pixelsOf(uint32_t frames){
+    uint64_t before = halNativeDisplay().pixelWrites;
+    for(uint32_t i=0; i<frames; i++) frameDiffPresent(back);
+    return (uint32_t)(halNativeDisplay().pixelWrites - before);
+}
+
+void setUp(){
+    halNativeReset();
+    memset(back, 0, sizeof(back));
+    frameDiffBegin();
+    TEST_ASSERT_EQUAL_UINT32(FULL_PIXELS * 2, frameDiffPresent(back));
+}
+
+void tearDown(){}
+
+void test_only_changed_tiles_are_sent(){
+    TEST_ASSERT_EQUAL_UINT32(0, frameDiffPresent(back));
+    fillRect4(40, 20, 8, 4, RED);       // タイル1枚（32x8）の中
+    TEST_ASSERT_EQUAL_UINT32(32 * 8, pixelsOf(1));
+    fillRect4(0, 100, SCREEN_W, 1, BLUE);   // タイル1行
+    TEST_ASSERT_EQUAL_UINT32(SCREEN_W * 8, pixelsOf(1));
+    TEST_ASSERT_TRUE(panelMatches());
+}
+
+void test_stale_panel_recovers_within_full_push_interval(){
+    fillRect4(0, 0, SCREEN_W, SCREEN_H, GREEN);
+    frameDiffPresent(back);
+    TEST_ASSERT_TRUE(panelMatches());
+
+    // パネルだけ消す（ハッシュは一致したまま = 送り損ねたタイルと同じ）
+    halNativeReset();
+    TEST_ASSERT_FALSE(panelMatches());
+
+    uint32_t frames = 0;
+    while(!panelMatches() && frames < FRAME_FULL_PUSH_FRAMES + 1){
+        frameDiffPresent(back);
+        frames++;
+    }
+    TEST_ASSERT_TRUE(panelMatches());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(FRAME_FULL_PUSH_FRAMES, frames);
+
+    // 次の全送りまでは変化なしで何も送らない
+    TEST_ASSERT_EQUAL_UINT32(0, pixelsOf(FRAME_FULL_PUSH_FRAMES - 1));
+    TEST_ASSERT_EQUAL_UINT32(FULL_PIXELS, pixelsOf(1));
+}
+
+void test_invalidate_sends_every_tile_once(){
+    frameDiffInvalidate();
+    TEST_ASSERT_EQUAL_UINT32(FULL_PIXELS, pixelsOf(1));
+    TEST_ASSERT_EQUAL_UINT32(0, pixelsOf(1));
+}
+
+int main(){
+    UNITY_BEGIN();
+    RUN_TEST(test_only_changed_tiles_are_sent);
+    RUN_TEST(test_stale_panel_recovers_within_full_push_interval);
+    RUN_TEST(test_invalidate_sends_every_tile_once);
+    return UNITY_END();
+}
@@ -0,0 +1,163 @@
+// ==========================================
+// 計測履歴ストアのテスト（pio test -e native -f test_history_store）
+// - 段ごとの集約・読めた件数・区間の集計（気圧のチャンネルも）・欠測の差し込み
+// - 前の時刻・millis()の一周で1分段が空の点で埋まらないか、1秒段の時刻が戻らないか
+// ==========================================
+
+#include <unity.h>
+#include "history_store.h"
+
+void setUp(){ historyReset(); }
+void tearDown(){}
+
+// 1秒ごとに温度 = 20 + (分 % 10)、湿度50、照度 = 秒、気圧 = 1000 + (分 % 10)
+static uint32_t appendSeconds(uint32_t start, int seconds){
+    uint32_t now = start;
+    for(int i=0;i<seconds;i++, now += 1000){
+        historyAppend(20.0f + (i / 60) % 10, 50.0f, i % 60, 1000.0f + (i / 60) % 10, now);
+    }
+    return now;
+}
+
+void test_tiers_aggregate(){
+    appendSeconds(0, 3 * 3600 + 1);
+    TEST_ASSERT_EQUAL(180, historySize(TIER_1MIN));
+    TEST_ASSERT_EQUAL(3, historySize(TIER_1HOUR));
+
+    HistBucket b;
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 0, b));
+    TEST_ASSERT_EQUAL_INT16(histEncode(HIST_TEMP, 29.0f), b.ch[HIST_TEMP].mean);
+    TEST_ASSERT_EQUAL_INT16(0, b.ch[HIST_LUX].min);
+    TEST_ASSERT_EQUAL_INT16(59, b.ch[HIST_LUX].max);
+
+    HistPoint p;
+    TEST_ASSERT_TRUE(historySummary(TIER_1HOUR, HIST_TEMP, 0, 3, p));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 24.5f, histDecode(HIST_TEMP, p.mean));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 20.0f, histDecode(HIST_TEMP, p.min));
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 29.0f, histDecode(HIST_TEMP, p.max));
+}
+
+// 読めた件数は保持している分まで。範囲の外は0
+void test_read_returns_visited_count(){
+    appendSeconds(0, 90);
+    HistPoint out[200];
+    TEST_ASSERT_EQUAL(90, historyRead(TIER_1SEC, HIST_LUX, 0, 200, out));
+    TEST_ASSERT_EQUAL(30, historyRead(TIER_1SEC, HIST_LUX, 60, 200, out));
+    TEST_ASSERT_EQUAL(0, historyRead(TIER_1SEC, HIST_LUX, 90, 10, out));
+    TEST_ASSERT_EQUAL(1, historyRead(TIER_1MIN, HIST_LUX, 0, 10, out));
+
+    // 古い順。最新は89秒目（照度29）
+    TEST_ASSERT_EQUAL(5, historyRead(TIER_1SEC, HIST_LUX, 0, 5, out));
+    for(int i=0;i<5;i++) TEST_ASSERT_EQUAL_INT16(25 + i, out[i].mean);
+}
+
+// 1秒段は圧縮ブロックを何個もまたいで読める
+void test_seconds_span_blocks(){
+    appendSeconds(0, 4000);
+    TEST_ASSERT_GREATER_THAN(2, (int)historySecBlocksClosed());
+    int size = historySize(TIER_1SEC);
+    static HistPoint out[4000];
+    TEST_ASSERT_EQUAL(size, historyRead(TIER_1SEC, HIST_LUX, 0, size, out));
+    for(int i=0;i<size;i++) TEST_ASSERT_EQUAL_INT16((4000 - size + i) % 60, out[i].mean);
+}
+
+// 前の時刻が来ても1分段を空の点で埋め尽くさない（差が桁あふれしていた）
+void test_earlier_time_does_not_flood(){
+    uint32_t now = appendSeconds(100000, 120);
+    int before = historySize(TIER_1MIN);
+    historyAppend(21.0f, 50.0f, 0, 1013.0f, now - 90000);     // 今の1分より前
+    TEST_ASSERT_EQUAL(before, historySize(TIER_1MIN));
+}
+
+// millis()の一周をまたいでも1秒段の時刻は進み続け、1分段は1分ずつ閉じる
+void test_clock_survives_millis_wrap(){
+    uint32_t start = 0xFFFFFFFFu - 90000;
+    historyAppend(20.0f, 50.0f, 0, 1013.0f, start);
+    uint32_t prev = historyClockSec();
+    uint32_t now = start;
+    for(int i=0;i<180;i++){
+        now += 1000;
+        historyAppend(20.0f, 50.0f, 0, 1013.0f, now);
+        TEST_ASSERT_EQUAL_UINT32(prev + 1, historyClockSec());
+        prev = historyClockSec();
+    }
+    TEST_ASSERT_EQUAL(3, historySize(TIER_1MIN));
+}
+
+// 空白の間は欠測の点で埋め、集計は欠測を飛ばす
+void test_gap_fills_missing(){
+    uint32_t now = appendSeconds(0, 60);
+    appendSeconds(now + 5 * 60000, 61);
+    HistBucket b;
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 2, b));
+    TEST_ASSERT_EQUAL_INT16(HIST_MISSING, b.ch[HIST_TEMP].mean);
+    HistPoint p;
+    TEST_ASSERT_TRUE(historySummary(TIER_1MIN, HIST_HUM, 0, historySize(TIER_1MIN), p));
+    TEST_ASSERT_EQUAL_INT16(histEncode(HIST_HUM, 50.0f), p.mean);
+}
+
+// 気圧は0.1hPaで1秒段（圧縮ブロック）にも上の段にも載る。読めなかった秒は欠測
+void test_pressure_channel(){
+    appendSeconds(0, 3600 + 1);
+    HistPoint p;
+    TEST_ASSERT_TRUE(historySummary(TIER_1HOUR, HIST_PRESS, 0, 1, p));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 1004.5f, histDecode(HIST_PRESS, p.mean));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 1000.0f, histDecode(HIST_PRESS, p.min));
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 1009.0f, histDecode(HIST_PRESS, p.max));
+    TEST_ASSERT_EQUAL_INT16(10132, histEncode(HIST_PRESS, 1013.2f));
+
+    historyReset();
+    uint32_t now = 0;
+    for(int i=0;i<120;i++, now += 1000) historyAppend(20.0f, 50.0f, 0, (i % 2) ? NAN : 1013.2f, now);
+    HistPoint out[2];
+    TEST_ASSERT_EQUAL(2, historyRead(TIER_1SEC, HIST_PRESS, 0, 2, out));
+    TEST_ASSERT_EQUAL_INT16(10132, out[0].mean);
+    TEST_ASSERT_EQUAL_INT16(HIST_MISSING, out[1].mean);
+    TEST_ASSERT_TRUE(historySummary(TIER_1MIN, HIST_PRESS, 0, 1, p));
+    TEST_ASSERT_EQUAL_INT16(10132, p.min);
+    TEST_ASSERT_EQUAL_INT16(10132, p.max);
+}
+
+// 欠測の差し込みは新しい方からback件の手前へ。満杯なら古い方から落ちる
+void test_insert_gap(){
+    appendSeconds(0, 10 * 60 + 1);      // 1分段は温度20〜29の10点
+    TEST_ASSERT_EQUAL(4, historyInsertGap(TIER_1MIN, 3, 4));
+    TEST_ASSERT_EQUAL(14, historySize(TIER_1MIN));
+    TEST_ASSERT_EQUAL_UINT32(14, historyAppendCount(TIER_1MIN));
+    HistBucket b;
+    for(int i=0;i<14;i++){
+        TEST_ASSERT_TRUE(historyGet(TIER_1MIN, i, b));
+        if(i >= 3 && i < 7) TEST_ASSERT_EQUAL_INT16(HIST_MISSING, b.ch[HIST_TEMP].mean);
+        else TEST_ASSERT_EQUAL_INT16(histEncode(HIST_TEMP, 29.0f - (i < 3 ? i : i - 4)), b.ch[HIST_TEMP].mean);
+    }
+    TEST_ASSERT_EQUAL(0, historyInsertGap(TIER_1MIN, 15, 1));
+    TEST_ASSERT_EQUAL(0, historyInsertGap(TIER_1SEC, 0, 1));
+
+    historyReset();
+    for(int i=0;i<HIST_HOUR_SLOTS;i++){
+        HistBucket h;
+        for(int c=0;c<NUM_HIST_CHANNELS;c++) h.ch[c] = { (int16_t)i, (int16_t)i, (int16_t)i };
+        historyRestore(TIER_1HOUR, h);
+    }
+    TEST_ASSERT_EQUAL(5, historyInsertGap(TIER_1HOUR, 2, 5));
+    TEST_ASSERT_EQUAL(HIST_HOUR_SLOTS, historySize(TIER_1HOUR));
+    TEST_ASSERT_TRUE(historyGet(TIER_1HOUR, 0, b));
+    TEST_ASSERT_EQUAL_INT16(HIST_HOUR_SLOTS - 1, b.ch[HIST_TEMP].mean);
+    TEST_ASSERT_TRUE(historyGet(TIER_1HOUR, 7, b));
+    TEST_ASSERT_EQUAL_INT16(HIST_HOUR_SLOTS - 3, b.ch[HIST_TEMP].mean);
+    TEST_ASSERT_TRUE(historyGet(TIER_1HOUR, HIST_HOUR_SLOTS - 1, b));
+    TEST_ASSERT_EQUAL_INT16(5, b.ch[HIST_TEMP].mean);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_tiers_aggregate);
+    RUN_TEST(test_read_returns_visited_count);
+    RUN_TEST(test_seconds_span_blocks);
+    RUN_TEST(test_earlier_time_does_not_flood);
+    RUN_TEST(test_clock_survives_millis_wrap);
+    RUN_TEST(test_gap_fills_missing);
+    RUN_TEST(test_pressure_channel);
+    RUN_TEST(test_insert_gap);
+    return UNITY_END();
+}
@@ -0,0 +1,111 @@
+// ==========================================
+// 照度センサーの信号処理のテスト（pio test -e native -f test_light_sensor）
+// - トリム平均が外れ値を捨てるか、残りが無い時の中央値
+// - 夜の照明のちらつき（100Hz）: 1回読みと計測タスクと同じ20回読み + トリム平均のばらつきを比べる
+// - 電圧→照度の表（校正点で一致・単調・端で張り付く）とLEDのヒステリシス
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "light_sensor.h"
+
+#include <math.h>
+#include <stdio.h>
+
+void setUp(){
+    halNativeReset();       // 模擬時計の0時（夜の照明）
+}
+
+void tearDown(){}
+
+void test_trimmed_mean_rejects_spikes(){
+    uint16_t s[LIGHT_OVERSAMPLE];
+    for(int i=0;i<LIGHT_OVERSAMPLE;i++) s[i] = 1000 + (i % 3);
+    s[2] = 4095; s[7] = 4095; s[11] = 4095; s[19] = 4095;
+    s[0] = 0; s[5] = 0; s[9] = 0; s[15] = 0;
+    uint16_t m = lightTrimmedMean(s, LIGHT_OVERSAMPLE, LIGHT_TRIM);
+    TEST_ASSERT_UINT32_WITHIN(2, 1001, m);
+    for(int i=1;i<LIGHT_OVERSAMPLE;i++) TEST_ASSERT_TRUE(s[i - 1] <= s[i]);     // 並べ替え済み
+}
+
+void test_trimmed_mean_rounding_and_median(){
+    uint16_t a[] = {1, 2};
+    TEST_ASSERT_EQUAL_UINT16(2, lightTrimmedMean(a, 2, 0));     // 1.5は切り上げ
+    uint16_t b[] = {9, 1, 5, 3, 7};
+    TEST_ASSERT_EQUAL_UINT16(5, lightTrimmedMean(b, 5, 3));     // 残りが無ければ中央値
+    TEST_ASSERT_EQUAL_UINT16(0, lightTrimmedMean(b, 0, 0));
+}
+
+// sensors.cppのreadLight()と同じ取り方
+static uint16_t readFiltered(){
+    uint16_t raw[LIGHT_OVERSAMPLE];
+    for(int i=0;i<LIGHT_OVERSAMPLE;i++){
+        if(i) halLightWait();
+        raw[i] = (uint16_t)halLightRaw();
+    }
+    return halLightMillivolts(lightTrimmedMean(raw, LIGHT_OVERSAMPLE, LIGHT_TRIM));
+}
+
+static double stddev(const double* v, int n){
+    double mean = 0, var = 0;
+    for(int i=0;i<n;i++) mean += v[i] / n;
+    for(int i=0;i<n;i++) var += (v[i] - mean) * (v[i] - mean) / n;
+    return sqrt(var);
+}
+
+// 1秒ごとに300回。1回読みは読んだ瞬間のちらつきの位相で値が揺れる
+void test_oversampling_reduces_flicker(){
+    const int n = 300;
+    double single[n], filtered[n];
+    for(int i=0;i<n;i++){
+        halNativeAdvance(997);      // 1秒周期から少しずらして、ちらつきの色々な位相で読む
+        single[i] = halLightMillivolts((uint16_t)halLightRaw());
+        filtered[i] = readFiltered();
+    }
+    double sSingle = stddev(single, n), sFiltered = stddev(filtered, n);
+    char msg[96];
+    snprintf(msg, sizeof(msg), "night: 1 read %.1f mV sd, %d reads + trim %.1f mV sd", sSingle, LIGHT_OVERSAMPLE, sFiltered);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(sSingle / 3, sFiltered);
+}
+
+void test_lux_table(){
+    TEST_ASSERT_EQUAL(0, lightMillivoltsToLux(0));
+    TEST_ASSERT_EQUAL(10, lightMillivoltsToLux(33));
+    TEST_ASSERT_EQUAL(100, lightMillivoltsToLux(330));
+    TEST_ASSERT_EQUAL(500, lightMillivoltsToLux(1650));
+    TEST_ASSERT_EQUAL(2000, lightMillivoltsToLux(3150));
+    TEST_ASSERT_EQUAL(2000, lightMillivoltsToLux(5000));        // 範囲外は端の値
+    TEST_ASSERT_EQUAL(200, lightMillivoltsToLux(660));          // 330〜990の中間
+    int last = 0;
+    for(uint32_t mv=0;mv<=3300;mv++){
+        int lux = lightMillivoltsToLux(mv);
+        TEST_ASSERT_TRUE(lux >= last);
+        last = lux;
+    }
+}
+
+// 20lx未満で点灯、40lx超で消灯。間を行き来している間は変わらない
+void test_led_hysteresis(){
+    const int lux[] = {100, 39, 25, 20, 19, 25, 35, 40, 39, 41, 30, 21, 19};
+    const bool expect[] = {false, false, false, false, true, true, true, true, true, false, false, false, true};
+    bool on = false;
+    int changes = 0;
+    for(unsigned i=0;i<sizeof(lux)/sizeof(lux[0]);i++){
+        bool next = lightLedState(on, lux[i], 20, 40);
+        if(next != on) changes++;
+        on = next;
+        TEST_ASSERT_EQUAL(expect[i], on);
+    }
+    TEST_ASSERT_EQUAL(3, changes);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_trimmed_mean_rejects_spikes);
+    RUN_TEST(test_trimmed_mean_rounding_and_median);
+    RUN_TEST(test_oversampling_reduces_flicker);
+    RUN_TEST(test_lux_table);
+    RUN_TEST(test_led_hysteresis);
+    return UNITY_END();
+}
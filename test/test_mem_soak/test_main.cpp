@@ -0,0 +1,224 @@
+// ==========================================
+// メモリ監視の耐久試験（pio test -e native -f test_mem_soak）
+// - 実機のヒープの代わりに先頭から詰めるだけの模擬ヒープ（96KB）を置き、
+//   空き・最大連続ブロック・最小空きをheap_caps_*と同じ意味で出す
+// - 確保は実際のmalloc/freeも通すので、MEM_HOOKSのフックで数えた回数と生きているブロック数を突き合わせる
+// - 1分ごとの計測と10分ごとの天気取得を48時間分流し、mem_statsの判定を見る
+//   きれいに解放する時は何も出ず、取得ごとに100B残す時はLEAK、
+//   長く持つ小さいブロックが隙間を挟んで並んでいく時はFRAG、空きが尽きかける時はLOWになること
+// ==========================================
+
+#include <unity.h>
+#include "mem_stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <deque>
+#include <map>
+
+constexpr uint32_t HEAP_BYTES = 96 * 1024;
+constexpr uint32_t MINUTE_MS = 60000;
+constexpr int SOAK_MINUTES = 48 * 60;
+constexpr int FETCH_EVERY_MIN = 10;
+
+// 先頭から最初に入る隙間へ置く（first fit）。隣の空きとはまとめない代わりに隙間を走査して数える
+class SimHeap {
+public:
+    void reset(){
+        blocks.clear();
+        minFree = HEAP_BYTES;
+    }
+    void* alloc(uint32_t size){
+        uint32_t at = 0;
+        bool found = false;
+        for(auto &b : blocks){
+            if(b.first - at >= size){ found = true; break; }
+            at = b.first + b.second.size;
+        }
+        if(!found && HEAP_BYTES - at < size) return nullptr;
+        void* p = malloc(size);         // 回数はMEM_HOOKSのフックで数える
+        if(!p) return nullptr;
+        blocks[at] = Block{size, p};
+        owner[p] = at;
+        uint32_t f = freeBytes();
+        if(f < minFree) minFree = f;
+        return p;
+    }
+    // その場で縮める（後ろが隙間になる）
+    void* shrink(void* p, uint32_t size){
+        auto it = owner.find(p);
+        TEST_ASSERT_TRUE(it != owner.end());
+        uint32_t pos = it->second;
+        Block &b = blocks[pos];
+        void* q = realloc(p, size);
+        TEST_ASSERT_NOT_NULL(q);
+        owner.erase(it);
+        owner[q] = pos;
+        b.size = size;
+        b.p = q;
+        return q;
+    }
+    void release(void* p){
+        if(!p) return;
+        auto it = owner.find(p);
+        TEST_ASSERT_TRUE(it != owner.end());
+        blocks.erase(it->second);
+        owner.erase(it);
+        free(p);
+    }
+    uint32_t freeBytes() const {
+        uint32_t used = 0;
+        for(auto &b : blocks) used += b.second.size;
+        return HEAP_BYTES - used;
+    }
+    uint32_t largestBlock() const {
+        uint32_t at = 0, largest = 0;
+        for(auto &b : blocks){
+            if(b.first - at > largest) largest = b.first - at;
+            at = b.first + b.second.size;
+        }
+        return HEAP_BYTES - at > largest ? HEAP_BYTES - at : largest;
+    }
+    uint32_t minimumFree() const { return minFree; }
+    size_t live() const { return blocks.size(); }
+
+private:
+    struct Block {
+        uint32_t size;
+        void* p;
+    };
+    std::map<uint32_t, Block> blocks;       // 位置 → ブロック
+    std::map<void*, uint32_t> owner;
+    uint32_t minFree = HEAP_BYTES;
+};
+
+static SimHeap heap;
+
+enum Fault { FAULT_NONE, FAULT_LEAK, FAULT_FRAG, FAULT_LOW };
+
+struct SoakResult {
+    uint8_t flags = 0;              // 最後の判定
+    uint8_t flagsSeen = 0;          // 途中で一度でも出た判定
+    int firstFlagMin = -1;          // 初めて判定が出た時刻（分）
+    MemTrend trend;
+};
+
+// 1分ぶんの仕事。描画と計測の一時的な確保は毎回解放する
+static void minuteWork(int minute, Fault fault, std::deque<void*> &keep){
+    void* frame = heap.alloc(2048);
+    void* line = heap.alloc(160 + (minute % 7) * 16);
+    heap.release(line);
+    heap.release(frame);
+
+    if(minute % FETCH_EVERY_MIN) return;
+    // 天気の取得: 受信バッファとパース中の小さい確保
+    void* buf = heap.alloc(6144 + (minute / FETCH_EVERY_MIN % 5) * 512);
+    void* parts[8];
+    for(int i=0;i<8;i++) parts[i] = heap.alloc(48 + i * 8);
+    switch(fault){
+    case FAULT_LEAK:
+        heap.alloc(100);            // 取得ごとに100B返さない
+        break;
+    case FAULT_FRAG: {
+        // 作業用の文字列の後ろに結果を確保し、16Bに縮めて持ち続ける。どちらも取得ごとに1Bずつ長くなる
+        // 作業用を返した隙間には次の（より長い）文字列が入らないので、隙間と16Bが交互に並び、
+        // 空きはほとんど減らないまま最大ブロックだけが縮んでいく
+        uint32_t len = 64 + minute / FETCH_EVERY_MIN;
+        void* scratch = heap.alloc(len);
+        keep.push_back(heap.shrink(heap.alloc(len + 1), 16));
+        heap.release(scratch);
+        break;
+    }
+    case FAULT_LOW:
+        keep.push_back(heap.alloc(2048));   // 取得ごとに2KB溜める（8時間ほどで尽きる）
+        break;
+    default:
+        break;
+    }
+    for(int i=0;i<8;i++) heap.release(parts[i]);
+    heap.release(buf);
+}
+
+static SoakResult runSoak(Fault fault){
+    heap.reset();
+    memStatsReset();
+    std::deque<void*> keep;
+    SoakResult r;
+    for(int m=0;m<SOAK_MINUTES;m++){
+        minuteWork(m, fault, keep);
+        memAddSample((uint32_t)m * MINUTE_MS, heap.freeBytes(), heap.largestBlock(), heap.minimumFree());
+        r.flags = memCheck(memTrend());
+        r.flagsSeen |= r.flags;
+        if(r.flags && r.firstFlagMin < 0) r.firstFlagMin = m;
+    }
+    r.trend = memTrend();
+    char msg[192];
+    snprintf(msg, sizeof(msg), "free %lu largest %lu min %lu, %+ld B/h free %+ld B/h largest, frag %u permille, flags 0x%02x first at %d min",
+             (unsigned long)r.trend.freeBytes, (unsigned long)r.trend.largestBlock, (unsigned long)r.trend.minFreeEver,
+             (long)r.trend.freePerHour, (long)r.trend.largestPerHour, r.trend.fragPermille, r.flagsSeen, r.firstFlagMin);
+    TEST_MESSAGE(msg);
+    return r;
+}
+
+void setUp(){}
+
+void tearDown(){
+    heap.reset();
+}
+
+void test_clean_churn_raises_nothing(){
+    MemTagStats before = memTagStats(MEM_TAG_LOOP);
+    SoakResult r = runSoak(FAULT_NONE);
+    TEST_ASSERT_EQUAL_HEX8(0, r.flagsSeen);
+    TEST_ASSERT_EQUAL(MEM_TREND_LEN, r.trend.points);
+    TEST_ASSERT_EQUAL(0, (int)heap.live());
+#ifdef MEM_HOOKS
+    // 数えたのは確保と解放の両方で同じ回数（48時間で2880分 × 2 + 288回 × 9）
+    const MemTagStats &after = memTagStats(MEM_TAG_LOOP);
+    uint32_t allocs = after.allocs - before.allocs, frees = after.frees - before.frees;
+    TEST_ASSERT_UINT32_WITHIN(64, SOAK_MINUTES * 2 + SOAK_MINUTES / FETCH_EVERY_MIN * 9, allocs);
+    TEST_ASSERT_EQUAL_UINT32(allocs, frees);
+#else
+    (void)before;
+#endif
+}
+
+void test_leak_is_flagged(){
+    MemTagStats before = memTagStats(MEM_TAG_LOOP);
+    SoakResult r = runSoak(FAULT_LEAK);
+    TEST_ASSERT_TRUE(r.flags & MEM_CHECK_LEAK);
+    TEST_ASSERT_FALSE(r.flagsSeen & MEM_CHECK_FRAG);
+    TEST_ASSERT_FALSE(r.flagsSeen & MEM_CHECK_LOW);
+    // 2時間分の点がたまるまでは判定しない
+    TEST_ASSERT_GREATER_OR_EQUAL(MEM_TREND_MIN_POINTS * 15, r.firstFlagMin);
+    TEST_ASSERT_INT_WITHIN(60, -600, r.trend.freePerHour);     // 6回 × 100B
+#ifdef MEM_HOOKS
+    const MemTagStats &after = memTagStats(MEM_TAG_LOOP);
+    TEST_ASSERT_EQUAL_UINT32(heap.live(), (after.allocs - before.allocs) - (after.frees - before.frees));
+#else
+    (void)before;
+#endif
+}
+
+void test_fragmentation_is_flagged(){
+    SoakResult r = runSoak(FAULT_FRAG);
+    TEST_ASSERT_TRUE(r.flagsSeen & MEM_CHECK_FRAG);
+    TEST_ASSERT_FALSE(r.flags & MEM_CHECK_LEAK);      // 空きの総量は減っていない
+    TEST_ASSERT_FALSE(r.flagsSeen & MEM_CHECK_LOW);
+}
+
+void test_exhaustion_is_flagged_low(){
+    SoakResult r = runSoak(FAULT_LOW);
+    TEST_ASSERT_TRUE(r.flagsSeen & MEM_CHECK_LOW);
+    TEST_ASSERT_TRUE(r.flagsSeen & MEM_CHECK_LEAK);
+    TEST_ASSERT_LESS_THAN(MEM_LOW_BYTES, r.trend.minFreeEver);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_clean_churn_raises_nothing);
+    RUN_TEST(test_leak_is_flagged);
+    RUN_TEST(test_fragmentation_is_flagged);
+    RUN_TEST(test_exhaustion_is_flagged_low);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+// ==========================================
+// ローリング統計のテスト（pio test -e native -f test_rolling_stats）
+// - 生の値を全部持って窓の中を走査した結果と一致するか
+// - 前の時刻のadd()・summary()の後のadd()・millis()の一周で窓が消えないか
+// ==========================================
+
+#include <unity.h>
+#include "rolling_stats.h"
+
+#include <stdlib.h>
+#include <vector>
+
+constexpr int SLOTS = 10;
+constexpr uint32_t SLOT_MS = 100;
+
+struct RawSample {
+    uint32_t slot;      // 始めからのスロット番号
+    float v;
+};
+
+// 窓 = nowのスロットを含む直近SLOTS個のスロット
+static RollingSummary naiveSummary(const std::vector<RawSample> &raw, uint32_t nowSlot){
+    RollingSummary s;
+    double sum = 0, sq = 0;
+    for(const RawSample &r : raw){
+        if(r.slot + SLOTS <= nowSlot) continue;
+        if(s.count == 0) s.min = s.max = r.v;
+        s.min = std::min(s.min, r.v);
+        s.max = std::max(s.max, r.v);
+        sum += r.v;
+        sq += (double)r.v * r.v;
+        s.count++;
+    }
+    s.valid = s.count > 0;
+    if(!s.valid) return s;
+    s.mean = sum / s.count;
+    s.stddev = s.count > 1 ? sqrt(std::max(0.0, (sq - sum * sum / s.count) / (s.count - 1))) : 0.0;
+    return s;
+}
+
+static void assertSame(const RollingSummary &want, const RollingSummary &got){
+    TEST_ASSERT_EQUAL(want.valid, got.valid);
+    TEST_ASSERT_EQUAL_UINT32(want.count, got.count);
+    if(!want.valid) return;
+    TEST_ASSERT_FLOAT_WITHIN(1e-3f, want.mean, got.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1e-2f, want.stddev, got.stddev);
+    TEST_ASSERT_EQUAL_FLOAT(want.min, got.min);
+    TEST_ASSERT_EQUAL_FLOAT(want.max, got.max);
+}
+
+void setUp(){ srand(1); }
+void tearDown(){}
+
+// 不規則な間隔（1スロットに0〜数個、空のスロットも挟む）で足し、毎回と少し先の時刻で比べる
+static void checkAgainstNaive(uint32_t t0){
+    RollingWindow<SLOTS> w(SLOT_MS);
+    std::vector<RawSample> raw;
+    uint32_t t = t0;
+    for(int i=0;i<3000;i++){
+        if(i > 0) t += rand() % (3 * SLOT_MS);     // スロットの区切りは最初に足した時刻から
+        float v = (rand() % 2000) / 10.0f - 50.0f;
+        w.add(v, t);
+        raw.push_back({ (t - t0) / SLOT_MS, v });
+
+        uint32_t nowSlot = (t - t0) / SLOT_MS;
+        assertSame(naiveSummary(raw, nowSlot), w.summary(t));
+        // 足さずに時間だけ進めた所（古いスロットが外れていく）
+        uint32_t ahead = rand() % (SLOTS + 2);
+        assertSame(naiveSummary(raw, nowSlot + ahead), w.summary(t + ahead * SLOT_MS));
+    }
+}
+
+void test_matches_naive_scan(){
+    checkAgainstNaive(5000);
+}
+
+void test_matches_naive_scan_across_millis_wrap(){
+    checkAgainstNaive(0xFFFFFFFFu - 20000);
+}
+
+// summary()は状態を変えない。窓を過ぎた時刻で聞いても、その後の参照と追加に影響しない
+void test_summary_does_not_advance(){
+    RollingWindow<SLOTS> w(SLOT_MS);
+    for(uint32_t t=0;t<SLOTS*SLOT_MS;t+=50) w.add(1.0f, t);
+    RollingSummary before = w.summary(SLOTS * SLOT_MS - 1);
+    TEST_ASSERT_TRUE(before.valid);
+
+    TEST_ASSERT_FALSE(w.summary(100 * SLOTS * SLOT_MS).valid);
+    assertSame(before, w.summary(SLOTS * SLOT_MS - 1));
+}
+
+// 先にmillis()で参照し、その後に少し前のサンプル時刻で足した時（以前は窓が全部消えた）
+void test_earlier_add_keeps_window(){
+    RollingWindow<SLOTS> w(SLOT_MS);
+    for(uint32_t t=1000;t<1500;t+=100) w.add(2.0f, t);
+    w.summary(1550);
+    w.add(4.0f, 1420);          // 今のスロット（1400〜）より前
+    RollingSummary s = w.summary(1450);
+    TEST_ASSERT_EQUAL_UINT32(6, s.count);
+    TEST_ASSERT_FLOAT_WITHIN(1e-5f, 14.0f / 6, s.mean);
+    TEST_ASSERT_EQUAL_FLOAT(4.0f, s.max);
+
+    w.add(6.0f, 1350);          // 前のスロットの時刻でも今のスロットに入る
+    s = w.summary(1450);
+    TEST_ASSERT_EQUAL_UINT32(7, s.count);
+    TEST_ASSERT_EQUAL_FLOAT(6.0f, s.max);
+}
+
+void test_nan_is_ignored(){
+    RollingStats stats;
+    stats.add(NAN, 0);
+    TEST_ASSERT_FALSE(stats.summary(STATS_1MIN, 0).valid);
+    stats.add(20.0f, 1000);
+    stats.add(NAN, 2000);
+    RollingSummary s = stats.summary(STATS_24HOUR, 2000);
+    TEST_ASSERT_EQUAL_UINT32(1, s.count);
+    TEST_ASSERT_EQUAL_FLOAT(20.0f, s.mean);
+}
+
+// 1分窓は1分後に空になるが、1時間窓には残る
+void test_windows_expire_independently(){
+    RollingStats stats;
+    for(uint32_t t=0;t<10000;t+=1000) stats.add(10.0f, t);
+    uint32_t later = 10000 + 61000;
+    TEST_ASSERT_FALSE(stats.summary(STATS_1MIN, later).valid);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.summary(STATS_1HOUR, later).count);
+    TEST_ASSERT_EQUAL_UINT32(10, stats.summary(STATS_24HOUR, later).count);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_matches_naive_scan);
+    RUN_TEST(test_matches_naive_scan_across_millis_wrap);
+    RUN_TEST(test_summary_does_not_advance);
+    RUN_TEST(test_earlier_add_keeps_window);
+    RUN_TEST(test_nan_is_ignored);
+    RUN_TEST(test_windows_expire_independently);
+    return UNITY_END();
+}
@@ -0,0 +1,208 @@
+// ==========================================
+// スケジューラのテスト（pio test -e native -f test_scheduler）
+// - 時刻はテストが渡すので、同じ入力なら実行順・時刻は毎回同じ
+// - 周期の位相・遅れた時に追いつこうとしないか・同じ期限の順序・millis()の一周
+// - 仕事の中からの停止、枠の上限、ランダムな開始/停止と単純な全走査との一致
+// ==========================================
+
+#include <unity.h>
+#include "scheduler.h"
+
+#include <stdint.h>
+
+constexpr int MAX_FIRES = 4096;
+
+struct Fire {
+    int job;
+    uint32_t at;
+};
+
+static Fire fires[MAX_FIRES];
+static int fireCount = 0;
+static uint32_t clockNow = 0;      // schedRun()に渡した時刻（仕事の中から見る）
+
+static void note(int job){
+    if(fireCount < MAX_FIRES) fires[fireCount++] = { job, clockNow };
+}
+
+template<int N> static void job(){ note(N); }
+static const SchedFn JOBS[SCHED_MAX_JOBS] = {
+    job<0>, job<1>, job<2>, job<3>, job<4>, job<5>, job<6>, job<7>, job<8>, job<9>, job<10>, job<11>
+};
+
+static uint32_t run(uint32_t now){
+    clockNow = now;
+    return schedRun(now);
+}
+
+// 再現できる乱数（xorshift32）
+static uint32_t rngState = 1;
+static uint32_t rng(){
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+void setUp(){
+    schedReset();
+    fireCount = 0;
+    clockNow = 0;
+    rngState = 2463534242u;
+}
+
+void tearDown(){}
+
+// loop()と同じく次の期限まで待ってから回す。起きるのが最大300ms遅れても、期限は1000msの格子から動かない
+void test_periodic_keeps_phase(){
+    SchedId id = schedCreate(JOBS[0], 1000);
+    schedStart(id, 0, 1000);
+    uint32_t now = 0;
+    while(fireCount < 3600){
+        uint32_t wait = run(now);
+        now += wait + rng() % 300;
+    }
+    TEST_ASSERT_EQUAL(3600, fireCount);
+    for(int i=0;i<fireCount;i++){
+        uint32_t due = (uint32_t)(i + 1) * 1000;
+        TEST_ASSERT_TRUE(fires[i].at >= due);
+        TEST_ASSERT_TRUE(fires[i].at - due < 300);
+    }
+}
+
+// 数周期ぶん遅れたら1回だけ実行し、次は今から1周期後（溜まった分をまとめて流さない）
+void test_late_run_does_not_burst(){
+    SchedId id = schedCreate(JOBS[0], 1000);
+    schedStart(id, 0, 1000);
+    TEST_ASSERT_EQUAL_UINT32(1000, run(5500));
+    TEST_ASSERT_EQUAL(1, fireCount);
+    TEST_ASSERT_EQUAL_UINT32(1000, run(6500));
+    TEST_ASSERT_EQUAL(2, fireCount);
+    TEST_ASSERT_EQUAL_UINT32(6500, fires[1].at);
+}
+
+void test_equal_deadlines_run_in_start_order(){
+    SchedId ids[4];
+    for(int i=0;i<4;i++) ids[i] = schedCreate(JOBS[i]);
+    const int order[4] = {2, 0, 3, 1};
+    for(int i=0;i<4;i++) schedStart(ids[order[i]], 100, 50);
+    TEST_ASSERT_EQUAL_UINT32(SCHED_IDLE_FOREVER, run(150));
+    TEST_ASSERT_EQUAL(4, fireCount);
+    for(int i=0;i<4;i++) TEST_ASSERT_EQUAL(order[i], fires[i].job);
+}
+
+// millis()が一周する直前に始めても、期限の前後と残り時間は正しい
+void test_deadlines_across_wrap(){
+    const uint32_t start = UINT32_MAX - 1500;
+    SchedId a = schedCreate(JOBS[0], 1000);
+    SchedId b = schedCreate(JOBS[1]);
+    schedStart(a, start, 1000);
+    schedStart(b, start, 2500);         // 一周した後の1000 - 1
+    TEST_ASSERT_EQUAL_UINT32(1000, schedNextDelay(start));
+    run(start + 1000);
+    TEST_ASSERT_EQUAL(1, fireCount);
+    TEST_ASSERT_EQUAL_UINT32(1000, schedNextDelay(start + 1000));
+    run(start + 2000);                  // 一周した後
+    TEST_ASSERT_EQUAL(2, fireCount);
+    TEST_ASSERT_EQUAL_UINT32(500, schedNextDelay(start + 2000));
+    run(start + 2500);
+    TEST_ASSERT_EQUAL(3, fireCount);
+    TEST_ASSERT_EQUAL(1, fires[2].job);
+    TEST_ASSERT_FALSE(schedActive(b));
+}
+
+static SchedId victim = SCHED_NONE;
+static void stopVictim(){
+    note(-1);
+    schedStop(victim);
+}
+
+// 仕事の中から止めた仕事は、同じschedRun()の中でも実行しない
+void test_stop_from_inside_job(){
+    SchedId killer = schedCreate(stopVictim);
+    victim = schedCreate(JOBS[1], 100);
+    schedStart(killer, 0, 10);
+    schedStart(victim, 0, 10);
+    TEST_ASSERT_EQUAL_UINT32(SCHED_IDLE_FOREVER, run(1000));
+    TEST_ASSERT_EQUAL(1, fireCount);
+    TEST_ASSERT_EQUAL(-1, fires[0].job);
+    TEST_ASSERT_FALSE(schedActive(victim));
+}
+
+void test_capacity(){
+    for(int i=0;i<SCHED_MAX_JOBS;i++) TEST_ASSERT_EQUAL(i, schedCreate(JOBS[i]));
+    TEST_ASSERT_EQUAL(SCHED_NONE, schedCreate(JOBS[0]));
+    schedStart(SCHED_NONE, 0, 10);      // 作れなかった仕事を渡しても何もしない
+    schedStop(SCHED_NONE);
+    TEST_ASSERT_FALSE(schedActive(SCHED_NONE));
+    TEST_ASSERT_EQUAL_UINT32(SCHED_IDLE_FOREVER, schedNextDelay(0));
+}
+
+// ランダムに開始・停止・実行し、全部の仕事を見て一番早い期限（同じなら開始順）を選ぶ単純な実装と比べる
+void test_matches_linear_scan(){
+    struct Ref { bool active; uint32_t due; uint32_t period; uint32_t seq; };
+    Ref ref[SCHED_MAX_JOBS];
+    uint32_t seq = 0;
+    for(int i=0;i<SCHED_MAX_JOBS;i++){
+        uint32_t period = (i % 3 == 0) ? 0 : 50 + rng() % 500;
+        schedCreate(JOBS[i], period);
+        ref[i] = { false, 0, period, 0 };
+    }
+
+    uint32_t now = UINT32_MAX - 200000;     // 途中で一周する
+    for(int step=0;step<20000;step++){
+        int id = rng() % SCHED_MAX_JOBS;
+        switch(rng() % 4){
+            case 0: {
+                uint32_t delay = rng() % 400;
+                schedStart(id, now, delay);
+                ref[id] = { true, now + delay, ref[id].period, seq++ };
+                break;
+            }
+            case 1:
+                schedStop(id);
+                ref[id].active = false;
+                break;
+            default: {
+                now += rng() % 120;
+                fireCount = 0;
+                run(now);
+                for(int i=0;i<fireCount;i++){
+                    int best = -1;
+                    for(int j=0;j<SCHED_MAX_JOBS;j++){
+                        if(!ref[j].active || (int32_t)(now - ref[j].due) < 0) continue;
+                        if(best < 0) { best = j; continue; }
+                        int32_t d = (int32_t)(ref[j].due - ref[best].due);
+                        if(d < 0 || (d == 0 && (int32_t)(ref[j].seq - ref[best].seq) < 0)) best = j;
+                    }
+                    TEST_ASSERT_EQUAL(best, fires[i].job);
+                    Ref &r = ref[best];
+                    if(r.period){
+                        r.due += r.period;
+                        if((int32_t)(now - r.due) >= 0) r.due = now + r.period;
+                        r.seq = seq++;
+                    } else {
+                        r.active = false;
+                    }
+                }
+                // 期限の来た仕事は残っていない
+                for(int j=0;j<SCHED_MAX_JOBS;j++){
+                    TEST_ASSERT_EQUAL(ref[j].active, schedActive(j));
+                    if(ref[j].active) TEST_ASSERT_TRUE((int32_t)(ref[j].due - now) > 0);
+                }
+            }
+        }
+    }
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_keeps_phase);
+    RUN_TEST(test_late_run_does_not_burst);
+    RUN_TEST(test_equal_deadlines_run_in_start_order);
+    RUN_TEST(test_deadlines_across_wrap);
+    RUN_TEST(test_stop_from_inside_job);
+    RUN_TEST(test_capacity);
+    RUN_TEST(test_matches_linear_scan);
+    return UNITY_END();
+}
@@ -0,0 +1,253 @@
+// ==========================================
+// 計測ログのテスト（pio test -e native -f test_sensor_log）
+// - フラッシュの代わりに一時ディレクトリのファイルへ書き、「再起動」して履歴へ戻す
+// - 再起動までの空白を欠測で埋めるか、1秒段を今の時計へ移して欠測で区切るか
+// - 時刻が分からずに起動した時は、分かるまで書かずに待ち、分かったら空白を差し込むか
+// - まとめ書き待ちはsensorLogFlush()しないと失う。CRCが合わないレコードは飛ばす
+// - 24時間分の書き込み回数・バイト数を出す
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "history_store.h"
+#include "sensor_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+constexpr uint32_t EPOCH0 = 1700000000;
+
+static char root[64];
+
+void setUp(){
+    snprintf(root, sizeof(root), "/tmp/sensor_logXXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(root));
+    halNativeReset();
+    halNativeFsRoot(root);
+    historyReset();
+}
+
+void tearDown(){
+    char cmd[96];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    TEST_ASSERT_EQUAL(0, system(cmd));
+}
+
+// 1秒ごとに計測してログへ積む（main.cppのprocessSampleと同じ順）。flushMsごとにまとめ書きを出す
+static void run(uint32_t seconds, uint32_t flushMs = 0){
+    for(uint32_t i=0;i<seconds;i++){
+        halNativeAdvance(1000);
+        uint32_t now = halMillis();
+        historyAppend(20.0f + (now / 60000) % 7, 40.0f + (now / 1000) % 13, (now / 1000) % 500, 1000.0f + (now / 60000) % 5, now);
+        sensorLogSync();
+        if(flushMs && now % flushMs == 0) sensorLogFlush();
+    }
+}
+
+// 電源を入れ直した時（millis()は0から。epochが0ならNTP前）
+static void reboot(uint32_t epoch){
+    historyReset();
+    halNativeReset();
+    if(epoch) halNativeSetEpoch(epoch);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+}
+
+static bool sameBucket(const HistBucket &a, const HistBucket &b){
+    return memcmp(&a, &b, sizeof(HistBucket)) == 0;
+}
+
+static bool isMissing(const HistBucket &b){
+    return b.ch[HIST_TEMP].mean == HIST_MISSING && b.ch[HIST_HUM].mean == HIST_MISSING;
+}
+
+// 最後の1分の点は起動1秒後 + 125分に閉じる。10分後に再起動すると、その間の10点が欠測になる
+void test_restore_fills_gap_to_now(){
+    halNativeSetEpoch(EPOCH0);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1 + 125 * 60);
+    sensorLogFlush();
+    HistBucket lastMinute, lastHour;
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 0, lastMinute));
+    TEST_ASSERT_TRUE(historyGet(TIER_1HOUR, 0, lastHour));
+
+    reboot(EPOCH0 + 1 + 125 * 60 + 600);
+    TEST_ASSERT_EQUAL(125 + 10, historySize(TIER_1MIN));
+    HistBucket b;
+    for(int i=0;i<10;i++){
+        TEST_ASSERT_TRUE(historyGet(TIER_1MIN, i, b));
+        TEST_ASSERT_TRUE(isMissing(b));
+    }
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 10, b));
+    TEST_ASSERT_TRUE(sameBucket(lastMinute, b));
+
+    // 1時間段は最後の点（120分）から今まで1時間たっていないので欠測は入らない
+    TEST_ASSERT_EQUAL(2, historySize(TIER_1HOUR));
+    TEST_ASSERT_TRUE(historyGet(TIER_1HOUR, 0, b));
+    TEST_ASSERT_TRUE(sameBucket(lastHour, b));
+}
+
+// 時刻が分からないまま再起動すると空白の長さは分からないので、欠測1点で区切る
+void test_unsynced_reboot_marks_gap(){
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1 + 30 * 60);
+    sensorLogFlush();
+
+    reboot(0);
+    TEST_ASSERT_EQUAL(30 + 1, historySize(TIER_1MIN));
+    HistBucket b;
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 0, b));
+    TEST_ASSERT_TRUE(isMissing(b));
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 1, b));
+    TEST_ASSERT_FALSE(isMissing(b));
+}
+
+// 1分段は8件ずつまとめて書くので、5分で落ちると何も残らない。flushしてあれば残る
+void test_flush_before_restart_keeps_records(){
+    halNativeSetEpoch(EPOCH0);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1 + 5 * 60);
+    reboot(0);
+    TEST_ASSERT_EQUAL(0, historySize(TIER_1MIN));
+
+    halNativeSetEpoch(EPOCH0 + 1000);
+    run(1 + 5 * 60);
+    sensorLogFlush();
+    reboot(0);
+    TEST_ASSERT_EQUAL(5 + 1, historySize(TIER_1MIN));
+}
+
+// 時刻が分からずに起動すると、分かるまでログへ書かずに待つ。分かったら欠測1点の区切りに残りの空白を差し込み、
+// 待っていた点は遡った時刻で書く（次の起動でも同じ並びに戻る）
+void test_unsynced_boot_fills_gap_when_time_arrives(){
+    halNativeSetEpoch(EPOCH0);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1 + 30 * 60);
+    sensorLogFlush();
+    HistBucket lastMinute;
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 0, lastMinute));
+
+    // 最後の1分の点から10分後に電源が入り、2分後にNTPが合う
+    const uint32_t epochAtBoot = EPOCH0 + 1 + 30 * 60 + 600;
+    reboot(0);
+    TEST_ASSERT_EQUAL(30 + 1, historySize(TIER_1MIN));
+    uint32_t appended = sensorLogStats().appended;
+    uint32_t blocks = historySecBlocksClosed();
+    run(120);
+    TEST_ASSERT_EQUAL_UINT32(appended, sensorLogStats().appended);
+
+    halNativeSetEpoch(epochAtBoot + 120);
+    run(1);
+    TEST_ASSERT_EQUAL(30 + 10 + 2, historySize(TIER_1MIN));
+    HistBucket b;
+    for(int i=0;i<2;i++){
+        TEST_ASSERT_TRUE(historyGet(TIER_1MIN, i, b));
+        TEST_ASSERT_FALSE(isMissing(b));
+    }
+    for(int i=2;i<12;i++){
+        TEST_ASSERT_TRUE(historyGet(TIER_1MIN, i, b));
+        TEST_ASSERT_TRUE(isMissing(b));
+    }
+    TEST_ASSERT_TRUE(historyGet(TIER_1MIN, 12, b));
+    TEST_ASSERT_TRUE(sameBucket(lastMinute, b));
+    // 差し込んだ欠測は書かず、待っていた2点（と閉じた1秒ブロック）だけ書く
+    TEST_ASSERT_EQUAL_UINT32(2 + historySecBlocksClosed() - blocks, sensorLogStats().appended - appended);
+
+    static HistBucket before[30 + 10 + 2];
+    TEST_ASSERT_EQUAL(30 + 10 + 2, historyReadBuckets(TIER_1MIN, 0, 30 + 10 + 2, before));
+    sensorLogFlush();
+    reboot(epochAtBoot + 121 + 30);
+    static HistBucket after[30 + 10 + 2];
+    TEST_ASSERT_EQUAL(30 + 10 + 2, historySize(TIER_1MIN));
+    TEST_ASSERT_EQUAL(30 + 10 + 2, historyReadBuckets(TIER_1MIN, 0, 30 + 10 + 2, after));
+    TEST_ASSERT_EQUAL_MEMORY(before, after, sizeof(before));
+}
+
+// 時刻が分からないまま10分たったら、待つのをやめて時刻なしで書く
+void test_unsynced_boot_gives_up_waiting(){
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    uint32_t appended = sensorLogStats().appended;
+    run(9 * 60);
+    TEST_ASSERT_EQUAL_UINT32(appended, sensorLogStats().appended);
+    run(2 * 60);
+    TEST_ASSERT_GREATER_OR_EQUAL(10, (int)(sensorLogStats().appended - appended));
+}
+
+// 前の起動の1秒段のブロックは、UNIX時刻との差で今の時計へ移し、最初の計測の前に欠測を1点置く
+void test_sec_blocks_move_to_current_clock(){
+    halNativeSetEpoch(EPOCH0);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1200);
+    TEST_ASSERT_GREATER_THAN(2, (int)historySecBlocksClosed());
+    uint32_t start = seriesBlockStart(historySecBlock(0));
+    uint32_t count = seriesBlockCount(historySecBlock(0));
+
+    const uint32_t epoch1 = EPOCH0 + 5000;
+    reboot(epoch1);
+    // 前の起動: 時計の秒 + EPOCH0 = UNIX時刻、今の起動: 時計の秒 + epoch1 = UNIX時刻
+    TEST_ASSERT_EQUAL_UINT32(start + EPOCH0 - epoch1, seriesBlockStart(historySecBlock(0)));
+    TEST_ASSERT_EQUAL_UINT32(count, seriesBlockCount(historySecBlock(0)));
+
+    run(1);
+    HistPoint p[2];
+    TEST_ASSERT_EQUAL(2, historyRead(TIER_1SEC, HIST_TEMP, 0, 2, p));
+    TEST_ASSERT_EQUAL_INT16(HIST_MISSING, p[0].mean);
+    TEST_ASSERT_NOT_EQUAL(HIST_MISSING, p[1].mean);
+}
+
+// 壊れたレコードはCRCで見つけて飛ばす（前後は戻る）
+void test_crc_error_skips_record(){
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    run(1 + 20 * 60);
+    sensorLogFlush();
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/log/m00000000.bin", root);
+    FILE* f = fopen(path, "r+b");
+    TEST_ASSERT_NOT_NULL(f);
+    fseek(f, 32 * 3 + 10, SEEK_SET);    // 4件目のbucketの中
+    fputc(0x5A, f);
+    fclose(f);
+
+    uint32_t errors = sensorLogStats().crcErrors;
+    reboot(0);
+    TEST_ASSERT_EQUAL_UINT32(errors + 1, sensorLogStats().crcErrors);
+    TEST_ASSERT_EQUAL(19 + 1, historySize(TIER_1MIN));
+}
+
+// 24時間、5分ごとにflushした時の書き込み量（実機ではwrite()ごとにフラッシュへ書く）
+void test_throughput_24h(){
+    halNativeSetEpoch(EPOCH0);
+    TEST_ASSERT_TRUE(sensorLogBegin());
+    uint32_t appended = sensorLogStats().appended;
+    run(24 * 3600, SENSOR_LOG_FLUSH_MS);
+    appended = sensorLogStats().appended - appended;
+    const HalNativeFs &fs = halNativeFs();
+    uint32_t blocks = historySecBlocksClosed();
+    char msg[160];
+    snprintf(msg, sizeof(msg), "24h: %lu writes, %llu bytes (%.0f bytes/hour), %lu records, %lu sec blocks",
+             (unsigned long)fs.writes, (unsigned long long)fs.bytesWritten,
+             fs.bytesWritten / 24.0, (unsigned long)appended, (unsigned long)blocks);
+    TEST_MESSAGE(msg);
+
+    // 最初の計測が1秒目なので、閉じた1分は1439点・1時間は23点
+    TEST_ASSERT_EQUAL_UINT32(1439 + 23 + blocks, appended);
+    TEST_ASSERT_LESS_THAN(24 * 3600 * 8, (int)fs.bytesWritten);
+    // まとめ書き: 1分段は5分ごと（288回）、1時間段は1件ずつ、1秒段はブロックごとに2回（ヘッダーと本体）
+    // セグメントの切り替えをまたぐまとめ書きは2回に分かれる
+    TEST_ASSERT_UINT32_WITHIN(4, 288 + 23 + 2 * blocks, fs.writes);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_restore_fills_gap_to_now);
+    RUN_TEST(test_unsynced_reboot_marks_gap);
+    RUN_TEST(test_flush_before_restart_keeps_records);
+    RUN_TEST(test_unsynced_boot_fills_gap_when_time_arrives);
+    RUN_TEST(test_unsynced_boot_gives_up_waiting);
+    RUN_TEST(test_sec_blocks_move_to_current_clock);
+    RUN_TEST(test_crc_error_skips_record);
+    RUN_TEST(test_throughput_24h);
+    return UNITY_END();
+}
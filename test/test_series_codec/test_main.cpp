@@ -0,0 +1,173 @@
+// ==========================================
+// 時系列ブロック圧縮のテスト（pio test -e native -f test_series_codec）
+// - 符号化 → 復号で時刻・値が完全に一致するか（乱数の歩み・極端な差・時刻の飛び）
+// - 書きかけのブロックが読めるか、満杯の後も壊れないか、先頭時刻の付け替え
+// - 模擬センサーの1秒データで1サンプルあたりのバイト数（生なら時刻4 + 値2 x 4 = 12バイト）
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "history_store.h"
+#include "series_codec.h"
+
+#include <stdio.h>
+#include <string.h>
+
+constexpr int MAX_SAMPLES = 4096;
+
+struct Sample {
+    uint32_t t;
+    int16_t v[SERIES_MAX_CHANNELS];
+};
+
+static uint8_t block[SERIES_BLOCK_BYTES];
+static Sample written[MAX_SAMPLES];
+
+static uint32_t rngState = 1;
+static uint32_t rng(){
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+void setUp(){
+    rngState = 2463534242u;
+    memset(block, 0xA5, sizeof(block));
+}
+
+void tearDown(){}
+
+// genが返すサンプルを満杯になるまで積み、件数を返す
+template<typename Gen>
+static int fill(int channels, Gen gen){
+    SeriesEncoder enc;
+    enc.begin(block, sizeof(block), channels);
+    int n = 0;
+    while(n < MAX_SAMPLES){
+        Sample s = gen(n);
+        if(!enc.add(s.t, s.v)) break;
+        written[n++] = s;
+        TEST_ASSERT_EQUAL_UINT16(n, seriesBlockCount(block));
+    }
+    TEST_ASSERT_EQUAL(n, enc.count());
+    TEST_ASSERT_LESS_OR_EQUAL(SERIES_BLOCK_BYTES, seriesBlockLength(block));
+    return n;
+}
+
+static void checkDecode(int channels, int n){
+    SeriesDecoder dec;
+    TEST_ASSERT_TRUE(dec.begin(block));
+    TEST_ASSERT_EQUAL(channels, dec.channelCount());
+    TEST_ASSERT_EQUAL(n, dec.count());
+    uint32_t t;
+    int16_t v[SERIES_MAX_CHANNELS];
+    for(int i=0;i<n;i++){
+        TEST_ASSERT_TRUE(dec.next(t, v));
+        TEST_ASSERT_EQUAL_UINT32(written[i].t, t);
+        for(int c=0;c<channels;c++) TEST_ASSERT_EQUAL_INT16(written[i].v[c], v[c]);
+    }
+    TEST_ASSERT_FALSE(dec.next(t, v));
+}
+
+void test_random_walk_roundtrip(){
+    Sample cur = { 1000, {2500, 5000, 300, 0} };
+    int n = fill(3, [&](int){
+        cur.t += (rng() % 20 == 0) ? 2 + rng() % 5 : 1;
+        for(int c=0;c<3;c++) cur.v[c] += (int16_t)(rng() % 21) - 10;
+        return cur;
+    });
+    TEST_ASSERT_GREATER_THAN(20, n);
+    checkDecode(3, n);
+}
+
+// 欠測（INT16_MIN）と最大値の行き来・1日の時刻の飛びでも値は戻る
+void test_extreme_deltas_roundtrip(){
+    const int16_t extremes[] = { INT16_MIN, INT16_MAX, 0, -1, INT16_MIN, 1, INT16_MAX, -32000 };
+    uint32_t t = 5;
+    int n = fill(4, [&](int i){
+        Sample s;
+        t += (i % 7 == 3) ? 86400 : 1;
+        s.t = t;
+        for(int c=0;c<4;c++) s.v[c] = extremes[(i + c * 3) % 8];
+        return s;
+    });
+    TEST_ASSERT_GREATER_THAN(4, n);
+    checkDecode(4, n);
+}
+
+// 1件ずつ積みながら、その時点のブロックを読む
+void test_partial_block_is_readable(){
+    SeriesEncoder enc;
+    enc.begin(block, sizeof(block), 2);
+    for(int i=0;i<40;i++){
+        written[i] = { 100u + i, { (int16_t)(i * i), (int16_t)(-i) } };
+        TEST_ASSERT_TRUE(enc.add(written[i].t, written[i].v));
+        checkDecode(2, i + 1);
+    }
+}
+
+// 満杯でaddが失敗しても、それまでのサンプルはそのまま読める
+void test_full_block_stays_valid(){
+    int n = fill(3, [&](int i){
+        Sample s = { (uint32_t)i, { (int16_t)(rng() & 0x7FFF), (int16_t)(rng() & 0x7FFF), (int16_t)(rng() & 0x7FFF) } };
+        return s;
+    });
+    checkDecode(3, n);
+    char msg[80];
+    snprintf(msg, sizeof(msg), "white noise: %d samples/block", n);
+    TEST_MESSAGE(msg);
+}
+
+void test_set_start_moves_all_timestamps(){
+    int n = fill(1, [&](int i){
+        Sample s = { 50000u + i * 3, { (int16_t)i } };
+        return s;
+    });
+    const uint32_t shift = 0xFFFF0000u;     // 時計を移すと一周をまたぐこともある
+    seriesBlockSetStart(block, seriesBlockStart(block) + shift);
+    for(int i=0;i<n;i++) written[i].t += shift;
+    checkDecode(1, n);
+}
+
+// 模擬センサー（温湿度の日変化・照度・気圧）の1秒データ。履歴の1秒段と同じ4チャンネル
+void test_ratio_on_sensor_data(){
+    halNativeReset();
+    halNativeAdvance(8 * 3600000);
+    int n = fill(NUM_HIST_CHANNELS, [&](int i){
+        HalEnvReading r;
+        halNativeAdvance(1000);
+        halEnvStart();
+        halNativeAdvance(20);
+        halEnvRead(r);
+        Sample s = { (uint32_t)i, { histEncode(HIST_TEMP, r.temp), histEncode(HIST_HUM, r.hum),
+                                    (int16_t)(halLightRaw() / 4), histEncode(HIST_PRESS, r.pressure) } };
+        return s;
+    });
+    checkDecode(NUM_HIST_CHANNELS, n);
+    double bytesPerSample = (double)seriesBlockLength(block) / n;
+    double perDay = 86400.0 / n * SERIES_BLOCK_BYTES / 1024;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "sensor data: %d samples/block, %.2f bytes/sample, %.0f KB/day", n, bytesPerSample, perDay);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(5.0, bytesPerSample);
+
+    // 値が変わらない間はほぼ時刻の1ビットずつ
+    n = fill(3, [&](int i){
+        Sample s = { (uint32_t)i, { 2500, 5000, 120 } };
+        return s;
+    });
+    checkDecode(3, n);
+    TEST_ASSERT_GREATER_THAN(400, n);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_random_walk_roundtrip);
+    RUN_TEST(test_extreme_deltas_roundtrip);
+    RUN_TEST(test_partial_block_is_readable);
+    RUN_TEST(test_full_block_stays_valid);
+    RUN_TEST(test_set_start_moves_all_timestamps);
+    RUN_TEST(test_ratio_on_sensor_data);
+    return UNITY_END();
+}
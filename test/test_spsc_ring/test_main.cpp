@@ -0,0 +1,143 @@
+// ==========================================
+// SPSCリングのテスト（pio test -e native -f test_spsc_ring）
+// - 1スレッドで満杯・空・順序
+// - 生産者と消費者を別スレッドにして、欠け・重複・順序の入れ替わり・書きかけの要素を読んでいないか
+//   要素は計測サンプルと同じくらいの大きさで、全部の項目を連番から作って照合する
+// ==========================================
+
+#include <unity.h>
+#include "spsc_ring.h"
+
+#include <atomic>
+#include <thread>
+#include <stdio.h>
+
+struct Item {
+    uint32_t seq;
+    uint32_t words[8];      // seqから作る（書きかけを読むと合わない）
+    uint32_t check;
+};
+
+static Item makeItem(uint32_t seq){
+    Item it;
+    it.seq = seq;
+    uint32_t x = seq * 2654435761u;
+    it.check = 0;
+    for(int i=0;i<8;i++){
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        it.words[i] = x;
+        it.check += x;
+    }
+    return it;
+}
+
+static bool intact(const Item &it){
+    Item expect = makeItem(it.seq);
+    for(int i=0;i<8;i++){
+        if(it.words[i] != expect.words[i]) return false;
+    }
+    return it.check == expect.check;
+}
+
+void setUp(){}
+void tearDown(){}
+
+void test_full_empty_and_order(){
+    SpscRing<uint32_t, 8> ring;
+    uint32_t v;
+    TEST_ASSERT_FALSE(ring.pop(v));
+    for(uint32_t i=0;i<8;i++) TEST_ASSERT_TRUE(ring.push(i));
+    TEST_ASSERT_FALSE(ring.push(99));       // 満杯なら新しい方を捨てる
+    TEST_ASSERT_EQUAL_UINT32(8, ring.size());
+    for(uint32_t i=0;i<8;i++){
+        TEST_ASSERT_TRUE(ring.pop(v));
+        TEST_ASSERT_EQUAL_UINT32(i, v);
+    }
+    TEST_ASSERT_FALSE(ring.pop(v));
+
+    // 添字が何周もしても同じ
+    for(uint32_t i=0;i<1000;i++){
+        TEST_ASSERT_TRUE(ring.push(i));
+        if(i % 3 == 2){
+            while(ring.pop(v)) {}
+        }
+    }
+    TEST_ASSERT_LESS_OR_EQUAL(3, ring.size());
+}
+
+// 満杯なら待って積み直す: 全部が順に、壊れずに届く
+void test_threaded_no_loss(){
+    static SpscRing<Item, 8> ring;
+    const uint32_t total = 500000;
+    std::thread producer([&]{
+        for(uint32_t seq=0;seq<total;){
+            if(ring.push(makeItem(seq))) seq++;
+            else std::this_thread::yield();
+        }
+    });
+
+    uint32_t expect = 0, torn = 0;
+    Item it;
+    while(expect < total){
+        if(!ring.pop(it)){
+            std::this_thread::yield();
+            continue;
+        }
+        TEST_ASSERT_EQUAL_UINT32(expect, it.seq);
+        if(!intact(it)) torn++;
+        expect++;
+    }
+    producer.join();
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(0, ring.size());
+}
+
+// 計測タスクと同じく満杯なら捨てる: 届いた分 + 捨てた分 = 積もうとした分、届いた分は増える順
+void test_threaded_drop_when_full(){
+    static SpscRing<Item, 8> ring;
+    const uint32_t total = 500000;
+    std::atomic<bool> done{false};
+    uint32_t dropped = 0;
+    std::thread producer([&]{
+        for(uint32_t seq=0;seq<total;seq++){
+            if(!ring.push(makeItem(seq))) dropped++;
+            if(seq % 64 == 0) std::this_thread::yield();     // 消費者にも回す（満杯と空の両方を通る）
+        }
+        done = true;
+    });
+
+    uint32_t received = 0, torn = 0;
+    int64_t last = -1;
+    bool ordered = true;
+    Item it;
+    for(;;){
+        bool finished = done;       // 終わったのを見てから残りを取り切る
+        while(ring.pop(it)){
+            if((int64_t)it.seq <= last) ordered = false;
+            last = it.seq;
+            if(!intact(it)) torn++;
+            received++;
+        }
+        if(finished) break;
+        std::this_thread::yield();
+    }
+    producer.join();
+
+    char msg[80];
+    snprintf(msg, sizeof(msg), "%lu received, %lu dropped", (unsigned long)received, (unsigned long)dropped);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE(ordered);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(total, received + dropped);
+    TEST_ASSERT_GREATER_THAN(8, received);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_full_empty_and_order);
+    RUN_TEST(test_threaded_no_loss);
+    RUN_TEST(test_threaded_drop_when_full);
+    return UNITY_END();
+}
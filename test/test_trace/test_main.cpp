@@ -0,0 +1,269 @@
+// ==========================================
+// 入力トレースのテスト（pio test -e native -f test_trace）
+// - 記録 → 取り出し → 読み出しで、時刻・固定小数の値・ボタン・HTTPの本文が元に戻るか
+//   読み出しは数バイトずつ補充して、レコードの途中でバッファが切れても読めるか
+// - 長い空白（varintの多バイト）とmillis()の一周
+// - 途中で切れたファイル・違う形式・書き出し待ちが溢れた時・本文の上限
+// ==========================================
+
+#include <unity.h>
+#include "trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static std::vector<uint8_t> file;
+
+struct FileSource {
+    const std::vector<uint8_t>* data;
+    size_t pos;
+    size_t chunk;       // 1回に補充する最大バイト数
+};
+
+static size_t fillFrom(uint8_t* buf, size_t len, void* ctx){
+    FileSource &src = *(FileSource*)ctx;
+    size_t n = src.data->size() - src.pos;
+    if(n > len) n = len;
+    if(n > src.chunk) n = src.chunk;
+    memcpy(buf, src.data->data() + src.pos, n);
+    src.pos += n;
+    return n;
+}
+
+// 書き出し側と同じく小分けに取り出してファイルへ足す
+static void drainAll(){
+    uint8_t chunk[100];
+    size_t n;
+    while((n = traceDrain(chunk, sizeof(chunk))) > 0) file.insert(file.end(), chunk, chunk + n);
+}
+
+static SensorSample makeSample(uint32_t t, uint8_t valid){
+    SensorSample s;
+    s.timestamp = t;
+    s.valid = valid;
+    s.temp = -12.34f;
+    s.hum = 87.65f;
+    s.pressure = 1013.27f;
+    s.lux = 1234;
+    s.lightMv = 2345;
+    s.accelMag = 1.016f;
+    s.magX = -31.4f;
+    s.magY = 27.2f;
+    return s;
+}
+
+void setUp(){
+    file.clear();
+}
+
+void tearDown(){
+    traceRelease();
+}
+
+void test_roundtrip(){
+    const char body[] = "{\"cnt\":1,\"list\":[{\"id\":1850147}]}";
+    TEST_ASSERT_TRUE(traceStart(5000));
+    traceSample(makeSample(4990, SAMPLE_TEMP_VALID | SAMPLE_HUM_VALID | SAMPLE_PRESS_VALID), 5000);
+    traceSample(makeSample(5995, SAMPLE_LUX_VALID | SAMPLE_IMU_VALID), 6000);
+    traceInput(InputEvent{BUTTON_C, INPUT_LONG, 6000000}, 6012, 6012345);
+    traceHttp(200, (const uint8_t*)body, strlen(body), 6100);
+    traceHttp(TRACE_HTTP_NO_WIFI, nullptr, 0, 6200);
+    traceHttp(-11, nullptr, 0, 6300);       // HTTPClientの負のエラーコード
+    traceStop();
+    drainAll();
+    TEST_ASSERT_EQUAL_UINT32(file.size(), traceStats().bytes);
+    TEST_ASSERT_EQUAL_UINT32(2, traceStats().samples);
+    TEST_ASSERT_EQUAL_UINT32(1, traceStats().inputs);
+    TEST_ASSERT_EQUAL_UINT32(3, traceStats().http);
+    TEST_ASSERT_EQUAL_UINT32(0, traceStats().dropped);
+
+    FileSource src = { &file, 0, 5 };
+    TraceReader reader;
+    TEST_ASSERT_TRUE(reader.begin(fillFrom, &src));
+    TEST_ASSERT_EQUAL_UINT32(5000, reader.startMs());
+    TraceRecord r;
+
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_SAMPLE, r.type);
+    TEST_ASSERT_EQUAL_UINT32(5000, r.ms);
+    TEST_ASSERT_EQUAL_UINT32(4990, r.sample.timestamp);
+    TEST_ASSERT_EQUAL_HEX8(SAMPLE_TEMP_VALID | SAMPLE_HUM_VALID | SAMPLE_PRESS_VALID, r.sample.valid);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, -12.34f, r.sample.temp);
+    TEST_ASSERT_FLOAT_WITHIN(0.005f, 87.65f, r.sample.hum);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 1013.27f, r.sample.pressure);
+    TEST_ASSERT_TRUE(isnan(r.sample.accelMag));     // 記録しなかった値は既定のまま
+
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_SAMPLE, r.type);
+    TEST_ASSERT_EQUAL_UINT32(6000, r.ms);
+    TEST_ASSERT_EQUAL_UINT32(5995, r.sample.timestamp);
+    TEST_ASSERT_EQUAL(1234, r.sample.lux);
+    TEST_ASSERT_EQUAL_UINT16(2345, r.sample.lightMv);
+    TEST_ASSERT_FLOAT_WITHIN(0.0005f, 1.016f, r.sample.accelMag);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, -31.4f, r.sample.magX);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, 27.2f, r.sample.magY);
+    TEST_ASSERT_TRUE(isnan(r.sample.temp));
+
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_INPUT, r.type);
+    TEST_ASSERT_EQUAL_UINT32(6012, r.ms);
+    TEST_ASSERT_EQUAL(BUTTON_C, r.input.button);
+    TEST_ASSERT_EQUAL(INPUT_LONG, r.input.type);
+    TEST_ASSERT_EQUAL_UINT32(12345, r.lagUs);
+
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_HTTP, r.type);
+    TEST_ASSERT_EQUAL_UINT32(6100, r.ms);
+    TEST_ASSERT_EQUAL(200, r.httpCode);
+    TEST_ASSERT_EQUAL(strlen(body), r.bodyLen);
+    TEST_ASSERT_EQUAL_MEMORY(body, r.body, r.bodyLen);
+
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_HTTP_NO_WIFI, r.httpCode);
+    TEST_ASSERT_EQUAL(0, r.bodyLen);
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(-11, r.httpCode);
+
+    TEST_ASSERT_FALSE(reader.next(r));
+    TEST_ASSERT_FALSE(reader.corrupt());
+}
+
+void test_long_gaps_and_millis_wrap(){
+    uint32_t t0 = UINT32_MAX - 1500;
+    const uint32_t at[] = {t0, t0 + 1, t0 + 1000, t0 + 3000, t0 + 3000 + 86400000u, t0 + 3000 + 86400000u};
+    TEST_ASSERT_TRUE(traceStart(t0));
+    for(uint32_t t : at) traceInput(InputEvent{BUTTON_A, INPUT_PRESS, 0}, t, 0);
+    drainAll();
+
+    FileSource src = { &file, 0, 3 };
+    TraceReader reader;
+    TEST_ASSERT_TRUE(reader.begin(fillFrom, &src));
+    TraceRecord r;
+    for(uint32_t t : at){
+        TEST_ASSERT_TRUE(reader.next(r));
+        TEST_ASSERT_EQUAL_UINT32(t, r.ms);
+    }
+    TEST_ASSERT_FALSE(reader.next(r));
+    TEST_ASSERT_FALSE(reader.corrupt());
+}
+
+void test_cut_and_foreign_files(){
+    const uint8_t body[64] = {};
+    TEST_ASSERT_TRUE(traceStart(0));
+    traceSample(makeSample(0, SAMPLE_TEMP_VALID), 1000);
+    traceHttp(200, body, sizeof(body), 2000);
+    drainAll();
+
+    // 本文の途中で切れたファイル: 前のレコードまでは読めて、壊れたと分かる
+    std::vector<uint8_t> cut(file.begin(), file.end() - 10);
+    FileSource src = { &cut, 0, 64 };
+    TraceReader reader;
+    TEST_ASSERT_TRUE(reader.begin(fillFrom, &src));
+    TraceRecord r;
+    TEST_ASSERT_TRUE(reader.next(r));
+    TEST_ASSERT_EQUAL(TRACE_SAMPLE, r.type);
+    TEST_ASSERT_FALSE(reader.next(r));
+    TEST_ASSERT_TRUE(reader.corrupt());
+
+    // 知らない種類
+    std::vector<uint8_t> odd(file.begin(), file.begin() + TRACE_HEADER_BYTES);
+    odd.push_back(0x7F);
+    odd.push_back(0);
+    src = { &odd, 0, 64 };
+    TEST_ASSERT_TRUE(reader.begin(fillFrom, &src));
+    TEST_ASSERT_FALSE(reader.next(r));
+    TEST_ASSERT_TRUE(reader.corrupt());
+
+    // 違う版・短すぎるファイル
+    std::vector<uint8_t> other(file.begin(), file.end());
+    other[4] = TRACE_VERSION + 1;
+    src = { &other, 0, 64 };
+    TEST_ASSERT_FALSE(reader.begin(fillFrom, &src));
+    std::vector<uint8_t> tiny(file.begin(), file.begin() + 6);
+    src = { &tiny, 0, 64 };
+    TEST_ASSERT_FALSE(reader.begin(fillFrom, &src));
+}
+
+void test_full_buffer_drops_whole_records(){
+    static uint8_t body[TRACE_HTTP_MAX];
+    memset(body, 'x', sizeof(body));
+    TEST_ASSERT_TRUE(traceStart(0));
+    traceHttp(200, body, sizeof(body), 10);
+    traceHttp(200, body, sizeof(body), 20);        // 書き出し前なので入りきらない
+    TEST_ASSERT_EQUAL_UINT32(1, traceStats().dropped);
+    uint32_t n = 0;
+    while(traceStats().dropped == 1 && n < 1000){
+        traceSample(makeSample(30, SAMPLE_TEMP_VALID), 30 + n);
+        n++;
+    }
+    drainAll();
+    TEST_ASSERT_LESS_OR_EQUAL(TRACE_BUFFER_BYTES, file.size());
+
+    // 捨てたレコードの時刻差は積まれていないので、後ろのレコードの時刻はずれない
+    traceSample(makeSample(5000, SAMPLE_TEMP_VALID), 5000);
+    drainAll();
+    FileSource src = { &file, 0, 64 };
+    TraceReader reader;
+    TEST_ASSERT_TRUE(reader.begin(fillFrom, &src));
+    TraceRecord r, last = {};
+    uint32_t count = 0;
+    while(reader.next(r)){
+        last = r;
+        count++;
+    }
+    TEST_ASSERT_FALSE(reader.corrupt());
+    TEST_ASSERT_EQUAL_UINT32(traceStats().samples + traceStats().http, count);
+    TEST_ASSERT_EQUAL_UINT32(5000, last.ms);
+}
+
+void test_tee_keeps_what_the_parser_read(){
+    static uint8_t big[TRACE_HTTP_MAX + 100];
+    for(size_t i=0;i<sizeof(big);i++) big[i] = (uint8_t)i;
+
+    TraceBodyStream idle(big, 10);
+    TraceTeeStream off(idle);           // 記録していない時は受け皿を持たない
+    TEST_ASSERT_EQUAL(0, off.read());
+    TEST_ASSERT_EQUAL(0, off.length());
+
+    TEST_ASSERT_TRUE(traceStart(0));
+    TraceBodyStream in(big, sizeof(big));
+    TraceTeeStream tee(in);
+    for(int i=0;i<100;i++) TEST_ASSERT_EQUAL(i & 0xFF, tee.read());
+    TEST_ASSERT_EQUAL(100, tee.length());
+    TEST_ASSERT_FALSE(tee.truncated());
+    while(tee.read() >= 0){}
+    TEST_ASSERT_EQUAL(TRACE_HTTP_MAX, tee.length());
+    TEST_ASSERT_TRUE(tee.truncated());
+    TEST_ASSERT_EQUAL_UINT32(1, traceStats().truncated);
+    TEST_ASSERT_EQUAL_MEMORY(big, tee.data(), TRACE_HTTP_MAX);
+}
+
+// 1秒ごとのサンプルの大きさ（温湿度・気圧は読んだ周期だけ）
+void test_sample_size(){
+    TEST_ASSERT_TRUE(traceStart(0));
+    const uint32_t n = 600;
+    for(uint32_t i=0;i<n;i++){
+        uint8_t valid = SAMPLE_LUX_VALID | SAMPLE_IMU_VALID;
+        if(i % 30 == 0) valid |= SAMPLE_TEMP_VALID | SAMPLE_HUM_VALID | SAMPLE_PRESS_VALID;
+        traceSample(makeSample(i * 1000, valid), i * 1000 + 2);
+        if(i % 100 == 99) drainAll();
+    }
+    drainAll();
+    double perSample = (double)(file.size() - TRACE_HEADER_BYTES) / n;
+    char msg[96];
+    snprintf(msg, sizeof(msg), "%.1f B/sample, %.0f KB/h", perSample, perSample * 3600 / 1024);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_LESS_THAN(20.0, perSample);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_roundtrip);
+    RUN_TEST(test_long_gaps_and_millis_wrap);
+    RUN_TEST(test_cut_and_foreign_files);
+    RUN_TEST(test_full_buffer_drops_whole_records);
+    RUN_TEST(test_tee_keeps_what_the_parser_read);
+    RUN_TEST(test_sample_size);
+    return UNITY_END();
+}
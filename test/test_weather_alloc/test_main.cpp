@@ -0,0 +1,128 @@
+// ==========================================
+// 天気キャッシュがヒープを使わないかのテスト（pio test -e native -f test_weather_alloc）
+// - malloc系はMEM_HOOKSのフック（mem_stats）、newはこのファイルで置き換えて数える
+// - 応答のパース・鮮度の確認・URLの組み立て・画面側の読み出しを繰り返して、確保が0回か
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "mem_stats.h"
+#include "weather_cache.h"
+
+#include <new>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t newCount = 0;
+
+__attribute__((noinline)) void* operator new(size_t size){
+    newCount++;
+    void* p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { ::operator delete(p); }
+
+static uint32_t allocCount(){
+#ifdef MEM_HOOKS
+    return memTagStats(MEM_TAG_LOOP).allocs + newCount;
+#else
+    return newCount;
+#endif
+}
+
+static std::string payload;
+
+void setUp(){
+    halNativeReset();
+    for(auto &c : weatherCache) c = WeatherCache();
+    if(payload.empty()){
+        payload = "{\"cnt\":6,\"list\":[";
+        for(int i=0;i<NUM_CITIES;i++){
+            char item[320];
+            snprintf(item, sizeof(item),
+                "%s{\"weather\":[{\"id\":%d,\"main\":\"X\",\"description\":\"scattered clouds\",\"icon\":\"03d\"}],"
+                "\"main\":{\"temp\":%.1f,\"humidity\":60},\"wind\":{\"speed\":2.0},\"id\":%lu,\"name\":\"%s\"}",
+                i ? "," : "", 802, 12.5 + i, (unsigned long)cities[i].id, cities[i].name);
+            payload += item;
+        }
+        payload += "]}";
+    }
+}
+
+void tearDown(){}
+
+// 数えられているか（0回が数え漏れでないことの確認）
+void test_counter_sees_allocations(){
+    uint32_t before = allocCount();
+    void* p = ::operator new(16);
+    ::operator delete(p);
+    TEST_ASSERT_GREATER_THAN(before, allocCount());
+#ifdef MEM_HOOKS
+    before = allocCount();
+    void* volatile m = malloc(16);
+    free(m);
+    TEST_ASSERT_GREATER_THAN(before, allocCount());
+#endif
+}
+
+// ワーカー側: 応答のパース（フィルターと1都市分のドキュメントは固定長）
+void test_parse_does_not_allocate(){
+    HalMemoryStream in(payload.data(), payload.size());
+    uint32_t mask = 0;
+    TEST_ASSERT_TRUE(parseWeatherGroupStream(in, mask));     // 初回にフィルターを組む
+    uint32_t before = allocCount();
+    for(int i=0;i<1000;i++){
+        in.rewind();
+        mask = 0;
+        parseWeatherGroupStream(in, mask);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, allocCount());
+    TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+}
+
+// 要求の判断とURL
+void test_request_path_does_not_allocate(){
+    uint32_t before = allocCount();
+    char url[256];
+    for(int i=0;i<1000;i++){
+        halNativeAdvance(1000);
+        uint32_t mask = weatherStaleMask(i % 2 == 0);
+        weatherGroupUrl(url, sizeof(url), "http://127.0.0.1:8080", mask, "KEY");
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, allocCount());
+}
+
+// loop()側: 天気画面・顔表示と同じ読み方（ロックして1都市分を写し、記号と説明文を使う）
+void test_reader_path_does_not_allocate(){
+    HalMemoryStream in(payload.data(), payload.size());
+    uint32_t mask = 0;
+    parseWeatherGroupStream(in, mask);
+    uint32_t before = allocCount();
+    char line[64];
+    int suns = 0;
+    for(int i=0;i<6000;i++){
+        int city = i % NUM_CITIES;
+        lockWeatherCache();
+        WeatherCache c = weatherCache[city];
+        unlockWeatherCache();
+        if(isWeatherStale(city)) continue;
+        snprintf(line, sizeof(line), "[%s] %.1fC %s", cities[city].name, c.temp, c.description);
+        if(weatherSymbolFromCode(c.conditionCode) == SYM_SUN) suns++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, allocCount());
+    TEST_ASSERT_EQUAL(0, suns);
+    TEST_ASSERT_EQUAL_STRING("[Naha] 17.5C scattered clouds", line);
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_sees_allocations);
+    RUN_TEST(test_parse_does_not_allocate);
+    RUN_TEST(test_request_path_does_not_allocate);
+    RUN_TEST(test_reader_path_does_not_allocate);
+    return UNITY_END();
+}
@@ -0,0 +1,318 @@
+// ==========================================
+// 天気取得のテスト（pio test -e native -f test_weather_fetch）
+// - 127.0.0.1の空いたポートにスタブのHTTPサーバー（スレッド）を立て、ワーカーと同じ
+//   halHttpGet() → parseWeatherGroupStream() の経路で取得する
+// - 応答コード・接続失敗・途中で切れた本文・遅いサーバーを取得している間の読む側（loop()役）
+// - サーバーは要求を数えるので、6都市が1回の要求で済むか・新しい都市は取りに行かないかを見る
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "weather_cache.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+// 1接続に1応答を返して閉じる（HTTP/1.0）
+struct StubServer {
+    int listenFd = -1;
+    uint16_t port = 0;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> requests{0};
+    int status = 200;
+    std::string body;
+    size_t cutAt = std::string::npos;   // 本文をここで切って閉じる
+    int delayMs = 0;                    // ヘッダーの後、本文を送る前に待つ
+    std::mutex pathMutex;
+    std::string lastPath;               // 最後の要求のパス（クエリ込み）
+
+    void start(){
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        TEST_ASSERT_EQUAL(0, bind(listenFd, (sockaddr*)&addr, sizeof(addr)));
+        TEST_ASSERT_EQUAL(0, listen(listenFd, 4));
+        socklen_t len = sizeof(addr);
+        getsockname(listenFd, (sockaddr*)&addr, &len);
+        port = ntohs(addr.sin_port);
+        thread = std::thread([this]{ serve(); });
+    }
+
+    void stop(){
+        stopping = true;
+        if(thread.joinable()) thread.join();
+        if(listenFd >= 0) close(listenFd);
+        listenFd = -1;
+    }
+
+    void url(char* out, size_t len, const char* path = "/data/2.5/group?id=1"){
+        snprintf(out, len, "http://127.0.0.1:%u%s", (unsigned)port, path);
+    }
+
+    std::string path(){
+        std::lock_guard<std::mutex> lock(pathMutex);
+        return lastPath;
+    }
+
+private:
+    void serve(){
+        while(!stopping){
+            pollfd p = { listenFd, POLLIN, 0 };
+            if(poll(&p, 1, 20) <= 0) continue;
+            int fd = accept(listenFd, nullptr, nullptr);
+            if(fd < 0) continue;
+            // 要求は空行まで読み捨てる
+            char buf[1024];
+            std::string request;
+            while(request.find("\r\n\r\n") == std::string::npos){
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if(n <= 0) break;
+                request.append(buf, n);
+            }
+            {
+                std::lock_guard<std::mutex> lock(pathMutex);
+                size_t start = request.find(' ') + 1;
+                lastPath = request.substr(start, request.find(' ', start) - start);
+            }
+            requests++;
+            char head[128];
+            int n = snprintf(head, sizeof(head), "HTTP/1.0 %d X\r\nContent-Type: application/json\r\n\r\n", status);
+            send(fd, head, n, MSG_NOSIGNAL);
+            if(delayMs) std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+            size_t len = cutAt < body.size() ? cutAt : body.size();
+            send(fd, body.data(), len, MSG_NOSIGNAL);
+            close(fd);
+        }
+    }
+};
+
+// groupエンドポイントと同じ形（使わない項目も含める）
+static std::string groupPayload(){
+    static const int CODES[NUM_CITIES] = { 800, 801, 803, 500, 600, 211 };
+    static const char* DESCRIPTIONS[NUM_CITIES] = {
+        "clear sky", "few clouds", "broken clouds", "light rain", "snow", "thunderstorm"
+    };
+    std::string s = "{\"cnt\":6,\"list\":[";
+    for(int i=0;i<NUM_CITIES;i++){
+        char item[512];
+        snprintf(item, sizeof(item),
+            "%s{\"coord\":{\"lon\":135.5,\"lat\":34.69},\"weather\":[{\"id\":%d,\"main\":\"X\","
+            "\"description\":\"%s\",\"icon\":\"01d\"}],\"main\":{\"temp\":%.2f,\"humidity\":60},"
+            "\"wind\":{\"speed\":3.1},\"id\":%lu,\"name\":\"%s\"}",
+            i ? "," : "", CODES[i], DESCRIPTIONS[i], 10.0 + i * 2.5, (unsigned long)cities[i].id, cities[i].name);
+        s += item;
+    }
+    return s + "]}";
+}
+
+static StubServer server;
+
+void setUp(){
+    halNativeReset();
+    for(auto &c : weatherCache) c = WeatherCache();
+    server.status = 200;
+    server.body = groupPayload();
+    server.cutAt = std::string::npos;
+    server.delayMs = 0;
+    server.requests = 0;
+    server.stopping = false;
+    server.start();
+}
+
+void tearDown(){
+    halHttpEnd();
+    server.stop();
+}
+
+// ワーカーの1回分（fetchWeatherGroup()のHTTPとパース）
+static int fetchOnce(uint32_t &mask, bool &parsed){
+    char url[96];
+    server.url(url, sizeof(url));
+    HalStream* body = nullptr;
+    int code = halHttpGet(url, body);
+    mask = 0;
+    parsed = code == 200 && parseWeatherGroupStream(*body, mask);
+    halHttpEnd();
+    return code;
+}
+
+// ワーカーの1要求分（weatherWorkerLoop()と同じ判断）。全都市が新しければ通信しない
+static bool refresh(bool force){
+    uint32_t staleMask = weatherStaleMask(force);
+    if(!staleMask) return false;
+    char base[48];
+    server.url(base, sizeof(base), "");
+    char url[256];
+    TEST_ASSERT_LESS_THAN((int)sizeof(url), weatherGroupUrl(url, sizeof(url), base, staleMask, "KEY"));
+    HalStream* body = nullptr;
+    uint32_t mask = 0;
+    if(halHttpGet(url, body) == 200) parseWeatherGroupStream(*body, mask);
+    halHttpEnd();
+    return true;
+}
+
+void test_fetch_updates_all_cities(){
+    halNativeAdvance(5000);
+    uint32_t mask;
+    bool parsed;
+    TEST_ASSERT_EQUAL(200, fetchOnce(mask, parsed));
+    TEST_ASSERT_TRUE(parsed);
+    TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+    TEST_ASSERT_EQUAL(1, server.requests.load());
+    for(int i=0;i<NUM_CITIES;i++){
+        TEST_ASSERT_TRUE(weatherCache[i].valid);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, 10.0f + i * 2.5f, weatherCache[i].temp);
+        TEST_ASSERT_EQUAL_UINT32(5000, weatherCache[i].lastFetch);
+        TEST_ASSERT_FALSE(isWeatherStale(i));
+    }
+    TEST_ASSERT_EQUAL(SYM_SUN, weatherCache[0].symbol);
+    TEST_ASSERT_EQUAL(SYM_RAIN, weatherCache[3].symbol);
+    TEST_ASSERT_EQUAL(SYM_THUNDER, weatherCache[5].symbol);
+    TEST_ASSERT_EQUAL_STRING("broken clouds", weatherCache[2].description);
+}
+
+// 401（キー誤り）や429（レート制限）はコードをそのまま返す。ワーカーは本文を読まずにHTTPエラーにする
+void test_error_status_is_returned(){
+    server.status = 401;
+    server.body = "{\"cod\":401,\"message\":\"Invalid API key\"}";
+    uint32_t mask;
+    bool parsed;
+    TEST_ASSERT_EQUAL(401, fetchOnce(mask, parsed));
+    TEST_ASSERT_EQUAL_HEX32(0, mask);
+    for(int i=0;i<NUM_CITIES;i++) TEST_ASSERT_FALSE(weatherCache[i].valid);
+}
+
+void test_connection_refused_is_negative(){
+    server.stop();      // ポートは閉じている
+    uint32_t mask;
+    bool parsed;
+    TEST_ASSERT_LESS_THAN(0, fetchOnce(mask, parsed));
+    TEST_ASSERT_FALSE(parsed);
+}
+
+// 途中で切れた応答でも、切れる前に読めた都市は更新して成功（残りは古いままなので次の取得で取り直す）
+// 戻り値とmaskは食い違わず、キャッシュは壊れない
+void test_truncated_body_keeps_complete_cities(){
+    std::string full = groupPayload();
+    server.cutAt = full.find(",{", full.find("\"Tokyo\"")) + 10;    // 3都市目の途中
+    uint32_t mask;
+    bool parsed;
+    TEST_ASSERT_EQUAL(200, fetchOnce(mask, parsed));
+    TEST_ASSERT_TRUE(parsed);
+    TEST_ASSERT_EQUAL_HEX32(0x3, mask);
+    TEST_ASSERT_TRUE(weatherCache[1].valid);
+    TEST_ASSERT_FALSE(weatherCache[2].valid);
+    TEST_ASSERT_EQUAL_HEX32(0x3c, weatherStaleMask(false));
+
+    // 最初の都市の途中で切れたら失敗で、何も更新しない
+    for(auto &c : weatherCache) c = WeatherCache();
+    server.cutAt = full.find("\"list\":[") + 20;
+    TEST_ASSERT_EQUAL(200, fetchOnce(mask, parsed));
+    TEST_ASSERT_FALSE(parsed);
+    TEST_ASSERT_EQUAL_HEX32(0, mask);
+    for(int i=0;i<NUM_CITIES;i++) TEST_ASSERT_FALSE(weatherCache[i].valid);
+}
+
+// 遅いサーバーから取っている間も、loop()役はキャッシュを読み続けられる（ロックは1都市の更新の間だけ）
+void test_slow_server_does_not_stall_reader(){
+    server.delayMs = 400;
+    std::atomic<bool> done{false};
+    uint32_t mask = 0;
+    std::thread worker([&]{
+        bool parsed;
+        fetchOnce(mask, parsed);
+        done = true;
+    });
+
+    using Clock = std::chrono::steady_clock;
+    auto last = Clock::now();
+    double maxGapMs = 0;
+    int reads = 0;
+    while(!done){
+        lockWeatherCache();
+        volatile float t = weatherCache[0].temp;
+        (void)t;
+        unlockWeatherCache();
+        isWeatherStale(0);
+        reads++;
+        auto now = Clock::now();
+        double gap = std::chrono::duration<double, std::milli>(now - last).count();
+        if(gap > maxGapMs) maxGapMs = gap;
+        last = now;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    worker.join();
+
+    char msg[96];
+    snprintf(msg, sizeof(msg), "reader: %d reads, max gap %.2f ms during a 400 ms fetch", reads, maxGapMs);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+    TEST_ASSERT_GREATER_THAN(100, reads);
+    TEST_ASSERT_LESS_THAN(50, (int)maxGapMs);
+}
+
+void test_one_request_for_all_cities(){
+    TEST_ASSERT_TRUE(refresh(true));
+    TEST_ASSERT_EQUAL(1, server.requests.load());
+    TEST_ASSERT_EQUAL_STRING("/data/2.5/group?id=1853909,1850147,1856057,2128295,1863967,1894616"
+                             "&units=metric&lang=en&appid=KEY", server.path().c_str());
+    for(int i=0;i<NUM_CITIES;i++) TEST_ASSERT_TRUE(weatherCache[i].valid);
+}
+
+// 都市を切り替えても、キャッシュが新しいうちは要求しない。古くなった都市だけを取る
+void test_only_stale_cities_are_requested(){
+    refresh(true);
+    halNativeAdvance(60000);
+    TEST_ASSERT_FALSE(refresh(false));
+    TEST_ASSERT_EQUAL(1, server.requests.load());
+
+    lockWeatherCache();
+    weatherCache[4].valid = false;
+    unlockWeatherCache();
+    TEST_ASSERT_TRUE(refresh(false));
+    TEST_ASSERT_EQUAL(2, server.requests.load());
+    TEST_ASSERT_EQUAL_STRING("/data/2.5/group?id=1863967&units=metric&lang=en&appid=KEY", server.path().c_str());
+}
+
+// 1日: 30分ごとの定期更新（force）と、10分ごとの都市の切り替え（古い時だけ）
+// 都市ごとに取っていた時は定期更新だけで6倍
+void test_requests_per_day(){
+    setWeatherStaleMs(WEATHER_STALE_MS);
+    for(uint32_t minute=0;minute<24*60;minute++){
+        if(minute % 30 == 0) refresh(true);
+        if(minute % 10 == 5) refresh(false);
+        halNativeAdvance(60000);
+    }
+    char msg[80];
+    snprintf(msg, sizeof(msg), "24h: %d requests (per-city fetching: %d)", server.requests.load(), 48 * NUM_CITIES);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_EQUAL(48, server.requests.load());
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_fetch_updates_all_cities);
+    RUN_TEST(test_error_status_is_returned);
+    RUN_TEST(test_connection_refused_is_negative);
+    RUN_TEST(test_truncated_body_keeps_complete_cities);
+    RUN_TEST(test_slow_server_does_not_stall_reader);
+    RUN_TEST(test_one_request_for_all_cities);
+    RUN_TEST(test_only_stale_cities_are_requested);
+    RUN_TEST(test_requests_per_day);
+    return UNITY_END();
+}
@@ -0,0 +1,188 @@
+// ==========================================
+// 天気のパースのテスト（pio test -e native -f test_weather_parse）
+// - groupレスポンスをストリームから1都市ずつ、フィルター付きで読む
+// - 使わない項目がどれだけ大きくても、1都市分のドキュメントで足りるか
+// - 知らない都市・欠けた項目・長すぎる説明文・天気が複数ある都市・壊れたJSON
+// - 応答の大きさとパースにかかる時間（PCの値）
+// ==========================================
+
+#include <unity.h>
+#include "hal_native.h"
+#include "weather_cache.h"
+
+#include <chrono>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+
+static std::string cityItem(uint32_t id, int code, const char* desc, float temp, size_t padding = 0){
+    char head[256];
+    snprintf(head, sizeof(head),
+        "{\"coord\":{\"lon\":135.5,\"lat\":34.69},\"weather\":[{\"id\":%d,\"main\":\"X\",\"description\":\"%s\","
+        "\"icon\":\"01d\"}],\"main\":{\"temp\":%.2f,\"pressure\":1012,\"humidity\":60},",
+        code, desc, temp);
+    std::string s = head;
+    // フィルターで捨てる大きな項目（数値の配列）
+    if(padding){
+        s += "\"extra\":[";
+        for(size_t i=0;s.size() < strlen(head) + padding;i++) s += i ? ",12345.6" : "12345.6";
+        s += "],";
+    }
+    char tail[64];
+    snprintf(tail, sizeof(tail), "\"id\":%lu,\"name\":\"X\"}", (unsigned long)id);
+    return s + tail;
+}
+
+static std::string groupPayload(size_t padding = 0){
+    std::string s = "{\"cnt\":6,\"list\":[";
+    for(int i=0;i<NUM_CITIES;i++){
+        if(i) s += ",";
+        s += cityItem(cities[i].id, 800 + i, "clear sky", 10.0f + i, padding);
+    }
+    return s + "]}";
+}
+
+static bool parse(const std::string &payload, uint32_t &mask){
+    HalMemoryStream in(payload.data(), payload.size());
+    mask = 0;
+    return parseWeatherGroupStream(in, mask);
+}
+
+void setUp(){
+    halNativeReset();
+    for(auto &c : weatherCache) c = WeatherCache();
+}
+
+void tearDown(){}
+
+void test_parses_all_cities(){
+    uint32_t mask;
+    TEST_ASSERT_TRUE(parse(groupPayload(), mask));
+    TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+    for(int i=0;i<NUM_CITIES;i++){
+        TEST_ASSERT_EQUAL_UINT16(800 + i, weatherCache[i].conditionCode);
+        TEST_ASSERT_FLOAT_WITHIN(0.001f, 10.0f + i, weatherCache[i].temp);
+        TEST_ASSERT_EQUAL_STRING("clear sky", weatherCache[i].description);
+    }
+}
+
+// 都市ごとに4KBの要らない項目があっても、フィルターで捨てるのでドキュメントは溢れない
+void test_large_unused_fields_are_filtered(){
+    std::string payload = groupPayload(4096);
+    TEST_ASSERT_GREATER_THAN(6 * 4096, (int)payload.size());
+    uint32_t mask;
+    TEST_ASSERT_TRUE(parse(payload, mask));
+    TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 15.0f, weatherCache[5].temp);
+}
+
+void test_unknown_city_is_skipped(){
+    std::string payload = "{\"list\":[" + cityItem(999, 500, "rain", 3.0f) + "," +
+                          cityItem(cities[2].id, 600, "snow", -1.5f) + "]}";
+    uint32_t mask;
+    TEST_ASSERT_TRUE(parse(payload, mask));
+    TEST_ASSERT_EQUAL_HEX32(1u << 2, mask);
+    TEST_ASSERT_EQUAL(SYM_SNOW, weatherCache[2].symbol);
+}
+
+// 欠けた項目は既定値、長すぎる説明文は切り詰める
+void test_missing_fields_and_long_description(){
+    char payload[256];
+    snprintf(payload, sizeof(payload), "{\"list\":[{\"id\":%lu},{\"id\":%lu,\"weather\":[{\"id\":211,"
+             "\"description\":\"thunderstorm with heavy drizzle and more\"}]}]}",
+             (unsigned long)cities[0].id, (unsigned long)cities[1].id);
+    uint32_t mask;
+    TEST_ASSERT_TRUE(parse(payload, mask));
+    TEST_ASSERT_EQUAL_HEX32(0x3, mask);
+    TEST_ASSERT_EQUAL_STRING("NoDesc", weatherCache[0].description);
+    TEST_ASSERT_EQUAL(SYM_UNKNOWN, weatherCache[0].symbol);
+    TEST_ASSERT_EQUAL(SYM_THUNDER, weatherCache[1].symbol);
+    TEST_ASSERT_EQUAL(WEATHER_DESC_LEN - 1, strlen(weatherCache[1].description));
+}
+
+// 複数の天気（雨 + 霧など）がある都市。使うのは先頭だけで、残りの要素でドキュメントが溢れないこと
+// 後ろの要素の文字列に括弧・カンマ・エスケープした引用符があっても、都市の区切りを見失わない
+void test_multiple_conditions_use_first(){
+    std::string payload = "{\"list\":[" + cityItem(cities[0].id, 800, "clear sky", 20.0f) + ",";
+    char multi[512];
+    snprintf(multi, sizeof(multi),
+        "{\"weather\":[{\"id\":500,\"main\":\"Rain\",\"description\":\"light rain\",\"icon\":\"10d\"},"
+        "{\"id\":701,\"main\":\"Mist\",\"description\":\"mist\",\"icon\":\"50d\"},"
+        "{\"id\":741,\"main\":\"Fog\",\"description\":\"fog ]}, \\\"thick\\\" [{\",\"icon\":\"50d\"},"
+        "{\"id\":211,\"main\":\"Thunderstorm\",\"description\":\"thunderstorm\",\"icon\":\"11d\"}],"
+        "\"main\":{\"temp\":12.5},\"id\":%lu,\"name\":\"Tokyo\"}",
+        (unsigned long)cities[1].id);
+    payload += multi;
+    payload += "," + cityItem(cities[2].id, 600, "snow", -1.5f) + "]}";
+    uint32_t mask;
+    TEST_ASSERT_TRUE(parse(payload, mask));
+    TEST_ASSERT_EQUAL_HEX32(0x7, mask);
+    TEST_ASSERT_EQUAL_UINT16(500, weatherCache[1].conditionCode);
+    TEST_ASSERT_EQUAL_STRING("light rain", weatherCache[1].description);
+    TEST_ASSERT_EQUAL(SYM_RAIN, weatherCache[1].symbol);
+    TEST_ASSERT_FLOAT_WITHIN(0.001f, 12.5f, weatherCache[1].temp);
+    TEST_ASSERT_EQUAL(SYM_SNOW, weatherCache[2].symbol);
+}
+
+// 戻り値は更新した都市があるかどうかで、maskと食い違わない
+void test_broken_json_fails(){
+    uint32_t mask;
+    TEST_ASSERT_FALSE(parse("{\"cod\":401,\"message\":\"Invalid API key\"}", mask));
+    TEST_ASSERT_FALSE(parse("{\"list\":[{\"id\":1853909,\"main\":{\"temp\":", mask));
+    TEST_ASSERT_EQUAL_HEX32(0, mask);
+    TEST_ASSERT_FALSE(weatherCache[0].valid);
+    TEST_ASSERT_FALSE(parse("{\"list\":[" + cityItem(123, 800, "clear sky", 10.0f) + "]}", mask));
+    TEST_ASSERT_EQUAL_HEX32(0, mask);
+
+    // 2都市目の途中で切れた。1都市目は更新して成功
+    std::string cut = "{\"list\":[" + cityItem(cities[0].id, 801, "few clouds", 9.0f) + ",{\"id\":" +
+                      std::to_string(cities[1].id) + ",\"main\":{\"te";
+    TEST_ASSERT_TRUE(parse(cut, mask));
+    TEST_ASSERT_EQUAL_HEX32(0x1, mask);
+    TEST_ASSERT_TRUE(weatherCache[0].valid);
+    TEST_ASSERT_EQUAL_STRING("few clouds", weatherCache[0].description);
+    TEST_ASSERT_FALSE(weatherCache[1].valid);
+}
+
+void test_symbol_table(){
+    TEST_ASSERT_EQUAL(SYM_THUNDER, weatherSymbolFromCode(200));
+    TEST_ASSERT_EQUAL(SYM_RAIN, weatherSymbolFromCode(301));
+    TEST_ASSERT_EQUAL(SYM_RAIN, weatherSymbolFromCode(502));
+    TEST_ASSERT_EQUAL(SYM_SNOW, weatherSymbolFromCode(601));
+    TEST_ASSERT_EQUAL(SYM_UNKNOWN, weatherSymbolFromCode(741));
+    TEST_ASSERT_EQUAL(SYM_SUN, weatherSymbolFromCode(800));
+    TEST_ASSERT_EQUAL(SYM_CLOUD, weatherSymbolFromCode(804));
+    TEST_ASSERT_EQUAL(SYM_UNKNOWN, weatherSymbolFromCode(0));
+    TEST_ASSERT_EQUAL(SYM_UNKNOWN, weatherSymbolFromCode(1200));
+}
+
+// 応答の大きさとパースの時間。時間はほぼ読んだバイト数に比例する（ドキュメントの大きさは変わらない）
+void test_parse_time_by_payload_size(){
+    const size_t paddings[] = {0, 1024, 4096};
+    for(size_t padding : paddings){
+        std::string payload = groupPayload(padding);
+        uint32_t mask = 0;
+        const int iters = 200;
+        auto t0 = std::chrono::steady_clock::now();
+        for(int i=0;i<iters;i++) parse(payload, mask);
+        auto t1 = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(t1 - t0).count() / iters;
+        char msg[96];
+        snprintf(msg, sizeof(msg), "parse: %6zu bytes %8.1f us (%.1f ns/byte)", payload.size(), us, us * 1000 / payload.size());
+        TEST_MESSAGE(msg);
+        TEST_ASSERT_EQUAL_HEX32((1u << NUM_CITIES) - 1, mask);
+    }
+}
+
+int main(int, char**){
+    UNITY_BEGIN();
+    RUN_TEST(test_parses_all_cities);
+    RUN_TEST(test_large_unused_fields_are_filtered);
+    RUN_TEST(test_unknown_city_is_skipped);
+    RUN_TEST(test_missing_fields_and_long_description);
+    RUN_TEST(test_multiple_conditions_use_first);
+    RUN_TEST(test_broken_json_fails);
+    RUN_TEST(test_symbol_table);
+    RUN_TEST(test_parse_time_by_payload_size);
+    return UNITY_END();
+}